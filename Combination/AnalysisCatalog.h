@@ -0,0 +1,72 @@
+///
+/// AnalysisCatalog.h
+///
+///  Hash indices over a list of analyses. Finding an analysis by its identity (name, flavor,
+/// tagger, operating point, jet algorithm), or all the analyses in a group, is a lookup rather
+/// than a scan of the whole list.
+///
+#ifndef COMBINATION_AnalysisCatalog
+#define COMBINATION_AnalysisCatalog
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace BTagCombination {
+
+  // The ways analyses can be grouped. Each is keyed by the name from BinNameUtils.
+  enum AnalysisGrouping {
+    kByAnalysisName,		// ana.name
+    kByJetTagFlavOp,		// OPIndependentName - what gets combined together
+    kByFlavorTaggerOp,		// OPByFlavorTaggerOp
+    kByCalibName,		// OPByCalibName
+    kByCalibJetTagger,		// OPByCalibJetTagger
+    kNAnalysisGroupings
+  };
+
+  class AnalysisCatalog
+  {
+  public:
+    // Index a list of analyses. Only positions are stored, so the list must outlive the
+    // catalog. If analyses are added to the end of the list, call Update. Each index (the identity
+    // one for Find, and each grouping) is only built the first time it is used, so a catalog that is
+    // just used for grouping never makes the identity keys. Don't share a catalog between threads.
+    AnalysisCatalog (const std::vector<CalibrationAnalysis> &anas);
+
+    // Include anything added to the end of the list since the last time.
+    void Update ();
+
+    // Position of the analysis with this identity, or npos. If the list has more than one, the first.
+    size_t Find (const CalibrationAnalysis &ana) const;
+    size_t Find (const std::string &name, const std::string &flavor, const std::string &tagger,
+		 const std::string &operatingPoint, const std::string &jetAlgorithm) const;
+
+    // Positions of the analyses in one group, in list order. Empty if there are none.
+    const std::vector<size_t> &Group (AnalysisGrouping by, const std::string &key) const;
+
+    // All the groups, sorted by key.
+    const std::map<std::string, std::vector<size_t> > &Groups (AnalysisGrouping by) const;
+
+    static const size_t npos;
+
+  private:
+    static std::string GroupKey (AnalysisGrouping by, const CalibrationAnalysis &ana);
+
+    // Bring the identity index up to date.
+    void IndexIdentities () const;
+
+    const std::vector<CalibrationAnalysis> &_anas;
+    size_t _nListed;			// How much of the list the catalog covers
+
+    mutable std::unordered_map<std::string, size_t> _byIdentity;
+    mutable size_t _nIdentified;
+
+    mutable std::map<std::string, std::vector<size_t> > _groups[kNAnalysisGroupings];
+    mutable size_t _nGrouped[kNAnalysisGroupings];
+  };
+}
+
+#endif
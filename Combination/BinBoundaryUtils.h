@@ -76,6 +76,11 @@ namespace BTagCombination {
 
   // Calculate the bin boundaries for a set of bins. Error if we find inconsistencies.
   bin_boundaries calcBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap = true);
+
+  // As calcBoundaries, but if the bins can't be laid out on a grid, return false with the
+  // reason in problems rather than throwing a bin_boundary_error (other errors still throw).
+  bool findRegularBoundaries (const CalibrationAnalysis &ana, bin_boundaries &result,
+			      std::string &problems, bool ignoreExtrap = true);
   
   // Check that this list of bin boundaries is consistent
   // with each other
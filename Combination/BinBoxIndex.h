@@ -0,0 +1,74 @@
+///
+/// BinBoxIndex.h
+///
+///  Bins as boxes in (pt, eta, ...) space, indexed so that finding the bins that overlap or
+/// contain another one doesn't mean testing every bin. Bins with the same axes are kept sorted
+/// along one of them; a query only looks at the run of bins whose range on that axis touches
+/// its own.
+///
+#ifndef COMBINATION_BinBoxIndex
+#define COMBINATION_BinBoxIndex
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+namespace BTagCombination {
+
+  // True if the bins overlap at all: they have the same axes and overlap (by more than an edge)
+  // along every one of them.
+  bool BinsOverlap (const std::vector<CalibrationBinBoundary> &b1, const std::vector<CalibrationBinBoundary> &b2);
+
+  // True if container has the same axes as bin, and bin is inside it along every one.
+  bool BinContains (const std::set<CalibrationBinBoundary> &container, const std::vector<CalibrationBinBoundary> &bin);
+
+  // The area (volume...) of a bin.
+  double BinArea (const std::set<CalibrationBinBoundary> &bin);
+
+  class BinBoxIndex
+  {
+  public:
+    BinBoxIndex (const std::vector<CalibrationBin> &bins);
+    BinBoxIndex (const std::set<std::set<CalibrationBinBoundary> > &bins);
+
+    // Positions (in the order the bins were given) of the bins that overlap spec (BinsOverlap).
+    std::vector<size_t> Overlapping (const std::vector<CalibrationBinBoundary> &spec) const;
+
+    // Positions of the bins that contain spec (BinContains).
+    std::vector<size_t> Containing (const std::vector<CalibrationBinBoundary> &spec) const;
+
+    // True if the bins exactly tile area: no two overlap, and together they are as big as it is.
+    // It is assumed they are all inside area.
+    bool Covers (const std::set<CalibrationBinBoundary> &area) const;
+
+    // True if no two of the bins overlap.
+    bool NoneOverlap () const;
+
+    size_t size () const { return _specs.size(); }
+
+  private:
+    // Bins with the same axes, sorted by their low edge along one of them.
+    struct Group {
+      std::string axis;			// The axis we sort along (empty if there are none)
+      std::vector<size_t> bins;		// Sorted by low edge
+      std::vector<double> lows;		// bins' edges along axis
+      std::vector<double> highs;
+      std::vector<double> maxHighs;	// Largest high edge of bins[0..i]
+    };
+
+    void Index ();
+    void Candidates (const std::vector<CalibrationBinBoundary> &spec, std::vector<size_t> &result) const;
+
+    std::vector<std::vector<CalibrationBinBoundary> > _specs;
+
+    // Keyed by the axis names. Bins that name an axis more than once (or have an edge that
+    // isn't a number) don't go in a group; they are checked for every query.
+    std::map<std::string, Group> _groups;
+    std::vector<size_t> _irregular;
+  };
+}
+
+#endif
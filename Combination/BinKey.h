@@ -0,0 +1,65 @@
+///
+/// BinKey.h
+///
+///  A compact, hashable name for a bin: the edges along each axis, with the axis names interned
+/// so comparing two keys never compares strings. It identifies a bin exactly the way a
+/// std::set<CalibrationBinBoundary> does (same equality, same ordering), and turns back into
+/// that set - and so into OPBinName - without any change.
+///
+#ifndef COMBINATION_BinKey
+#define COMBINATION_BinKey
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstddef>
+
+namespace BTagCombination {
+
+  class BinKey
+  {
+  public:
+    BinKey ();
+    explicit BinKey (const std::vector<CalibrationBinBoundary> &binSpec);
+    explicit BinKey (const std::set<CalibrationBinBoundary> &binSpec);
+    explicit BinKey (const CalibrationBin &bin);
+
+    // The bin with one axis left out (if it has it).
+    static BinKey Without (const std::string &axis, const std::vector<CalibrationBinBoundary> &binSpec);
+
+    // Back to the data model, in the usual (sorted) order.
+    std::set<CalibrationBinBoundary> Boundaries () const;
+    std::vector<CalibrationBinBoundary> BinSpec () const;
+
+    // Exactly OPBinName of the boundaries.
+    std::string Name () const;
+
+    size_t Hash () const { return _hash; }
+    size_t size () const { return _edges.size(); }
+
+    bool operator== (const BinKey &other) const;
+    bool operator!= (const BinKey &other) const { return !(*this == other); }
+    bool operator< (const BinKey &other) const;
+
+  private:
+    struct Edge {
+      const std::string *axis;	// Interned - equal names are the same pointer
+      double low, high;
+    };
+
+    void Add (const CalibrationBinBoundary &b);
+    void Finish ();
+
+    std::vector<Edge> _edges;
+    size_t _hash;
+  };
+
+  // For std::unordered_map and friends.
+  struct BinKeyHash {
+    size_t operator() (const BinKey &k) const { return k.Hash(); }
+  };
+}
+
+#endif
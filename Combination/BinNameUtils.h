@@ -30,6 +30,8 @@ namespace BTagCombination {
 
   // Returns a name that is how we partition everything (flavor, tagger, jet, op, etc.).
   std::string OPIndependentName (const CalibrationAnalysis &ana);
+  // The group of analyses a correlation is between - the same name as for the analyses.
+  std::string OPIndependentName (const AnalysisCorrelation &cor);
 
   // Returns a name that uses flavor, tagger, op, but not jet.
   std::string OPByFlavorTaggerOp (const CalibrationAnalysis &ana);
@@ -0,0 +1,64 @@
+///
+/// BinaryCalibrationInfo.h
+///
+///  A compact, versioned binary form of a CalibrationInfo. Reading it back is just copying
+/// numbers out of a (memory-mapped) buffer, so the big text inputs only have to be parsed once:
+/// loadOPsFromFile keeps one of these next to each text file as a cache, and FTDump can
+/// convert files in both directions.
+///
+#ifndef COMBINATION_BinaryCalibrationInfo
+#define COMBINATION_BinaryCalibrationInfo
+
+#include "Combination/CalibrationDataModel.h"
+#include "Combination/CalibrationFilter.h"
+
+#include <string>
+#include <ostream>
+
+namespace BTagCombination {
+
+  // Where a binary file came from. All zero for a file that isn't a cache (e.g. written by FTDump).
+  struct BinaryCalibrationHeader {
+    unsigned long long filterKey;	// FilterKey of the settings used when the source was parsed
+    long long sourceSize;		// Size and modification time (ns) of the text file
+    long long sourceModTime;
+    unsigned long long sourceHash;	// Hash of the text file's contents
+
+    BinaryCalibrationHeader()
+      : filterKey(0), sourceSize(0), sourceModTime(0), sourceHash(0)
+    {}
+  };
+
+  // Write info out in the binary format.
+  void WriteBinary (std::ostream &out, const CalibrationInfo &info,
+		    const BinaryCalibrationHeader &header = BinaryCalibrationHeader());
+
+  // Read it back from a buffer or a file (which is memory mapped). Throws if it isn't a binary
+  // calibration file of the current version, or if it is cut short.
+  CalibrationInfo ReadBinary (const char *begin, const char *end, BinaryCalibrationHeader *header = 0);
+  CalibrationInfo ReadBinaryFile (const std::string &fname, BinaryCalibrationHeader *header = 0);
+
+  // True if the file starts the way a binary calibration file does.
+  bool IsBinaryCalibrationFile (const std::string &fname);
+
+  // A hash of the filter settings and the ParserVersion - a cache made with different settings, or
+  // by a different parser, can hold different analyses.
+  unsigned long long FilterKey (const calibrationFilterInfo &fInfo);
+
+  // The cache that sits next to a text input file.
+  std::string BinaryCacheName (const std::string &textFile);
+
+  // Load textFile from its cache. Returns false if there is no cache, or it is out of date,
+  // unreadable, or was made with different filter settings or a different ParserVersion.
+  bool LoadBinaryCache (const std::string &textFile, const calibrationFilterInfo &fInfo, CalibrationInfo &info);
+
+  // Write the cache for textFile. It is written to a temp file and renamed, so jobs can share it.
+  // Failure (a read-only directory, say) is quietly ignored - the cache is only a speed up.
+  void StoreBinaryCache (const std::string &textFile, const calibrationFilterInfo &fInfo, const CalibrationInfo &info);
+
+  // Turn the cache off (it is on by default).
+  void SetBinaryCacheEnabled (bool enabled);
+  bool GetBinaryCacheEnabled ();
+}
+
+#endif
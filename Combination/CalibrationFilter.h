@@ -5,10 +5,13 @@
 
 #include <map>
 #include <string>
+#include <memory>
 #include <boost/regex.hpp>
 
 namespace BTagCombination {
 
+  class IgnorePatternMatcher;
+
   // What can be filtered out, and a method that filters everythign out.
   // Note: operatingPoints is an in/out argument! :(
   struct calibrationFilterInfo {
@@ -16,8 +19,22 @@ namespace BTagCombination {
     // do this.
     std::map<std::string, boost::regex*> OPsToIgnore;
     std::map<std::string, boost::regex*> spOnlyFlavor, spOnlyTagger, spOnlyOP, spOnlyJetAlgorithm, spOnlyAnalysis;
+
+    // OPsToIgnore, compiled. Use GetIgnoreMatcher rather than looking at this directly.
+    mutable std::shared_ptr<const IgnorePatternMatcher> ignoreMatcher;
   };
   void FilterAnalyses(CalibrationInfo &operatingPoints, const calibrationFilterInfo &fInfo);
+
+  // The same filtering, one item at a time, for use while parsing. The "PassesFilter" checks are
+  // the "only" lists, and look at nothing but the names (so they can be done before any bins are read).
+  bool AnalysisPassesFilter(const CalibrationAnalysis &ana, const calibrationFilterInfo &fInfo);
+  bool CorrelationPassesFilter(const AnalysisCorrelation &cor, const calibrationFilterInfo &fInfo);
+  bool BinIgnored(const CalibrationAnalysis &ana, const CalibrationBin &bin, const calibrationFilterInfo &fInfo);
+  bool BinIgnored(const AnalysisCorrelation &cor, const BinCorrelation &bin, const calibrationFilterInfo &fInfo);
+
+  // The matcher for OPsToIgnore. It is built the first time it is asked for, and again if patterns
+  // have been added since. Safe to call from several threads at once.
+  std::shared_ptr<const IgnorePatternMatcher> GetIgnoreMatcher(const calibrationFilterInfo &fInfo);
 }
 
 #endif
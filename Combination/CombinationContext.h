@@ -16,6 +16,12 @@ namespace BTagCombination {
   class CombinationContext : public CombinationContextBase
   {
   public:
+    /// How the total error is broken down into the individual systematic errors.
+    enum SysErrorDecomposition {
+      kRefitPerSystematic, // Refit with each nuisance parameter frozen in turn
+      kFromCovariance // Linear error propagation from the covariance matrix of the master fit
+    };
+
     /// Create/Destroy a new context. This will contain the common
     /// data to do a fit to multiple measurements.
     CombinationContext(void);
@@ -27,18 +33,15 @@ namespace BTagCombination {
     /// Turn on/off production of plots. Plots are expensive!
     inline void setDoPlots(bool v = false) { _doPlots = v;}
 
-    inline void SetVerbose (bool v) { _verbose = v; }
+    /// Set how the systematic errors are extracted. Refitting costs one full fit per systematic error.
+    inline void setSysErrorDecomposition(SysErrorDecomposition v) { _decomposition = v; }
 
   private:
-    // How quiet should we be? Mouse like is false.
-    bool _verbose;
-
     /// Should we make plots as a diagnostic output?
     bool _doPlots;
 
-    // Any common measurements that are over correlated are "bad"
-    void TurnOffOverCorrelations();
-
+    /// How to extract the systematic errors
+    SysErrorDecomposition _decomposition;
   };
 }
 
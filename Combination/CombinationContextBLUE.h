@@ -0,0 +1,31 @@
+///
+/// A combination context that solves the combination likelihood exactly. The likelihood
+/// built by CombinationContext (measurement Gaussians around what + sum width*nuisance, along
+/// with unit Gaussian constraints on the nuisances) is linear in all its parameters, so the
+/// minimum and the covariance can be found directly with linear algebra (BLUE/GLS).
+///
+#ifndef COMBINATION_CombinationContextBLUE
+#define COMBINATION_CombinationContextBLUE
+
+#include "Combination/CombinationContextBase.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace BTagCombination {
+
+  class CombinationContextBLUE : public CombinationContextBase
+  {
+  public:
+    /// Create/Destroy a new context. This will contain the common
+    /// data to do a fit to multiple measurements.
+    CombinationContextBLUE(void);
+    ~CombinationContextBLUE(void) {};
+
+    /// Fit all the measurements that we've asked for, and return results for each measurement done.
+    std::map<std::string, FitResult> Fit(const std::string &name = "");
+  };
+}
+
+#endif
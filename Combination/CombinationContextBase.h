@@ -6,12 +6,17 @@
 #define COMBINATION_CombinationContextBase
 
 #include "Combination/RooRealVarCache.h"
+#include "Combination/SysErrorNameTable.h"
 
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
+#include <ostream>
 
 class RooRealVar;
+template <class Element> class TMatrixTSym;
 
 namespace BTagCombination {
 
@@ -30,6 +35,21 @@ namespace BTagCombination {
       std::map<std::string, double> cvShifts;
     };
 
+    // What happened in one call to the minimizer.
+    struct FitTelemetry
+    {
+      std::string _phase; // "master", "freeze <sys error>", or "restore"
+      double _wallTime; // Seconds
+      int _status; // MINUIT status (0 is good)
+      double _edm; // Estimated distance to minimum
+      int _covQual; // Covariance matrix quality (3 is full and accurate)
+      int _nllEvaluations; // Number of times the NLL was calculated
+
+      int _nMeasurements; // Size of the model that was fit
+      int _nNuisance;
+      int _nPDFNodes;
+    };
+
     class ExtraFitInfo
     {
     public:
@@ -39,7 +59,12 @@ namespace BTagCombination {
       std::map<std::string, double> _pulls; // Pulls from the fit.
       std::map<std::string, std::pair<double, double> > _nuisance; // Nuisance from the fit, along with the error
 
+      std::vector<FitTelemetry> _fits; // Every minimizer call, in the order they were made.
+
       void clear();
+
+      // Write everything out as a single line JSON object.
+      void WriteJSON(std::ostream &out, const std::string &fitName) const;
     };
 
     // Clean up
@@ -76,13 +101,26 @@ namespace BTagCombination {
     /// Returns the stat-only error on each measurement.
     virtual std::map<std::string, double> CalculateStatisticalErrors(void);
 
+    // How quiet should we be? Mouse like is false.
+    inline void SetVerbose (bool v) { _verbose = v; }
+
     // Get the extra info from a fit that was just run.
     virtual ExtraFitInfo GetExtraFitInformation (void) { return _extraInfo;}
     
     // Get a list of all measurements
     const std::vector<Measurement*> &GetAllMeasurements(void) const { return _measurements; }
 
+    // RooFit is not thread safe. Anyone creating, fitting, or deleting RooFit objects (which
+    // includes creating and deleting a context) while other threads are running must hold this.
+    static std::recursive_mutex &RooFitMutex(void);
+
   protected:
+    // Only sub-classes can be created.
+    CombinationContextBase(void);
+
+    // Name for an internal RooFit object that won't clash with another context's objects.
+    std::string RooObjectName(const std::string &name) const;
+
     // Helper method that scans the internal list of measurements to get
     // a list of the good ones (i.e. that are participating in the fit).
     std::vector<Measurement*> GoodMeasurements(void);
@@ -90,6 +128,36 @@ namespace BTagCombination {
     // Is this sys error connected by this measurement?
     bool sysErrorUsedBy(const std::string &sysErrName, const std::string &what);
 
+    // Any common measurements that are over correlated are "bad"
+    void TurnOffOverCorrelations();
+
+    // Calculate the BLUE chi2 between the measurements and the fit results, and
+    // store it in the extra fit info.
+    void CalcGlobalChi2 (const std::vector<Measurement*> &gMeas,
+			 const std::map<std::string, FitResult> &result,
+			 const std::string &name);
+
+    // Given the covariance matrix of a converged fit (and the fitted parameter values), fill
+    // the sys errors and central value shifts for each systematic error. whatIndex and
+    // sysIndex give the location of each parameter in the matrix.
+    void DecomposeSystematicErrors (const TMatrixTSym<double> &cov,
+				    const std::vector<double> &pars,
+				    const std::map<std::string, int> &whatIndex,
+				    const std::map<std::string, int> &sysIndex,
+				    std::map<std::string, FitResult> &result,
+				    std::map<std::string, double> &runningErrorXCheck);
+
+    // Warn if the individual errors do not add back up to the total error.
+    void CheckErrorSums (const std::map<std::string, double> &runningErrorXCheck,
+			 const std::map<std::string, double> &totalError) const;
+
+    // Statistical correlations are modeled as shared systematic errors. Fold them
+    // back into the statistical error.
+    void FoldInStatisticalCorrelations (std::map<std::string, FitResult> &result) const;
+
+    // How quiet should we be? Mouse like is false.
+    bool _verbose;
+
     // Cache is shared between machines.
     ExtraFitInfo _extraInfo;
 
@@ -113,6 +181,21 @@ namespace BTagCombination {
 
     // Keep a list of all measurements
     std::vector<Measurement*> _measurements;
+
+    // The same measurements, by name, for FindMeasurement.
+    std::unordered_map<std::string, Measurement*> _measurementsByName;
+
+    // Systematic error names used by all the measurements.
+    SysErrorNameTable _sysErrorNames;
+
+    // Make up a unique measurement name.
+    std::string NewMeasurementName(const std::string &name);
+
+    // Next index to use for each measurement name we've made up.
+    std::map<std::string, int> _nameIndex;
+
+    // Unique id for this context.
+    int _contextID;
   };
 
   // Dump a fit result out.
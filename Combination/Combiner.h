@@ -9,10 +9,11 @@
 
 #include "Combination/Parser.h"
 #include <set>
+#include <ostream>
 
 namespace BTagCombination
 {
-	class CombinationContext;
+  class CombinationContextBase;
 
   // Given a list of single bins, return a combined single bin
   // Reuses much of internal infrastructure, so good for testing, but
@@ -28,20 +29,47 @@ namespace BTagCombination
     kCombineBySingleBin // Combine each bin separately from all other bins
   };
 
+  // What fitter should be used to do the combination
+  enum CombinationFitter {
+    kFitWithMinuit, // Build the likelihood with RooFit and minimize it with MINUIT
+    kFitWithBLUE, // Solve the (linear) likelihood exactly with matrix algebra
+    kFitWithMinuitSingleFit // As MINUIT, but systematic errors from the covariance of one fit rather than refitting
+  };
+
   // Given a list of analyses (different jet algorithms, different tags, different, etc.), with bins all equal on boundaries,
-  // combine them and return the total new combined analysis.
+  // combine them and return the total new combined analysis. Independent fits are run nThreads at a
+  // time (0 means one per core): BLUE fits on threads, and, as RooFit and MINUIT can only do one fit
+  // at a time in a process, MINUIT fits in forked worker processes. If cacheDir is given, groups whose inputs haven't changed since
+  // they were last fit are read back from there rather than refit.
   std::vector<CalibrationAnalysis> CombineAnalyses (const CalibrationInfo &info, bool verbose = true,
-						    CombinationType combineType = kCombineByFullAnalysis);
+						    CombinationType combineType = kCombineByFullAnalysis,
+						    CombinationFitter fitter = kFitWithMinuit,
+						    unsigned int nThreads = 1,
+						    const std::string &cacheDir = "");
+
+  // Write the fit telemetry (timing, MINUIT status, model size, etc.) of every combination fit to
+  // out as it finishes, one JSON object per line. Pass null to turn it off.
+  void SetFitTelemetryOutput (std::ostream *out);
+
+  // How the source bins inside a template bin are turned into one bin
+  enum RebinMethod {
+    kRebinWeightedAverage, // Average weighted by the statistical errors
+    kRebinFit // Fit them as measurements of the same thing (as the combination does)
+  };
 
   // Given a set of template bins, force the analysis into those bins. Bins are combined - they can't
   // be split. Further source bins must fully cover the template bins - no gaps. runtime_error is
   // thrown if any of this doesn't work.
-  // Fit is done separately in each template bin.
+  // Fit is done separately in each template bin. With kRebinFit the fits are run nThreads at a time
+  // (0 means one per core), each in a worker process as RooFit and MINUIT can only do one fit at a
+  // time in a process; the bins come back in the same order either way.
   CalibrationAnalysis RebinAnalysis (const std::set<std::set<CalibrationBinBoundary> > &templateBinning,
-				     const CalibrationAnalysis &ana);
+				     const CalibrationAnalysis &ana,
+				     RebinMethod method = kRebinWeightedAverage,
+				     unsigned int nThreads = 1);
 
   // Populate a combination context with everything from a single analysis
-  void FillContext(CombinationContext &ctx, CalibrationAnalysis &ana);
+  void FillContext(CombinationContextBase &ctx, CalibrationAnalysis &ana);
 }
 
 #endif
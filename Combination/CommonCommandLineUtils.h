@@ -30,6 +30,17 @@ namespace BTagCombination {
   // Useful utility. :-)
   std::map<std::string, std::vector<CalibrationAnalysis> > BinAnalysesByJetTagFlavOp (const std::vector<CalibrationAnalysis> &anas);
 
+  // Which of nShards shards a group from BinAnalysesByJetTagFlavOp belongs to. The hash is fixed (not
+  // std::hash), so every process, machine, and build puts a group in the same shard.
+  unsigned int ShardForGroup (const std::string &groupName, unsigned int nShards);
+
+  // Keep only the analyses whose group falls into shard (counting from zero) of nShards.
+  std::vector<CalibrationAnalysis> AnalysesInShard (const std::vector<CalibrationAnalysis> &anas,
+						    unsigned int shard, unsigned int nShards);
+
+  // The N from a --threadsN flag (0 means one per core). False if it isn't a non-negative integer.
+  bool ParseThreadCount (const std::string &text, unsigned int &nThreads);
+
   // If any of the analyses in here have the same name, op, etc., combine the lists of bins. Bomb if the
   // bins overlap or other issues are found.
   std::vector<CalibrationAnalysis> CombineSameAnalyses(const std::vector<CalibrationAnalysis> &anas);
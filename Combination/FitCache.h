@@ -0,0 +1,42 @@
+///
+/// FitCache.h
+///
+/// An on-disk cache of combination results. Each group of analyses (flavor, tagger, OP, jet)
+/// is stored under a hash of everything that goes into its fit, so unchanged groups don't
+/// have to be refit.
+///
+#ifndef __BTagCombination__FitCache__
+#define __BTagCombination__FitCache__
+
+#include "Combination/CalibrationDataModel.h"
+
+#include <string>
+#include <vector>
+
+namespace BTagCombination {
+
+  class FitCache {
+  public:
+    // Cache files live in this directory, which is created if needed.
+    FitCache (const std::string &cacheDir);
+
+    // The key for a group of analyses: the analyses, their bins and errors, any correlations
+    // between them, and the fit mode. Anything that can change the fit result must be in fitMode.
+    std::string Key (const std::vector<CalibrationAnalysis> &group,
+		     const std::vector<AnalysisCorrelation> &correlations,
+		     const std::string &fitMode) const;
+
+    // Fetch a result. Returns false if it isn't in the cache.
+    bool Lookup (const std::string &key, CalibrationAnalysis &result) const;
+
+    // Save a result.
+    void Store (const std::string &key, const CalibrationAnalysis &result) const;
+
+  private:
+    std::string FileName (const std::string &key) const;
+
+    std::string _cacheDir;
+  };
+}
+
+#endif
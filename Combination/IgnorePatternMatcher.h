@@ -0,0 +1,54 @@
+///
+/// IgnorePatternMatcher.h
+///
+///  All the --ignore patterns compiled into one matcher. Most patterns are plain bin names
+/// (where the only regex syntax is the "." in "0.60" or "4.5"); those are looked up in a hash
+/// table. The rest are merged into a few combined regular expressions, so a key costs a couple
+/// of lookups rather than one regex_match per pattern.
+///
+#ifndef COMBINATION_IgnorePatternMatcher
+#define COMBINATION_IgnorePatternMatcher
+
+#include <boost/regex.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace BTagCombination {
+
+  class IgnorePatternMatcher
+  {
+  public:
+    // The patterns as stored in calibrationFilterInfo::OPsToIgnore.
+    IgnorePatternMatcher (const std::map<std::string, boost::regex*> &patterns);
+
+    // True if the key (see OPIgnoreFormat) fully matches one of the patterns.
+    bool Matches (const std::string &key) const;
+
+    // How many patterns went into this matcher.
+    size_t size() const { return _nPatterns; }
+
+  private:
+    // A pattern whose only special character is ".". Bucketed by the text after the last
+    // ".", and checked character by character.
+    struct SimplePattern {
+      std::string text;
+      size_t tailLength;
+    };
+
+    static bool IsSimple (const std::string &pattern);
+    static bool Matches (const SimplePattern &p, const std::string &key);
+    void AddRegexPatterns (const std::vector<std::string> &patterns, const std::vector<const boost::regex*> &compiled);
+
+    size_t _nPatterns;
+
+    std::unordered_map<std::string, std::vector<SimplePattern> > _simpleByTail;
+    std::vector<size_t> _tailLengths;
+
+    std::vector<boost::regex> _regexes;
+  };
+}
+
+#endif
@@ -0,0 +1,37 @@
+///
+/// MappedFile.h
+///
+///  A read-only view of a file on disk. Memory mapped where we can, otherwise read in.
+///
+#ifndef COMBINATION_MappedFile
+#define COMBINATION_MappedFile
+
+#include <string>
+#include <cstddef>
+
+namespace BTagCombination {
+
+  class MappedFile
+  {
+  public:
+    // Throws if the file can't be opened.
+    MappedFile (const std::string &fname);
+    ~MappedFile();
+
+    const char *begin() const { return _data; }
+    const char *end() const { return _data + _size; }
+    size_t size() const { return _size; }
+
+  private:
+    MappedFile (const MappedFile &);
+    MappedFile &operator= (const MappedFile &);
+
+    const char *_data;
+    size_t _size;
+#ifdef _MSC_VER
+    std::string _text;
+#endif
+  };
+}
+
+#endif
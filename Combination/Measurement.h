@@ -10,6 +10,8 @@
 #include <RooConstVar.h>
 #include <RooAbsReal.h>
 
+#include "Combination/SysErrorNameTable.h"
+
 #include <string>
 #include <vector>
 #include <map>
@@ -88,8 +90,9 @@ namespace BTagCombination {
     friend class CombinationContext;
     friend class CombinationContextBase;
 
-    /// Only the Context can create a new measurement.
-    Measurement(const std::string &measurementName, const std::string &what, const double val, const double statError);
+    /// Only the Context can create a new measurement. Systematic error names are interned in sysNames.
+    Measurement(const std::string &measurementName, const std::string &what, const double val, const double statError,
+		SysErrorNameTable *sysNames);
 
     ~Measurement(void);
 
@@ -100,6 +103,15 @@ namespace BTagCombination {
 
     std::vector<std::pair<std::string, double> > _sysErrors;
 
+    /// The same errors as (id, width), sorted by id, so two measurements can be compared
+    /// by walking both lists once. Ids come from the context's name table.
+    typedef std::vector<std::pair<unsigned int, double> > SysRow;
+    SysRow _sysRow;
+    SysErrorNameTable *_sysNames;
+
+    // Where this error sits in _sysRow (end if we don't have it).
+    SysRow::const_iterator FindSysError (const std::string &name) const;
+
     /// Variables we'll need later
     RooRealVar _actualValue;
     RooConstVar *_statError;
@@ -8,6 +8,7 @@
 #include <TMatrixTSym.h>
 
 #include <vector>
+#include <utility>
 
 namespace BTagCombination {
 
@@ -16,6 +17,57 @@ namespace BTagCombination {
   TMatrixTSym<double> CalcCovarMatrixUsingRho (const std::vector<Measurement*> &measurements);
   TMatrixTSym<double> CalcCovarMatrixUsingComposition (const std::vector<Measurement*> &measurements);
 
+  // The covariance of a list of measurements, stored as diag(d) + A A^T rather than as a full
+  // N x N matrix. d holds each measurement's uncorrelated variance (stat, plus any systematic
+  // error no other measurement has), and A is the measurement x shared systematic error loading
+  // matrix (the error widths). Same matrix as CalcCovarMatrixUsingComposition.
+  class LowRankCovariance {
+  public:
+    LowRankCovariance (const std::vector<Measurement*> &measurements);
+
+    // delta^T V^-1 delta, done with the Woodbury identity so only an S x S matrix (S shared
+    // systematic errors) is ever factored.
+    double Chi2 (const std::vector<double> &delta) const;
+
+    // Build the full matrix (for small problems and cross checks).
+    TMatrixTSym<double> Dense (void) const;
+
+    size_t nMeasurements (void) const { return _diag.size(); }
+    size_t nSharedSystematics (void) const { return _nShared; }
+
+  private:
+    std::vector<double> _diag;
+    // Non-zero loadings for each measurement: (shared systematic index, width).
+    std::vector<std::vector<std::pair<size_t, double> > > _loadings;
+    size_t _nShared;
+  };
+
+  // Every pairwise correlation between a list of measurements at once. The widths are packed into a
+  // dense (measurement x systematic error) matrix W, and the shared variances are the matrix
+  // product W W^T. Numbers are the same as calling Measurement::Rho/Covar on each pair.
+  class PairwiseCorrelations {
+  public:
+    PairwiseCorrelations (const std::vector<Measurement*> &measurements);
+
+    size_t size (void) const { return _measurements.size(); }
+
+    // sum_k w_ik w_jk over the systematic errors both have.
+    double SharedVariance (size_t i, size_t j) const { return _shared[i*_measurements.size() + j]; }
+    double TotalError (size_t i) const { return _totalError[i]; }
+
+    double RhoUnbounded (size_t i, size_t j) const;
+
+    // Bounded to [-1, 1], with a warning if that has to be done (as Measurement::Rho).
+    double Rho (size_t i, size_t j) const;
+
+    double Covar (size_t i, size_t j) const;
+
+  private:
+    std::vector<Measurement*> _measurements;
+    std::vector<double> _totalError;
+    std::vector<double> _shared; // Row major, N x N
+  };
+
   // Calculate the fully correlated value of the chi2 for a sequence of measurements.
   double CalcChi2(const std::vector<Measurement*> &measurements, const std::vector<Measurement*> &fitResults);
 }
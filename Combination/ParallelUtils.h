@@ -0,0 +1,33 @@
+///
+/// ParallelUtils.h
+///
+/// Run a list of independent jobs on a pool of worker threads, or of worker processes.
+///
+#ifndef __BTagCombination__ParallelUtils__
+#define __BTagCombination__ParallelUtils__
+
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace BTagCombination {
+
+  // Run all the jobs, nThreads at a time. Jobs are started in the order they are given,
+  // so put the longest ones first. If any job throws, the remaining jobs are not started and
+  // the first exception is re-thrown once the running ones have finished.
+  // nThreads of 1 runs everything in this thread; 0 means one thread per core.
+  void RunInParallel (const std::vector<std::function<void (void)> > &jobs, unsigned int nThreads = 0);
+
+  // Run each job in its own forked process, nProcesses at a time (0 means one per core), and
+  // return what each one returned, in the same order as the jobs. For code that can't run on
+  // several threads at once (RooFit and MINUIT). If any job throws, or its process dies, the
+  // remaining jobs are not started and a runtime_error is thrown once the running ones are done.
+  // nProcesses of 1 runs everything in this process. Don't call it while other threads are running.
+  std::vector<std::string> RunInWorkerProcesses (const std::vector<std::function<std::string (void)> > &jobs,
+						 unsigned int nProcesses = 0);
+
+  // The number of threads that nThreads will actually turn into.
+  unsigned int NumberOfWorkerThreads (unsigned int nThreads);
+}
+
+#endif
@@ -17,6 +17,7 @@
 #include <cmath>
 #include <sstream>
 #include <stdexcept>
+#include <functional>
 
 #include "Combination/CalibrationDataModel.h"
 #include "Combination/CalibrationFilter.h"
@@ -33,6 +34,40 @@ namespace BTagCombination
 
   // Returns a list of analyses given an input text file (reads the complete text file)
 	CalibrationInfo Parse(std::istream &input, calibrationFilterInfo &fInfo);
+
+  // Returns a list of analyses given a file name. The file is memory-mapped and parsed in place.
+	CalibrationInfo ParseFile(const std::string &fname, calibrationFilterInfo &fInfo);
+
+  // Parse text sitting in memory without copying it. Lines that start with a '#' are dropped
+  // if skipCommentLines is true (as is done when reading from a file). Always uses the hand-written parser.
+	CalibrationInfo ParseBuffer(const char *begin, const char *end, calibrationFilterInfo &fInfo, bool skipCommentLines = false);
+
+  // Streaming parse: each item is handed to its callback as soon as its block closes. The
+  // filter is applied on the way, so items (and bins) that are filtered out are never stored.
+  // Nothing else is done - split analyses are not combined. A callback may move the item away.
+	struct CalibrationInfoCallbacks {
+		std::function<void (CalibrationAnalysis &)> Analysis;
+		std::function<void (AnalysisCorrelation &)> Correlation;
+		std::function<void (DefaultAnalysis &)> Default;
+		std::function<void (AliasAnalysis &)> Alias;
+	};
+	void ParseStream(const char *begin, const char *end, const calibrationFilterInfo &fInfo,
+		const CalibrationInfoCallbacks &callbacks, bool skipCommentLines = false);
+	void ParseFileStream(const std::string &fname, const calibrationFilterInfo &fInfo,
+		const CalibrationInfoCallbacks &callbacks);
+
+  // Bump this whenever a change to the parsers or the filtering changes what a text file turns
+  // into. It is part of the key of the binary caches (BinaryCalibrationInfo.h), so old ones get remade.
+	const unsigned int ParserVersion = 1;
+
+  // Parse with the Boost.Spirit grammar. This was the original parser, and is kept as the reference
+  // the hand-written parser is checked against.
+	CalibrationInfo ParseSpirit(const std::string &inputText, calibrationFilterInfo &fInfo);
+
+  // Which parser Parse and ParseFile use. The hand-written one is the default.
+	enum ParserBackend { kHandWrittenParser, kSpiritParser };
+	void SetParserBackend(ParserBackend backend);
+	ParserBackend GetParserBackend();
 }
 
 #endif
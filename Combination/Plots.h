@@ -10,6 +10,7 @@
 
 #include <TDirectory.h>
 #include <vector>
+#include <string>
 
 namespace BTagCombination
 {
@@ -27,10 +28,36 @@ namespace BTagCombination
     pcEffOnly
   };
 
+  /// The kinds of plots that can be made for a group. Or them together.
+  enum PlotKind {
+    pkAnalysis = 0x01,		// Pulls and nuisance parameters of each fit
+    pkSF = 0x02,		// Scale factors of all the analyses on one canvas, along each axis
+    pkBinValues = 0x04,		// Central value, stat and total error histograms for each analysis
+    pkSysErrors = 0x08,		// Systematic errors, stacked and side by side
+    pkCVShifts = 0x10,		// Central value shifts, stacked
+    pkAllKinds = 0x1f
+  };
+
+  /// Which plots to make. Only the groups and kinds asked for are built.
+  struct PlotSelection {
+    inline PlotSelection (PlotCollection whatToPlot = pcAll)
+      : kinds (whatToPlot == pcEffOnly ? pkSF : pkAllKinds), nThreads (1)
+    {}
+
+    unsigned int kinds;		// PlotKinds or'd together
+    std::string groupFilter;	// Regex a group name must contain a match for (empty for all)
+    unsigned int nThreads;	// Threads used to work out what goes in the plots (0 for one per core)
+  };
+
   /// Store plots in the directory given for all the analyses.
   void DumpPlots (TDirectory *outputDir, const std::vector<CalibrationAnalysis> &anas,
 		  GroupCriteria gp, PlotCollection whatToPlot = pcAll);
 
+  /// Store just the selected plots. The contents of each group's plots are worked out in
+  /// parallel; the plots are then drawn and written one group at a time, in order.
+  void DumpPlots (TDirectory *outputDir, const std::vector<CalibrationAnalysis> &anas,
+		  GroupCriteria gp, const PlotSelection &what);
+
 }
 
 #endif
@@ -0,0 +1,47 @@
+///
+/// Hand out a small integer for each systematic error name. Every measurement in a context
+/// shares one table, so comparing errors between measurements is an integer compare.
+///
+#ifndef COMBINATION_SysErrorNameTable
+#define COMBINATION_SysErrorNameTable
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace BTagCombination {
+
+  class SysErrorNameTable
+  {
+  public:
+    // Id for a name - a new one is made the first time a name is seen.
+    unsigned int Intern (const std::string &name)
+    {
+      std::map<std::string, unsigned int>::const_iterator itr = _ids.find(name);
+      if (itr != _ids.end())
+	return itr->second;
+      unsigned int id = _names.size();
+      _ids[name] = id;
+      _names.push_back(name);
+      return id;
+    }
+
+    // Id for a name we may not have seen. Returns false if we haven't.
+    bool Find (const std::string &name, unsigned int &id) const
+    {
+      std::map<std::string, unsigned int>::const_iterator itr = _ids.find(name);
+      if (itr == _ids.end())
+	return false;
+      id = itr->second;
+      return true;
+    }
+
+    const std::string &Name (unsigned int id) const { return _names[id]; }
+
+  private:
+    std::map<std::string, unsigned int> _ids;
+    std::vector<std::string> _names;
+  };
+}
+
+#endif
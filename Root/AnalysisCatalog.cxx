@@ -0,0 +1,110 @@
+//
+// AnalysisCatalog - hash indices over a list of analyses.
+//
+
+#include "Combination/AnalysisCatalog.h"
+#include "Combination/BinNameUtils.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  // The names can hold almost any character, so they are joined with one that the
+  // parser never lets into a name.
+  string IdentityKey (const string &name, const string &flavor, const string &tagger,
+		      const string &operatingPoint, const string &jetAlgorithm)
+  {
+    string key;
+    key.reserve(name.size() + flavor.size() + tagger.size() + operatingPoint.size() + jetAlgorithm.size() + 4);
+    key += name;
+    key += '\0';
+    key += flavor;
+    key += '\0';
+    key += tagger;
+    key += '\0';
+    key += operatingPoint;
+    key += '\0';
+    key += jetAlgorithm;
+    return key;
+  }
+}
+
+namespace BTagCombination {
+
+  const size_t AnalysisCatalog::npos = static_cast<size_t>(-1);
+
+  AnalysisCatalog::AnalysisCatalog (const vector<CalibrationAnalysis> &anas)
+    : _anas(anas), _nListed(0), _nIdentified(0)
+  {
+    for (int i = 0; i < kNAnalysisGroupings; i++)
+      _nGrouped[i] = 0;
+    Update();
+  }
+
+  //
+  // Take in the new analyses. The indices catch up when they are next used.
+  //
+  void AnalysisCatalog::Update ()
+  {
+    _nListed = _anas.size();
+  }
+
+  void AnalysisCatalog::IndexIdentities () const
+  {
+    for (; _nIdentified < _nListed; _nIdentified++) {
+      const CalibrationAnalysis &ana(_anas[_nIdentified]);
+      // insert leaves an existing entry alone, so the first of any duplicates is the one found.
+      _byIdentity.insert(make_pair(IdentityKey(ana.name, ana.flavor, ana.tagger, ana.operatingPoint, ana.jetAlgorithm),
+				   _nIdentified));
+    }
+  }
+
+  size_t AnalysisCatalog::Find (const CalibrationAnalysis &ana) const
+  {
+    return Find(ana.name, ana.flavor, ana.tagger, ana.operatingPoint, ana.jetAlgorithm);
+  }
+
+  size_t AnalysisCatalog::Find (const string &name, const string &flavor, const string &tagger,
+				const string &operatingPoint, const string &jetAlgorithm) const
+  {
+    IndexIdentities();
+    unordered_map<string, size_t>::const_iterator itr = _byIdentity.find(IdentityKey(name, flavor, tagger, operatingPoint, jetAlgorithm));
+    return itr == _byIdentity.end() ? npos : itr->second;
+  }
+
+  const vector<size_t> &AnalysisCatalog::Group (AnalysisGrouping by, const string &key) const
+  {
+    static const vector<size_t> empty;
+    const map<string, vector<size_t> > &groups(Groups(by));
+    map<string, vector<size_t> >::const_iterator itr = groups.find(key);
+    return itr == groups.end() ? empty : itr->second;
+  }
+
+  const map<string, vector<size_t> > &AnalysisCatalog::Groups (AnalysisGrouping by) const
+  {
+    map<string, vector<size_t> > &groups(_groups[by]);
+    for (; _nGrouped[by] < _nListed; _nGrouped[by]++)
+      groups[GroupKey(by, _anas[_nGrouped[by]])].push_back(_nGrouped[by]);
+    return groups;
+  }
+
+  string AnalysisCatalog::GroupKey (AnalysisGrouping by, const CalibrationAnalysis &ana)
+  {
+    switch (by) {
+    case kByAnalysisName:
+      return ana.name;
+    case kByJetTagFlavOp:
+      return OPIndependentName(ana);
+    case kByFlavorTaggerOp:
+      return OPByFlavorTaggerOp(ana);
+    case kByCalibName:
+      return OPByCalibName(ana);
+    case kByCalibJetTagger:
+      return OPByCalibJetTagger(ana);
+    default:
+      break;
+    }
+    throw runtime_error("Unknown analysis grouping");
+  }
+}
@@ -18,14 +18,10 @@ namespace {
 
   typedef map<string, vector<pair<double,double> > > t_bin_list;
 
-  // Error class used to move info between layers when there is a failure.
-  class binning_error : public runtime_error {
-  public:
-    inline binning_error (double lowbinHigh, double highbinLow, const string &message)
-      : runtime_error (message.c_str()), _lowbinH (lowbinHigh), _highbinL (highbinLow)
-    {}
-
+  // What went wrong when an axis can't be laid out as a histogram axis.
+  struct binning_problem {
     double _lowbinH, _highbinL;
+    string _message;
   };
 
   // Go through all the analysis and extract all the bins that are
@@ -75,36 +71,47 @@ namespace {
   }
 
   // Given all bins make sure the are adjacent and create just a list of bin boundaries much
-  // like what you would put in a histogram.
-  vector<double> get_bin_boundaries_hist(const vector<pair<double, double> > &allbins)
+  // like what you would put in a histogram. False (and what is wrong in problem) if they
+  // can't be.
+  bool get_bin_boundaries_hist(const vector<pair<double, double> > &allbins,
+			       vector<double> &result,
+			       binning_problem &problem)
   {
 	  // Put them in order
 	  vector<pair<double, double> > acopy(allbins);
 	  sort(acopy.begin(), acopy.end(), compare_first_of_pair);
 
 	  // Now, extract the boundaries
-	  vector<double> result;
+	  result.clear();
 	  pair<double, double> last;
 	  for (unsigned int i = 0; i < acopy.size(); i++) {
 		  if (acopy[i].first == acopy[i].second) {
 			  ostringstream errtext;
 			  errtext << "Bins can't be infinitely thing - lower and upper have the same boundary: " << acopy[i].first;
-			  throw binning_error(acopy[i].first, acopy[i].second, errtext.str());
+			  problem._lowbinH = acopy[i].first;
+			  problem._highbinL = acopy[i].second;
+			  problem._message = errtext.str();
+			  return false;
 		  }
 		  if (result.size() == 0) {
 			  result.push_back(acopy[i].first);
 		  }
 		  else {
 			  if (acopy[i] == last) {
-				  ostringstream errtxt;
-				  throw binning_error(last.first, last.second, "Duplicate bin boundaries!");
+				  problem._lowbinH = last.first;
+				  problem._highbinL = last.second;
+				  problem._message = "Duplicate bin boundaries!";
+				  return false;
 			  }
 			  if (last.second != acopy[i].first) {
 				  ostringstream errtxt;
 				  errtxt << "Bins must be adjacent and exclusive - "
 					  << " lower bin's upper boundary (" << last.second << ")"
 					  << " and upper bins' lower boundary (" << acopy[i].first << ") need to be the same";
-				  throw binning_error(last.second, acopy[i].first, errtxt.str());
+				  problem._lowbinH = last.second;
+				  problem._highbinL = acopy[i].first;
+				  problem._message = errtxt.str();
+				  return false;
 			  }
 			  result.push_back(acopy[i].first);
 		  }
@@ -112,7 +119,7 @@ namespace {
 		  last = acopy[i];
 	  }
 	  result.push_back(last.second);
-	  return result;
+	  return true;
   }
 
   CalibrationBinBoundary get_bin_boundary_for (const CalibrationBin &bin, const string &boundaryname)
@@ -249,6 +256,18 @@ namespace BTagCombination {
   // an object that knows how to create historams, etc., for teh CDI.
   // Fail fairly resolutely if we find problems (overlaps, thin bins, etc.).
   bin_boundaries calcBoundaries (const CalibrationAnalysis &ana, bool ignoreExtrap)
+  {
+    bin_boundaries result;
+    string problems;
+    if (!findRegularBoundaries(ana, result, problems, ignoreExtrap)) {
+      throw bin_boundary_error (problems);
+    }
+    return result;
+  }
+
+  // Does the work for calcBoundaries, but hands back a bad binning rather than
+  // throwing, so callers can look before they leap.
+  bool findRegularBoundaries (const CalibrationAnalysis &ana, bin_boundaries &result, string &problems, bool ignoreExtrap)
   {
     // Find all the bins that are in the analysis
     t_bin_list raw_bins = extract_bins(ana, ignoreExtrap);
@@ -261,16 +280,18 @@ namespace BTagCombination {
 
     // For each variable, get a set of bin boundaries
 
-    bin_boundaries result;
+    result = bin_boundaries();
     bool errorSeen = false;
     ostringstream errmsg;
     errmsg << "Found problems with binning: ";
+    vector<double> edges;
+    binning_problem e;
     for (t_bin_list::const_iterator ibin = raw_bins.begin(); ibin != raw_bins.end(); ibin++) {
-      try {
-	result.add_axis(ibin->first, get_bin_boundaries_hist(ibin->second));
-      } catch (binning_error &e){
+      if (get_bin_boundaries_hist(ibin->second, edges, e)) {
+	result.add_axis(ibin->first, edges);
+      } else {
 	errmsg << endl;
-	errmsg << "    " << e.what() << endl;
+	errmsg << "    " << e._message << endl;
 
 	// Now we have to find all the possibly offending bins, and then
 	// print them out in the standard printing format that can be used as part
@@ -288,10 +309,11 @@ namespace BTagCombination {
     }
 
     if (errorSeen) {
-      throw bin_boundary_error (errmsg.str().c_str());
+      problems = errmsg.str();
+      return false;
     }
 
-    return result;
+    return true;
   }
 
   //
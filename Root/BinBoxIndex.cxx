@@ -0,0 +1,299 @@
+//
+// BinBoxIndex - find overlapping and containing bins without testing every pair.
+//
+
+#include "Combination/BinBoxIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // The axes of a bin, sorted and joined into one key. False if it can't be indexed: an axis is
+  // named twice, or an edge isn't a number (and so compares oddly).
+  bool AxesKey (const vector<CalibrationBinBoundary> &spec, string &key)
+  {
+    vector<string> axes;
+    for (size_t i = 0; i < spec.size(); i++) {
+      if (std::isnan(spec[i].lowvalue) || std::isnan(spec[i].highvalue))
+	return false;
+      axes.push_back(spec[i].variable);
+    }
+    sort(axes.begin(), axes.end());
+    if (adjacent_find(axes.begin(), axes.end()) != axes.end())
+      return false;
+
+    key.clear();
+    for (size_t i = 0; i < axes.size(); i++) {
+      key += axes[i];
+      key += '\0';
+    }
+    return true;
+  }
+
+  const CalibrationBinBoundary &Edge (const vector<CalibrationBinBoundary> &spec, const string &axis)
+  {
+    for (size_t i = 0; i < spec.size(); i++) {
+      if (spec[i].variable == axis)
+	return spec[i];
+    }
+    throw runtime_error("Internal error: bin in the index has lost its axis " + axis);
+  }
+
+  vector<vector<CalibrationBinBoundary> > Specs (const vector<CalibrationBin> &bins)
+  {
+    vector<vector<CalibrationBinBoundary> > r;
+    r.reserve(bins.size());
+    for (size_t i = 0; i < bins.size(); i++)
+      r.push_back(bins[i].binSpec);
+    return r;
+  }
+
+  vector<vector<CalibrationBinBoundary> > Specs (const set<set<CalibrationBinBoundary> > &bins)
+  {
+    vector<vector<CalibrationBinBoundary> > r;
+    r.reserve(bins.size());
+    for (set<set<CalibrationBinBoundary> >::const_iterator itr = bins.begin(); itr != bins.end(); itr++)
+      r.push_back(vector<CalibrationBinBoundary>(itr->begin(), itr->end()));
+    return r;
+  }
+}
+
+namespace BTagCombination {
+
+  //
+  // Every axis named in either bin must be named exactly twice in all - once in each, as long
+  // as neither names an axis twice.
+  //
+  bool BinsOverlap (const vector<CalibrationBinBoundary> &b1, const vector<CalibrationBinBoundary> &b2)
+  {
+    size_t n = b1.size() + b2.size();
+    for (size_t i = 0; i < n; i++) {
+      const CalibrationBinBoundary &bi(i < b1.size() ? b1[i] : b2[i - b1.size()]);
+
+      // Each axis is checked where it first turns up.
+      bool seen = false;
+      for (size_t j = 0; j < i && !seen; j++)
+	seen = (j < b1.size() ? b1[j] : b2[j - b1.size()]).variable == bi.variable;
+      if (seen)
+	continue;
+
+      const CalibrationBinBoundary *other = 0;
+      for (size_t j = i + 1; j < n; j++) {
+	const CalibrationBinBoundary &bj(j < b1.size() ? b1[j] : b2[j - b1.size()]);
+	if (bj.variable == bi.variable) {
+	  if (other != 0)
+	    return false;
+	  other = &bj;
+	}
+      }
+      if (other == 0)
+	return false;
+
+      if (bi.highvalue <= other->lowvalue)
+	return false;
+      if (bi.lowvalue >= other->highvalue)
+	return false;
+    }
+    return true;
+  }
+
+  bool BinContains (const set<CalibrationBinBoundary> &container, const vector<CalibrationBinBoundary> &bin)
+  {
+    // The bin's axes, with the last one winning if it names one twice.
+    size_t nAxes = 0;
+    for (size_t i = 0; i < bin.size(); i++) {
+      bool later = false;
+      for (size_t j = i + 1; j < bin.size() && !later; j++)
+	later = bin[j].variable == bin[i].variable;
+      if (!later)
+	nAxes++;
+    }
+    if (container.size() != nAxes)
+      return false;
+
+    for (set<CalibrationBinBoundary>::const_iterator itr = container.begin(); itr != container.end(); itr++) {
+      const CalibrationBinBoundary *b = 0;
+      for (size_t i = 0; i < bin.size(); i++) {
+	if (bin[i].variable == itr->variable)
+	  b = &bin[i];
+      }
+      if (b == 0)
+	return false;
+
+      if (b->lowvalue < itr->lowvalue
+	  || b->highvalue > itr->highvalue)
+	return false;
+    }
+    return true;
+  }
+
+  double BinArea (const set<CalibrationBinBoundary> &b)
+  {
+    double r = 1.0;
+    for (set<CalibrationBinBoundary>::const_iterator i = b.begin(); i != b.end(); i++) {
+      r *= (i->highvalue - i->lowvalue);
+    }
+    return r;
+  }
+
+  BinBoxIndex::BinBoxIndex (const vector<CalibrationBin> &bins)
+    : _specs(Specs(bins))
+  {
+    Index();
+  }
+
+  BinBoxIndex::BinBoxIndex (const set<set<CalibrationBinBoundary> > &bins)
+    : _specs(Specs(bins))
+  {
+    Index();
+  }
+
+  //
+  // Sort each group along the axis that has the most different low edges - for a grid that is
+  // the finest one, so a query looks at the fewest bins.
+  //
+  void BinBoxIndex::Index ()
+  {
+    map<string, vector<size_t> > byAxes;
+    string key;
+    for (size_t i = 0; i < _specs.size(); i++) {
+      if (AxesKey(_specs[i], key))
+	byAxes[key].push_back(i);
+      else
+	_irregular.push_back(i);
+    }
+
+    for (map<string, vector<size_t> >::const_iterator itr = byAxes.begin(); itr != byAxes.end(); itr++) {
+      const vector<size_t> &bins(itr->second);
+      Group &g(_groups[itr->first]);
+
+      size_t best = 0;
+      const vector<CalibrationBinBoundary> &first(_specs[bins[0]]);
+      for (size_t a = 0; a < first.size(); a++) {
+	set<double> lows;
+	for (size_t i = 0; i < bins.size(); i++)
+	  lows.insert(Edge(_specs[bins[i]], first[a].variable).lowvalue);
+	if (lows.size() > best) {
+	  best = lows.size();
+	  g.axis = first[a].variable;
+	}
+      }
+
+      vector<pair<double, size_t> > order;
+      for (size_t i = 0; i < bins.size(); i++) {
+	double low = g.axis.empty() ? 0.0 : Edge(_specs[bins[i]], g.axis).lowvalue;
+	order.push_back(make_pair(low, bins[i]));
+      }
+      sort(order.begin(), order.end());
+
+      for (size_t i = 0; i < order.size(); i++) {
+	g.bins.push_back(order[i].second);
+	if (g.axis.empty())
+	  continue;
+	const CalibrationBinBoundary &e(Edge(_specs[order[i].second], g.axis));
+	g.lows.push_back(e.lowvalue);
+	g.highs.push_back(e.highvalue);
+	g.maxHighs.push_back(i == 0 ? e.highvalue : max(g.maxHighs.back(), e.highvalue));
+      }
+    }
+  }
+
+  //
+  // Everything that might overlap or contain spec: the bins with the same axes whose range along
+  // the sorted axis touches spec's (edges included), and the bins we couldn't index.
+  //
+  void BinBoxIndex::Candidates (const vector<CalibrationBinBoundary> &spec, vector<size_t> &result) const
+  {
+    result.clear();
+
+    string key;
+    if (!AxesKey(spec, key)) {
+      for (size_t i = 0; i < _specs.size(); i++)
+	result.push_back(i);
+      return;
+    }
+
+    result = _irregular;
+    map<string, Group>::const_iterator itr = _groups.find(key);
+    if (itr != _groups.end()) {
+      const Group &g(itr->second);
+      if (g.axis.empty()) {
+	result.insert(result.end(), g.bins.begin(), g.bins.end());
+      } else {
+	const CalibrationBinBoundary &e(Edge(spec, g.axis));
+	double qlow = min(e.lowvalue, e.highvalue);
+	double qhigh = max(e.lowvalue, e.highvalue);
+
+	size_t first = lower_bound(g.maxHighs.begin(), g.maxHighs.end(), qlow) - g.maxHighs.begin();
+	size_t last = upper_bound(g.lows.begin(), g.lows.end(), qhigh) - g.lows.begin();
+	for (size_t i = first; i < last; i++) {
+	  if (g.highs[i] >= qlow)
+	    result.push_back(g.bins[i]);
+	}
+      }
+    }
+    sort(result.begin(), result.end());
+  }
+
+  vector<size_t> BinBoxIndex::Overlapping (const vector<CalibrationBinBoundary> &spec) const
+  {
+    vector<size_t> candidates;
+    Candidates(spec, candidates);
+
+    vector<size_t> result;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      if (BinsOverlap(spec, _specs[candidates[i]]))
+	result.push_back(candidates[i]);
+    }
+    return result;
+  }
+
+  vector<size_t> BinBoxIndex::Containing (const vector<CalibrationBinBoundary> &spec) const
+  {
+    vector<size_t> candidates;
+    Candidates(spec, candidates);
+
+    vector<size_t> result;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      const vector<CalibrationBinBoundary> &c(_specs[candidates[i]]);
+      if (BinContains(set<CalibrationBinBoundary>(c.begin(), c.end()), spec))
+	result.push_back(candidates[i]);
+    }
+    return result;
+  }
+
+  bool BinBoxIndex::NoneOverlap () const
+  {
+    vector<size_t> candidates;
+    for (size_t i = 0; i < _specs.size(); i++) {
+      Candidates(_specs[i], candidates);
+      for (size_t j = 0; j < candidates.size(); j++) {
+	if (candidates[j] > i && BinsOverlap(_specs[i], _specs[candidates[j]]))
+	  return false;
+      }
+    }
+    return true;
+  }
+
+  //
+  // There are all sorts of crazy things that can be done when we are talking about 2D. Since the
+  // bins are all inside the area, if they add up to it and none of them overlap, it is covered.
+  //
+  bool BinBoxIndex::Covers (const set<CalibrationBinBoundary> &area) const
+  {
+    double barea = 0.0;
+    for (size_t i = 0; i < _specs.size(); i++) {
+      barea += BinArea(set<CalibrationBinBoundary>(_specs[i].begin(), _specs[i].end()));
+    }
+
+    if (barea != BinArea(area))
+      return false;
+
+    return NoneOverlap();
+  }
+}
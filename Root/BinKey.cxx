@@ -0,0 +1,179 @@
+//
+// BinKey - a compact, hashable bin identity.
+//
+
+#include "Combination/BinKey.h"
+#include "Combination/BinNameUtils.h"
+
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+  // There are only ever a handful of axis names (pt, abseta, ...), and they are never forgotten, so
+  // a pointer to the one copy is a good stand-in for the name. Each thread keeps its own cache in
+  // front of the shared table so the lock is only taken the first time a thread sees a name.
+  const string *InternAxis (const string &axis)
+  {
+    static thread_local unordered_map<string, const string*> cache;
+    unordered_map<string, const string*>::const_iterator c = cache.find(axis);
+    if (c != cache.end())
+      return c->second;
+
+    static unordered_set<string> table;
+    static mutex lock;
+    const string *interned;
+    {
+      lock_guard<mutex> guard(lock);
+      interned = &*(table.insert(axis).first);
+    }
+    cache[axis] = interned;
+    return interned;
+  }
+
+  // -0.0 == 0.0, so they have to hash the same.
+  size_t HashDouble (double v)
+  {
+    return v == 0.0 ? 0 : hash<double>()(v);
+  }
+
+  void HashCombine (size_t &seed, size_t v)
+  {
+    seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+}
+
+namespace BTagCombination {
+
+  BinKey::BinKey ()
+    : _hash(0)
+  {
+  }
+
+  BinKey::BinKey (const vector<CalibrationBinBoundary> &binSpec)
+  {
+    _edges.reserve(binSpec.size());
+    for (vector<CalibrationBinBoundary>::const_iterator itr = binSpec.begin(); itr != binSpec.end(); itr++)
+      Add(*itr);
+    Finish();
+  }
+
+  BinKey::BinKey (const set<CalibrationBinBoundary> &binSpec)
+  {
+    _edges.reserve(binSpec.size());
+    for (set<CalibrationBinBoundary>::const_iterator itr = binSpec.begin(); itr != binSpec.end(); itr++)
+      Add(*itr);
+    Finish();
+  }
+
+  BinKey::BinKey (const CalibrationBin &bin)
+  {
+    _edges.reserve(bin.binSpec.size());
+    for (vector<CalibrationBinBoundary>::const_iterator itr = bin.binSpec.begin(); itr != bin.binSpec.end(); itr++)
+      Add(*itr);
+    Finish();
+  }
+
+  BinKey BinKey::Without (const string &axis, const vector<CalibrationBinBoundary> &binSpec)
+  {
+    BinKey k;
+    for (vector<CalibrationBinBoundary>::const_iterator itr = binSpec.begin(); itr != binSpec.end(); itr++) {
+      if (itr->variable != axis)
+	k.Add(*itr);
+    }
+    k.Finish();
+    return k;
+  }
+
+  void BinKey::Add (const CalibrationBinBoundary &b)
+  {
+    Edge e;
+    e.axis = InternAxis(b.variable);
+    e.low = b.lowvalue;
+    e.high = b.highvalue;
+    _edges.push_back(e);
+  }
+
+  //
+  // Put the edges in the order a set<CalibrationBinBoundary> would, drop repeats (a set would
+  // hold them only once), and hash.
+  //
+  void BinKey::Finish ()
+  {
+    sort(_edges.begin(), _edges.end(), [](const Edge &x, const Edge &y) {
+	if (x.axis != y.axis)
+	  return *x.axis < *y.axis;
+	if (x.low != y.low)
+	  return x.low < y.low;
+	return x.high < y.high;
+      });
+    _edges.erase(unique(_edges.begin(), _edges.end(), [](const Edge &x, const Edge &y) {
+	  return x.axis == y.axis && x.low == y.low && x.high == y.high;
+	}), _edges.end());
+
+    _hash = _edges.size();
+    for (vector<Edge>::const_iterator itr = _edges.begin(); itr != _edges.end(); itr++) {
+      HashCombine(_hash, hash<const string*>()(itr->axis));
+      HashCombine(_hash, HashDouble(itr->low));
+      HashCombine(_hash, HashDouble(itr->high));
+    }
+  }
+
+  set<CalibrationBinBoundary> BinKey::Boundaries () const
+  {
+    vector<CalibrationBinBoundary> spec(BinSpec());
+    return set<CalibrationBinBoundary>(spec.begin(), spec.end());
+  }
+
+  vector<CalibrationBinBoundary> BinKey::BinSpec () const
+  {
+    vector<CalibrationBinBoundary> result;
+    result.reserve(_edges.size());
+    for (vector<Edge>::const_iterator itr = _edges.begin(); itr != _edges.end(); itr++) {
+      CalibrationBinBoundary b;
+      b.variable = *itr->axis;
+      b.lowvalue = itr->low;
+      b.highvalue = itr->high;
+      result.push_back(b);
+    }
+    return result;
+  }
+
+  string BinKey::Name () const
+  {
+    return OPBinName(Boundaries());
+  }
+
+  bool BinKey::operator== (const BinKey &other) const
+  {
+    if (_hash != other._hash || _edges.size() != other._edges.size())
+      return false;
+    for (size_t i = 0; i < _edges.size(); i++) {
+      const Edge &x(_edges[i]);
+      const Edge &y(other._edges[i]);
+      if (x.axis != y.axis || x.low != y.low || x.high != y.high)
+	return false;
+    }
+    return true;
+  }
+
+  // The same order as comparing the two sets of boundaries.
+  bool BinKey::operator< (const BinKey &other) const
+  {
+    for (size_t i = 0; i < _edges.size() && i < other._edges.size(); i++) {
+      const Edge &x(_edges[i]);
+      const Edge &y(other._edges[i]);
+      if (x.axis != y.axis)
+	return *x.axis < *y.axis;
+      if (x.low != y.low)
+	return x.low < y.low;
+      if (x.high != y.high)
+	return x.high < y.high;
+    }
+    return _edges.size() < other._edges.size();
+  }
+}
@@ -10,6 +10,21 @@
 
 using namespace std;
 
+namespace {
+  // The flavor, tagger, OP, jet name. Analyses and correlations have to come out exactly the
+  // same, so both are made here.
+  template <class T>
+  string IndependentName (const T &item)
+  {
+    ostringstream msg;
+    msg << item.flavor
+	<< "-" << item.tagger
+	<< "-" << item.operatingPoint
+	<< "-" << item.jetAlgorithm;
+    return msg.str();
+  }
+}
+
 namespace BTagCombination {
 
   // Returns a well formed name for the analysis. This is text only,
@@ -76,12 +91,12 @@ namespace BTagCombination {
   // by strings into how they should be combined.
   string OPIndependentName (const CalibrationAnalysis &ana)
   {
-    ostringstream msg;
-    msg << ana.flavor
-	<< "-" << ana.tagger
-	<< "-" << ana.operatingPoint
-	<< "-" << ana.jetAlgorithm;
-    return msg.str();
+    return IndependentName(ana);
+  }
+
+  string OPIndependentName (const AnalysisCorrelation &cor)
+  {
+    return IndependentName(cor);
   }
 
   string OPByFlavorTaggerOp (const CalibrationAnalysis &ana)
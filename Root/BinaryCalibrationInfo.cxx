@@ -0,0 +1,594 @@
+//
+// BinaryCalibrationInfo - write and read a CalibrationInfo in a compact binary format.
+//
+//  Layout (all integers little-endian, doubles as their IEEE bits):
+//    "FTCALBIN", u32 version, u32 (unused), u64 filter key, i64 source size, i64 source mtime (ns),
+//    u64 source content hash, u64 length of what follows
+//    string table: u32 count, then for each a u32 length and the characters
+//    the info: counts are u32, strings are u32 indices into the table, bools are a byte
+//  Names (systematic errors, bin variables, taggers, ...) repeat endlessly in a big file, so
+//  each is written once in the string table.
+//
+//  If you change the layout, bump cBinaryVersion - old files are then rejected (and caches remade).
+//
+
+#include "Combination/BinaryCalibrationInfo.h"
+#include "Combination/MappedFile.h"
+#include "Combination/Parser.h"
+
+#include <TSystem.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  const char cBinaryMagic[8] = {'F', 'T', 'C', 'A', 'L', 'B', 'I', 'N'};
+  const unsigned int cBinaryVersion = 2;
+  const size_t cHeaderSize = 56;
+
+  bool gBinaryCacheEnabled = true;
+
+  // Makes temp file names unique when several threads write caches at once.
+  atomic<unsigned int> gTempFileCounter (0);
+
+  // Size and modification time (in ns, where the system keeps it) of a file. Plain stat rather
+  // than TSystem, as files are loaded from several threads at once.
+  bool FileStat (const string &fname, long long &size, long long &modTime)
+  {
+    struct stat info;
+    if (stat(fname.c_str(), &info) != 0)
+      return false;
+    size = info.st_size;
+    modTime = (long long) info.st_mtime * 1000000000LL;
+#if defined(__APPLE__)
+    modTime += info.st_mtimespec.tv_nsec;
+#elif !defined(_MSC_VER)
+    modTime += info.st_mtim.tv_nsec;
+#endif
+    return true;
+  }
+
+  // 64 bit FNV-1a, as in the fit cache.
+  unsigned long long StableHash (const string &s)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); i++) {
+      h ^= (unsigned char) s[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  // Hash of a file's contents. Size and time stamp can't see an edit that keeps the size and
+  // lands in the same clock tick, this can.
+  bool FileHash (const string &fname, unsigned long long &hash)
+  {
+    try {
+      MappedFile file (fname);
+      unsigned long long h = 14695981039346656037ULL;
+      for (const char *p = file.begin(); p != file.end(); p++) {
+	h ^= (unsigned char) *p;
+	h *= 1099511628211ULL;
+      }
+      hash = h;
+    }
+    catch (exception &) {
+      return false;
+    }
+    return true;
+  }
+
+  void Put (string &out, unsigned long long v, int nbytes)
+  {
+    for (int i = 0; i < nbytes; i++)
+      out.push_back(char((v >> (8*i)) & 0xff));
+  }
+
+  //
+  // Collects the strings and the body separately - the table has to come first in the file.
+  //
+  class BinaryWriter
+  {
+  public:
+    void U8 (bool v) { _body.push_back(char(v ? 1 : 0)); }
+    void U32 (size_t v) { Put(_body, v, 4); }
+    void Double (double v)
+    {
+      unsigned long long bits;
+      memcpy(&bits, &v, sizeof(bits));
+      Put(_body, bits, 8);
+    }
+    void String (const string &s)
+    {
+      map<string, size_t>::const_iterator itr = _ids.find(s);
+      if (itr == _ids.end()) {
+	itr = _ids.insert(make_pair(s, _names.size())).first;
+	_names.push_back(s);
+      }
+      U32(itr->second);
+    }
+
+    void Write (ostream &out, const BinaryCalibrationHeader &header) const
+    {
+      string table;
+      Put(table, _names.size(), 4);
+      for (size_t i = 0; i < _names.size(); i++) {
+	Put(table, _names[i].size(), 4);
+	table += _names[i];
+      }
+
+      string head (cBinaryMagic, sizeof(cBinaryMagic));
+      Put(head, cBinaryVersion, 4);
+      Put(head, 0, 4);
+      Put(head, header.filterKey, 8);
+      Put(head, header.sourceSize, 8);
+      Put(head, header.sourceModTime, 8);
+      Put(head, header.sourceHash, 8);
+      Put(head, table.size() + _body.size(), 8);
+
+      out.write(head.data(), head.size());
+      out.write(table.data(), table.size());
+      out.write(_body.data(), _body.size());
+    }
+
+  private:
+    map<string, size_t> _ids;
+    vector<string> _names;
+    string _body;
+  };
+
+  //
+  // Walks a buffer, checking we never step off the end.
+  //
+  class BinaryReader
+  {
+  public:
+    BinaryReader (const char *begin, const char *end)
+      : _p(begin), _end(end)
+    {}
+
+    void Header (BinaryCalibrationHeader &header)
+    {
+      if (_end - _p < (long) cHeaderSize || memcmp(_p, cBinaryMagic, sizeof(cBinaryMagic)) != 0)
+	throw runtime_error("Not a binary calibration file");
+      _p += sizeof(cBinaryMagic);
+
+      unsigned long long version = Get(4);
+      if (version != cBinaryVersion) {
+	ostringstream msg;
+	msg << "Binary calibration file is version " << version << ", but only version " << cBinaryVersion << " can be read";
+	throw runtime_error(msg.str());
+      }
+      Get(4);
+      header.filterKey = Get(8);
+      header.sourceSize = Get(8);
+      header.sourceModTime = Get(8);
+      header.sourceHash = Get(8);
+      unsigned long long length = Get(8);
+      if ((unsigned long long) (_end - _p) < length)
+	Corrupt();
+      _end = _p + length;
+    }
+
+    void StringTable ()
+    {
+      size_t n = Count();
+      _names.resize(n);
+      for (size_t i = 0; i < n; i++) {
+	size_t len = Get(4);
+	Need(len);
+	_names[i].assign(_p, len);
+	_p += len;
+      }
+    }
+
+    bool U8 () { Need(1); return *_p++ != 0; }
+    double Double ()
+    {
+      unsigned long long bits = Get(8);
+      double v;
+      memcpy(&v, &bits, sizeof(v));
+      return v;
+    }
+    const string &String ()
+    {
+      size_t id = Get(4);
+      if (id >= _names.size())
+	Corrupt();
+      return _names[id];
+    }
+
+    // A count of things that follow. Each takes at least a byte, so a corrupt count is caught
+    // here instead of turning into a huge allocation.
+    size_t Count ()
+    {
+      size_t n = Get(4);
+      if (n > (size_t) (_end - _p))
+	Corrupt();
+      return n;
+    }
+
+  private:
+    unsigned long long Get (int nbytes)
+    {
+      Need(nbytes);
+      unsigned long long v = 0;
+      for (int i = 0; i < nbytes; i++)
+	v |= (unsigned long long) (unsigned char) _p[i] << (8*i);
+      _p += nbytes;
+      return v;
+    }
+
+    void Need (size_t n)
+    {
+      if ((size_t) (_end - _p) < n)
+	Corrupt();
+    }
+
+    void Corrupt ()
+    {
+      throw runtime_error("Binary calibration file is corrupt or cut short");
+    }
+
+    const char *_p;
+    const char *_end;
+    vector<string> _names;
+  };
+
+  //
+  // The data model, one struct at a time. Read and Write must match exactly!
+  //
+  void Write (BinaryWriter &w, const vector<CalibrationBinBoundary> &spec)
+  {
+    w.U32(spec.size());
+    for (size_t i = 0; i < spec.size(); i++) {
+      w.String(spec[i].variable);
+      w.Double(spec[i].lowvalue);
+      w.Double(spec[i].highvalue);
+    }
+  }
+
+  void Read (BinaryReader &r, vector<CalibrationBinBoundary> &spec)
+  {
+    spec.resize(r.Count());
+    for (size_t i = 0; i < spec.size(); i++) {
+      spec[i].variable = r.String();
+      spec[i].lowvalue = r.Double();
+      spec[i].highvalue = r.Double();
+    }
+  }
+
+  void Write (BinaryWriter &w, const CalibrationBin &b)
+  {
+    Write(w, b.binSpec);
+    w.Double(b.centralValue);
+    w.Double(b.centralValueStatisticalError);
+    w.U8(b.isExtended);
+    w.U32(b.metadata.size());
+    for (map<string, pair<double, double> >::const_iterator itr = b.metadata.begin(); itr != b.metadata.end(); itr++) {
+      w.String(itr->first);
+      w.Double(itr->second.first);
+      w.Double(itr->second.second);
+    }
+    w.U32(b.systematicErrors.size());
+    for (size_t i = 0; i < b.systematicErrors.size(); i++) {
+      w.String(b.systematicErrors[i].name);
+      w.Double(b.systematicErrors[i].value);
+      w.U8(b.systematicErrors[i].uncorrelated);
+    }
+  }
+
+  void Read (BinaryReader &r, CalibrationBin &b)
+  {
+    Read(r, b.binSpec);
+    b.centralValue = r.Double();
+    b.centralValueStatisticalError = r.Double();
+    b.isExtended = r.U8();
+    size_t nmeta = r.Count();
+    for (size_t i = 0; i < nmeta; i++) {
+      pair<double, double> &m (b.metadata[r.String()]);
+      m.first = r.Double();
+      m.second = r.Double();
+    }
+    b.systematicErrors.resize(r.Count());
+    for (size_t i = 0; i < b.systematicErrors.size(); i++) {
+      b.systematicErrors[i].name = r.String();
+      b.systematicErrors[i].value = r.Double();
+      b.systematicErrors[i].uncorrelated = r.U8();
+    }
+  }
+
+  // name, flavor, tagger, operatingPoint and jetAlgorithm - every item starts with these.
+  template <class T>
+  void WriteNames (BinaryWriter &w, const T &item)
+  {
+    w.String(item.name);
+    w.String(item.flavor);
+    w.String(item.tagger);
+    w.String(item.operatingPoint);
+    w.String(item.jetAlgorithm);
+  }
+
+  template <class T>
+  void ReadNames (BinaryReader &r, T &item)
+  {
+    item.name = r.String();
+    item.flavor = r.String();
+    item.tagger = r.String();
+    item.operatingPoint = r.String();
+    item.jetAlgorithm = r.String();
+  }
+
+  void Write (BinaryWriter &w, const CalibrationAnalysis &ana)
+  {
+    WriteNames(w, ana);
+    w.U32(ana.bins.size());
+    for (size_t i = 0; i < ana.bins.size(); i++)
+      Write(w, ana.bins[i]);
+    w.U32(ana.metadata.size());
+    for (map<string, vector<double> >::const_iterator itr = ana.metadata.begin(); itr != ana.metadata.end(); itr++) {
+      w.String(itr->first);
+      w.U32(itr->second.size());
+      for (size_t i = 0; i < itr->second.size(); i++)
+	w.Double(itr->second[i]);
+    }
+    w.U32(ana.metadata_s.size());
+    for (map<string, string>::const_iterator itr = ana.metadata_s.begin(); itr != ana.metadata_s.end(); itr++) {
+      w.String(itr->first);
+      w.String(itr->second);
+    }
+  }
+
+  void Read (BinaryReader &r, CalibrationAnalysis &ana)
+  {
+    ReadNames(r, ana);
+    ana.bins.resize(r.Count());
+    for (size_t i = 0; i < ana.bins.size(); i++)
+      Read(r, ana.bins[i]);
+    size_t nmeta = r.Count();
+    for (size_t i = 0; i < nmeta; i++) {
+      vector<double> &m (ana.metadata[r.String()]);
+      m.resize(r.Count());
+      for (size_t j = 0; j < m.size(); j++)
+	m[j] = r.Double();
+    }
+    size_t nmeta_s = r.Count();
+    for (size_t i = 0; i < nmeta_s; i++) {
+      const string &key (r.String());
+      ana.metadata_s[key] = r.String();
+    }
+  }
+
+  void Write (BinaryWriter &w, const AnalysisCorrelation &cor)
+  {
+    w.String(cor.analysis1Name);
+    w.String(cor.analysis2Name);
+    w.String(cor.flavor);
+    w.String(cor.tagger);
+    w.String(cor.operatingPoint);
+    w.String(cor.jetAlgorithm);
+    w.U32(cor.bins.size());
+    for (size_t i = 0; i < cor.bins.size(); i++) {
+      Write(w, cor.bins[i].binSpec);
+      w.U8(cor.bins[i].hasStatCorrelation);
+      w.Double(cor.bins[i].statCorrelation);
+    }
+  }
+
+  void Read (BinaryReader &r, AnalysisCorrelation &cor)
+  {
+    cor.analysis1Name = r.String();
+    cor.analysis2Name = r.String();
+    cor.flavor = r.String();
+    cor.tagger = r.String();
+    cor.operatingPoint = r.String();
+    cor.jetAlgorithm = r.String();
+    cor.bins.resize(r.Count());
+    for (size_t i = 0; i < cor.bins.size(); i++) {
+      Read(r, cor.bins[i].binSpec);
+      cor.bins[i].hasStatCorrelation = r.U8();
+      cor.bins[i].statCorrelation = r.Double();
+    }
+  }
+
+  void Write (BinaryWriter &w, const AliasAnalysis &alias)
+  {
+    WriteNames(w, alias);
+    w.U32(alias.CopyTargets.size());
+    for (size_t i = 0; i < alias.CopyTargets.size(); i++)
+      WriteNames(w, alias.CopyTargets[i]);
+  }
+
+  void Read (BinaryReader &r, AliasAnalysis &alias)
+  {
+    ReadNames(r, alias);
+    alias.CopyTargets.resize(r.Count());
+    for (size_t i = 0; i < alias.CopyTargets.size(); i++)
+      ReadNames(r, alias.CopyTargets[i]);
+  }
+
+  CalibrationInfo ReadInfo (BinaryReader &r)
+  {
+    r.StringTable();
+
+    CalibrationInfo info;
+    info.CombinationAnalysisName = r.String();
+    info.BinByBin = r.U8();
+
+    info.Analyses.resize(r.Count());
+    for (size_t i = 0; i < info.Analyses.size(); i++)
+      Read(r, info.Analyses[i]);
+    info.Correlations.resize(r.Count());
+    for (size_t i = 0; i < info.Correlations.size(); i++)
+      Read(r, info.Correlations[i]);
+    info.Defaults.resize(r.Count());
+    for (size_t i = 0; i < info.Defaults.size(); i++)
+      ReadNames(r, info.Defaults[i]);
+    info.Aliases.resize(r.Count());
+    for (size_t i = 0; i < info.Aliases.size(); i++)
+      Read(r, info.Aliases[i]);
+
+    return info;
+  }
+
+  void FilterListKey (ostringstream &out, const char *listName, const map<string, boost::regex*> &list)
+  {
+    out << listName << "\n";
+    for (map<string, boost::regex*>::const_iterator itr = list.begin(); itr != list.end(); itr++)
+      out << " " << itr->first << "\n";
+  }
+}
+
+namespace BTagCombination {
+
+  void WriteBinary (ostream &out, const CalibrationInfo &info, const BinaryCalibrationHeader &header)
+  {
+    BinaryWriter w;
+    w.String(info.CombinationAnalysisName);
+    w.U8(info.BinByBin);
+
+    w.U32(info.Analyses.size());
+    for (size_t i = 0; i < info.Analyses.size(); i++)
+      Write(w, info.Analyses[i]);
+    w.U32(info.Correlations.size());
+    for (size_t i = 0; i < info.Correlations.size(); i++)
+      Write(w, info.Correlations[i]);
+    w.U32(info.Defaults.size());
+    for (size_t i = 0; i < info.Defaults.size(); i++)
+      WriteNames(w, info.Defaults[i]);
+    w.U32(info.Aliases.size());
+    for (size_t i = 0; i < info.Aliases.size(); i++)
+      Write(w, info.Aliases[i]);
+
+    w.Write(out, header);
+  }
+
+  CalibrationInfo ReadBinary (const char *begin, const char *end, BinaryCalibrationHeader *header)
+  {
+    BinaryReader r (begin, end);
+    BinaryCalibrationHeader h;
+    r.Header(h);
+    if (header != 0)
+      *header = h;
+    return ReadInfo(r);
+  }
+
+  CalibrationInfo ReadBinaryFile (const string &fname, BinaryCalibrationHeader *header)
+  {
+    MappedFile file (fname);
+    return ReadBinary(file.begin(), file.end(), header);
+  }
+
+  bool IsBinaryCalibrationFile (const string &fname)
+  {
+    ifstream input (fname.c_str(), ios::binary);
+    char magic[sizeof(cBinaryMagic)];
+    if (!input.read(magic, sizeof(magic)))
+      return false;
+    return memcmp(magic, cBinaryMagic, sizeof(magic)) == 0;
+  }
+
+  unsigned long long FilterKey (const calibrationFilterInfo &fInfo)
+  {
+    ostringstream key;
+    FilterListKey(key, "ignore", fInfo.OPsToIgnore);
+    FilterListKey(key, "flavor", fInfo.spOnlyFlavor);
+    FilterListKey(key, "tagger", fInfo.spOnlyTagger);
+    FilterListKey(key, "op", fInfo.spOnlyOP);
+    FilterListKey(key, "jet", fInfo.spOnlyJetAlgorithm);
+    FilterListKey(key, "analysis", fInfo.spOnlyAnalysis);
+    key << "parser " << ParserVersion << "\n";
+    return StableHash(key.str());
+  }
+
+  string BinaryCacheName (const string &textFile)
+  {
+    return textFile + ".ftbin";
+  }
+
+  //
+  // The cache is good if it was written after the text file, for this very text file (same size,
+  // time stamp and contents), with the same filter and parser version. The cheap checks go first.
+  //
+  bool LoadBinaryCache (const string &textFile, const calibrationFilterInfo &fInfo, CalibrationInfo &info)
+  {
+    if (!gBinaryCacheEnabled)
+      return false;
+
+    string cacheName (BinaryCacheName(textFile));
+    long long textSize, textModTime, cacheSize, cacheModTime;
+    if (!FileStat(textFile, textSize, textModTime)
+	|| !FileStat(cacheName, cacheSize, cacheModTime))
+      return false;
+    if (cacheModTime < textModTime)
+      return false;
+
+    try {
+      MappedFile file (cacheName);
+      BinaryReader r (file.begin(), file.end());
+      BinaryCalibrationHeader h;
+      r.Header(h);
+      if (h.filterKey != FilterKey(fInfo)
+	  || h.sourceSize != textSize
+	  || h.sourceModTime != textModTime)
+	return false;
+      unsigned long long textHash;
+      if (!FileHash(textFile, textHash) || h.sourceHash != textHash)
+	return false;
+      info = ReadInfo(r);
+    }
+    catch (exception &) {
+      // A cache we can't read is just remade.
+      return false;
+    }
+    return true;
+  }
+
+  void StoreBinaryCache (const string &textFile, const calibrationFilterInfo &fInfo, const CalibrationInfo &info)
+  {
+    if (!gBinaryCacheEnabled)
+      return;
+
+    BinaryCalibrationHeader h;
+    if (!FileStat(textFile, h.sourceSize, h.sourceModTime)
+	|| !FileHash(textFile, h.sourceHash))
+      return;
+    h.filterKey = FilterKey(fInfo);
+
+    string cacheName (BinaryCacheName(textFile));
+    ostringstream tmpName;
+    tmpName << cacheName << ".tmp" << gSystem->GetPid() << "-" << gTempFileCounter++;
+
+    ofstream out (tmpName.str().c_str(), ios::binary);
+    if (!out.is_open())
+      return;
+    WriteBinary(out, info, h);
+    out.close();
+
+    if (!out || rename(tmpName.str().c_str(), cacheName.c_str()) != 0)
+      remove(tmpName.str().c_str());
+  }
+
+  void SetBinaryCacheEnabled (bool enabled)
+  {
+    gBinaryCacheEnabled = enabled;
+  }
+
+  bool GetBinaryCacheEnabled ()
+  {
+    return gBinaryCacheEnabled;
+  }
+}
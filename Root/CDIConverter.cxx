@@ -93,6 +93,12 @@ namespace {
       histo->SetBinContent (xbin, ybin, central);
       histo->SetBinError (xbin, ybin, error);
     }
+
+    // The (x, y) histogram bin a bin spec lands in, so it can be looked up once and reused.
+    pair<int, int> get_bin_cell (const vector<CalibrationBinBoundary> &bin_spec) const
+    {
+      return make_pair(get_xaxis_bin (bin_spec), get_yaxis_bin (bin_spec));
+    }
   };
 
   // Using a functor to extract the name/value pairs for all the bins, set them.
@@ -152,71 +158,102 @@ namespace {
     }
   }
 
- // Helper to find errors. Lord, what-for to have lambda functions enabled in ATLAS already!
-  class find_error
+  // Whether each systematic error is uncorrelated, going by the first time it is seen (in any
+  // bin, extended or not).
+  map<string, bool> uncorrelated_errors (const CalibrationAnalysis &ana)
   {
-  public:
-    inline find_error (const string &name)
-      : _name(name)
-    {}
-    inline bool operator() (const SystematicError &err)
-    { return err.name == _name;}
-  private:
-    const string &_name;
-  };
+    map<string, bool> result;
+    for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
+      const CalibrationBin &bin (ana.bins[ibin]);
+      for (size_t i_sys = 0; i_sys < bin.systematicErrors.size(); i_sys++) {
+	const SystematicError &e(bin.systematicErrors[i_sys]);
+	result.insert(make_pair(e.name, e.uncorrelated));
+      }
+    }
+    return result;
+  }
 
-  // Extract a systematic error
-  class get_sys_error
-  {
+  //
+  // The systematic errors of an analysis turned on their side: one column per error (in
+  // name order) and one row per non-extended bin. A bin without an error has 0 in that
+  // column; if a bin lists an error twice the first one counts.
+  //
+  class sys_error_table {
   public:
-    inline get_sys_error (const string &sys_name)
-      : _name (sys_name)
-    {}
-    pair<double, double> operator() (const CalibrationBin &bin) const
+    sys_error_table (const bin_boundaries_hist &bins, const CalibrationAnalysis &ana)
     {
-      vector<SystematicError>::const_iterator e = find_if (bin.systematicErrors.begin(),
-							   bin.systematicErrors.end(),
-							   find_error(_name));
-      if (e == bin.systematicErrors.end())
-	return make_pair(0.0, 0.0);
-      return make_pair(e->value, e->value);
-    }
-  private:
-    const string &_name;
-  };
+      // Every error name, to fix the column order.
+      map<string, size_t> columns;
+      for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
+	const CalibrationBin &bin (ana.bins[ibin]);
+	if (bin.isExtended)
+	  continue;
+	for (size_t i_sys = 0; i_sys < bin.systematicErrors.size(); i_sys++)
+	  columns.insert(make_pair(bin.systematicErrors[i_sys].name, size_t(0)));
+      }
+      for (map<string, size_t>::iterator itr = columns.begin(); itr != columns.end(); itr++) {
+	itr->second = _names.size();
+	_names.push_back(itr->first);
+      }
 
+      map<string, bool> uncorrelated (uncorrelated_errors(ana));
+      for (size_t i = 0; i < _names.size(); i++)
+	_uncorrelated.push_back(uncorrelated[_names[i]]);
 
-  // Returns a list of all systematic errors used in this analysis
-  set<string> sys_error_names (const CalibrationAnalysis &ana)
-  {
-    set<string> result;
-    for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
-      const CalibrationBin &bin (ana.bins[ibin]);
+      // Now the values, along with the histogram bin each row goes in.
+      vector<bool> seen;
+      for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
+	const CalibrationBin &bin (ana.bins[ibin]);
+	if (bin.isExtended)
+	  continue;
+
+	_cells.push_back(bins.get_bin_cell(bin.binSpec));
+	size_t row = _values.size();
+	_values.resize(row + _names.size(), 0.0);
+	seen.assign(_names.size(), false);
+	for (size_t i_sys = 0; i_sys < bin.systematicErrors.size(); i_sys++) {
+	  const SystematicError &e(bin.systematicErrors[i_sys]);
+	  size_t col = columns[e.name];
+	  if (!seen[col]) {
+	    seen[col] = true;
+	    _values[row + col] = e.value;
+	  }
+	}
+      }
+    }
 
-      // Ignore extended bins.
-      if (bin.isExtended)
-	continue;
+    size_t columns () const { return _names.size(); }
+    const string &name (size_t col) const { return _names[col]; }
+    bool uncorrelated (size_t col) const { return _uncorrelated[col]; }
 
-      transform (bin.systematicErrors.begin(), bin.systematicErrors.end(),
-		 inserter(result, result.begin()),
-		 bind<const string&>(&SystematicError::name, ph::_1));
+    // Fill a histogram with one column. The error is the value, as that is what the CDI expects.
+    void fill (TH2 *histo, size_t col) const
+    {
+      for (size_t row = 0; row < _cells.size(); row++) {
+	double v = _values[row*_names.size() + col];
+	histo->SetBinContent (_cells[row].first, _cells[row].second, v);
+	histo->SetBinError (_cells[row].first, _cells[row].second, v);
+      }
     }
-    return result;
-  }
 
-  // sees if this error is uncorrelated or not.
-  bool is_uncorrelated (const CalibrationAnalysis &ana, const string &ename)
+  private:
+    vector<string> _names;
+    vector<bool> _uncorrelated;
+    vector<pair<int, int> > _cells;
+    vector<double> _values;		// rows x columns
+  };
+
+  // Build the table, adding the analysis to any error message (as set_bin_values does).
+  sys_error_table make_sys_error_table (const bin_boundaries_hist &bins, const CalibrationAnalysis &ana)
   {
-    for (unsigned int ibin = 0; ibin < ana.bins.size(); ibin++) {
-      const CalibrationBin &bin (ana.bins[ibin]);
-      for (size_t i_sys = 0; i_sys < bin.systematicErrors.size(); i_sys++) {
-	const SystematicError &e(bin.systematicErrors[i_sys]);
-	if (e.name == ename) {
-	  return e.uncorrelated;
-	}
-      }
+    try {
+      return sys_error_table(bins, ana);
+    } catch (runtime_error &e) {
+      ostringstream msg;
+      msg << "Error while processing analysis: " << e.what() << endl
+	  << ana;
+      throw runtime_error(msg.str().c_str());
     }
-    return false;
   }
 
   CalibrationAnalysis addTotalSysError (const CalibrationAnalysis &eff)
@@ -242,9 +279,11 @@ namespace {
 
   //
   // Convert to the CDI format using regular bins - that is, everythign is layed out as a simple
-  // grid.
+  // grid. bins and ebins are the grid without and with the extrapolation bins.
   //
-  CalibrationDataContainer *ConvertToCDIRegularBins (const CalibrationAnalysis &eff, const std::string &name)
+  CalibrationDataContainer *ConvertToCDIRegularBins (const CalibrationAnalysis &eff, const std::string &name,
+						     const bin_boundaries_hist &bins,
+						     const bin_boundaries_hist &ebins)
   {
     CalibrationDataHistogramContainer *result = new CalibrationDataHistogramContainer(name.c_str());
 
@@ -274,24 +313,21 @@ namespace {
     // being the systematic errors for each value.
     //
 
-    bin_boundaries_hist bins = calcBoundaries(ana);
     TH2 *central_value = set_bin_values(bins, ana, "central", get_central_value);
     result->setResult(central_value);
 
-    // Get all systematic errors
-    set<string> error_names (sys_error_names(ana));
-
-    // Get the full set of values for each.
-    for (set<string>::const_iterator e_name = error_names.begin(); e_name != error_names.end(); e_name++) {
-      TH2 *errors = set_bin_values(bins, ana, *e_name, get_sys_error(*e_name));
-      result->setUncertainty(e_name->c_str(), errors);
+    // Get the full set of values for each systematic error, all in one go.
+    sys_error_table errors (make_sys_error_table(bins, ana));
+    for (size_t i_sys = 0; i_sys < errors.columns(); i_sys++) {
+      TH2 *h = bins.create_histo(errors.name(i_sys));
+      errors.fill(h, i_sys);
+      result->setUncertainty(errors.name(i_sys).c_str(), h);
 
-      if (is_uncorrelated(ana, *e_name))
-	result->setUncorrelated(e_name->c_str());
+      if (errors.uncorrelated(i_sys))
+	result->setUncorrelated(errors.name(i_sys).c_str());
     }
 
     // If there are any extrapolation bins, then set that too.
-    bin_boundaries_hist ebins = calcBoundaries(ana, false);
     TH2 *extrap_errors = set_bin_values(ebins, ana, "extrap", get_extrapolation_error, true);
     if (extrap_errors->GetMaximum() > 0.0) {
       result->setUncertainty("extrapolation", extrap_errors);
@@ -442,6 +478,7 @@ namespace {
     //
 
     map<string, TH1FHolder> mapped_histograms;
+    map<string, bool> uncorrelated (uncorrelated_errors(ana));
     for (size_t ibin = 0; ibin < ana.bins.size(); ibin++) {
       const CalibrationBin &b(ana.bins[ibin]);
 
@@ -464,7 +501,7 @@ namespace {
 	result->setResult(itr->second);
       } else {
 	result->setUncertainty(itr->first, itr->second);
-	if (is_uncorrelated(ana, itr->first))
+	if (uncorrelated[itr->first])
 	  result->setUncorrelated(itr->first.c_str());
       }
     }
@@ -481,15 +518,16 @@ namespace BTagCombination {
   //
   CalibrationDataContainer *ConvertToCDI (const CalibrationAnalysis &eff, const std::string &name)
   {
-    // Try the regular flat/grid binning first.
+    // Use the regular flat/grid binning if the bins (with and without the extrapolation
+    // bins) lay out on a grid.
 
     string binError;
-    try {
-      return ConvertToCDIRegularBins(eff, name);
-    } catch (bin_boundary_error &e) {
-      binError = e.what();
+    bin_boundaries bins, ebins;
+    if (findRegularBoundaries(eff, bins, binError)
+	&& findRegularBoundaries(eff, ebins, binError, false)) {
+      return ConvertToCDIRegularBins(eff, name, bins, ebins);
     }
-      
+
     // If we are here, then the irregular binning is the only hope.
 
     try {
@@ -16,15 +16,20 @@
 #include <RooAddition.h>
 #include <RooPlot.h>
 #include <RooFitResult.h>
+#include <RooMinimizer.h>
+#include <RooArgSet.h>
 
 #include <TFile.h>
 #include <TH1F.h>
 #include <TMatrixT.h>
+#include <TMatrixTSym.h>
 
 #include <algorithm>
 #include <stdexcept>
 #include <iterator>
 #include <sstream>
+#include <chrono>
+#include <memory>
 
 using namespace std;
 
@@ -36,48 +41,6 @@ namespace {
   const size_t cMaxParameterNameLength = 90;
   const int cMINUITStrat = 1;
 
-  // Helper function that will look at the over correlation of two results and if it finds the over
-  // correlation it will then turn it off.
-
-  void CheckForAndDisableOverCorrelation(Measurement *m1, Measurement *m2, bool verbose = true)
-  {
-    // Basic constants needed to calculate the weight.
-
-    double s1 = m1->totalError();
-    double s2 = m2->totalError();
-    double s11 = s1*s1;
-    double s22 = s2*s2;
-
-    double rho = m1->Rho(m2);
-
-    // And now the weight, assuming a straight combination.
-
-    double wt = (s22 - rho*s1*s2) / (s11 + s22 - 2 * rho*s1*s2);
-
-    // Dump the measurement if we don't need it.
-
-    if (wt > 1.0 || wt < 0.0) {
-      if (verbose)
-        cout << "WARNING: Correlated and uncorrelated errors make it impossible to combine these measurements." << endl
-        << "  " << m1->What() << endl
-        << "  #1: " << m1->Name() << endl
-        << "  s1=" << s1 << endl
-        << "  #2: " << m2->Name() << endl
-        << "  s2=" << s2 << endl
-        << "  rho=" << rho << " wt=" << wt << endl;
-      if (s1 > s2) {
-        if (verbose)
-          cout << "  Keeping #2" << endl;
-        m1->setDoNotUse(true);
-      }
-      else {
-        if (verbose)
-          cout << "  Keeping #1" << endl;
-        m2->setDoNotUse(true);
-      }
-    }
-  }
-
   //
   // Given a variable (which has been fit and so has an error), generate a range
   // that is +- 5 sigma around the variable.
@@ -89,6 +52,39 @@ namespace {
     return RooFit::Range(low, high);
   }
 
+  //
+  // Run MINUIT the same way fitTo does (migrad then hesse), but hold on to the minimizer
+  // so we can record how much work it did. The telemetry is appended to the fit list.
+  //
+  RooFitResult *RunMinimizer(RooAbsPdf &pdf, RooDataSet &data,
+                             const string &phase, const CombinationContextBase::FitTelemetry &modelSize,
+                             vector<CombinationContextBase::FitTelemetry> &fits)
+  {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    RooAbsReal *nll = pdf.createNLL(data);
+    RooMinimizer m(*nll);
+    m.setPrintLevel(1);
+    m.optimizeConst(2);
+    m.setStrategy(cMINUITStrat);
+    m.migrad();
+    m.hesse();
+    RooFitResult *r = m.save();
+
+    CombinationContextBase::FitTelemetry t(modelSize);
+    t._phase = phase;
+    t._status = r->status();
+    t._edm = r->edm();
+    t._covQual = r->covQual();
+    t._nllEvaluations = m.evalCounter();
+    delete nll;
+
+    t._wallTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    fits.push_back(t);
+
+    return r;
+  }
+
 }
 
 namespace BTagCombination {
@@ -97,53 +93,8 @@ namespace BTagCombination {
   /// Creates a new combination context.
   ///
   CombinationContext::CombinationContext(void)
-    : _verbose(true), _doPlots(false)
-  {
-  }
-
-  //
-  // Look through all the measurements to be combined and make sure they
-  // aren't going to put us in a region that is "bad".
-  //
-  void CombinationContext::TurnOffOverCorrelations()
+    : _doPlots(false), _decomposition(kRefitPerSystematic)
   {
-    //
-    // First we need to catalog all the data points by what they are measuring, as
-    // that is where we have to do the testing.
-    //
-
-    typedef map<string, vector<Measurement*> > t_MeasureByWhat;
-    t_MeasureByWhat mapper;
-    vector<Measurement*> gmes(GoodMeasurements());
-    for (vector<Measurement*>::const_iterator itr = gmes.begin(); itr != gmes.end(); itr++) {
-      if ((*itr)->doNotUse())
-        continue;
-      mapper[(*itr)->What()].push_back(*itr);
-    }
-
-    //
-    // For each one calculate the conditions for over correlations, and turn off one if
-    // it occurs.
-    //
-
-    for (t_MeasureByWhat::iterator itr = mapper.begin(); itr != mapper.end(); itr++) {
-
-      // Silly cases.
-
-      if (itr->second.size() < 2)
-        continue; // Nothing to combine here! :-)
-
-      // Now, for each combination of two we have to look to check for over correlation. If any of them
-      // are, we drop the one with the lowest error.
-
-      for (size_t i_1 = 0; i_1 < itr->second.size(); i_1++) {
-        for (size_t i_2 = i_1 + 1; i_2 < itr->second.size(); i_2++) {
-          if (!itr->second[i_2]->doNotUse() && !itr->second[i_1]->doNotUse()) {
-            CheckForAndDisableOverCorrelation(itr->second[i_1], itr->second[i_2], _verbose);
-          }
-        }
-      }
-    }
   }
 
   ///
@@ -158,6 +109,12 @@ namespace BTagCombination {
 
     _extraInfo.clear();
 
+    //
+    // RooFit and MINUIT can only run one fit at a time in a process.
+    //
+
+    lock_guard<recursive_mutex> rooLock(RooFitMutex());
+
     //
     // First thing to do is x-check the measurements to eliminate any combinations
     // that will lead to bad points in phase space (i.e. the correlated/uncorrelated
@@ -248,8 +205,8 @@ namespace BTagCombination {
       products.add(**itr);
     }
 
-    RooConstVar *zero = new RooConstVar("zero", "zero", 0.0);
-    RooConstVar *one = new RooConstVar("one", "one", 1.0);
+    RooConstVar *zero = new RooConstVar(RooObjectName("zero").c_str(), "zero", 0.0);
+    RooConstVar *one = new RooConstVar(RooObjectName("one").c_str(), "one", 1.0);
     vector<string> allVars = _systematicErrors.GetAllVars();
 
     vector<RooGaussian*> toDeleteGaussians;
@@ -262,7 +219,7 @@ namespace BTagCombination {
       toDeleteGaussians.push_back(constraint);
     }
 
-    RooProdPdf finalPDF("ConstraintPDF", "Constraint PDF", products);
+    RooProdPdf finalPDF(RooObjectName("ConstraintPDF").c_str(), "Constraint PDF", products);
 
     ///
     /// Next, we need to fit to a dataset. It will have a single data point - the
@@ -279,17 +236,35 @@ namespace BTagCombination {
       varValues.add(*(m->GetActualMeasurement()));
     }
 
-    RooDataSet measuredPoints("pointsMeasured", "Measured Values", varNames);
+    RooDataSet measuredPoints(RooObjectName("pointsMeasured").c_str(), "Measured Values", varNames);
     measuredPoints.add(varValues);
 
     ///
     /// And do the fit
     ///
 
+    FitTelemetry modelSize;
+    modelSize._nMeasurements = gMeas.size();
+    modelSize._nNuisance = allVars.size();
+    RooArgSet *components = finalPDF.getComponents();
+    modelSize._nPDFNodes = components->getSize();
+    delete components;
+
     if (_verbose)
       cout << "Starting the master fit..." << endl;
-    RooFitResult *r = finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
-    delete r;
+    unique_ptr<RooFitResult> masterFit (RunMinimizer(finalPDF, measuredPoints, "master", modelSize, _extraInfo._fits));
+
+    ///
+    /// Decide how to extract the systematic errors. The covariance matrix is only any good
+    /// if MINUIT was able to calculate it accurately - otherwise fall back to refitting.
+    ///
+
+    bool useCovariance = _decomposition == kFromCovariance;
+    if (useCovariance && masterFit->covQual() < 3) {
+      cout << "WARNING The covariance matrix for " << name << " is not accurate (quality " << masterFit->covQual()
+           << "). Refitting for each systematic error instead." << endl;
+      useCovariance = false;
+    }
 
     ///
     /// Dump out the graph-viz tree
@@ -314,48 +289,10 @@ namespace BTagCombination {
     }
 
     //
-    // To actually calculate the chi2 we have a fair amount of work to do.
-    // Using the method from the BLUE paper, equation 14 (loosely based on this, actually).
-    //  (published ???)
+    // The chi2 is calculated directly from the measurements and the fit results.
     //
 
-    {
-      // Get the matrix of the measurements, the fits, and the covariance.
-      TMatrixT<double> y(gMeas.size(), 1); // Actual measurement
-      TMatrixT<double> Ux(gMeas.size(), 1); // The fit measurements for each guy
-
-      int i_meas_row = 0;
-      for (vector<Measurement*>::const_iterator imeas = gMeas.begin(); imeas != gMeas.end(); imeas++, i_meas_row++) {
-        Measurement *m(*imeas);
-        y(i_meas_row, 0) = m->centralValue();
-        Ux(i_meas_row, 0) = result[m->What()].centralValue;
-      }
-
-      //TMatrixTSym<double> W (CalcCovarMatrixUsingRho(gMeas));
-      TMatrixTSym<double> W(CalcCovarMatrixUsingComposition(gMeas));
-
-      // Now, calculate the chi2
-
-      TMatrixT<double> Winv(W);
-      // Invert inverts in place!!
-      Winv.Invert();
-
-      // Do the covar calc -- oh for the "auto" keyword.
-      TMatrixT<double> del(gMeas.size(), 1);
-      del = Ux - y;
-
-      TMatrixT<double> delT(del);
-      delT.Transpose(delT);
-
-      TMatrixT<double> xchi2(1, 1);
-      xchi2 = (delT*Winv)*del;
-
-      _extraInfo._globalChi2 = xchi2(0, 0);
-      _extraInfo._ndof = gMeas.size() - _whatMeasurements.size();
-
-      if (_verbose)
-        cout << "Total chi2 for " << name << ": " << xchi2(0, 0) << " measurements: " << gMeas.size() << " fits: " << _whatMeasurements.size() << endl;
-    }
+    CalcGlobalChi2(gMeas, result, name);
 
     //
     // Dump out the pulls that the fit settled on... so this crudely for now.
@@ -483,61 +420,101 @@ namespace BTagCombination {
         }
       }
 
-      ///
-      /// Next, we need to re-run the fit,
-      /// freezing each systematic error in turn, and extract the 
-      /// errors so we can decide how large each error is.
-      ///
+      if (useCovariance) {
 
-      for (unsigned int i_av = 0; i_av < allVars.size(); i_av++) {
-        const string sysErrorName(allVars[i_av]);
+        ///
+        /// Find where each parameter lives in the covariance matrix. The fit result
+        /// holds copies of the parameters, so match them by name. Anything that wasn't
+        /// floated (a quantity whose measurements are all marked do-not-use, say) has
+        /// no errors to decompose, so it is skipped.
+        ///
 
-        RooRealVar *sysErr = _systematicErrors.FindRooVar(sysErrorName);
+        const RooArgList &floated(masterFit->floatParsFinal());
+        map<string, int> floatIndex;
+        for (int i = 0; i < floated.getSize(); i++) {
+          floatIndex[floated.at(i)->GetName()] = i;
+        }
 
-        double sysErrOldVal = sysErr->getVal();
-        double sysErrOldError = sysErr->getError();
-        sysErr->setConstant(true);
-        sysErr->setVal(0.0);
-        sysErr->setError(0.0);
+        vector<double> pars(floated.getSize(), 0.0);
+        map<string, int> whatIndex, sysIndex;
+        for (size_t i_mn = 0; i_mn < allMeasureNames.size(); i_mn++) {
+          RooRealVar *v = _whatMeasurements.FindRooVar(allMeasureNames[i_mn]);
+          map<string, int>::const_iterator itr = floatIndex.find(v->GetName());
+          if (itr == floatIndex.end())
+            continue;
+          whatIndex[allMeasureNames[i_mn]] = itr->second;
+          pars[itr->second] = v->getVal();
+        }
+        for (size_t i_av = 0; i_av < allVars.size(); i_av++) {
+          RooRealVar *v = _systematicErrors.FindRooVar(allVars[i_av]);
+          map<string, int>::const_iterator itr = floatIndex.find(v->GetName());
+          if (itr == floatIndex.end())
+            continue;
+          sysIndex[allVars[i_av]] = itr->second;
+          pars[itr->second] = v->getVal();
+        }
 
-        RooFitResult *r = finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
-        delete r;
+        DecomposeSystematicErrors(masterFit->covarianceMatrix(), pars, whatIndex, sysIndex, result, runningErrorXCheck);
 
-        // Loop over all measurements. If the measurement knows about
-        // this systematic error, then extract a number from it.
+      } else {
 
-        for (size_t i_mn = 0; i_mn < allMeasureNames.size(); i_mn++) {
-          const string &item(allMeasureNames[i_mn]);
-          RooRealVar *m = _whatMeasurements.FindRooVar(item);
+        ///
+        /// Next, we need to re-run the fit,
+        /// freezing each systematic error in turn, and extract the 
+        /// errors so we can decide how large each error is.
+        ///
 
-          if (sysErrorUsedBy(sysErrorName, item)) {
+        for (unsigned int i_av = 0; i_av < allVars.size(); i_av++) {
+          const string sysErrorName(allVars[i_av]);
 
-            double centralError = totalError[item];
-            double delta = centralError*centralError - m->getError()*m->getError();
-            double errDiff = sqrt(fabs(delta));
+          RooRealVar *sysErr = _systematicErrors.FindRooVar(sysErrorName);
 
-            // Propagate the sign
-            if (delta < 0.0)
-              errDiff = -errDiff;
+          double sysErrOldVal = sysErr->getVal();
+          double sysErrOldError = sysErr->getError();
+          sysErr->setConstant(true);
+          sysErr->setVal(0.0);
+          sysErr->setError(0.0);
 
-            // Save for later use!
-            result[item].sysErrors[sysErrorName] = errDiff;
-            runningErrorXCheck[item] += errDiff*errDiff;
+          RooFitResult *r = RunMinimizer(finalPDF, measuredPoints, "freeze " + sysErrorName, modelSize, _extraInfo._fits);
+          delete r;
 
-          }
+          // Loop over all measurements. If the measurement knows about
+          // this systematic error, then extract a number from it.
 
+          for (size_t i_mn = 0; i_mn < allMeasureNames.size(); i_mn++) {
+            const string &item(allMeasureNames[i_mn]);
+            RooRealVar *m = _whatMeasurements.FindRooVar(item);
 
-          // Save the change in the central value, regardless if this sys error was part of this
-          // fit bin!
+            if (sysErrorUsedBy(sysErrorName, item)) {
 
-          result[item].cvShifts[sysErrorName] = result[item].centralValue - m->getVal();
-        }
+              double centralError = totalError[item];
+              double delta = centralError*centralError - m->getError()*m->getError();
+              double errDiff = sqrt(fabs(delta));
 
-        // Restore the systematic errors to their former glory
+              // Propagate the sign
+              if (delta < 0.0)
+                errDiff = -errDiff;
 
-        sysErr->setConstant(false);
-        sysErr->setVal(sysErrOldVal);
-        sysErr->setError(sysErrOldError);
+              // Save for later use!
+              result[item].sysErrors[sysErrorName] = errDiff;
+              runningErrorXCheck[item] += errDiff*errDiff;
+
+            }
+
+
+            // Save the change in the central value, regardless if this sys error was part of this
+            // fit bin!
+
+            result[item].cvShifts[sysErrorName] = result[item].centralValue - m->getVal();
+          }
+
+          // Restore the systematic errors to their former glory
+
+          sysErr->setConstant(false);
+          sysErr->setVal(sysErrOldVal);
+          sysErr->setError(sysErrOldError);
+
+        }
 
       }
 
@@ -610,26 +587,18 @@ namespace BTagCombination {
 
 
     ///
-    /// Since we've been futzing with all of this, we had better return the fit to be "normal".
+    /// If we've been futzing with all of this, we had better return the fit to be "normal".
     ///
 
-    finalPDF.fitTo(measuredPoints, RooFit::Strategy(cMINUITStrat));
+    if (!useCovariance)
+      delete RunMinimizer(finalPDF, measuredPoints, "restore", modelSize, _extraInfo._fits);
+    masterFit.reset();
 
     //
     // How did the total errors work out?
     //
 
-    for (map<string, double>::const_iterator itr = runningErrorXCheck.begin(); itr != runningErrorXCheck.end(); itr++) {
-      double terr = sqrt(itr->second);
-      double delta = fabs(terr - totalError[itr->first]);
-      if (delta > 0.01) {
-        cout << "WARNING Checking errors for measurement " << itr->first
-          << "   total error: " << totalError[itr->first]
-          << "   Summed Error: " << terr << endl
-          << "   Delta Error: " << delta << endl
-          << "   something went wrong in how we calc errors" << endl;
-      }
-    }
+    CheckErrorSums(runningErrorXCheck, totalError);
 
     ///
     /// Done. We need to clean up the measurement Gaussian
@@ -643,22 +612,7 @@ namespace BTagCombination {
     // put in we need to "take them out", as it were.
     //
 
-    for (size_t i_c = 0; i_c < _correlations.size(); i_c++) {
-      const CorrInfo &ci(_correlations[i_c]);
-      if (ci._errorName == "statistical") {
-        for (map<string, FitResult>::const_iterator i_fr = result.begin(); i_fr != result.end(); i_fr++) {
-          FitResult fr(i_fr->second);
-          string fr_name(i_fr->first);
-          map<string, double>::iterator s_value = fr.sysErrors.find(ci._sharedSysName);
-          if (s_value != fr.sysErrors.end()) {
-            fr.statisticalError = sqrt(fr.statisticalError*fr.statisticalError
-              + s_value->second*s_value->second);
-            fr.sysErrors.erase(s_value);
-            result[fr_name] = fr;
-          }
-        }
-      }
-    }
+    FoldInStatisticalCorrelations(result);
 
     //
     // Clean up some memory
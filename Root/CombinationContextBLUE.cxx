@@ -0,0 +1,195 @@
+///
+/// Implementation of the linear algebra (BLUE) combination context.
+///
+///  The likelihood is -2 ln L = sum_i (y_i - x_w(i) - sum_k a_ik t_k)^2/s_i^2 + sum_k t_k^2,
+/// where y_i is a measurement of x_w(i) with stat error s_i, and a_ik is the width of
+/// systematic error k (nuisance parameter t_k). It is quadratic in (x, t), so the normal
+/// equations H p = b give the minimum, and H^-1 is the covariance of the parameters.
+///
+
+#include "Combination/CombinationContextBLUE.h"
+#include "Combination/Measurement.h"
+
+#include <TMatrixTSym.h>
+#include <TDecompChol.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+
+namespace BTagCombination {
+
+  ///
+  /// Creates a new combination context.
+  ///
+  CombinationContextBLUE::CombinationContextBLUE(void)
+  {
+  }
+
+  ///
+  /// Do the fit. Build the normal equations, solve them, and then extract
+  /// everything in the same format as the MINUIT fit.
+  ///
+  map<string, CombinationContextBLUE::FitResult> CombinationContextBLUE::Fit(const std::string &name)
+  {
+    _extraInfo.clear();
+
+    //
+    // Same pre-fit cleaning as the MINUIT fit - drop measurements that are going to
+    // be impossible to combine.
+    //
+
+    TurnOffOverCorrelations();
+    vector<Measurement*> gMeas(GoodMeasurements());
+
+    //
+    // Number the parameters. The things we are measuring come first, and then the
+    // nuisance parameters. Maps are used so the ordering is always the same.
+    //
+
+    map<string, int> parIndex;
+    for (vector<Measurement*>::const_iterator imeas = gMeas.begin(); imeas != gMeas.end(); imeas++) {
+      parIndex[(*imeas)->What()] = 0;
+    }
+    vector<string> allWhats;
+    for (map<string, int>::iterator itr = parIndex.begin(); itr != parIndex.end(); itr++) {
+      itr->second = allWhats.size();
+      allWhats.push_back(itr->first);
+    }
+
+    map<string, int> sysIndex;
+    for (vector<Measurement*>::const_iterator imeas = gMeas.begin(); imeas != gMeas.end(); imeas++) {
+      vector<string> errorNames((*imeas)->GetSystematicErrorNames());
+      for (vector<string>::const_iterator isyserr = errorNames.begin(); isyserr != errorNames.end(); isyserr++) {
+	sysIndex[*isyserr] = 0;
+      }
+    }
+    vector<string> allVars;
+    for (map<string, int>::iterator itr = sysIndex.begin(); itr != sysIndex.end(); itr++) {
+      itr->second = allWhats.size() + allVars.size();
+      allVars.push_back(itr->first);
+    }
+
+    const int nPars = allWhats.size() + allVars.size();
+
+    //
+    // Build the normal equations. Each measurement row only touches its own "what" and
+    // its own systematic errors, so the accumulation is done on the sparse row.
+    //
+
+    TMatrixTSym<double> H(nPars);
+    vector<double> b(nPars, 0.0);
+
+    for (vector<Measurement*>::const_iterator imeas = gMeas.begin(); imeas != gMeas.end(); imeas++) {
+      Measurement *m(*imeas);
+
+      vector<pair<int, double> > row;
+      row.push_back(make_pair(parIndex[m->What()], 1.0));
+      vector<string> errorNames(m->GetSystematicErrorNames());
+      for (vector<string>::const_iterator isyserr = errorNames.begin(); isyserr != errorNames.end(); isyserr++) {
+	row.push_back(make_pair(sysIndex[*isyserr], m->GetSystematicErrorWidth(*isyserr)));
+      }
+
+      double s = m->statError();
+      double wt = 1.0/(s*s);
+      double y = m->centralValue();
+
+      for (size_t i_r1 = 0; i_r1 < row.size(); i_r1++) {
+	b[row[i_r1].first] += wt*row[i_r1].second*y;
+	for (size_t i_r2 = 0; i_r2 < row.size(); i_r2++) {
+	  H(row[i_r1].first, row[i_r2].first) += wt*row[i_r1].second*row[i_r2].second;
+	}
+      }
+    }
+
+    // The unit Gaussian constraint on each nuisance parameter.
+    for (size_t i_sys = 0; i_sys < allVars.size(); i_sys++) {
+      int idx = allWhats.size() + i_sys;
+      H(idx, idx) += 1.0;
+    }
+
+    //
+    // Solve. H is positive definite (as long as every stat error is non-zero), so
+    // Cholesky does the job. The inverse is the covariance matrix of the fit.
+    //
+
+    if (_verbose)
+      cout << "Solving the linear combination for " << name << "..." << endl;
+
+    TDecompChol chol(H);
+    if (!chol.Decompose()) {
+      ostringstream err;
+      err << "Unable to solve the linear combination for " << name << " - the normal equations are singular";
+      throw runtime_error(err.str());
+    }
+    TMatrixTSym<double> C(nPars);
+    chol.Invert(C);
+
+    vector<double> p(nPars, 0.0);
+    for (int i = 0; i < nPars; i++) {
+      for (int j = 0; j < nPars; j++) {
+	p[i] += C(i, j)*b[j];
+      }
+    }
+
+    //
+    // Extract the central values
+    //
+
+    map<string, FitResult> result;
+    map<string, double> totalError;
+    map<string, double> runningErrorXCheck;
+    for (size_t i_w = 0; i_w < allWhats.size(); i_w++) {
+      const string &item(allWhats[i_w]);
+      result[item].centralValue = p[i_w];
+      totalError[item] = sqrt(C(i_w, i_w));
+      runningErrorXCheck[item] = 0.0;
+    }
+
+    CalcGlobalChi2(gMeas, result, name);
+
+    //
+    // The pulls and nuisance parameters
+    //
+
+    for (size_t i_sys = 0; i_sys < allVars.size(); i_sys++) {
+      int idx = allWhats.size() + i_sys;
+      double err = sqrt(C(idx, idx));
+      if (_verbose)
+	_extraInfo._nuisance[allVars[i_sys]] = make_pair(p[idx], err);
+      _extraInfo._pulls[allVars[i_sys]] = p[idx] / err;
+    }
+
+    //
+    // The MINUIT fit can freeze each nuisance parameter at zero in turn and refit. For a linear model
+    // that is exactly the conditional covariance, so no refitting is needed.
+    //
+
+    DecomposeSystematicErrors(C, p, parIndex, sysIndex, result, runningErrorXCheck);
+
+    //
+    // And the statistical error, done the same way as for the MINUIT fit.
+    //
+
+    map<string, double> stat_errors = CalculateStatisticalErrors();
+    for (size_t i_w = 0; i_w < allWhats.size(); i_w++) {
+      const string &item(allWhats[i_w]);
+      const double e(stat_errors[item]);
+      result[item].statisticalError = e;
+      runningErrorXCheck[item] += e*e;
+    }
+
+    CheckErrorSums(runningErrorXCheck, totalError);
+
+    //
+    // And fold any statistical correlations back into the stat error.
+    //
+
+    FoldInStatisticalCorrelations(result);
+
+    return result;
+  }
+}
@@ -21,36 +21,99 @@
 #include <TFile.h>
 #include <TH1F.h>
 #include <TMatrixT.h>
+#include <TMatrixTSym.h>
 
 #include <algorithm>
 #include <stdexcept>
 #include <iterator>
 #include <sstream>
+#include <iostream>
+#include <cmath>
+#include <atomic>
+#include <iomanip>
+#include <cstdio>
 
 using namespace std;
 
 namespace {
+  using namespace BTagCombination;
 
   // Max length of a parameter we allow into RooFit to prevent a crash.
   // It does change with RooFit version number...
   const size_t cMaxParameterNameLength = 110;
 
-  /// When we don't have a measurement name, generate it!
-  static string NewMeasurementName(const string &name) {
-    static map<string, int> gNameIndex;
+  // Each context gets its own number so the RooFit objects it makes have unique names.
+  atomic<int> gContextCounter(0);
 
-    int index = 0;
-    map<string, int>::const_iterator f = gNameIndex.find(name);
-    if (f == gNameIndex.end()) {
-      gNameIndex[name] = 1;
-    } else {
-      index = gNameIndex[name];
-      gNameIndex[name] += 1;
+  // Helper function that will look at the over correlation of two results and if it finds the over
+  // correlation it will then turn it off.
+
+  void CheckForAndDisableOverCorrelation(const PairwiseCorrelations &pairs, size_t i_1, size_t i_2,
+					 Measurement *m1, Measurement *m2, bool verbose = true)
+  {
+    // Basic constants needed to calculate the weight.
+
+    double s1 = pairs.TotalError(i_1);
+    double s2 = pairs.TotalError(i_2);
+    double s11 = s1*s1;
+    double s22 = s2*s2;
+
+    double rho = pairs.Rho(i_1, i_2);
+
+    // And now the weight, assuming a straight combination.
+
+    double wt = (s22 - rho*s1*s2) / (s11 + s22 - 2 * rho*s1*s2);
+
+    // Dump the measurement if we don't need it.
+
+    if (wt > 1.0 || wt < 0.0) {
+      if (verbose)
+        cout << "WARNING: Correlated and uncorrelated errors make it impossible to combine these measurements." << endl
+        << "  " << m1->What() << endl
+        << "  #1: " << m1->Name() << endl
+        << "  s1=" << s1 << endl
+        << "  #2: " << m2->Name() << endl
+        << "  s2=" << s2 << endl
+        << "  rho=" << rho << " wt=" << wt << endl;
+      if (s1 > s2) {
+        if (verbose)
+          cout << "  Keeping #2" << endl;
+        m1->setDoNotUse(true);
+      }
+      else {
+        if (verbose)
+          cout << "  Keeping #1" << endl;
+        m2->setDoNotUse(true);
+      }
     }
+  }
 
-    ostringstream result;
-    result << "m_" << name << "_" << index;
-    return result.str();	
+  // Write a string as a JSON string, quotes and all.
+  void WriteJSONString(ostream &out, const string &s)
+  {
+    out << '"';
+    for (size_t i = 0; i < s.size(); i++) {
+      unsigned char c = s[i];
+      if (c == '"' || c == '\\') {
+        out << '\\' << c;
+      } else if (c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out << buf;
+      } else {
+        out << c;
+      }
+    }
+    out << '"';
+  }
+
+  // JSON has no inf or nan.
+  void WriteJSONNumber(ostream &out, double v)
+  {
+    if (std::isfinite(v))
+      out << v;
+    else
+      out << "null";
   }
 }
 
@@ -61,6 +124,92 @@ namespace BTagCombination {
   {
     _globalChi2 = 0.0;
     _ndof = 0.0;
+    _fits.clear();
+  }
+
+  ///
+  /// Dump the fit information as JSON, one object per fit, so a file of them can be read line by line.
+  ///
+  void CombinationContextBase::ExtraFitInfo::WriteJSON (ostream &out, const string &fitName) const
+  {
+    ostringstream line;
+    line << setprecision(10);
+    line << "{\"fit\": ";
+    WriteJSONString(line, fitName);
+    line << ", \"chi2\": ";
+    WriteJSONNumber(line, _globalChi2);
+    line << ", \"ndof\": ";
+    WriteJSONNumber(line, _ndof);
+
+    double totalTime = 0.0;
+    for (size_t i = 0; i < _fits.size(); i++)
+      totalTime += _fits[i]._wallTime;
+    line << ", \"wall_time\": ";
+    WriteJSONNumber(line, totalTime);
+
+    line << ", \"minimizations\": [";
+    for (size_t i = 0; i < _fits.size(); i++) {
+      const FitTelemetry &f(_fits[i]);
+      if (i != 0)
+        line << ", ";
+      line << "{\"phase\": ";
+      WriteJSONString(line, f._phase);
+      line << ", \"wall_time\": ";
+      WriteJSONNumber(line, f._wallTime);
+      line << ", \"status\": " << f._status
+           << ", \"edm\": ";
+      WriteJSONNumber(line, f._edm);
+      line << ", \"cov_qual\": " << f._covQual
+           << ", \"nll_evaluations\": " << f._nllEvaluations
+           << ", \"measurements\": " << f._nMeasurements
+           << ", \"nuisances\": " << f._nNuisance
+           << ", \"pdf_nodes\": " << f._nPDFNodes
+           << "}";
+    }
+    line << "]}";
+
+    out << line.str() << endl;
+  }
+
+  ///
+  /// Sub-classes do the real work.
+  ///
+  CombinationContextBase::CombinationContextBase(void)
+    : _verbose(true), _contextID(gContextCounter++)
+  {
+  }
+
+  ///
+  /// RooFit keeps a lot of global state (name registry, MINUIT, etc.), so only one thread
+  /// may touch it at a time.
+  ///
+  recursive_mutex &CombinationContextBase::RooFitMutex(void)
+  {
+    static recursive_mutex gRooFitMutex;
+    return gRooFitMutex;
+  }
+
+  ///
+  /// When we don't have a measurement name, generate it! Names only have to be
+  /// unique inside this context.
+  ///
+  string CombinationContextBase::NewMeasurementName(const string &name)
+  {
+    int index = _nameIndex[name]++;
+
+    ostringstream result;
+    result << "m_" << name << "_" << index;
+    return result.str();	
+  }
+
+  ///
+  /// Return a name for an internal RooFit object that is unique to this context.
+  ///
+  string CombinationContextBase::RooObjectName(const string &name) const
+  {
+    ostringstream result;
+    result << name << "_ctx" << _contextID;
+    return result.str();
   }
 
   ///
@@ -282,8 +431,9 @@ namespace BTagCombination {
     RooRealVar* whatVar = _whatMeasurements.FindOrCreateRooVar(what, minValue, maxValue);
     whatVar->setVal(value);
 
-    Measurement *m = new Measurement(measurementName, what, value, statError);
+    Measurement *m = new Measurement(measurementName, what, value, statError, &_sysErrorNames);
     _measurements.push_back(m);
+    _measurementsByName.insert(make_pair(measurementName, m));
     return m;
   }
 
@@ -304,11 +454,8 @@ namespace BTagCombination {
   //
   Measurement *CombinationContextBase::FindMeasurement(const string &measurementName)
   {
-    for (size_t i = 0; i < _measurements.size(); i++) {
-      if (_measurements[i]->Name() == measurementName)
-	return _measurements[i];
-    }
-    return 0;
+    unordered_map<string, Measurement*>::const_iterator itr = _measurementsByName.find(measurementName);
+    return itr == _measurementsByName.end() ? 0 : itr->second;
   }
 
   //
@@ -358,6 +505,165 @@ namespace BTagCombination {
     return false;
   }
 
+  //
+  // Look through all the measurements to be combined and make sure they
+  // aren't going to put us in a region that is "bad".
+  //
+  void CombinationContextBase::TurnOffOverCorrelations()
+  {
+    //
+    // First we need to catalog all the data points by what they are measuring, as
+    // that is where we have to do the testing.
+    //
+
+    typedef map<string, vector<Measurement*> > t_MeasureByWhat;
+    t_MeasureByWhat mapper;
+    vector<Measurement*> gmes(GoodMeasurements());
+    for (vector<Measurement*>::const_iterator itr = gmes.begin(); itr != gmes.end(); itr++) {
+      if ((*itr)->doNotUse())
+        continue;
+      mapper[(*itr)->What()].push_back(*itr);
+    }
+
+    //
+    // For each one calculate the conditions for over correlations, and turn off one if
+    // it occurs.
+    //
+
+    for (t_MeasureByWhat::iterator itr = mapper.begin(); itr != mapper.end(); itr++) {
+
+      // Silly cases.
+
+      if (itr->second.size() < 2)
+        continue; // Nothing to combine here! :-)
+
+      // Now, for each combination of two we have to look to check for over correlation. If any of them
+      // are, we drop the one with the lowest error. The correlations don't change as measurements
+      // are turned off, so get them all in one go.
+
+      PairwiseCorrelations pairs(itr->second);
+      for (size_t i_1 = 0; i_1 < itr->second.size(); i_1++) {
+        for (size_t i_2 = i_1 + 1; i_2 < itr->second.size(); i_2++) {
+          if (!itr->second[i_2]->doNotUse() && !itr->second[i_1]->doNotUse()) {
+            CheckForAndDisableOverCorrelation(pairs, i_1, i_2, itr->second[i_1], itr->second[i_2], _verbose);
+          }
+        }
+      }
+    }
+  }
+
+  //
+  // To actually calculate the chi2 we have a fair amount of work to do.
+  // Using the method from the BLUE paper, equation 14 (loosely based on this, actually).
+  //  (published ???)
+  //
+  void CombinationContextBase::CalcGlobalChi2 (const vector<Measurement*> &gMeas,
+					       const map<string, FitResult> &result,
+					       const string &name)
+  {
+    // How far each measurement is from its fit value.
+    vector<double> del(gMeas.size());
+    for (size_t i_meas = 0; i_meas < gMeas.size(); i_meas++) {
+      Measurement *m(gMeas[i_meas]);
+      del[i_meas] = result.find(m->What())->second.centralValue - m->centralValue();
+    }
+
+    // The covariance is the stat errors plus a handful of shared systematic errors - it is
+    // never built as a full matrix (large groups have thousands of measurements).
+    LowRankCovariance W(gMeas);
+    double chi2 = W.Chi2(del);
+
+    _extraInfo._globalChi2 = chi2;
+    _extraInfo._ndof = gMeas.size() - _whatMeasurements.size();
+
+    if (_verbose)
+      cout << "Total chi2 for " << name << ": " << chi2 << " measurements: " << gMeas.size() << " fits: " << _whatMeasurements.size() << endl;
+  }
+
+  ///
+  /// Break the total error down into its systematic components using only the covariance
+  /// matrix of the converged fit. Freezing nuisance parameter k at zero and refitting is, for
+  /// a Gaussian likelihood, the same as conditioning on it: the variance of what w drops by
+  /// C_wk^2/C_kk and its central value moves by C_wk/C_kk * t_k. This gives the same numbers
+  /// as one refit per systematic error, without the refits.
+  ///
+  void CombinationContextBase::DecomposeSystematicErrors (const TMatrixTSym<double> &cov,
+							  const vector<double> &pars,
+							  const map<string, int> &whatIndex,
+							  const map<string, int> &sysIndex,
+							  map<string, FitResult> &result,
+							  map<string, double> &runningErrorXCheck)
+  {
+    for (map<string, int>::const_iterator isys = sysIndex.begin(); isys != sysIndex.end(); isys++) {
+      const string &sysErrorName(isys->first);
+      const int k = isys->second;
+      const double ckk = cov(k, k);
+      if (ckk <= 0.0) {
+	ostringstream err;
+	err << "Nuisance parameter " << sysErrorName << " has a non-positive variance (" << ckk << ") - can't decompose the errors";
+	throw runtime_error(err.str());
+      }
+
+      for (map<string, int>::const_iterator iwhat = whatIndex.begin(); iwhat != whatIndex.end(); iwhat++) {
+	const string &item(iwhat->first);
+	const double cwk = cov(iwhat->second, k);
+
+	if (sysErrorUsedBy(sysErrorName, item)) {
+	  double errDiff = fabs(cwk)/sqrt(ckk);
+	  result[item].sysErrors[sysErrorName] = errDiff;
+	  runningErrorXCheck[item] += errDiff*errDiff;
+	}
+
+	// The change in the central value, regardless if this sys error was part of this
+	// fit bin!
+
+	result[item].cvShifts[sysErrorName] = cwk/ckk*pars[k];
+      }
+    }
+  }
+
+  //
+  // How did the total errors work out?
+  //
+  void CombinationContextBase::CheckErrorSums (const map<string, double> &runningErrorXCheck,
+					       const map<string, double> &totalError) const
+  {
+    for (map<string, double>::const_iterator itr = runningErrorXCheck.begin(); itr != runningErrorXCheck.end(); itr++) {
+      double total = totalError.find(itr->first)->second;
+      double terr = sqrt(itr->second);
+      double delta = fabs(terr - total);
+      if (delta > 0.01) {
+	cout << "WARNING Checking errors for measurement " << itr->first
+	     << "   total error: " << total
+	     << "   Summed Error: " << terr << endl
+	     << "   Delta Error: " << delta << endl
+	     << "   something went wrong in how we calc errors" << endl;
+      }
+    }
+  }
+
+  //
+  // One last thing to take care of - if there were any correlations that were
+  // put in we need to "take them out", as it were.
+  //
+  void CombinationContextBase::FoldInStatisticalCorrelations (map<string, FitResult> &result) const
+  {
+    for (size_t i_c = 0; i_c < _correlations.size(); i_c++) {
+      const CorrInfo &ci(_correlations[i_c]);
+      if (ci._errorName == "statistical") {
+	for (map<string, FitResult>::iterator i_fr = result.begin(); i_fr != result.end(); i_fr++) {
+	  FitResult &fr(i_fr->second);
+	  map<string, double>::iterator s_value = fr.sysErrors.find(ci._sharedSysName);
+	  if (s_value != fr.sysErrors.end()) {
+	    fr.statisticalError = sqrt(fr.statisticalError*fr.statisticalError
+				       + s_value->second*s_value->second);
+	    fr.sysErrors.erase(s_value);
+	  }
+	}
+      }
+    }
+  }
+
   // Dump a fit result out to an output stream (mostly for debugging)
   ostream &operator<< (ostream &out, const CombinationContextBase::FitResult &fr)
   {
@@ -7,12 +7,18 @@
 #include "Combination/BinBoundaryUtils.h"
 #include "Combination/BinUtils.h"
 #include "Combination/CombinationContext.h"
+#include "Combination/CombinationContextBLUE.h"
 #include "Combination/Measurement.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/BinNameUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
 #include "Combination/MeasurementUtils.h"
+#include "Combination/ParallelUtils.h"
+#include "Combination/FitCache.h"
+#include "Combination/BinKey.h"
+#include "Combination/BinBoxIndex.h"
+#include "Combination/BinaryCalibrationInfo.h"
 
 #include <RooRealVar.h>
 
@@ -20,20 +26,97 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdlib>
 
 using namespace std;
 
 namespace {
   using namespace BTagCombination;
 
-  // Fill the context info for a single bin.
-  void FillContextWithBinInfo(CombinationContext &ctx,
-    const CalibrationBin &b,
-    const string &prefix = "",
-    const string &mname = "",
-    bool verbose = true) {
+  // Where fit telemetry goes (if anywhere). Fits can finish on several threads at once.
+  ostream *gFitTelemetryOutput = 0;
+  mutex gFitTelemetryMutex;
+
+  // Deleting a context deletes RooFit objects, so it has to hold the RooFit lock, just like
+  // building one does.
+  struct LockedContextDelete {
+    void operator() (CombinationContextBase *ctx) const
+    {
+      lock_guard<recursive_mutex> rooLock(CombinationContextBase::RooFitMutex());
+      delete ctx;
+    }
+  };
+  typedef unique_ptr<CombinationContextBase, LockedContextDelete> t_ContextPtr;
+
+  //
+  // Run fits that each make one analysis, and return the analyses in the same order. BLUE fits
+  // run on threads. RooFit and MINUIT can only do one fit at a time in a process, so with more
+  // than one thread the other fitters each run in a worker process, which sends back its analysis
+  // (after any telemetry it wrote) in the binary calibration format.
+  //
+  vector<CalibrationAnalysis> RunFits (const vector<function<CalibrationAnalysis (void)> > &fits,
+				       CombinationFitter fitter, unsigned int nThreads)
+  {
+    vector<CalibrationAnalysis> results(fits.size());
+
+    if (fitter == kFitWithBLUE || NumberOfWorkerThreads(nThreads) == 1 || fits.size() < 2) {
+      vector<function<void (void)> > jobs;
+      for (size_t i = 0; i < fits.size(); i++) {
+        jobs.push_back([&, i] () { results[i] = fits[i](); });
+      }
+      RunInParallel(jobs, nThreads);
+      return results;
+    }
+
+    vector<function<string (void)> > jobs;
+    for (size_t i = 0; i < fits.size(); i++) {
+      jobs.push_back([&, i] () {
+          ostringstream telemetry;
+          if (gFitTelemetryOutput != 0)
+            gFitTelemetryOutput = &telemetry;
+          CalibrationInfo info;
+          info.Analyses.push_back(fits[i]());
+
+          ostringstream out;
+          out << telemetry.str().size() << "\n" << telemetry.str();
+          WriteBinary(out, info);
+          return out.str();
+        });
+    }
+
+    if (gFitTelemetryOutput != 0)
+      gFitTelemetryOutput->flush();
+    vector<string> sent(RunInWorkerProcesses(jobs, nThreads));
+
+    for (size_t i = 0; i < sent.size(); i++) {
+      size_t header = sent[i].find('\n');
+      size_t telemetrySize = strtoul(sent[i].c_str(), 0, 10);
+      if (header == string::npos || header + 1 + telemetrySize > sent[i].size())
+        throw runtime_error("Internal error: badly formed fit result from a worker process");
+      {
+        lock_guard<mutex> lock(gFitTelemetryMutex);
+        if (gFitTelemetryOutput != 0)
+          *gFitTelemetryOutput << sent[i].substr(header + 1, telemetrySize);
+      }
+      const char *binary = sent[i].data() + header + 1 + telemetrySize;
+      CalibrationInfo info(ReadBinary(binary, sent[i].data() + sent[i].size()));
+      if (info.Analyses.size() != 1)
+        throw runtime_error("Internal error: a worker process sent back the wrong number of fit results");
+      results[i] = info.Analyses[0];
+    }
+    return results;
+  }
 
-    string binName(prefix + OPBinName(b));
+  // Fill the context info for a single bin, whose measurements are called binName.
+  void FillContextWithNamedBinInfo(CombinationContextBase &ctx,
+    const CalibrationBin &b,
+    const string &binName,
+    const string &mname,
+    bool verbose) {
 
     Measurement *m;
     if (mname.size() == 0) {
@@ -57,13 +140,22 @@ namespace {
     }
   }
 
+  // Fill the context info for a single bin.
+  void FillContextWithBinInfo(CombinationContextBase &ctx,
+    const CalibrationBin &b,
+    const string &prefix = "",
+    const string &mname = "",
+    bool verbose = true) {
+    FillContextWithNamedBinInfo(ctx, b, prefix + OPBinName(b), mname, verbose);
+  }
+
   //
   // Add all the measurements for a particular bin into the context.
   //  - Assume everything in the bins vector is the same bin! (no x-checking).
   //  - Variable name is based on the bin name - mapping should be "obvious".
   //  - Sys errors are added as well.
   //
-  void FillContextWithBinInfo(CombinationContext &ctx, const vector<CalibrationBin> &bins, const string &prefix = "")
+  void FillContextWithBinInfo(CombinationContextBase &ctx, const vector<CalibrationBin> &bins, const string &prefix = "")
   {
     // Simple x-checks and setup
     if (bins.size() == 0)
@@ -78,17 +170,26 @@ namespace {
 
   // Fill the fitting context with a list of analyses info... it is assumed that common bins
   // in here can be fit together.
-  map<string, vector<CalibrationBin> > FillContextWithCommonAnaInfo(CombinationContext &ctx, const vector<CalibrationAnalysis> &ana, const string &prefix = "", bool verbose = true)
+  map<string, vector<CalibrationBin> > FillContextWithCommonAnaInfo(CombinationContextBase &ctx, const vector<CalibrationAnalysis> &ana, const string &prefix = "", bool verbose = true)
   {
-    // Sort the bins all together.
+    // Sort the bins all together. Most bins turn up once per analysis, so remember the name
+    // (and where its bins go) rather than building it over again each time.
     map<string, vector<CalibrationBin> > bybins;
+    unordered_map<BinKey, pair<string, vector<CalibrationBin>*>, BinKeyHash> named;
     for (unsigned int i_ana = 0; i_ana < ana.size(); i_ana++) {
       const CalibrationAnalysis &a(ana[i_ana]);
+      const string anaName(OPFullName(a) + ":");
       for (unsigned int i_bin = 0; i_bin < a.bins.size(); i_bin++) {
         const CalibrationBin &b(a.bins[i_bin]);
-        string binName(OPBinName(b));
-        bybins[prefix + binName].push_back(b);
-        FillContextWithBinInfo(ctx, b, prefix, OPIgnoreFormat(a, b), verbose);
+        BinKey key(b);
+        unordered_map<BinKey, pair<string, vector<CalibrationBin>*>, BinKeyHash>::iterator n = named.find(key);
+        if (n == named.end()) {
+          string binName(key.Name());
+          n = named.insert(make_pair(key, make_pair(binName, &bybins[prefix + binName]))).first;
+        }
+        const string &binName(n->second.first);
+        n->second.second->push_back(b);
+        FillContextWithNamedBinInfo(ctx, b, prefix + binName, anaName + binName, verbose);
       }
     }
 
@@ -99,7 +200,7 @@ namespace {
   // Extract the complete result - with sys errors - from the calibration bin
   //  - Context has already had the fit run.
   //
-  CalibrationBin ExtractBinResult(const CombinationContext::FitResult &binResult, const CalibrationBin &forThisBin)
+  CalibrationBin ExtractBinResult(const CombinationContextBase::FitResult &binResult, const CalibrationBin &forThisBin)
   {
     CalibrationBin result;
     result.binSpec = forThisBin.binSpec;
@@ -137,12 +238,12 @@ namespace {
   // Given a mapping of bins to analysis bins, and a set of fit results, extract the mapping
   // and return a list of combined fits.
   vector<CalibrationBin> ExtractBinsResult(const map<string, vector<CalibrationBin> > &bybins,
-    const map<string, CombinationContext::FitResult> &fitResult)
+    const map<string, CombinationContextBase::FitResult> &fitResult)
   {
     vector<CalibrationBin> result;
     for (map<string, vector<CalibrationBin> >::const_iterator i_b = bybins.begin(); i_b != bybins.end(); i_b++) {
       string binName = i_b->first;
-      map<string, CombinationContext::FitResult>::const_iterator itr = fitResult.find(binName);
+      map<string, CombinationContextBase::FitResult>::const_iterator itr = fitResult.find(binName);
       if (itr == fitResult.end()) {
         ostringstream err;
         err << "Unable to recover bin " << binName << " in the output of the fit!";
@@ -158,95 +259,18 @@ namespace {
   // Nice way of sorting analyses for fitting.
   typedef map<string, vector<CalibrationAnalysis> > t_anaMap;
 
-  // Looking at sets of bin boundaries, return true if one of the sent in bins is a container of our
-  // given bin.
-  class ContainsBin {
-  public:
-    inline ContainsBin(const CalibrationBin &b)
-    {
-      for (size_t i = 0; i < b.binSpec.size(); i++) {
-        _binB[b.binSpec[i].variable] = b.binSpec[i];
-      }
-    }
-
-    bool operator() (const set<CalibrationBinBoundary> &bounds)
-    {
-      if (bounds.size() != _binB.size())
-        return false;
-
-      for (set<CalibrationBinBoundary>::const_iterator itr = bounds.begin(); itr != bounds.end(); itr++) {
-        map<string, CalibrationBinBoundary>::const_iterator fb = _binB.find(itr->variable);
-        if (fb == _binB.end())
-          return false;
-
-        if (fb->second.lowvalue < itr->lowvalue
-          || fb->second.highvalue > itr->highvalue)
-          return false;
-      }
-
-      return true;
-    }
-
-  private:
-    map<string, CalibrationBinBoundary> _binB;
-  };
-
-  double BinArea(const set<CalibrationBinBoundary> &b)
-  {
-    double r = 1.0;
-    for (set<CalibrationBinBoundary>::const_iterator i = b.begin(); i != b.end(); i++) {
-      r *= (i->highvalue - i->lowvalue);
-    }
-    return r;
-  }
-
-  // Calculate the bin area
-  double BinArea(const CalibrationBin &b)
-  {
-    set<CalibrationBinBoundary> spec(b.binSpec.begin(), b.binSpec.end());
-    return BinArea(spec);
-  }
-
-  //
-  // Return true if these bins have any overlap at all. To have overlap then every single
-  // coordinate must have overlap. Any of them don't and then you don't have overlap.
-  //
-  bool BinsOverlap(const CalibrationBin &b1, const CalibrationBin &b2)
-  {
-    // Put in a map to make the lookup easier.
-    map<string, vector<CalibrationBinBoundary> > binfo;
-    for (size_t i = 0; i < b1.binSpec.size(); i++) {
-      binfo[b1.binSpec[i].variable].push_back(b1.binSpec[i]);
-    }
-    for (size_t i = 0; i < b2.binSpec.size(); i++) {
-      binfo[b2.binSpec[i].variable].push_back(b2.binSpec[i]);
-    }
-
-    for (map<string, vector<CalibrationBinBoundary> >::const_iterator i = binfo.begin(); i != binfo.end(); i++) {
-      if (i->second.size() != 2)
-        return false;
-      const CalibrationBinBoundary &bb1(i->second[0]);
-      const CalibrationBinBoundary &bb2(i->second[1]);
-
-      if (bb1.highvalue <= bb2.lowvalue)
-        return false;
-      if (bb1.lowvalue >= bb2.highvalue)
-        return false;
-    }
-    return true;
-  }
-
-  // Return the list of bins in two analyses that overlap
-  vector<CalibrationBin> PartialOverlappingBins(const CalibrationAnalysis &a1, const CalibrationAnalysis &a2)
+  // Return the list of bins in two analyses that overlap (a2Bins indexes a2).
+  vector<CalibrationBin> PartialOverlappingBins(const CalibrationAnalysis &a1, const CalibrationAnalysis &a2, const BinBoxIndex &a2Bins)
   {
     for (vector<CalibrationBin>::const_iterator i_b1 = a1.bins.begin(); i_b1 != a1.bins.end(); i_b1++) {
-      set<CalibrationBinBoundary> b1_bins(i_b1->binSpec.begin(), i_b1->binSpec.end());
-      for (vector<CalibrationBin>::const_iterator i_b2 = a2.bins.begin(); i_b2 != a2.bins.end(); i_b2++) {
-        set<CalibrationBinBoundary> b2_bins(i_b2->binSpec.begin(), i_b2->binSpec.end());
-        if (BinsOverlap(*i_b1, *i_b2) && (b1_bins != b2_bins)) {
+      BinKey b1_bins(*i_b1);
+      vector<size_t> overlapping(a2Bins.Overlapping(i_b1->binSpec));
+      for (size_t i = 0; i < overlapping.size(); i++) {
+        const CalibrationBin &b2(a2.bins[overlapping[i]]);
+        if (b1_bins != BinKey(b2)) {
           vector<CalibrationBin> result;
           result.push_back(*i_b1);
-          result.push_back(*i_b2);
+          result.push_back(b2);
           return result;
         }
       }
@@ -257,9 +281,14 @@ namespace {
   // Return any bins in two analyses that overlap partially.
   vector<CalibrationBin> PartialOverlappingBins(const vector<CalibrationAnalysis> &anas)
   {
-    for (vector<CalibrationAnalysis>::const_iterator i_a1 = anas.begin(); i_a1 != anas.end(); i_a1++) {
-      for (vector<CalibrationAnalysis>::const_iterator i_a2(i_a1); i_a2 != anas.end(); i_a2++) {
-        vector<CalibrationBin> r(PartialOverlappingBins(*i_a1, *i_a2));
+    vector<BinBoxIndex> anaBins;
+    for (vector<CalibrationAnalysis>::const_iterator i_a = anas.begin(); i_a != anas.end(); i_a++) {
+      anaBins.push_back(BinBoxIndex(i_a->bins));
+    }
+
+    for (size_t i_a1 = 0; i_a1 < anas.size(); i_a1++) {
+      for (size_t i_a2 = i_a1; i_a2 < anas.size(); i_a2++) {
+        vector<CalibrationBin> r(PartialOverlappingBins(anas[i_a1], anas[i_a2], anaBins[i_a2]));
         if (r.size() > 0)
           return r;
       }
@@ -267,35 +296,6 @@ namespace {
     return vector<CalibrationBin>();
   }
 
-  // Make sure that the bin area is totally covered by "bins". There are all sorts of crazy things
-  // that can be done when we are talking about 2D. :( As a result, since writing a general algorithm
-  // seems odd, we will be a little clever. First, we know when we get here that all bins are already
-  // within the area. So, we can then calculate the total area and see if they match. If they do, then
-  // we make sure that no bin is overlapping any other bin. Those two criteria together should assure
-  // that we are ok.
-  bool BinAreaCovered(const set<CalibrationBinBoundary> &area, const vector<CalibrationBin> &bins)
-  {
-    double barea = 0.0;
-    for (size_t i = 0; i < bins.size(); i++) {
-      barea += BinArea(bins[i]);
-    }
-
-    if (barea != BinArea(area))
-      return false;
-
-    // Now check for overlap
-    for (size_t i = 0; i < bins.size(); i++) {
-      for (size_t j = i + 1; j < bins.size(); j++) {
-        if (BinsOverlap(bins[i], bins[j])) {
-          return false;
-        }
-      }
-    }
-
-    // Ok - then we are satisfied!
-    return true;
-  }
-
   // Calc the weighted average
   double CalcWTAverage(vector<double> values, vector<double> weights)
   {
@@ -388,8 +388,8 @@ namespace {
 
   }
 
-  // Combine an arbitrary set of bins. The resulting bin coordinates are zeroed out, and left
-  // to the caller to put in.
+  // Combine an arbitrary set of bins by fitting them as measurements of one bin. The result
+  // has combinedBin's coordinates.
   CalibrationBin CombineArbitraryBin(const vector<CalibrationBin> &bins, const set<CalibrationBinBoundary> &combinedBin)
   {
     // Simple checks to make sure we aren't bent out of shape
@@ -420,16 +420,20 @@ namespace {
       binsToFit.push_back(b);
     }
 
-    // Now we are ready to build the combination. Do a single fit of everything.
-
-    CombinationContext ctx;
-    FillContextWithBinInfo(ctx, binsToFit);
-    const map<string, CombinationContext::FitResult> fitResult = ctx.Fit("working on it");
+    // Now we are ready to build the combination. Do a single fit of everything. Building the
+    // context makes RooFit objects, so that is done under the RooFit lock (the fit takes it itself).
 
+    t_ContextPtr ctx;
+    {
+      lock_guard<recursive_mutex> rooLock(CombinationContextBase::RooFitMutex());
+      ctx.reset(new CombinationContext());
+      FillContextWithBinInfo(*ctx, binsToFit);
+    }
     string binName(OPBinName(binsToFit[0]));
+    const map<string, CombinationContextBase::FitResult> fitResult = ctx->Fit(binName);
 
 
-    map<string, CombinationContext::FitResult>::const_iterator ptr = fitResult.find(binName);
+    map<string, CombinationContextBase::FitResult>::const_iterator ptr = fitResult.find(binName);
     if (ptr == fitResult.end())
       throw runtime_error("Unable to find bin '" + binName + "' in the fit results");
 
@@ -438,6 +442,62 @@ namespace {
     return ExtractBinResult(ptr->second, resultTemplate);
   }
 
+  // One bin of a correlation, along with the names of the two measurements it ties together.
+  struct CorrelationBinRef {
+    const AnalysisCorrelation *correlation;
+    const BinCorrelation *bin;
+    pair<string, string> measurementNames;
+  };
+
+  //
+  // The correlations, split up the way the fits need them: by group (flavor, tagger, OP, jet - their
+  // OPIndependentName), and then by bin. Built once, so each fit only looks at the correlations that
+  // can apply to it. Within each list the bins are in the same order as in the input.
+  //
+  class CorrelationIndex
+  {
+  public:
+    CorrelationIndex (const vector<AnalysisCorrelation> &correlations)
+    {
+      for (size_t i_cor = 0; i_cor < correlations.size(); i_cor++) {
+        const AnalysisCorrelation &cor(correlations[i_cor]);
+        string group(OPIndependentName(cor));
+        for (size_t i_cbin = 0; i_cbin < cor.bins.size(); i_cbin++) {
+          CorrelationBinRef ref;
+          ref.correlation = &cor;
+          ref.bin = &(cor.bins[i_cbin]);
+          ref.measurementNames = OPIgnoreCorrelatedFormat(cor, cor.bins[i_cbin]);
+          _byGroup[group].push_back(ref);
+          _byGroupAndBin[make_pair(group, OPBinName(cor.bins[i_cbin]))].push_back(ref);
+        }
+      }
+    }
+
+    // Everything for one group.
+    const vector<CorrelationBinRef> &ForGroup (const string &group) const
+    {
+      return Lookup(_byGroup, group);
+    }
+
+    // Everything for one bin (as named by OPBinName) of one group.
+    const vector<CorrelationBinRef> &ForGroupBin (const string &group, const string &binName) const
+    {
+      return Lookup(_byGroupAndBin, make_pair(group, binName));
+    }
+
+  private:
+    template <class K>
+    static const vector<CorrelationBinRef> &Lookup (const map<K, vector<CorrelationBinRef> > &index, const K &key)
+    {
+      static const vector<CorrelationBinRef> empty;
+      typename map<K, vector<CorrelationBinRef> >::const_iterator itr = index.find(key);
+      return itr == index.end() ? empty : itr->second;
+    }
+
+    map<string, vector<CorrelationBinRef> > _byGroup;
+    map<pair<string, string>, vector<CorrelationBinRef> > _byGroupAndBin;
+  };
+
 }
 
 namespace BTagCombination
@@ -464,13 +524,13 @@ namespace BTagCombination
     // Now we are ready to build the combination. Do a single fit of everything.
     CombinationContext ctx;
     FillContextWithBinInfo(ctx, bins);
-    const map<string, CombinationContext::FitResult> fitResult = ctx.Fit(fitName);
+    const map<string, CombinationContextBase::FitResult> fitResult = ctx.Fit(fitName);
 
     // Now that we have the result, we need to extract the numbers and build the resulting bin
     string binName(OPBinName(bins[0]));
 
 
-    map<string, CombinationContext::FitResult>::const_iterator ptr = fitResult.find(binName);
+    map<string, CombinationContextBase::FitResult>::const_iterator ptr = fitResult.find(binName);
     if (ptr == fitResult.end())
       throw runtime_error("Unable to find bin '" + binName + "' in the fit results");
 
@@ -522,7 +582,7 @@ namespace BTagCombination
 
     CombinationContext ctx;
     map<string, vector<CalibrationBin> > bybins = FillContextWithCommonAnaInfo(ctx, ana);
-    const map<string, CombinationContext::FitResult> fitResult = ctx.Fit();
+    const map<string, CombinationContextBase::FitResult> fitResult = ctx.Fit();
 
     //
     // Finally, go through and extract the fit results.
@@ -572,11 +632,34 @@ namespace BTagCombination
     }
   }
 
+  // Create an empty context that will use the requested fitter.
+  CombinationContextBase *CreateContext(CombinationFitter fitter)
+  {
+    switch (fitter) {
+    case kFitWithMinuit:
+      return new CombinationContext();
+
+    case kFitWithBLUE:
+      return new CombinationContextBLUE();
+
+    case kFitWithMinuitSingleFit:
+      {
+	CombinationContext *ctx = new CombinationContext();
+	ctx->setSysErrorDecomposition(CombinationContext::kFromCovariance);
+	return ctx;
+      }
+
+    default:
+      throw runtime_error("Unknown combination fitter!");
+    }
+  }
+
   // We plunk everything we are given here into a single context, and return the new
   // fit.
-  pair<CombinationContext *, map<string, vector<CalibrationBin> > > CreateContextInOneContext(const vector<CalibrationAnalysis> &anas,
-    const vector<AnalysisCorrelation> &correlations,
-    bool verbose)
+  pair<CombinationContextBase *, map<string, vector<CalibrationBin> > > CreateContextInOneContext(const vector<CalibrationAnalysis> &anas,
+    const vector<CorrelationBinRef> &correlations,
+    bool verbose,
+    CombinationFitter fitter = kFitWithMinuit)
   {
     // Make sure that we have a good setup for a fit - no non-overlapping bins.
     vector<CalibrationBin> partialOverlap(PartialOverlappingBins(anas));
@@ -588,46 +671,44 @@ namespace BTagCombination
       throw runtime_error("Partial overlap of analyses found!");
     }
 
-    CombinationContext *ctx = new CombinationContext();
+    t_ContextPtr ctx(CreateContext(fitter));
     ctx->SetVerbose(verbose);
     map<string, vector<CalibrationBin> > bins = FillContextWithCommonAnaInfo(*ctx, anas, "", verbose);
 
     // Now, go look for any correlations that might apply here.
     for (size_t i_cor = 0; i_cor < correlations.size(); i_cor++) {
-      for (size_t i_cbin = 0; i_cbin < correlations[i_cor].bins.size(); i_cbin++) {
-        const BinCorrelation &bin(correlations[i_cor].bins[i_cbin]);
-        pair<string, string> aNames(OPIgnoreCorrelatedFormat(correlations[i_cor], bin));
-
-        Measurement *m1 = ctx->FindMeasurement(aNames.first);
-        Measurement *m2 = ctx->FindMeasurement(aNames.second);
-
-        if (m1 == 0 || m2 == 0) {
-          if (!(m1 == 0 && m2 == 0)) {
-            ostringstream out;
-            out << "Both analyses not present for correlation " << OPFullName(correlations[i_cor]) << " - but at least one is!";
-            throw runtime_error(out.str());
-          }
-          continue;
+      const CorrelationBinRef &cor(correlations[i_cor]);
+      const BinCorrelation &bin(*cor.bin);
+
+      Measurement *m1 = ctx->FindMeasurement(cor.measurementNames.first);
+      Measurement *m2 = ctx->FindMeasurement(cor.measurementNames.second);
+
+      if (m1 == 0 || m2 == 0) {
+        if (!(m1 == 0 && m2 == 0)) {
+          ostringstream out;
+          out << "Both analyses not present for correlation " << OPFullName(*cor.correlation) << " - but at least one is!";
+          throw runtime_error(out.str());
         }
+        continue;
+      }
 
-        //
-        if (verbose)
-          cout << "--> Adding correlation " << OPIgnoreFormat(correlations[i_cor], bin)
-          << std::endl;
+      //
+      if (verbose)
+        cout << "--> Adding correlation " << OPIgnoreFormat(*cor.correlation, bin)
+        << std::endl;
 
-        //
-        // Now, do the correlations
+      //
+      // Now, do the correlations
 
-        if (bin.hasStatCorrelation) {
-          ctx->AddCorrelation("statistical", m1, m2, bin.statCorrelation);
-        }
+      if (bin.hasStatCorrelation) {
+        ctx->AddCorrelation("statistical", m1, m2, bin.statCorrelation);
       }
     }
-    return make_pair(ctx, bins);
+    return make_pair(ctx.release(), bins);
   }
 
   // Do the actual fit, extract results, return them.
-  CalibrationAnalysis CombineAnalysesInOneContext(pair<CombinationContext *, map<string, vector<CalibrationBin> > > &info, const vector<CalibrationAnalysis> &anas, const string &resultFitName)
+  CalibrationAnalysis CombineAnalysesInOneContext(pair<CombinationContextBase *, map<string, vector<CalibrationBin> > > &info, const vector<CalibrationAnalysis> &anas, const string &resultFitName)
   {
     // We make an assumption about the fit name here, and the way the fit is being done (constant over flavor, tag, OP).
     string fitName = anas[0].flavor
@@ -635,9 +716,14 @@ namespace BTagCombination
       + ":" + anas[0].operatingPoint;
 
     // Do the fit.
-    CombinationContext *ctx(info.first);
-    map<string, CombinationContext::FitResult> fitResult = ctx->Fit(fitName);
-    CombinationContext::ExtraFitInfo extraInfo = ctx->GetExtraFitInformation();
+    CombinationContextBase *ctx(info.first);
+    map<string, CombinationContextBase::FitResult> fitResult = ctx->Fit(fitName);
+    CombinationContextBase::ExtraFitInfo extraInfo = ctx->GetExtraFitInformation();
+    {
+      lock_guard<mutex> lock(gFitTelemetryMutex);
+      if (gFitTelemetryOutput != 0)
+        extraInfo.WriteJSON(*gFitTelemetryOutput, OPIndependentName(anas[0]) + ":" + resultFitName);
+    }
 
     // Dummy analysis that we will fill in with the results.
     CalibrationAnalysis r(anas[0]);
@@ -670,43 +756,91 @@ namespace BTagCombination
   // We plunk everything we are given here into a single context, and return the new
   // fit.
   CalibrationAnalysis CombineAnalysesInOneContext(const vector<CalibrationAnalysis> &anas,
-    const vector<AnalysisCorrelation> &correlations,
+    const vector<CorrelationBinRef> &correlations,
     const string &resultFitName,
-    bool verbose)
+    bool verbose,
+    CombinationFitter fitter)
   {
-    pair<CombinationContext *, map<string, vector<CalibrationBin> > > info(CreateContextInOneContext(anas, correlations, verbose));
-    CalibrationAnalysis a(CombineAnalysesInOneContext(info, anas, resultFitName));
-    delete info.first;
-    return a;
+    // Building and deleting a context makes RooFit objects, so make sure nothing else is doing
+    // that in another thread. The fit itself takes care of its own locking.
+    pair<CombinationContextBase *, map<string, vector<CalibrationBin> > > info;
+    t_ContextPtr ctx;
+    {
+      lock_guard<recursive_mutex> rooLock(CombinationContextBase::RooFitMutex());
+      info = CreateContextInOneContext(anas, correlations, verbose, fitter);
+      ctx.reset(info.first);
+    }
+    return CombineAnalysesInOneContext(info, anas, resultFitName);
   }
 
-  // Do the combination, doing everything across bins.
-  vector<CalibrationAnalysis> CombineAnalysesAllBins(const CalibrationInfo &info, bool verbose)
+  // Rough measure of how long it will take to fit a group of analyses - the number of
+  // parameters the fit will have to deal with.
+  size_t FitSize(const vector<CalibrationAnalysis> &anas)
+  {
+    size_t size = 0;
+    for (vector<CalibrationAnalysis>::const_iterator i_ana = anas.begin(); i_ana != anas.end(); i_ana++) {
+      for (vector<CalibrationBin>::const_iterator i_bin = i_ana->bins.begin(); i_bin != i_ana->bins.end(); i_bin++) {
+        size += 1 + i_bin->systematicErrors.size();
+      }
+    }
+    return size;
+  }
+
+  // Do the combination, doing everything across bins. Each group of analyses (flavor, tagger, OP, jet)
+  // is an independent fit, so they can be run in parallel (see RunFits). The results come back in the
+  // same order no matter how many threads are used.
+  vector<CalibrationAnalysis> CombineAnalysesAllBins(const CalibrationInfo &info, bool verbose, CombinationFitter fitter, unsigned int nThreads)
   {
     t_anaMap binnedAnalyses(BinAnalysesByJetTagFlavOp(info.Analyses));
+    CorrelationIndex correlations(info.Correlations);
+
+    vector<const vector<CalibrationAnalysis>*> groups;
+    vector<const vector<CorrelationBinRef>*> groupCorrelations;
+    for (t_anaMap::const_iterator i_ana = binnedAnalyses.begin(); i_ana != binnedAnalyses.end(); i_ana++) {
+      groups.push_back(&(i_ana->second));
+      groupCorrelations.push_back(&(correlations.ForGroup(i_ana->first)));
+    }
 
     //
     // in each bin, fit everything. one odd thing is we have to loop through all
     // the correlations and extract any we need.
     //
 
-    vector<CalibrationAnalysis> result;
-    for (t_anaMap::const_iterator i_ana = binnedAnalyses.begin(); i_ana != binnedAnalyses.end(); i_ana++) {
-      if (i_ana->second.size() > 1) {
-        CalibrationAnalysis r(CombineAnalysesInOneContext(i_ana->second,
-          info.Correlations,
-          info.CombinationAnalysisName,
-          verbose));
+    vector<CalibrationAnalysis> result(groups.size());
+    vector<pair<size_t, size_t> > schedule;
+    for (size_t i_g = 0; i_g < groups.size(); i_g++) {
+      schedule.push_back(make_pair(FitSize(*groups[i_g]), i_g));
+    }
 
-        result.push_back(r);
+    // Biggest fits first so one long fit doesn't get left until the end.
+    stable_sort(schedule.begin(), schedule.end(), [] (const pair<size_t, size_t> &a, const pair<size_t, size_t> &b) { return a.first > b.first; });
+
+    vector<function<CalibrationAnalysis (void)> > fits;
+    for (size_t i_s = 0; i_s < schedule.size(); i_s++) {
+      size_t i_g = schedule[i_s].second;
+      const vector<CalibrationAnalysis> &anas(*groups[i_g]);
+      if (anas.size() > 1) {
+        fits.push_back([&, i_g] () {
+            return CombineAnalysesInOneContext(*groups[i_g],
+              *groupCorrelations[i_g],
+              info.CombinationAnalysisName,
+              verbose,
+              fitter);
+          });
       }
       else {
-        CalibrationAnalysis r(i_ana->second[0]);
-        r.name = info.CombinationAnalysisName;
-        result.push_back(r);
+        result[i_g] = anas[0];
+        result[i_g].name = info.CombinationAnalysisName;
       }
     }
 
+    vector<CalibrationAnalysis> fitted(RunFits(fits, fitter, nThreads));
+    for (size_t i_s = 0, i_f = 0; i_s < schedule.size(); i_s++) {
+      size_t i_g = schedule[i_s].second;
+      if (groups[i_g]->size() > 1)
+        result[i_g] = fitted[i_f++];
+    }
+
     return result;
   }
 
@@ -730,10 +864,11 @@ namespace BTagCombination
   }
 
   // Do the fits bin-by-bin.
-  vector<CalibrationAnalysis> CombineAnalysesByBin(const CalibrationInfo &info, bool verbose)
+  vector<CalibrationAnalysis> CombineAnalysesByBin(const CalibrationInfo &info, bool verbose, CombinationFitter fitter, unsigned int nThreads)
   {
     // Split this list of analyses by bin, do the fit, and then recombine.
     t_anaMap analysesInCommon(BinAnalysesByJetTagFlavOp(info.Analyses));
+    CorrelationIndex correlations(info.Correlations);
     vector<CalibrationAnalysis> result;
     for (t_anaMap::const_iterator i_ana = analysesInCommon.begin(); i_ana != analysesInCommon.end(); i_ana++) {
       if (i_ana->second.size() > 1) {
@@ -747,19 +882,47 @@ namespace BTagCombination
         }
 
         // Do the fits bin-by-bin here. For each bin, collect the measurements as we will be needing them
-        // to calculate the chi2 at the end of the process.
+        // to calculate the chi2 at the end of the process. The bins are independent fits, so they
+        // can be run in parallel (see RunFits); each keeps its slot so the merge order is the same as the bin order.
         set<set<CalibrationBinBoundary> > allBins(listAllBins(i_ana->second));
-        vector<CalibrationAnalysis> binByBinFits;
-        vector<CombinationContext*> contexts;
-        for (set<set<CalibrationBinBoundary> >::const_iterator i_bin = allBins.begin(); i_bin != allBins.end(); i_bin++) {
-          vector<CalibrationAnalysis> anaForBin(removeAllBinsButBin(i_ana->second, *i_bin));
+        vector<set<CalibrationBinBoundary> > binList(allBins.begin(), allBins.end());
+        vector<vector<CalibrationAnalysis> > anasForBins;
+        vector<pair<size_t, size_t> > schedule;
+        for (size_t i_bin = 0; i_bin < binList.size(); i_bin++) {
+          anasForBins.push_back(removeAllBinsButBin(i_ana->second, binList[i_bin]));
+          schedule.push_back(make_pair(FitSize(anasForBins.back()), i_bin));
+        }
+        stable_sort(schedule.begin(), schedule.end(), [] (const pair<size_t, size_t> &a, const pair<size_t, size_t> &b) { return a.first > b.first; });
+
+        // The contexts are kept for the chi2 below, and freed even if one of the fits throws.
+        vector<t_ContextPtr> contexts(binList.size());
+        vector<function<CalibrationAnalysis (void)> > fits;
+        for (size_t i_s = 0; i_s < schedule.size(); i_s++) {
+          size_t i_bin = schedule[i_s].second;
+          fits.push_back([&, i_bin] () {
+              pair<CombinationContextBase*, map<string, vector<CalibrationBin> > > resultInfo;
+              {
+                lock_guard<recursive_mutex> rooLock(CombinationContextBase::RooFitMutex());
+                resultInfo = CreateContextInOneContext(anasForBins[i_bin], correlations.ForGroupBin(i_ana->first, OPBinName(binList[i_bin])), verbose, fitter);
+                contexts[i_bin].reset(resultInfo.first);
+              }
+              return CombineAnalysesInOneContext(resultInfo, anasForBins[i_bin], OPBinName(binList[i_bin]));
+            });
+        }
 
-          pair<CombinationContext*, map<string, vector<CalibrationBin> > > resultInfo(CreateContextInOneContext(anaForBin,
-            info.Correlations, verbose));
-          CalibrationAnalysis r(CombineAnalysesInOneContext(resultInfo, anaForBin, OPBinName(*i_bin)));
+        vector<CalibrationAnalysis> fitted(RunFits(fits, fitter, nThreads));
+        vector<CalibrationAnalysis> binByBinFits(binList.size());
+        for (size_t i_s = 0; i_s < schedule.size(); i_s++) {
+          binByBinFits[schedule[i_s].second] = fitted[i_s];
+        }
 
-          binByBinFits.push_back(r);
-          contexts.push_back(resultInfo.first);
+        // A bin that was fit in a worker process left its context there. The fit doesn't change
+        // anything the chi2 uses, so a freshly built context gives it the same measurements.
+        for (size_t i_bin = 0; i_bin < binList.size(); i_bin++) {
+          if (!contexts[i_bin]) {
+            lock_guard<recursive_mutex> rooLock(CombinationContextBase::RooFitMutex());
+            contexts[i_bin].reset(CreateContextInOneContext(anasForBins[i_bin], correlations.ForGroupBin(i_ana->first, OPBinName(binList[i_bin])), false, fitter).first);
+          }
         }
 
         // Merge the various bins into a single bin, track the linage.
@@ -774,7 +937,8 @@ namespace BTagCombination
         //  - A summed chi2 will be calculated in MergeAnalysis above, and transferred to sum_gchi2 below.
         vector<CalibrationAnalysis> anasForResult;
         anasForResult.push_back(mergedResult);
-        pair<CombinationContext*, map<string, vector<CalibrationBin> > > resultInfo(CreateContextInOneContext(anasForResult, vector<AnalysisCorrelation>(), false));
+        pair<CombinationContextBase*, map<string, vector<CalibrationBin> > > resultInfo(CreateContextInOneContext(anasForResult, vector<CorrelationBinRef>(), false));
+        t_ContextPtr resultCtx(resultInfo.first);
 
         vector<Measurement*> initialMeasurements, finalMeasurements;
         copy(resultInfo.first->GetAllMeasurements().begin(), resultInfo.first->GetAllMeasurements().end(), back_inserter(finalMeasurements));
@@ -787,11 +951,6 @@ namespace BTagCombination
         mergedResult.metadata["gchi2"].clear();
         mergedResult.metadata["gchi2"].push_back(CalcChi2(initialMeasurements, finalMeasurements));
 
-        delete resultInfo.first;
-        for (size_t i = 0; i < contexts.size(); i++) {
-          delete contexts[i];
-        }
-
         // Save it to be returned.
         result.push_back(mergedResult);
       }
@@ -809,14 +968,14 @@ namespace BTagCombination
   // Master entry to do the fitting. Shell routine that calls out depending on the type of fit
   // desired.
   //
-  vector<CalibrationAnalysis> CombineAnalyses(const CalibrationInfo &info, bool verbose, CombinationType combineType)
+  vector<CalibrationAnalysis> CombineAnalysesUncached(const CalibrationInfo &info, bool verbose, CombinationType combineType, CombinationFitter fitter, unsigned int nThreads)
   {
     switch (combineType) {
     case kCombineByFullAnalysis:
-      return CombineAnalysesAllBins(info, verbose);
+      return CombineAnalysesAllBins(info, verbose, fitter, nThreads);
 
     case kCombineBySingleBin:
-      return CombineAnalysesByBin(info, verbose);
+      return CombineAnalysesByBin(info, verbose, fitter, nThreads);
 
     default:
       throw runtime_error("Unknown combination type!");
@@ -824,6 +983,67 @@ namespace BTagCombination
     }
   }
 
+  //
+  // If there is a cache, only fit the groups that aren't already in it. Every group turns into
+  // exactly one result analysis, so the results can be put back in order by group name.
+  //
+  vector<CalibrationAnalysis> CombineAnalyses(const CalibrationInfo &info, bool verbose, CombinationType combineType, CombinationFitter fitter, unsigned int nThreads, const string &cacheDir)
+  {
+    if (cacheDir == "")
+      return CombineAnalysesUncached(info, verbose, combineType, fitter, nThreads);
+
+    FitCache cache(cacheDir);
+
+    // Everything besides the inputs that changes the result.
+    ostringstream fitMode;
+    fitMode << "type=" << combineType
+            << " fitter=" << fitter
+            << " verbose=" << verbose
+            << " name=" << info.CombinationAnalysisName;
+
+    t_anaMap groups(BinAnalysesByJetTagFlavOp(info.Analyses));
+    map<string, CalibrationAnalysis> results;
+    map<string, string> keys;
+    CalibrationInfo toFit(info);
+    toFit.Analyses.clear();
+    for (t_anaMap::const_iterator i_g = groups.begin(); i_g != groups.end(); i_g++) {
+      string key(cache.Key(i_g->second, info.Correlations, fitMode.str()));
+      CalibrationAnalysis r;
+      if (cache.Lookup(key, r)) {
+        results[i_g->first] = r;
+      } else {
+        keys[i_g->first] = key;
+        toFit.Analyses.insert(toFit.Analyses.end(), i_g->second.begin(), i_g->second.end());
+      }
+    }
+
+    cout << "Fit cache " << cacheDir << ": " << results.size() << " groups reused, " << keys.size() << " to fit." << endl;
+
+    if (toFit.Analyses.size() > 0) {
+      vector<CalibrationAnalysis> fitResults(CombineAnalysesUncached(toFit, verbose, combineType, fitter, nThreads));
+      for (vector<CalibrationAnalysis>::const_iterator i_r = fitResults.begin(); i_r != fitResults.end(); i_r++) {
+        string group(OPIndependentName(*i_r));
+        map<string, string>::const_iterator i_k = keys.find(group);
+        if (i_k == keys.end())
+          throw runtime_error("Internal error: fit result for group " + group + " that wasn't asked for");
+        cache.Store(i_k->second, *i_r);
+        results[group] = *i_r;
+      }
+    }
+
+    vector<CalibrationAnalysis> result;
+    for (map<string, CalibrationAnalysis>::const_iterator i_r = results.begin(); i_r != results.end(); i_r++) {
+      result.push_back(i_r->second);
+    }
+    return result;
+  }
+
+  void SetFitTelemetryOutput(ostream *out)
+  {
+    lock_guard<mutex> lock(gFitTelemetryMutex);
+    gFitTelemetryOutput = out;
+  }
+
   //
   // Combine bins in a single analysis to generate a new analysis.
   // - Can't split bins
@@ -831,7 +1051,9 @@ namespace BTagCombination
   // - Fit is done separately in each bin.
   //
   CalibrationAnalysis RebinAnalysis(const set<set<CalibrationBinBoundary> > &templateBinning,
-    const CalibrationAnalysis &ana)
+    const CalibrationAnalysis &ana,
+    RebinMethod method,
+    unsigned int nThreads)
   {
     // Do quick checks to make sure inputs look basically good.
 
@@ -844,17 +1066,19 @@ namespace BTagCombination
     // We need to associate bins in the source analysis with the targets. We create a map and look
     // for completely contained bins.
 
-    map<set<CalibrationBinBoundary>, vector<CalibrationBin> > matchedBins;
+    unordered_map<BinKey, vector<CalibrationBin>, BinKeyHash> matchedBins;
+    vector<BinKey> templateKeys;
     for (set<set<CalibrationBinBoundary> >::const_iterator itr = templateBinning.begin(); itr != templateBinning.end(); itr++) {
-      matchedBins[*itr] = vector<CalibrationBin>();
+      templateKeys.push_back(BinKey(*itr));
+      matchedBins[templateKeys.back()] = vector<CalibrationBin>();
     }
+    BinBoxIndex templateBins(templateBinning);
 
     for (size_t i_bin = 0; i_bin < ana.bins.size(); i_bin++) {
       const CalibrationBin &anab(ana.bins[i_bin]);
-      set<set<CalibrationBinBoundary> >::const_iterator foundBin =
-        find_if(templateBinning.begin(), templateBinning.end(), ContainsBin(anab));
+      vector<size_t> foundBins(templateBins.Containing(anab.binSpec));
 
-      if (foundBin == templateBinning.end()) {
+      if (foundBins.size() == 0) {
         ostringstream err;
         err << "Bin " << OPBinName(anab) << " is not contained by any template bins:" << endl;
         for (set<set<CalibrationBinBoundary> >::const_iterator i_be = templateBinning.begin(); i_be != templateBinning.end(); i_be++) {
@@ -864,7 +1088,7 @@ namespace BTagCombination
         throw runtime_error(err.str().c_str());
       }
 
-      matchedBins[*foundBin].push_back(anab);
+      matchedBins[templateKeys[foundBins[0]]].push_back(anab);
     }
 
     //
@@ -872,19 +1096,22 @@ namespace BTagCombination
     // just looks for consistency before we spend anytime running fits.
     //
 
-    for (map<set<CalibrationBinBoundary>, vector<CalibrationBin> >::const_iterator itr = matchedBins.begin(); itr != matchedBins.end(); itr++) {
+    // The template order (rather than the hash table's) keeps the output bins in a fixed order.
+    set<set<CalibrationBinBoundary> >::const_iterator templateBin = templateBinning.begin();
+    for (size_t i_t = 0; i_t < templateKeys.size(); i_t++, templateBin++) {
+      const vector<CalibrationBin> &matched(matchedBins[templateKeys[i_t]]);
 
       // If there are zero source bins, then it is as if this guy didn't exist!
-      if (itr->second.size() == 0) {
+      if (matched.size() == 0) {
         continue;
       }
 
       // Make sure there are no gaps in any of the coverage
-      if (!BinAreaCovered(itr->first, itr->second)) {
+      if (!BinBoxIndex(matched).Covers(*templateBin)) {
         ostringstream err;
-        err << "Gaps or extra overlaps discovered in binning covering " << OPBinName(itr->first) << ". The following has a gap/overlap: " << endl;
-        for (size_t i = 0; i < itr->second.size(); i++) {
-          err << "  - " << OPBinName(itr->second[i]) << endl;
+        err << "Gaps or extra overlaps discovered in binning covering " << templateKeys[i_t].Name() << ". The following has a gap/overlap: " << endl;
+        for (size_t i = 0; i < matched.size(); i++) {
+          err << "  - " << OPBinName(matched[i]) << endl;
         }
         err << "  -> Analysis: " << ana.name << endl;
         throw runtime_error(err.str().c_str());
@@ -892,28 +1119,54 @@ namespace BTagCombination
     }
 
     // 
-    // Loop through all the bins and run the combiner on them.
+    // Loop through all the bins and run the combiner on them. Each template bin is on its own, so
+    // the fits can be run at the same time (see RunFits). The weighted average is too quick to
+    // be worth it.
     //
 
-    CalibrationAnalysis result(ana);
-    result.bins.clear();
-    for (map<set<CalibrationBinBoundary>, vector<CalibrationBin> >::const_iterator itr = matchedBins.begin(); itr != matchedBins.end(); itr++) {
+    vector<CalibrationBin> combined(templateKeys.size());
+    vector<size_t> fitBins;
+    vector<function<CalibrationAnalysis (void)> > fits;
+    for (size_t i_t = 0; i_t < templateKeys.size(); i_t++) {
+      const vector<CalibrationBin> *matched(&matchedBins[templateKeys[i_t]]);
 
       // If there are zero source bins, then it is as if this guy didn't exist!
-      if (itr->second.size() == 0) {
+      if (matched->size() == 0) {
         continue;
       }
 
-      CalibrationBin b(CombineBinsWeightedAverage(itr->second));
-      b.binSpec = vector<CalibrationBinBoundary>(itr->first.begin(), itr->first.end());
-      result.bins.push_back(b);
+      if (method == kRebinFit) {
+        fitBins.push_back(i_t);
+        fits.push_back([&, i_t, matched] () {
+            CalibrationAnalysis r;
+            r.bins.push_back(CombineArbitraryBin(*matched, templateKeys[i_t].Boundaries()));
+            return r;
+          });
+      }
+      else {
+        combined[i_t] = CombineBinsWeightedAverage(*matched);
+        combined[i_t].binSpec = templateKeys[i_t].BinSpec();
+      }
+    }
+
+    vector<CalibrationAnalysis> fitted(RunFits(fits, kFitWithMinuit, nThreads));
+    for (size_t i_f = 0; i_f < fitted.size(); i_f++) {
+      combined[fitBins[i_f]] = fitted[i_f].bins[0];
+    }
+
+    CalibrationAnalysis result(ana);
+    result.bins.clear();
+    for (size_t i_t = 0; i_t < templateKeys.size(); i_t++) {
+      if (matchedBins[templateKeys[i_t]].size() > 0) {
+        result.bins.push_back(combined[i_t]);
+      }
     }
 
     return result;
   }
 
   // Populate a combination context with everything from a single analysis
-  void FillContext(CombinationContext &ctx, CalibrationAnalysis &ana)
+  void FillContext(CombinationContextBase &ctx, CalibrationAnalysis &ana)
   {
     vector<CalibrationAnalysis> anas;
     anas.push_back(ana);
@@ -7,6 +7,10 @@
 #include "Combination/Parser.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/BinBoundaryUtils.h"
+#include "Combination/BinaryCalibrationInfo.h"
+#include "Combination/AnalysisCatalog.h"
+#include "Combination/ParallelUtils.h"
+#include "Combination/IgnorePatternMatcher.h"
 
 #include <TSystem.h>
 
@@ -18,6 +22,9 @@
 #include <fstream>
 #include <iterator>
 #include <algorithm>
+#include <functional>
+#include <mutex>
+#include <limits>
 
 using namespace std;
 
@@ -28,55 +35,86 @@ using namespace std;
 namespace {
   using namespace BTagCombination;
 
-  void Combine(vector<CalibrationAnalysis> &master, const vector<CalibrationAnalysis> &newstuff)
+  // Add analyses to the master list. Bins of an analysis already there are added to it.
+  void Combine(vector<CalibrationAnalysis> &master, AnalysisCatalog &catalog, const vector<CalibrationAnalysis> &newstuff)
   {
     for (vector<CalibrationAnalysis>::const_iterator itr = newstuff.begin(); itr != newstuff.end(); itr++) {
-      bool inserted = false;
-      for (vector<CalibrationAnalysis>::iterator mitr = master.begin(); mitr != master.end(); mitr++) {
-        if (itr->name == mitr->name
-          && itr->flavor == mitr->flavor
-          && itr->tagger == mitr->tagger
-          && itr->operatingPoint == mitr->operatingPoint
-          && itr->jetAlgorithm == mitr->jetAlgorithm) {
-          // Should make sure there are no collisions!
-          for (vector<CalibrationBin>::const_iterator bitr = itr->bins.begin(); bitr != itr->bins.end(); bitr++) {
-            mitr->bins.push_back(*bitr);
-          }
-          inserted = true;
-          break;
-        }
+      size_t found = catalog.Find(*itr);
+      if (found != AnalysisCatalog::npos) {
+        // Should make sure there are no collisions!
+        master[found].bins.insert(master[found].bins.end(), itr->bins.begin(), itr->bins.end());
       }
-      if (!inserted) {
+      else {
         master.push_back(*itr);
+        catalog.Update();
       }
     }
   }
 
-  // Load operating points from a text file on disk.
-  void loadOPsFromFile(CalibrationInfo &list, const string &fname, calibrationFilterInfo &fInfo)
+  // Read operating points from a text (or binary) file on disk. Touches nothing but the file
+  // (and its cache), so several files can be read at once.
+  CalibrationInfo readOPsFile(const string &fname, calibrationFilterInfo &fInfo)
   {
-    // See if the file exists - bomb if not!
-    if (gSystem->AccessPathName(fname.c_str(), kFileExists)) {
+    try {
+      // A binary file is read as is. A text file comes from its binary cache if that is
+      // up to date, otherwise it is parsed and the cache written.
+      CalibrationInfo calib;
+      if (IsBinaryCalibrationFile(fname)) {
+        calib = ReadBinaryFile(fname);
+        FilterAnalyses(calib, fInfo);
+      }
+      else if (!LoadBinaryCache(fname, fInfo, calib)) {
+        calib = ParseFile(fname, fInfo);
+        StoreBinaryCache(fname, fInfo, calib);
+      }
+      return calib;
+    }
+    catch (exception &e) {
       ostringstream msg;
-      msg << "Unable to operating points file find file '" << fname << "'.";
+      msg << "Caught error parsing file '" << fname << "': " << e.what();
       throw runtime_error(msg.str().c_str());
     }
+  }
+
+  // Load operating points from a list of files. The files are read in parallel, and then added
+  // to the list in order - so the result is the same as reading them one after the other. If
+  // more than one file has a problem, the error for the first is the one reported.
+  void loadOPsFromFiles(CalibrationInfo &list, const vector<string> &fnames, calibrationFilterInfo &fInfo)
+  {
+    vector<CalibrationInfo> calibs (fnames.size());
+    vector<string> errors (fnames.size());
+    vector<function<void (void)> > jobs;
+    for (size_t i = 0; i < fnames.size(); i++) {
+      // See if the file exists - bomb if not!
+      if (gSystem->AccessPathName(fnames[i].c_str(), kFileExists)) {
+        ostringstream msg;
+        msg << "Unable to operating points file find file '" << fnames[i] << "'.";
+        errors[i] = msg.str();
+        continue;
+      }
+
+      jobs.push_back([i, &fnames, &fInfo, &calibs, &errors] () {
+          try {
+            calibs[i] = readOPsFile(fnames[i], fInfo);
+          }
+          catch (exception &e) {
+            errors[i] = e.what();
+          }
+        });
+    }
+    RunInParallel(jobs);
 
-    // Load it up!
-    try {
-      ifstream input(fname.c_str());
-      CalibrationInfo calib = Parse(input, fInfo);
-      input.close();
-      Combine(list.Analyses, calib.Analyses);
+    AnalysisCatalog catalog (list.Analyses);
+    for (size_t i = 0; i < fnames.size(); i++) {
+      if (errors[i].size() > 0)
+        throw runtime_error(errors[i]);
+
+      const CalibrationInfo &calib(calibs[i]);
+      Combine(list.Analyses, catalog, calib.Analyses);
       list.Correlations.insert(list.Correlations.end(), calib.Correlations.begin(), calib.Correlations.end());
       list.Defaults.insert(list.Defaults.begin(), calib.Defaults.begin(), calib.Defaults.end());
       list.Aliases.insert(list.Aliases.begin(), calib.Aliases.begin(), calib.Aliases.end());
     }
-    catch (exception &e) {
-      ostringstream msg;
-      msg << "Caught error parsing file '" << fname << "': " << e.what();
-      throw runtime_error(msg.str().c_str());
-    }
   }
 
   // The file contains a list of items to ignore, one per line.
@@ -165,25 +203,26 @@ namespace BTagCombination {
   // Clean out the incoming analysis according to spec.
   void FilterAnalyses(CalibrationInfo &operatingPoints, const calibrationFilterInfo &fInfo)
   {
-    for (map<string, boost::regex*>::const_iterator itr = fInfo.OPsToIgnore.begin(); itr != fInfo.OPsToIgnore.end(); itr++) {
+    if (fInfo.OPsToIgnore.size() > 0) {
+      shared_ptr<const IgnorePatternMatcher> ignore(GetIgnoreMatcher(fInfo));
+
+      // The name part of the key is the same for every bin, so build it once.
       vector<CalibrationAnalysis> &ops(operatingPoints.Analyses);
-      for (unsigned int op = 0; op < ops.size(); op++) {
-        for (unsigned int b = 0; b < ops[op].bins.size(); b++) {
-          if (regex_match(OPIgnoreFormat(ops[op], ops[op].bins[b]), *(itr->second))) {
-            ops[op].bins.erase(ops[op].bins.begin() + b);
-            b = b - 1;
-          }
-        }
+      for (size_t op = 0; op < ops.size(); op++) {
+        vector<CalibrationBin> &bins(ops[op].bins);
+        const string prefix(OPFullName(ops[op]) + ":");
+        bins.erase(remove_if(bins.begin(), bins.end(),
+                             [&](const CalibrationBin &b) { return ignore->Matches(prefix + OPBinName(b)); }),
+                   bins.end());
       }
 
       vector<AnalysisCorrelation> &cors(operatingPoints.Correlations);
-      for (unsigned int ic = 0; ic < cors.size(); ic++) {
-        for (unsigned int b = 0; b < cors[ic].bins.size(); b++) {
-          if (regex_match(OPIgnoreFormat(cors[ic], cors[ic].bins[b]), *(itr->second))) {
-            cors[ic].bins.erase(cors[ic].bins.begin() + b);
-            b = b - 1;
-          }
-        }
+      for (size_t ic = 0; ic < cors.size(); ic++) {
+        vector<BinCorrelation> &bins(cors[ic].bins);
+        const string prefix(OPFullName(cors[ic]) + ":");
+        bins.erase(remove_if(bins.begin(), bins.end(),
+                             [&](const BinCorrelation &b) { return ignore->Matches(prefix + OPBinName(b)); }),
+                   bins.end());
       }
     }
 
@@ -192,26 +231,62 @@ namespace BTagCombination {
     // as a wild-card. Otherwise, demand an exact match.
     //
 
-    for (size_t op = operatingPoints.Analyses.size(); op > size_t(0); op--) {
-      if (!CheckInList(fInfo.spOnlyFlavor, operatingPoints.Analyses[op - 1].flavor)
-        || !CheckInList(fInfo.spOnlyAnalysis, operatingPoints.Analyses[op - 1].name)
-        || !CheckInList(fInfo.spOnlyTagger, operatingPoints.Analyses[op - 1].tagger)
-        || !CheckInList(fInfo.spOnlyOP, operatingPoints.Analyses[op - 1].operatingPoint)
-        || !CheckInList(fInfo.spOnlyJetAlgorithm, operatingPoints.Analyses[op - 1].jetAlgorithm)) {
-        operatingPoints.Analyses.erase(operatingPoints.Analyses.begin() + (op - 1));
-      }
-    }
+    vector<CalibrationAnalysis> &anas(operatingPoints.Analyses);
+    anas.erase(remove_if(anas.begin(), anas.end(),
+                         [&](const CalibrationAnalysis &a) { return !AnalysisPassesFilter(a, fInfo); }),
+               anas.end());
 
-    for (size_t op = operatingPoints.Correlations.size(); op > size_t(0); op--) {
-      if (!CheckInList(fInfo.spOnlyFlavor, operatingPoints.Correlations[op - 1].flavor)
-        || !CheckInList(fInfo.spOnlyTagger, operatingPoints.Correlations[op - 1].tagger)
-        || !CheckInList(fInfo.spOnlyAnalysis, operatingPoints.Correlations[op - 1].analysis1Name)
-        || !CheckInList(fInfo.spOnlyAnalysis, operatingPoints.Correlations[op - 1].analysis2Name)
-        || !CheckInList(fInfo.spOnlyOP, operatingPoints.Correlations[op - 1].operatingPoint)
-        || !CheckInList(fInfo.spOnlyJetAlgorithm, operatingPoints.Correlations[op - 1].jetAlgorithm)) {
-        operatingPoints.Correlations.erase(operatingPoints.Correlations.begin() + (op - 1));
-      }
-    }
+    vector<AnalysisCorrelation> &cors(operatingPoints.Correlations);
+    cors.erase(remove_if(cors.begin(), cors.end(),
+                         [&](const AnalysisCorrelation &c) { return !CorrelationPassesFilter(c, fInfo); }),
+               cors.end());
+  }
+
+  // True if the analysis passes all the "only" lists.
+  bool AnalysisPassesFilter(const CalibrationAnalysis &ana, const calibrationFilterInfo &fInfo)
+  {
+    return CheckInList(fInfo.spOnlyFlavor, ana.flavor)
+      && CheckInList(fInfo.spOnlyAnalysis, ana.name)
+      && CheckInList(fInfo.spOnlyTagger, ana.tagger)
+      && CheckInList(fInfo.spOnlyOP, ana.operatingPoint)
+      && CheckInList(fInfo.spOnlyJetAlgorithm, ana.jetAlgorithm);
+  }
+
+  // True if the correlation passes all the "only" lists (both analyses must be allowed).
+  bool CorrelationPassesFilter(const AnalysisCorrelation &cor, const calibrationFilterInfo &fInfo)
+  {
+    return CheckInList(fInfo.spOnlyFlavor, cor.flavor)
+      && CheckInList(fInfo.spOnlyTagger, cor.tagger)
+      && CheckInList(fInfo.spOnlyAnalysis, cor.analysis1Name)
+      && CheckInList(fInfo.spOnlyAnalysis, cor.analysis2Name)
+      && CheckInList(fInfo.spOnlyOP, cor.operatingPoint)
+      && CheckInList(fInfo.spOnlyJetAlgorithm, cor.jetAlgorithm);
+  }
+
+  // True if the bin matches one of the --ignore patterns.
+  bool BinIgnored(const CalibrationAnalysis &ana, const CalibrationBin &bin, const calibrationFilterInfo &fInfo)
+  {
+    if (fInfo.OPsToIgnore.size() == 0)
+      return false;
+    return GetIgnoreMatcher(fInfo)->Matches(OPIgnoreFormat(ana, bin));
+  }
+
+  bool BinIgnored(const AnalysisCorrelation &cor, const BinCorrelation &bin, const calibrationFilterInfo &fInfo)
+  {
+    if (fInfo.OPsToIgnore.size() == 0)
+      return false;
+    return GetIgnoreMatcher(fInfo)->Matches(OPIgnoreFormat(cor, bin));
+  }
+
+  // Patterns are only ever added to OPsToIgnore, so a matcher with as many patterns as there are
+  // now is up to date.
+  shared_ptr<const IgnorePatternMatcher> GetIgnoreMatcher(const calibrationFilterInfo &fInfo)
+  {
+    static mutex lock;
+    lock_guard<mutex> guard(lock);
+    if (!fInfo.ignoreMatcher || fInfo.ignoreMatcher->size() != fInfo.OPsToIgnore.size())
+      fInfo.ignoreMatcher.reset(new IgnorePatternMatcher(fInfo.OPsToIgnore));
+    return fInfo.ignoreMatcher;
   }
 
   //
@@ -324,6 +399,12 @@ namespace BTagCombination {
           else if (flag == "profile") {
             operatingPoints.BinByBin = false;
           }
+          else if (flag == "spiritParser") {
+            SetParserBackend(kSpiritParser);
+          }
+          else if (flag == "noParseCache") {
+            SetBinaryCacheEnabled(false);
+          }
           else {
             unknownFlags.push_back(flag);
           }
@@ -339,9 +420,7 @@ namespace BTagCombination {
     // Now that we have a complete profile of everything, load in the files.
     //
 
-    for (size_t i = 0; i < filesToLoad.size(); i++) {
-      loadOPsFromFile(operatingPoints, filesToLoad[i], fInfo);
-    }
+    loadOPsFromFiles(operatingPoints, filesToLoad, fInfo);
 
     //
     // Remove any systematic errors we've been asked to.
@@ -398,17 +477,15 @@ namespace BTagCombination {
     // we want to eliminate them.
     //
 
-    for (size_t op = operatingPoints.Analyses.size(); op > size_t(0); op--) {
-      if (operatingPoints.Analyses[op - 1].bins.size() == 0) {
-        operatingPoints.Analyses.erase(operatingPoints.Analyses.begin() + (op - 1));
-      }
-    }
+    vector<CalibrationAnalysis> &anas(operatingPoints.Analyses);
+    anas.erase(remove_if(anas.begin(), anas.end(),
+                         [](const CalibrationAnalysis &a) { return a.bins.size() == 0; }),
+               anas.end());
 
-    for (size_t cr = operatingPoints.Correlations.size(); cr > size_t(0); cr--) {
-      if (operatingPoints.Correlations[cr - 1].bins.size() == 0) {
-        operatingPoints.Correlations.erase(operatingPoints.Correlations.begin() + (cr - 1));
-      }
-    }
+    vector<AnalysisCorrelation> &cors(operatingPoints.Correlations);
+    cors.erase(remove_if(cors.begin(), cors.end(),
+                         [](const AnalysisCorrelation &c) { return c.bins.size() == 0; }),
+               cors.end());
   }
 
   //
@@ -417,37 +494,103 @@ namespace BTagCombination {
   //
   map<string, vector<CalibrationAnalysis> > BinAnalysesByJetTagFlavOp(const vector<CalibrationAnalysis> &anas)
   {
+    AnalysisCatalog catalog (anas);
+    const map<string, vector<size_t> > &groups(catalog.Groups(kByJetTagFlavOp));
+
     map<string, vector<CalibrationAnalysis> > result;
+    for (map<string, vector<size_t> >::const_iterator itr = groups.begin(); itr != groups.end(); itr++) {
+      vector<CalibrationAnalysis> &group(result[itr->first]);
+      group.reserve(itr->second.size());
+      for (size_t i = 0; i < itr->second.size(); i++)
+        group.push_back(anas[itr->second[i]]);
+    }
+    return result;
+  }
+
+  //
+  // Stable hash of the group name (64 bit FNV-1a) so sharding is the same everywhere.
+  //
+  unsigned int ShardForGroup(const string &groupName, unsigned int nShards)
+  {
+    if (nShards == 0)
+      throw runtime_error("Number of shards must be at least one");
+
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < groupName.size(); i++) {
+      h ^= (unsigned char) groupName[i];
+      h *= 1099511628211ULL;
+    }
+    return (unsigned int) (h % nShards);
+  }
+
+  //
+  // Pick out just the analyses that belong in a single shard.
+  //
+  vector<CalibrationAnalysis> AnalysesInShard(const vector<CalibrationAnalysis> &anas, unsigned int shard, unsigned int nShards)
+  {
+    if (shard >= nShards) {
+      ostringstream msg;
+      msg << "Shard " << shard << " does not exist - there are only " << nShards << " shards (numbered from zero)";
+      throw runtime_error(msg.str());
+    }
+
+    vector<CalibrationAnalysis> result;
     for (size_t i = 0; i < anas.size(); i++) {
-      result[OPIndependentName(anas[i])].push_back(anas[i]);
+      if (ShardForGroup(OPIndependentName(anas[i]), nShards) == shard)
+        result.push_back(anas[i]);
     }
     return result;
   }
 
+  //
+  // Only digits - atoi would quietly turn anything else into 0 (all the cores).
+  //
+  bool ParseThreadCount(const string &text, unsigned int &nThreads)
+  {
+    if (text.size() == 0 || text.find_first_not_of("0123456789") != string::npos)
+      return false;
+
+    istringstream in(text);
+    unsigned long n = 0;
+    in >> n;
+    if (in.fail() || n > numeric_limits<unsigned int>::max())
+      return false;
+    nThreads = (unsigned int) n;
+    return true;
+  }
+
   //
   // Given two analyses with the same name, combine their bins.
   vector<CalibrationAnalysis> CombineSameAnalyses(const vector<CalibrationAnalysis> &anas)
   {
     // Combine when they are the same.
-    map<string, CalibrationAnalysis> combinedAnalyses;
+    vector<CalibrationAnalysis> combinedAnalyses;
+    AnalysisCatalog catalog (combinedAnalyses);
     for (vector<CalibrationAnalysis>::const_iterator itr(anas.begin()); itr != anas.end(); itr++) {
-      string anaName(OPFullName(*itr));
-      map<string, CalibrationAnalysis>::const_iterator f = combinedAnalyses.find(anaName);
-      if (f == combinedAnalyses.end()) {
-        combinedAnalyses[anaName] = *itr;
+      size_t found = catalog.Find(*itr);
+      if (found == AnalysisCatalog::npos) {
+        combinedAnalyses.push_back(*itr);
+        catalog.Update();
       }
       else {
-        combinedAnalyses[anaName].bins.insert(combinedAnalyses[anaName].bins.end(), itr->bins.begin(), itr->bins.end());
+        combinedAnalyses[found].bins.insert(combinedAnalyses[found].bins.end(), itr->bins.begin(), itr->bins.end());
       }
     }
 
-    // Change the map back into a list. For each one make sure we can calculate a reasonable set of binning boundaries.
+    // They come back sorted by name. For each one make sure we can calculate a reasonable set of binning boundaries.
     // Only return bins that have at least one bin in them (e.g. aren't empty!).
+    vector<pair<string, size_t> > order;
+    for (size_t i = 0; i < combinedAnalyses.size(); i++)
+      order.push_back(make_pair(OPFullName(combinedAnalyses[i]), i));
+    sort(order.begin(), order.end());
+
     vector<CalibrationAnalysis> result;
-    for (map<string, CalibrationAnalysis>::const_iterator itr(combinedAnalyses.begin()); itr != combinedAnalyses.end(); itr++) {
-      if (itr->second.bins.size() > 0) {
-        bin_boundaries temp(calcBoundaries(itr->second, false));
-        result.push_back(itr->second);
+    for (size_t i = 0; i < order.size(); i++) {
+      CalibrationAnalysis &ana(combinedAnalyses[order[i].second]);
+      if (ana.bins.size() > 0) {
+        bin_boundaries temp(calcBoundaries(ana, false));
+        result.push_back(CalibrationAnalysis());
+        swap(result.back(), ana);
       }
     }
 
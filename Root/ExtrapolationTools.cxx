@@ -6,10 +6,13 @@
 #include "Combination/BinNameUtils.h"
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/FitLinage.h"
+#include "Combination/BinKey.h"
 
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -30,27 +33,22 @@ namespace {
     return b;
   }
 
-  // Helper function to return bin coordinates minus a particular axis cordinate.
-  set<CalibrationBinBoundary> boundary_set_without(const string &axis, const vector<CalibrationBinBoundary> &coords) {
-    set<CalibrationBinBoundary> r;
-    for (vector<CalibrationBinBoundary>::const_iterator itr = coords.begin(); itr != coords.end(); itr++) {
-      if (itr->variable != axis)
-        r.insert(*itr);
+  // Helper function that will catalog the bins by coordinates other than the axis
+  unordered_map<BinKey, CalibrationBin, BinKeyHash> bin_dict(const string &axis, const vector<CalibrationBin> &bins)
+  {
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> r;
+    for (vector<CalibrationBin>::const_iterator itr = bins.begin(); itr != bins.end(); itr++) {
+      r[BinKey::Without(axis, itr->binSpec)] = *itr;
     }
     return r;
   }
 
-  // Helper function to return bin coordinates
-  set<CalibrationBinBoundary> boundary_set(const vector<CalibrationBinBoundary> &coords) {
-    return set<CalibrationBinBoundary>(coords.begin(), coords.end());
-  }
-
-  // Helper function that will catalog the bins by coordinates other than the axis
-  map<set<CalibrationBinBoundary>, CalibrationBin> bin_dict(const string &axis, const vector<CalibrationBin> &bins)
+  // All the bins in an analysis.
+  unordered_set<BinKey, BinKeyHash> analysis_bin_keys(const CalibrationAnalysis &ana)
   {
-    map<set<CalibrationBinBoundary>, CalibrationBin> r;
-    for (vector<CalibrationBin>::const_iterator itr = bins.begin(); itr != bins.end(); itr++) {
-      r[boundary_set_without(axis, itr->binSpec)] = *itr;
+    unordered_set<BinKey, BinKeyHash> r;
+    for (vector<CalibrationBin>::const_iterator itr = ana.bins.begin(); itr != ana.bins.end(); itr++) {
+      r.insert(BinKey(*itr));
     }
     return r;
   }
@@ -184,15 +182,15 @@ namespace BTagCombination {
     auto ext_bins_ledge(find_bins_with_low_edge(extrapolated_axis, lowedge, extrapolated.bins));
 
     // Cache the systematic errors for the reference extrapolation bin.
-    map<set<CalibrationBinBoundary>, CalibrationBin> ana_bin_info(bin_dict(extrapolated_axis, ana_bins_ledge));
-    map<set<CalibrationBinBoundary>, CalibrationBin> ext_bin_info(bin_dict(extrapolated_axis, ext_bins_ledge));
-    map<set<CalibrationBinBoundary>, vector<SystematicError>> ext_sys;
-    map<set<CalibrationBinBoundary>, CalibrationBin> ana_bin_cache;
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ana_bin_info(bin_dict(extrapolated_axis, ana_bins_ledge));
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ext_bin_info(bin_dict(extrapolated_axis, ext_bins_ledge));
+    unordered_map<BinKey, vector<SystematicError>, BinKeyHash> ext_sys;
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ana_bin_cache;
     for (auto a_itr = ana_bin_info.begin(); a_itr != ana_bin_info.end(); a_itr++) {
       auto e_itr = ext_bin_info.find(a_itr->first);
       if (e_itr == ext_bin_info.end()) {
         ostringstream err;
-        err << "Unable to find a bin that matches " << OPBinName(a_itr->first) << " in the extrapolation.";
+        err << "Unable to find a bin that matches " << a_itr->first.Name() << " in the extrapolation.";
         throw runtime_error(err.str());
       }
 
@@ -208,11 +206,11 @@ namespace BTagCombination {
 
     CalibrationAnalysis r(ana);
 
-    set<set<CalibrationBinBoundary> > all_analysis_bin_boundaries(listAnalysisBins(ana));
+    unordered_set<BinKey, BinKeyHash> all_analysis_bin_boundaries(analysis_bin_keys(ana));
     for (auto e_itr = extrapolated.bins.begin(); e_itr != extrapolated.bins.end(); e_itr++) {
-      set<CalibrationBinBoundary> all_bounds(boundary_set(e_itr->binSpec));
+      BinKey all_bounds(*e_itr);
       if (all_analysis_bin_boundaries.find(all_bounds) == all_analysis_bin_boundaries.end()) {
-        set<CalibrationBinBoundary> bounds(boundary_set_without(extrapolated_axis, e_itr->binSpec));
+        BinKey bounds(BinKey::Without(extrapolated_axis, e_itr->binSpec));
         if (ext_sys.find(bounds) != ext_sys.end()) {
 
           // Make sure that extrapolated bin is reasonable (this is a dataquality test
@@ -254,16 +252,16 @@ namespace BTagCombination {
     vector<CalibrationBin> ana_bins_ledge(find_bins_with_low_edge(extrapolated_axis, lowedge, ana.bins));
     vector<CalibrationBin> ext_bins_ledge(find_bins_with_low_edge(extrapolated_axis, lowedge, extrapolated.bins));
 
-    map<set<CalibrationBinBoundary>, CalibrationBin> ana_bin_info(bin_dict(extrapolated_axis, ana_bins_ledge));
-    map<set<CalibrationBinBoundary>, CalibrationBin> ext_bin_info(bin_dict(extrapolated_axis, ext_bins_ledge));
-    map<set<CalibrationBinBoundary>, double> ana_sys;
-    map<set<CalibrationBinBoundary>, double> ext_sys;
-    map<set<CalibrationBinBoundary>, CalibrationBin> ana_bin_cache;
-    for (map<set<CalibrationBinBoundary>, CalibrationBin>::const_iterator a_itr = ana_bin_info.begin(); a_itr != ana_bin_info.end(); a_itr++) {
-      map<set<CalibrationBinBoundary>, CalibrationBin>::const_iterator e_itr = ext_bin_info.find(a_itr->first);
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ana_bin_info(bin_dict(extrapolated_axis, ana_bins_ledge));
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ext_bin_info(bin_dict(extrapolated_axis, ext_bins_ledge));
+    unordered_map<BinKey, double, BinKeyHash> ana_sys;
+    unordered_map<BinKey, double, BinKeyHash> ext_sys;
+    unordered_map<BinKey, CalibrationBin, BinKeyHash> ana_bin_cache;
+    for (unordered_map<BinKey, CalibrationBin, BinKeyHash>::const_iterator a_itr = ana_bin_info.begin(); a_itr != ana_bin_info.end(); a_itr++) {
+      unordered_map<BinKey, CalibrationBin, BinKeyHash>::const_iterator e_itr = ext_bin_info.find(a_itr->first);
       if (e_itr == ext_bin_info.end()) {
         ostringstream err;
-        err << "Unable to find a bin that matches " << OPBinName(a_itr->first) << " in the extrapolation.";
+        err << "Unable to find a bin that matches " << a_itr->first.Name() << " in the extrapolation.";
         throw runtime_error(err.str());
       }
 
@@ -280,11 +278,11 @@ namespace BTagCombination {
 
     CalibrationAnalysis r(ana);
 
-    set<set<CalibrationBinBoundary> > all_analysis_bin_boundaries(listAnalysisBins(ana));
+    unordered_set<BinKey, BinKeyHash> all_analysis_bin_boundaries(analysis_bin_keys(ana));
     for (vector<CalibrationBin>::const_iterator e_itr = extrapolated.bins.begin(); e_itr != extrapolated.bins.end(); e_itr++) {
-      set<CalibrationBinBoundary> all_bounds(boundary_set(e_itr->binSpec));
+      BinKey all_bounds(*e_itr);
       if (all_analysis_bin_boundaries.find(all_bounds) == all_analysis_bin_boundaries.end()) {
-        set<CalibrationBinBoundary> bounds(boundary_set_without(extrapolated_axis, e_itr->binSpec));
+        BinKey bounds(BinKey::Without(extrapolated_axis, e_itr->binSpec));
         if (ana_sys.find(bounds) != ana_sys.end()) {
           double ext_sys_current = bin_sys(*e_itr);
           double ext_sys_base = ext_sys[bounds];
@@ -0,0 +1,839 @@
+//
+// FastParser.cxx
+//
+//  A hand-written tokenizer and recursive-descent parser for the calibration text format.
+// It accepts exactly the grammar of the Spirit parser in Parser.cxx, which is kept around
+// as the reference. This one works in place on a buffer (normally a memory-mapped file): there
+// is no copy of the text, and no grammar to build on each call.
+//
+//  Items are handed out (ParseStream) as soon as their block closes, with the filter already
+// applied, so anything filtered out is never stored.
+//
+//  If you change the grammar, change it in both places! The parser tests run a pile of
+// input through both and check they come out the same.
+//
+//  The Spirit rules are quoted above the method that implements each. Two details that
+// matter for getting the same answer:
+//  - Everything not inside a lexeme[] skips leading white space.
+//  - Once a keyword has been seen ("Analysis", "bin", ...) any failure is a parse error. The
+//    only soft failure in the grammar is "sys(", and its failure also ends in a parse error.
+//
+
+#include "Combination/Parser.h"
+#include "Combination/CommonCommandLineUtils.h"
+#include "Combination/MappedFile.h"
+#include "Combination/IgnorePatternMatcher.h"
+#include "Combination/BinNameUtils.h"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <memory>
+#include <limits>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+using namespace BTagCombination;
+
+// Older versions of VC don't have NaN quite the same way as the standard.
+#ifdef _MSC_VER
+#if (_MSC_VER <= 1800)
+namespace std {
+  inline double isnan(double a) {
+    return _isnan(a);
+  }
+  inline double isinf(double a) {
+    return !_finite(a) && !_isnan(a);
+  }
+}
+#endif
+#endif
+
+namespace {
+
+  //
+  // A set of characters, given by the same sort of definition string a Spirit char_("a-z") uses.
+  //
+  class CharSet
+  {
+  public:
+    CharSet (const char *definition)
+    {
+      memset(_in, 0, sizeof(_in));
+      unsigned char ch = *definition++;
+      while (ch) {
+	unsigned char next = *definition++;
+	if (next == '-') {
+	  next = *definition++;
+	  if (next == 0) {
+	    _in[ch] = true;
+	    _in[(unsigned char)'-'] = true;
+	    break;
+	  }
+	  for (unsigned int c = ch; c <= next; c++)
+	    _in[c] = true;
+	} else {
+	  _in[ch] = true;
+	}
+	ch = next;
+      }
+    }
+
+    inline bool operator() (char c) const { return _in[(unsigned char)c]; }
+
+  private:
+    bool _in[256];
+  };
+
+  // The name string character sets from Parser.cxx. The "P" version allows parens (for meta data names).
+  const CharSet gNameChars ("-_a-zA-Z0-9+:\\;.*/!=<>][");
+  const CharSet gQuotedNameChars ("-_a-zA-Z0-9+:\\;.*/!=<>][, ");
+  const CharSet gNameCharsP ("-_a-zA-Z0-9+;:.*/!=][)(");
+  const CharSet gQuotedNameCharsP ("-_a-zA-Z0-9+;:.*/!=][)(, ");
+
+  // 10^i as the nearest double (what the literal 1e<i> is), as Spirit scales numbers with.
+  class Pow10Table
+  {
+  public:
+    Pow10Table()
+    {
+      for (int i = 0; i <= numeric_limits<double>::max_exponent10; i++) {
+	ostringstream text;
+	text << "1e" << i;
+	_values.push_back(strtod(text.str().c_str(), 0));
+      }
+    }
+    inline double operator[] (int i) const { return _values[i]; }
+  private:
+    vector<double> _values;
+  };
+  const Pow10Table gPow10;
+
+  // The ascii::space skipper
+  inline bool IsSpace (char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+  }
+  inline bool IsDigit (char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+  inline bool IsAlpha (char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  }
+
+  // A systematic error or central value error before we know what it is relative to.
+  struct ErrorValue
+  {
+    double error;
+    bool relative;
+  };
+
+  //
+  // The parser. Walks a pointer through the buffer, and hands each item to a callback
+  // as soon as it is done (and has passed the filter).
+  //
+  class CalibrationTextParser
+  {
+  public:
+    CalibrationTextParser (const char *begin, const char *end, bool skipCommentLines,
+			   const calibrationFilterInfo &fInfo, const CalibrationInfoCallbacks &callbacks)
+      : _p(begin), _end(end), _skipCommentLines(skipCommentLines), _fInfo(fInfo), _callbacks(callbacks)
+    {
+      if (_fInfo.OPsToIgnore.size() > 0)
+	_ignore = GetIgnoreMatcher(_fInfo);
+      if (_skipCommentLines)
+	SkipCommentLines();
+    }
+
+    //
+    // anaParser > eoi, where
+    //   anaParser = *(Analysis | Correlation | Default | Copy)
+    //
+    void ParseAll()
+    {
+      while (true) {
+	if (Keyword("Analysis")) {
+	  ParseAnalysis();
+	} else if (Keyword("Correlation")) {
+	  ParseCorrelation();
+	} else if (Keyword("Default")) {
+	  ParseDefault();
+	} else if (Keyword("Copy")) {
+	  ParseCopy();
+	} else {
+	  break;
+	}
+      }
+
+      SkipSpace();
+      if (_p != _end)
+	Fail("end of input");
+    }
+
+  private:
+    const char *_p;
+    const char *_end;
+    bool _skipCommentLines;
+    const calibrationFilterInfo &_fInfo;
+    const CalibrationInfoCallbacks &_callbacks;
+    shared_ptr<const IgnorePatternMatcher> _ignore;	// Null if nothing is ignored
+
+    //
+    // Character level. The only way across a new line is Advance, so that is where we drop comment
+    // lines (this is what the line-by-line copy in Parse(istream) did before).
+    //
+
+    inline void Advance()
+    {
+      _p++;
+      if (_skipCommentLines && _p[-1] == '\n')
+	SkipCommentLines();
+    }
+
+    void SkipCommentLines()
+    {
+      while (_p != _end && *_p == '#') {
+	while (_p != _end && *_p != '\n')
+	  _p++;
+	if (_p != _end)
+	  _p++;
+      }
+    }
+
+    inline void SkipSpace()
+    {
+      while (_p != _end && IsSpace(*_p))
+	Advance();
+    }
+
+    // lit("word") - no new lines in any of these, so no need to Advance one at a time.
+    bool Keyword (const char *word)
+    {
+      SkipSpace();
+      size_t len = strlen(word);
+      if ((size_t)(_end - _p) < len || strncmp(_p, word, len) != 0)
+	return false;
+      _p += len;
+      return true;
+    }
+
+    bool Char (char c)
+    {
+      SkipSpace();
+      if (_p == _end || *_p != c)
+	return false;
+      Advance();
+      return true;
+    }
+
+    void Expect (char c)
+    {
+      if (!Char(c)) {
+	string what ("\"");
+	what += c;
+	what += "\"";
+	Fail(what);
+      }
+    }
+
+    // Same message and exception the Spirit parser's error handler gives.
+    void Fail (const string &what)
+    {
+      const char *eol = _p;
+      while (eol != _end && *eol != '\n')
+	eol++;
+      cout << "Error! Expecting " << what << " here: \"" << string(_p, eol) << "\"" << endl;
+      throw runtime_error ("Unable to parse!");
+    }
+
+    //
+    // double_ - the Spirit real parser: [+-] digits [. digits] [(e|E) [+-] digits], where
+    // one of the two digit strings can be missing, and the exponent is only taken if it has
+    // digits. Also nan, nan(...), inf, and infinity in any case.
+    //
+    //  The value is built the way Spirit builds it, not with strtod: the digits are collected
+    // in a 64 bit integer, and then there is one multiply or divide by a power of ten. This
+    // isn't always the closest double (e.g. 1e-24), but it is what the reference parser gives.
+    //
+    bool MatchNoCase (const char *&p, const char *word)
+    {
+      const char *q = p;
+      for (; *word; word++, q++) {
+	if (q == _end || tolower((unsigned char)*q) != *word)
+	  return false;
+      }
+      p = q;
+      return true;
+    }
+
+    // Add a digit to the accumulator. False if it would overflow.
+    static inline bool AddDigit (unsigned long long &acc, char c)
+    {
+      unsigned long long digit = c - '0';
+      if (acc > (numeric_limits<unsigned long long>::max() - digit) / 10)
+	return false;
+      acc = acc*10 + digit;
+      return true;
+    }
+
+    bool Number (double &v)
+    {
+      SkipSpace();
+      const char *p = _p;
+
+      bool neg = false;
+      if (p != _end && (*p == '-' || *p == '+')) {
+	neg = *p == '-';
+	p++;
+      }
+
+      // The integer part. Only the first 17 digits (counting leading zeros) are kept, the
+      // rest just scale the number.
+      unsigned long long acc = 0;
+      int excessDigits = 0;
+      const char *digits = p;
+      while (p != _end && IsDigit(*p) && p - digits < 17) {
+	AddDigit(acc, *p);
+	p++;
+      }
+      bool gotNumber = p != digits;
+      while (p != _end && IsDigit(*p)) {
+	excessDigits++;
+	p++;
+      }
+
+      if (!gotNumber) {
+	if (MatchNoCase(p, "nan")) {
+	  if (p != _end && *p == '(') {
+	    const char *close = p;
+	    while (++close != _end && *close != ')')
+	      ;
+	    if (close == _end)
+	      return false;
+	    p = close + 1;
+	  }
+	  v = numeric_limits<double>::quiet_NaN();
+	  _p = p;
+	  return true;
+	}
+	if (MatchNoCase(p, "inf")) {
+	  MatchNoCase(p, "inity");
+	  v = neg ? -numeric_limits<double>::infinity() : numeric_limits<double>::infinity();
+	  _p = p;
+	  return true;
+	}
+      }
+
+      // The fraction. Digits past what the accumulator can hold are dropped.
+      int fracDigits = 0;
+      if (p != _end && *p == '.') {
+	p++;
+	const char *frac = p;
+	if (excessDigits == 0) {
+	  while (p != _end && IsDigit(*p) && AddDigit(acc, *p))
+	    p++;
+	  fracDigits = p - frac;
+	}
+	while (p != _end && IsDigit(*p))
+	  p++;
+	if (!gotNumber && p == frac)
+	  return false;
+      } else if (!gotNumber) {
+	return false;
+      }
+
+      // The exponent, if it has any digits (and fits in an int).
+      bool gotExponent = false, sawE = false;
+      int exponent = 0;
+      if (p != _end && (*p == 'e' || *p == 'E')) {
+	sawE = true;
+	const char *e = p + 1;
+	bool negExp = false;
+	if (e != _end && (*e == '-' || *e == '+')) {
+	  negExp = *e == '-';
+	  e++;
+	}
+	const char *expDigits = e;
+	long long exp = 0;
+	const long long maxExp = negExp ? -(long long) numeric_limits<int>::min() : numeric_limits<int>::max();
+	while (e != _end && IsDigit(*e)) {
+	  if (exp <= maxExp)
+	    exp = exp*10 + (*e - '0');
+	  e++;
+	}
+	if (e != expDigits && exp <= maxExp) {
+	  exponent = (int) (negExp ? -exp : exp);
+	  gotExponent = true;
+	  p = e;
+	}
+      }
+
+      double n = 0.0;
+      if (gotExponent) {
+	if (!Scale(exponent + excessDigits - fracDigits, acc, n))
+	  return false;
+      } else if (sawE || fracDigits != 0) {
+	// An "e" with no exponent loses any excess digits too - this is what Spirit does.
+	Scale(-fracDigits, acc, n);
+      } else if (excessDigits != 0) {
+	if (!Scale(excessDigits, acc, n))
+	  return false;
+      } else {
+	n = double(acc);
+      }
+
+      v = neg ? -n : n;
+      _p = p;
+      return true;
+    }
+
+    // acc * 10^exp, as spirit's traits::scale does it.
+    static bool Scale (int exp, unsigned long long acc, double &n)
+    {
+      if (exp >= 0) {
+	if (exp > numeric_limits<double>::max_exponent10)
+	  return false;
+	n = acc * gPow10[exp];
+      } else if (exp < numeric_limits<double>::min_exponent10) {
+	const int minExp = numeric_limits<double>::min_exponent10;
+	n = double((acc / 10) * 10);
+	n += double(acc % 10);
+	n /= gPow10[-minExp];
+	exp += -minExp;
+	if (exp < minExp)
+	  return false;
+	n /= gPow10[-exp];
+      } else {
+	n = double(acc) / gPow10[-exp];
+      }
+      return true;
+    }
+
+    void ExpectNumber (double &v)
+    {
+      if (!Number(v))
+	Fail("real number");
+    }
+
+    //
+    // name_string for most things (NameStringParser and NameStringParserP):
+    //   quoted %= '"' > lexeme[*char_(allChars + ", ")] > '"';
+    //   unquoted %= lexeme[+char_(allChars) >> *(hold[+char_(" ") >> +char_(allChars)])];
+    // Neither allows a new line, so we can work directly on the pointer.
+    //
+    bool NameString (const CharSet &chars, const CharSet &quotedChars, string &name)
+    {
+      SkipSpace();
+      if (_p == _end)
+	return false;
+
+      if (*_p == '"') {
+	Advance();
+	SkipSpace();
+	const char *start = _p;
+	while (_p != _end && quotedChars(*_p))
+	  _p++;
+	name.assign(start, _p);
+	Expect('"');
+	return true;
+      }
+
+      const char *start = _p;
+      const char *p = _p;
+      while (p != _end && chars(*p))
+	p++;
+      if (p == start)
+	return false;
+
+      while (true) {
+	const char *word = p;
+	while (word != _end && *word == ' ')
+	  word++;
+	if (word == p)
+	  break;
+	const char *wordEnd = word;
+	while (wordEnd != _end && chars(*wordEnd))
+	  wordEnd++;
+	if (wordEnd == word)
+	  break;
+	p = wordEnd;
+      }
+
+      name.assign(start, p);
+      _p = p;
+      return true;
+    }
+
+    string ExpectNameString (const CharSet &chars, const CharSet &quotedChars)
+    {
+      string name;
+      if (!NameString(chars, quotedChars, name))
+	Fail("Name String");
+      return name;
+    }
+
+    //
+    // name_string for the Correlation, Default, and Copy items:
+    //   lexeme[+(char_ - ',' - '"' - '}' - '{' - ')' - '(')]
+    // This can run across lines (and trailing spaces are kept).
+    //
+    string ExpectFieldName ()
+    {
+      SkipSpace();
+      string name;
+      while (_p != _end) {
+	char c = *_p;
+	if ((c & 0x80) || c == ',' || c == '"' || c == '}' || c == '{' || c == ')' || c == '(')
+	  break;
+	name += c;
+	Advance();
+      }
+      if (name.empty())
+	Fail("name");
+      return name;
+    }
+
+    // "(n1, n2, ..., nN)" of field names.
+    void FieldNames (string *names[], int n)
+    {
+      Expect('(');
+      for (int i = 0; i < n; i++) {
+	if (i > 0)
+	  Expect(',');
+	*names[i] = ExpectFieldName();
+      }
+      Expect(')');
+    }
+
+    //
+    // Bin boundary list: boundary % ',', where
+    //   boundary %= double_ >> '<' >> lexeme[+alpha] >> '<' >> double_
+    //
+    CalibrationBinBoundary Boundary ()
+    {
+      CalibrationBinBoundary b;
+      if (!Number(b.lowvalue))
+	Fail("Boundary");
+      Expect('<');
+      SkipSpace();
+      const char *start = _p;
+      while (_p != _end && IsAlpha(*_p))
+	_p++;
+      if (_p == start)
+	Fail("variable name");
+      b.variable.assign(start, _p);
+      Expect('<');
+      ExpectNumber(b.highvalue);
+      return b;
+    }
+
+    vector<CalibrationBinBoundary> BoundaryList ()
+    {
+      vector<CalibrationBinBoundary> result;
+      Expect('(');
+      result.push_back(Boundary());
+      while (Char(','))
+	result.push_back(Boundary());
+      Expect(')');
+      return result;
+    }
+
+    //
+    // error: double_ >> -lit("%")
+    //
+    ErrorValue Error ()
+    {
+      ErrorValue e;
+      ExpectNumber(e.error);
+      if (std::isnan(e.error))
+	throw runtime_error("error value is NaN during input - not legal!");
+      e.relative = Char('%');
+      return e;
+    }
+
+    //
+    // (bin | exbin) > '(' > boundary_list > ')' > '{' > *(sys | usys | central_value | meta_data) > '}'
+    //
+    CalibrationBin ParseBin (bool isExtended)
+    {
+      CalibrationBin result;
+      result.binSpec = BoundaryList();
+      result.isExtended = isExtended;
+      Expect('{');
+
+      struct localSysError {
+	string name;
+	ErrorValue value;
+	bool uncorrelated;
+      };
+      vector<localSysError> sysErrors;
+      vector<pair<string, pair<double, double> > > metaData;
+      int nCentralValues = 0;
+
+      while (true) {
+	bool isSys = Keyword("sys");
+	if (isSys || Keyword("usys")) {
+	  // sys(name, error)
+	  localSysError s;
+	  s.uncorrelated = !isSys;
+	  Expect('(');
+	  s.name = ExpectNameString(gNameChars, gQuotedNameChars);
+	  Expect(',');
+	  s.value = Error();
+	  Expect(')');
+	  sysErrors.push_back(s);
+	} else if (Keyword("central_value")) {
+	  // central_value(value, error)
+	  Expect('(');
+	  double v;
+	  ExpectNumber(v);
+	  if (std::isnan(v))
+	    throw runtime_error ("Unable to parse a central value for a bin that is NaN");
+	  Expect(',');
+	  ErrorValue e (Error());
+	  Expect(')');
+
+	  double error = e.error;
+	  if (e.relative)
+	    error = error / 100.0 * v;
+	  result.centralValue = v;
+	  result.centralValueStatisticalError = error;
+	  nCentralValues++;
+	} else if (Keyword("meta_data")) {
+	  // meta_data(name, value) or meta_data(name, value, error)
+	  Expect('(');
+	  string name (ExpectNameString(gNameCharsP, gQuotedNameCharsP));
+	  Expect(',');
+	  double value, error = 0.0;
+	  ExpectNumber(value);
+	  if (Char(','))
+	    ExpectNumber(error);
+	  Expect(')');
+	  metaData.push_back(make_pair(name, make_pair(value, error)));
+	} else {
+	  break;
+	}
+      }
+      Expect('}');
+
+      //
+      // Now that the whole bin is here, we can turn relative errors into absolute ones.
+      //
+
+      if (nCentralValues != 1)
+	throw std::runtime_error("One and only one central value must be present in each bin");
+
+      for (size_t i = 0; i < sysErrors.size(); i++) {
+	SystematicError e;
+	e.name = sysErrors[i].name;
+	e.value = sysErrors[i].value.error;
+	e.uncorrelated = sysErrors[i].uncorrelated;
+	if (sysErrors[i].value.relative)
+	  e.value *= result.centralValue / 100.0;
+	result.systematicErrors.push_back(e);
+      }
+
+      for (size_t i = 0; i < metaData.size(); i++)
+	result.metadata[metaData[i].first] = metaData[i].second;
+
+      return result;
+    }
+
+    //
+    // Analysis(name, flavor, tagger, op, jet) { *(bin | exbin | meta_data_s | meta_data) }
+    //
+    void ParseAnalysis ()
+    {
+      CalibrationAnalysis result;
+      Expect('(');
+      result.name = ExpectNameString(gNameChars, gQuotedNameChars);
+      Expect(',');
+      result.flavor = ExpectNameString(gNameChars, gQuotedNameChars);
+      Expect(',');
+      result.tagger = ExpectNameString(gNameChars, gQuotedNameChars);
+      Expect(',');
+      result.operatingPoint = ExpectNameString(gNameChars, gQuotedNameChars);
+      Expect(',');
+      result.jetAlgorithm = ExpectNameString(gNameChars, gQuotedNameChars);
+      Expect(')');
+      Expect('{');
+
+      // The "only" lists need just the names, so we know now if we will keep any of this. The
+      // bins still have to be parsed (and checked), but they don't need to be stored.
+      bool keep = AnalysisPassesFilter(result, _fInfo);
+
+      while (true) {
+	bool isBin = Keyword("bin");
+	if (isBin || Keyword("exbin")) {
+	  CalibrationBin bin (ParseBin(!isBin));
+	  if (keep && !(_ignore && _ignore->Matches(OPIgnoreFormat(result, bin))))
+	    result.bins.push_back(bin);
+	} else if (Keyword("meta_data_s")) {
+	  // meta_data_s(name, value)
+	  Expect('(');
+	  string name (ExpectNameString(gNameChars, gQuotedNameChars));
+	  Expect(',');
+	  result.metadata_s[name] = ExpectNameString(gNameChars, gQuotedNameChars);
+	  Expect(')');
+	} else if (Keyword("meta_data")) {
+	  // meta_data(name, v1, v2, ...)
+	  Expect('(');
+	  string name (ExpectNameString(gNameCharsP, gQuotedNameCharsP));
+	  vector<double> values;
+	  Expect(',');
+	  do {
+	    double v;
+	    ExpectNumber(v);
+	    values.push_back(v);
+	  } while (Char(','));
+	  Expect(')');
+	  result.metadata[name] = values;
+	} else {
+	  break;
+	}
+      }
+      Expect('}');
+
+      if (keep && _callbacks.Analysis)
+	_callbacks.Analysis(result);
+    }
+
+    //
+    // Correlation(ana1, ana2, flavor, tagger, op, jet) { *(bin(boundaries) { *statistical(rho) }) }
+    //
+    void ParseCorrelation ()
+    {
+      AnalysisCorrelation result;
+      string *names[] = {&result.analysis1Name, &result.analysis2Name, &result.flavor,
+			 &result.tagger, &result.operatingPoint, &result.jetAlgorithm};
+      FieldNames(names, 6);
+      Expect('{');
+      bool keep = CorrelationPassesFilter(result, _fInfo);
+
+      while (Keyword("bin")) {
+	BinCorrelation bin;
+	bin.binSpec = BoundaryList();
+	Expect('{');
+	while (Keyword("statistical")) {
+	  Expect('(');
+	  double v;
+	  ExpectNumber(v);
+	  if (fabs(v) > 1.0) {
+	    ostringstream err;
+	    err << "The statistical correlation coeff '" << v << "' is larger than one! Not allowed!";
+	    throw runtime_error (err.str().c_str());
+	  }
+	  bin.hasStatCorrelation = true;
+	  bin.statCorrelation = v;
+	  Expect(')');
+	}
+	Expect('}');
+	if (keep && !(_ignore && _ignore->Matches(OPIgnoreFormat(result, bin))))
+	  result.bins.push_back(bin);
+      }
+      Expect('}');
+
+      if (keep && _callbacks.Correlation)
+	_callbacks.Correlation(result);
+    }
+
+    //
+    // Default(name, flavor, tagger, op, jet)
+    //
+    void ParseDefault ()
+    {
+      DefaultAnalysis result;
+      string *names[] = {&result.name, &result.flavor, &result.tagger, &result.operatingPoint, &result.jetAlgorithm};
+      FieldNames(names, 5);
+      if (_callbacks.Default)
+	_callbacks.Default(result);
+    }
+
+    //
+    // Copy(name, flavor, tagger, op, jet) { *Analysis(name, flavor, tagger, op, jet) }
+    //
+    void ParseCopy ()
+    {
+      AliasAnalysis result;
+      string *names[] = {&result.name, &result.flavor, &result.tagger, &result.operatingPoint, &result.jetAlgorithm};
+      FieldNames(names, 5);
+      Expect('{');
+      while (Keyword("Analysis")) {
+	AliasAnalysisCopyTo c;
+	string *cnames[] = {&c.name, &c.flavor, &c.tagger, &c.operatingPoint, &c.jetAlgorithm};
+	FieldNames(cnames, 5);
+	result.CopyTargets.push_back(c);
+      }
+      Expect('}');
+      if (_callbacks.Alias)
+	_callbacks.Alias(result);
+    }
+  };
+}
+
+namespace BTagCombination
+{
+  //
+  // Parse a buffer, handing each item to the callbacks as we go.
+  //
+  void ParseStream(const char *begin, const char *end, const calibrationFilterInfo &fInfo,
+		   const CalibrationInfoCallbacks &callbacks, bool skipCommentLines)
+  {
+    CalibrationTextParser parser (begin, end, skipCommentLines, fInfo, callbacks);
+    parser.ParseAll();
+  }
+
+  void ParseFileStream(const string &fname, const calibrationFilterInfo &fInfo, const CalibrationInfoCallbacks &callbacks)
+  {
+    MappedFile file (fname);
+    ParseStream(file.begin(), file.end(), fInfo, callbacks, true);
+  }
+
+  //
+  // Parse a buffer with the hand-written parser. Everything that survives the filter
+  // is collected, and then split analyses are put back together.
+  //
+  CalibrationInfo ParseBuffer(const char *begin, const char *end, calibrationFilterInfo &fInfo, bool skipCommentLines)
+  {
+    CalibrationInfo result;
+    CalibrationInfoCallbacks collect;
+    collect.Analysis = [&result] (CalibrationAnalysis &a) { result.Analyses.push_back(std::move(a)); };
+    collect.Correlation = [&result] (AnalysisCorrelation &c) { result.Correlations.push_back(std::move(c)); };
+    collect.Default = [&result] (DefaultAnalysis &d) { result.Defaults.push_back(std::move(d)); };
+    collect.Alias = [&result] (AliasAnalysis &a) { result.Aliases.push_back(std::move(a)); };
+
+    ParseStream(begin, end, fInfo, collect, skipCommentLines);
+
+    result.Analyses = CombineSameAnalyses(result.Analyses);
+    return result;
+  }
+
+  //
+  // Parse a file on disk.
+  //
+  CalibrationInfo ParseFile(const string &fname, calibrationFilterInfo &fInfo)
+  {
+    if (GetParserBackend() == kSpiritParser) {
+      ifstream input (fname.c_str());
+      if (!input.is_open()) {
+	ostringstream msg;
+	msg << "Unable to open file '" << fname << "' for parsing.";
+	throw runtime_error(msg.str());
+      }
+      return Parse(input, fInfo);
+    }
+
+    MappedFile file (fname);
+    return ParseBuffer(file.begin(), file.end(), fInfo, true);
+  }
+}
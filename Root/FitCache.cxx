@@ -0,0 +1,195 @@
+//
+// FitCache - save combination results on disk by a hash of their inputs.
+//
+
+#include "Combination/FitCache.h"
+#include "Combination/Parser.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+
+#include <TSystem.h>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdio>
+#include <cctype>
+
+using namespace std;
+
+namespace {
+  using namespace BTagCombination;
+
+  // The version of the fitting code, as far as the cache is concerned. It is part of every key, so
+  // bumping it invalidates everything already in the cache. The build has no stamp to go by, so it
+  // is kept by hand: any commit that can change a fit result (the context, the minimizer sequence,
+  // Measurement, the chi2 or the correlation calculations, the BLUE fitter, ExtractBinResult, ...)
+  // must bump it in that same commit, and add a line here.
+  //   1 - first version
+  //   2 - minimizer sequence, low-rank chi2, interned systematics, blocked correlations
+  const char *cFitCacheVersion = "2";
+
+  // 64 bit FNV-1a. Fixed, so the same inputs give the same key everywhere.
+  unsigned long long StableHash (const string &s)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); i++) {
+      h ^= (unsigned char) s[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  // Write out every input field exactly - the normal text format rounds and uses relative errors,
+  // so two different inputs could look the same.
+  void WriteCanonical (ostream &out, const CalibrationBinBoundary &b)
+  {
+    out << "[" << b.variable << " " << b.lowvalue << " " << b.highvalue << "]";
+  }
+
+  void WriteCanonical (ostream &out, const CalibrationAnalysis &ana)
+  {
+    out << "A " << ana.name << "|" << ana.flavor << "|" << ana.tagger << "|" << ana.operatingPoint << "|" << ana.jetAlgorithm << "\n";
+    for (size_t i_b = 0; i_b < ana.bins.size(); i_b++) {
+      const CalibrationBin &b(ana.bins[i_b]);
+      out << " B ";
+      for (size_t i = 0; i < b.binSpec.size(); i++)
+	WriteCanonical(out, b.binSpec[i]);
+      out << " " << b.centralValue << " " << b.centralValueStatisticalError << " " << b.isExtended << "\n";
+      for (size_t i = 0; i < b.systematicErrors.size(); i++) {
+	out << "  S " << b.systematicErrors[i].name << " " << b.systematicErrors[i].value << " " << b.systematicErrors[i].uncorrelated << "\n";
+      }
+      for (map<string, pair<double, double> >::const_iterator itr = b.metadata.begin(); itr != b.metadata.end(); itr++) {
+	out << "  M " << itr->first << " " << itr->second.first << " " << itr->second.second << "\n";
+      }
+    }
+    for (map<string, vector<double> >::const_iterator itr = ana.metadata.begin(); itr != ana.metadata.end(); itr++) {
+      out << " M " << itr->first;
+      for (size_t i = 0; i < itr->second.size(); i++)
+	out << " " << itr->second[i];
+      out << "\n";
+    }
+    for (map<string, string>::const_iterator itr = ana.metadata_s.begin(); itr != ana.metadata_s.end(); itr++) {
+      out << " MS " << itr->first << " " << itr->second << "\n";
+    }
+  }
+
+  void WriteCanonical (ostream &out, const AnalysisCorrelation &cor)
+  {
+    out << "C " << cor.analysis1Name << "|" << cor.analysis2Name << "|" << OPIndependentName(cor) << "\n";
+    for (size_t i_b = 0; i_b < cor.bins.size(); i_b++) {
+      const BinCorrelation &b(cor.bins[i_b]);
+      out << " B ";
+      for (size_t i = 0; i < b.binSpec.size(); i++)
+	WriteCanonical(out, b.binSpec[i]);
+      out << " " << b.hasStatCorrelation << " " << b.statCorrelation << "\n";
+    }
+  }
+}
+
+namespace BTagCombination {
+
+  //
+  // Create the cache, and the directory it lives in.
+  //
+  FitCache::FitCache (const string &cacheDir)
+    : _cacheDir(cacheDir)
+  {
+    if (gSystem->AccessPathName(_cacheDir.c_str(), kFileExists)) {
+      if (gSystem->mkdir(_cacheDir.c_str(), true) != 0) {
+	ostringstream msg;
+	msg << "Unable to create the fit cache directory '" << _cacheDir << "'";
+	throw runtime_error(msg.str());
+      }
+    }
+  }
+
+  //
+  // Build the key for a group. Everything is written out in full precision and hashed.
+  //
+  string FitCache::Key (const vector<CalibrationAnalysis> &group,
+			const vector<AnalysisCorrelation> &correlations,
+			const string &fitMode) const
+  {
+    ostringstream canonical;
+    canonical << setprecision(17);
+    canonical << "V " << cFitCacheVersion << "\n"
+	      << "F " << fitMode << "\n";
+
+    string groupName;
+    for (size_t i = 0; i < group.size(); i++) {
+      WriteCanonical(canonical, group[i]);
+      groupName = OPIndependentName(group[i]);
+    }
+
+    // Only correlations in this group can change its fit.
+    for (size_t i = 0; i < correlations.size(); i++) {
+      if (OPIndependentName(correlations[i]) == groupName)
+	WriteCanonical(canonical, correlations[i]);
+    }
+
+    // Keep the group name readable in the file name, but only with safe characters.
+    for (size_t i = 0; i < groupName.size(); i++) {
+      if (!isalnum((unsigned char) groupName[i]) && groupName[i] != '.' && groupName[i] != '-' && groupName[i] != '_')
+	groupName[i] = '_';
+    }
+
+    ostringstream key;
+    key << groupName << "-" << hex << setw(16) << setfill('0') << StableHash(canonical.str());
+    return key.str();
+  }
+
+  //
+  // Load a result back from the cache.
+  //
+  bool FitCache::Lookup (const string &key, CalibrationAnalysis &result) const
+  {
+    string fname (FileName(key));
+    ifstream input (fname.c_str());
+    if (!input.is_open())
+      return false;
+
+    ostringstream text;
+    text << input.rdbuf();
+    CalibrationInfo info (Parse(text.str()));
+    if (info.Analyses.size() != 1) {
+      ostringstream msg;
+      msg << "Fit cache file '" << fname << "' is corrupt - remove it and rerun";
+      throw runtime_error(msg.str());
+    }
+    result = info.Analyses[0];
+    return true;
+  }
+
+  //
+  // Save a result. It is written to a temp file and renamed, so several jobs can share
+  // a cache directory.
+  //
+  void FitCache::Store (const string &key, const CalibrationAnalysis &result) const
+  {
+    string fname (FileName(key));
+    ostringstream tmpName;
+    tmpName << fname << ".tmp" << gSystem->GetPid();
+
+    ofstream out (tmpName.str().c_str());
+    if (!out.is_open()) {
+      ostringstream msg;
+      msg << "Unable to write fit cache file '" << tmpName.str() << "'";
+      throw runtime_error(msg.str());
+    }
+    out << setprecision(17) << result << endl;
+    out.close();
+
+    if (rename(tmpName.str().c_str(), fname.c_str()) != 0) {
+      ostringstream msg;
+      msg << "Unable to rename fit cache file '" << tmpName.str() << "' to '" << fname << "'";
+      throw runtime_error(msg.str());
+    }
+  }
+
+  string FitCache::FileName (const string &key) const
+  {
+    return _cacheDir + "/" + key + ".txt";
+  }
+}
@@ -0,0 +1,138 @@
+//
+// IgnorePatternMatcher - the --ignore patterns compiled into one matcher.
+//
+
+#include "Combination/IgnorePatternMatcher.h"
+
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+namespace {
+  // How many patterns go into one combined regex. Larger ones take longer to compile, and come
+  // closer to boost's limits on how much work a single match may do.
+  const size_t gPatternsPerRegex = 64;
+
+  // Wrapping a pattern in "(?:...)" and joining with "|" changes what it means if it refers to its
+  // own groups (by number or name), or quotes to the end of the pattern with \Q. Those stay alone.
+  bool CanCombine (const string &pattern)
+  {
+    for (size_t i = 0; i + 1 < pattern.size(); i++) {
+      char c = pattern[i];
+      char n = pattern[i+1];
+      if (c == '\\') {
+	if (isdigit(static_cast<unsigned char>(n)) || n == 'g' || n == 'k' || n == 'Q')
+	  return false;
+	i++;
+      } else if (c == '(' && n == '?' && i + 2 < pattern.size()) {
+	char t = pattern[i+2];
+	if (t == '<' || t == 'P' || t == '\'' || t == '(')
+	  return false;
+      }
+    }
+    return true;
+  }
+}
+
+namespace BTagCombination {
+
+  IgnorePatternMatcher::IgnorePatternMatcher (const map<string, boost::regex*> &patterns)
+    : _nPatterns(patterns.size())
+  {
+    vector<string> regexPatterns;
+    vector<const boost::regex*> compiled;
+    for (map<string, boost::regex*>::const_iterator itr = patterns.begin(); itr != patterns.end(); itr++) {
+      if (IsSimple(itr->first)) {
+	SimplePattern p;
+	p.text = itr->first;
+	size_t lastDot = p.text.rfind('.');
+	p.tailLength = lastDot == string::npos ? p.text.size() : p.text.size() - lastDot - 1;
+	_simpleByTail[p.text.substr(p.text.size() - p.tailLength)].push_back(p);
+	if (find(_tailLengths.begin(), _tailLengths.end(), p.tailLength) == _tailLengths.end())
+	  _tailLengths.push_back(p.tailLength);
+      } else {
+	regexPatterns.push_back(itr->first);
+	compiled.push_back(itr->second);
+      }
+    }
+    sort(_tailLengths.begin(), _tailLengths.end());
+
+    AddRegexPatterns(regexPatterns, compiled);
+  }
+
+  //
+  // Everything that isn't simple. Combine what we can into a few big alternations.
+  //
+  void IgnorePatternMatcher::AddRegexPatterns (const vector<string> &patterns, const vector<const boost::regex*> &compiled)
+  {
+    vector<size_t> toCombine;
+    for (size_t i = 0; i < patterns.size(); i++) {
+      if (CanCombine(patterns[i]))
+	toCombine.push_back(i);
+      else
+	_regexes.push_back(*compiled[i]);
+    }
+
+    for (size_t first = 0; first < toCombine.size(); first += gPatternsPerRegex) {
+      size_t last = min(first + gPatternsPerRegex, toCombine.size());
+      if (last - first == 1) {
+	_regexes.push_back(*compiled[toCombine[first]]);
+	continue;
+      }
+
+      string combined;
+      for (size_t i = first; i < last; i++) {
+	if (i != first)
+	  combined += "|";
+	combined += "(?:" + patterns[toCombine[i]] + ")";
+      }
+
+      // Each pattern compiled on its own (they all came through OPsToIgnore), so this should
+      // too. If boost says otherwise, fall back to matching them one at a time.
+      try {
+	_regexes.push_back(boost::regex(combined));
+      } catch (boost::regex_error &) {
+	for (size_t i = first; i < last; i++)
+	  _regexes.push_back(*compiled[toCombine[i]]);
+      }
+    }
+  }
+
+  bool IgnorePatternMatcher::Matches (const string &key) const
+  {
+    for (vector<size_t>::const_iterator itr = _tailLengths.begin(); itr != _tailLengths.end() && *itr <= key.size(); itr++) {
+      unordered_map<string, vector<SimplePattern> >::const_iterator bucket = _simpleByTail.find(key.substr(key.size() - *itr));
+      if (bucket == _simpleByTail.end())
+	continue;
+      for (vector<SimplePattern>::const_iterator p = bucket->second.begin(); p != bucket->second.end(); p++) {
+	if (Matches(*p, key))
+	  return true;
+      }
+    }
+
+    for (vector<boost::regex>::const_iterator itr = _regexes.begin(); itr != _regexes.end(); itr++) {
+      if (boost::regex_match(key, *itr))
+	return true;
+    }
+    return false;
+  }
+
+  // Plain text, where "." matches any one character.
+  bool IgnorePatternMatcher::IsSimple (const string &pattern)
+  {
+    return pattern.find_first_of("\\^$|()[]{}*+?") == string::npos;
+  }
+
+  // The tail already matched (that is how p was found).
+  bool IgnorePatternMatcher::Matches (const SimplePattern &p, const string &key)
+  {
+    if (p.text.size() != key.size())
+      return false;
+    for (size_t i = 0; i < p.text.size() - p.tailLength; i++) {
+      if (p.text[i] != '.' && p.text[i] != key[i])
+	return false;
+    }
+    return true;
+  }
+}
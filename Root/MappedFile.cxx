@@ -0,0 +1,73 @@
+//
+// MappedFile - a read-only view of a file, memory mapped where the OS lets us.
+//
+
+#include "Combination/MappedFile.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <fstream>
+#include <iterator>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+  void OpenError (const string &fname)
+  {
+    ostringstream msg;
+    msg << "Unable to open file '" << fname << "' for parsing.";
+    throw runtime_error(msg.str());
+  }
+}
+
+namespace BTagCombination {
+
+  MappedFile::MappedFile (const string &fname)
+    : _data(0), _size(0)
+  {
+#ifdef _MSC_VER
+    ifstream input (fname.c_str(), ios::binary);
+    if (!input.is_open())
+      OpenError(fname);
+    _text.assign((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+    _data = _text.data();
+    _size = _text.size();
+#else
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+      OpenError(fname);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      OpenError(fname);
+    }
+    _size = info.st_size;
+    if (_size > 0) {
+      void *m = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m == MAP_FAILED) {
+	close(fd);
+	OpenError(fname);
+      }
+      madvise(m, _size, MADV_SEQUENTIAL);
+      _data = static_cast<const char*>(m);
+    }
+    close(fd);
+#endif
+  }
+
+  MappedFile::~MappedFile()
+  {
+#ifndef _MSC_VER
+    if (_size > 0)
+      munmap(const_cast<char*>(_data), _size);
+#endif
+  }
+}
@@ -26,6 +26,14 @@ namespace {
       return -r;
     return r;
   }
+
+  // Order systematic error rows by id only.
+  struct CompareSysId {
+    bool operator() (const pair<unsigned int, double> &a, const pair<unsigned int, double> &b) const
+    {
+      return a.first < b.first;
+    }
+  };
 }
 
 namespace BTagCombination {
@@ -42,8 +50,10 @@ namespace BTagCombination {
     delete _statError;
   }
 
-  Measurement::Measurement(const string &measurementName, const string &what, const double val, const double statError)
+  Measurement::Measurement(const string &measurementName, const string &what, const double val, const double statError,
+			   SysErrorNameTable *sysNames)
     : _name(measurementName), _what(what),
+      _sysNames(sysNames),
       _actualValue(_name.c_str(), _name.c_str(), val),
       _statError(new RooConstVar((_name + "StatError").c_str(), (_name + "StatError").c_str(), statError)),
       _doNotUse (false)
@@ -116,11 +126,22 @@ namespace BTagCombination {
   ///
   bool Measurement::hasSysError (const string &name) const
   {
-    for(vector<pair<string,double> >::const_iterator itr = _sysErrors.begin(); itr != _sysErrors.end(); itr++) {
-      if (itr->first == name)
-	return true;
-    }
-    return false;
+    return FindSysError(name) != _sysRow.end();
+  }
+
+  ///
+  /// Look up an error in the sorted row. If an error was added more than once, this
+  /// finds the first one added.
+  ///
+  Measurement::SysRow::const_iterator Measurement::FindSysError (const string &name) const
+  {
+    unsigned int id;
+    if (!_sysNames->Find(name, id))
+      return _sysRow.end();
+    SysRow::const_iterator itr = lower_bound(_sysRow.begin(), _sysRow.end(), make_pair(id, 0.0), CompareSysId());
+    if (itr == _sysRow.end() || itr->first != id)
+      return _sysRow.end();
+    return itr;
   }
 
   ///
@@ -151,11 +172,9 @@ namespace BTagCombination {
   ///
   double Measurement::GetSystematicErrorWidth (const std::string &errorName) const
   {
-    for(vector<pair<string,double> >::const_iterator itr = _sysErrors.begin(); itr != _sysErrors.end(); itr++) {
-      if (errorName == itr->first) {
-	return itr->second;
-      }
-    }
+    SysRow::const_iterator itr = FindSysError(errorName);
+    if (itr != _sysRow.end())
+      return itr->second;
 
     throw runtime_error ("Don't know about error '" + errorName + "'.");
   }
@@ -166,6 +185,10 @@ namespace BTagCombination {
   void Measurement::addSystematicAbs (const std::string &errorName, const double oneSigmaSizeAbsoulte)
   {
     _sysErrors.push_back(std::make_pair(errorName, oneSigmaSizeAbsoulte));
+
+    // Keep the row sorted by id. Errors with the same id stay in the order they were added.
+    pair<unsigned int, double> entry (_sysNames->Intern(errorName), oneSigmaSizeAbsoulte);
+    _sysRow.insert(upper_bound(_sysRow.begin(), _sysRow.end(), entry, CompareSysId()), entry);
   }
   void Measurement::addSystematicRel (const std::string &errorName, const double oneSigmaSizeRelativeFractional)
   {
@@ -186,16 +209,34 @@ namespace BTagCombination {
     double corErr2 = 0.0;
     double uncorErr2 = _statError->getVal()*_statError->getVal();
 
-    for (size_t i = 0; i < _sysErrors.size(); i++) {
-      double v2r = _sysErrors[i].second;
-      double v2 = v2r*v2r;
-      if (v2r < 0.0)
-	v2 = -v2;
-
-      if (other->hasSysError(_sysErrors[i].first)) {
-	corErr2 += v2;
-      } else {
-	uncorErr2 += v2;
+    if (other->_sysNames == _sysNames) {
+      // Both rows are sorted by id - walk them together.
+      SysRow::const_iterator o = other->_sysRow.begin();
+      for (SysRow::const_iterator i = _sysRow.begin(); i != _sysRow.end(); i++) {
+	while (o != other->_sysRow.end() && o->first < i->first)
+	  o++;
+	double v2 = i->second*i->second;
+	if (i->second < 0.0)
+	  v2 = -v2;
+	if (o != other->_sysRow.end() && o->first == i->first) {
+	  corErr2 += v2;
+	} else {
+	  uncorErr2 += v2;
+	}
+      }
+    } else {
+      // Different contexts number their errors differently, so go by name.
+      for (size_t i = 0; i < _sysErrors.size(); i++) {
+	double v2r = _sysErrors[i].second;
+	double v2 = v2r*v2r;
+	if (v2r < 0.0)
+	  v2 = -v2;
+
+	if (other->hasSysError(_sysErrors[i].first)) {
+	  corErr2 += v2;
+	} else {
+	  uncorErr2 += v2;
+	}
       }
     }
 
@@ -230,16 +271,34 @@ namespace BTagCombination {
     // Loop over all systematic errors, calculating the shared systematic (sigma_1j*sigma_2j, over all
     // sys errors j). If a systematic error is missing, it is assumed to be zero.
 
-    map<string, double> myErrors;
-    for(size_t i = 0; i < _sysErrors.size(); i++) {
-      myErrors[_sysErrors[i].first] = _sysErrors[i].second;
-    }
-
     double sigma12 = 0.0;
-    for(size_t i = 0; i < other->_sysErrors.size(); i++) {
-      map<string,double>::const_iterator my_i = myErrors.find(other->_sysErrors[i].first);
-      if (my_i != myErrors.end()) {
-	sigma12 += other->_sysErrors[i].second * my_i->second;
+    if (other->_sysNames == _sysNames) {
+      // Both rows are sorted by id - walk them together. If we have an error more than once,
+      // the last one added is the one that counts.
+      SysRow::const_iterator my_i = _sysRow.begin();
+      for (SysRow::const_iterator o = other->_sysRow.begin(); o != other->_sysRow.end(); o++) {
+	while (my_i != _sysRow.end() && my_i->first < o->first)
+	  my_i++;
+	if (my_i == _sysRow.end())
+	  break;
+	if (my_i->first == o->first) {
+	  SysRow::const_iterator last = my_i;
+	  while (last+1 != _sysRow.end() && (last+1)->first == o->first)
+	    last++;
+	  sigma12 += o->second * last->second;
+	}
+      }
+    } else {
+      map<string, double> myErrors;
+      for(size_t i = 0; i < _sysErrors.size(); i++) {
+	myErrors[_sysErrors[i].first] = _sysErrors[i].second;
+      }
+
+      for(size_t i = 0; i < other->_sysErrors.size(); i++) {
+	map<string,double>::const_iterator my_i = myErrors.find(other->_sysErrors[i].first);
+	if (my_i != myErrors.end()) {
+	  sigma12 += other->_sysErrors[i].second * my_i->second;
+	}
       }
     }
 
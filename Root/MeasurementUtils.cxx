@@ -6,9 +6,12 @@
 #include "Combination/Measurement.h"
 
 #include "TMatrixT.h"
+#include "TDecompChol.h"
 
 #include <iostream>
 #include <set>
+#include <map>
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 
@@ -22,20 +25,90 @@ namespace BTagCombination {
   //
   TMatrixTSym<double> CalcCovarMatrixUsingRho (const vector<Measurement*> &measurements)
   {
+    PairwiseCorrelations pairs(measurements);
     TMatrixTSym<double> W(measurements.size());
-    int i_meas_row = 0;
-    for (vector<Measurement*>::const_iterator imeas = measurements.begin(); imeas != measurements.end(); imeas++, i_meas_row++) {
-      Measurement *m(*imeas);
-      int i_meas_row2 = i_meas_row;
-      for (vector<Measurement*>::const_iterator imeas2 = imeas; imeas2 != measurements.end(); imeas2++, i_meas_row2++) {
-	Measurement *m2(*imeas2);
-	W(i_meas_row, i_meas_row2) = m->Covar(m2);
+    for (size_t i_meas_row = 0; i_meas_row < measurements.size(); i_meas_row++) {
+      for (size_t i_meas_row2 = i_meas_row; i_meas_row2 < measurements.size(); i_meas_row2++) {
+	W(i_meas_row, i_meas_row2) = pairs.Covar(i_meas_row, i_meas_row2);
 	W(i_meas_row2, i_meas_row) = W(i_meas_row, i_meas_row2);
       }
     }
     return W;
   }
 
+  //
+  // Pack the widths into W and do W W^T. Only the upper triangle is calculated, in blocks so the
+  // rows being dotted stay in cache, and the inner loop is a plain dot product over contiguous
+  // memory that the compiler can vectorize.
+  //
+  PairwiseCorrelations::PairwiseCorrelations (const vector<Measurement*> &measurements)
+    : _measurements(measurements), _totalError(measurements.size()), _shared(measurements.size()*measurements.size(), 0.0)
+  {
+    const size_t n = measurements.size();
+
+    map<string, size_t> sysIndex;
+    for (size_t i = 0; i < n; i++) {
+      _totalError[i] = measurements[i]->totalError();
+      vector<string> errs (measurements[i]->GetSystematicErrorNames());
+      for (size_t i_e = 0; i_e < errs.size(); i_e++)
+	sysIndex.insert(make_pair(errs[i_e], sysIndex.size()));
+    }
+    const size_t k = sysIndex.size();
+    if (k == 0)
+      return;
+
+    vector<double> W(n*k, 0.0);
+    for (size_t i = 0; i < n; i++) {
+      vector<string> errs (measurements[i]->GetSystematicErrorNames());
+      for (size_t i_e = 0; i_e < errs.size(); i_e++)
+	W[i*k + sysIndex[errs[i_e]]] = measurements[i]->GetSystematicErrorWidth(errs[i_e]);
+    }
+
+    const size_t block = 32;
+    for (size_t i_b = 0; i_b < n; i_b += block) {
+      const size_t i_e = min(n, i_b + block);
+      for (size_t j_b = i_b; j_b < n; j_b += block) {
+	const size_t j_e = min(n, j_b + block);
+	for (size_t i = i_b; i < i_e; i++) {
+	  const double *wi = &W[i*k];
+	  for (size_t j = max(i, j_b); j < j_e; j++) {
+	    const double *wj = &W[j*k];
+	    double sum = 0.0;
+	    for (size_t l = 0; l < k; l++)
+	      sum += wi[l]*wj[l];
+	    _shared[i*n + j] = sum;
+	    _shared[j*n + i] = sum;
+	  }
+	}
+      }
+    }
+  }
+
+  double PairwiseCorrelations::RhoUnbounded (size_t i, size_t j) const
+  {
+    return SharedVariance(i, j)/(_totalError[i]*_totalError[j]);
+  }
+
+  double PairwiseCorrelations::Rho (size_t i, size_t j) const
+  {
+    double rho = RhoUnbounded(i, j);
+    if (rho < -1.0 || rho > 1.0) {
+      cout << "Error calculating covariance between "
+	   << _measurements[i]->Name() << " and "
+	   << _measurements[j]->Name() << " - rho found to be " << rho << endl;
+      rho = rho < 0.0 ? -1.0 : 1.0;
+    }
+    return rho;
+  }
+
+  // Covariance is rho*s1*s2 - except with ourselves, where the stat error is fully correlated too.
+  double PairwiseCorrelations::Covar (size_t i, size_t j) const
+  {
+    if (_measurements[i] == _measurements[j])
+      return _totalError[i]*_totalError[j];
+    return Rho(i, j)*_totalError[i]*_totalError[j];
+  }
+
   //
   // Calc the covariance matrix one systematic error at a time. Check each one to make sure it can
   // be inverted.
@@ -123,6 +196,123 @@ namespace BTagCombination {
     return result;
   }
 
+  //
+  // Split the systematic errors into those shared between measurements (columns of the loading
+  // matrix) and those only one measurement has (which are just more uncorrelated variance).
+  //
+  LowRankCovariance::LowRankCovariance (const vector<Measurement*> &measurements)
+    : _diag(measurements.size(), 0.0), _loadings(measurements.size()), _nShared(0)
+  {
+    map<string, int> useCount;
+    vector<set<string> > names(measurements.size());
+    for (size_t i = 0; i < measurements.size(); i++) {
+      vector<string> errs (measurements[i]->GetSystematicErrorNames());
+      names[i].insert(errs.begin(), errs.end());
+      for (set<string>::const_iterator i_err = names[i].begin(); i_err != names[i].end(); i_err++)
+	useCount[*i_err]++;
+    }
+
+    map<string, size_t> sharedIndex;
+    for (map<string, int>::const_iterator itr = useCount.begin(); itr != useCount.end(); itr++) {
+      if (itr->second > 1)
+	sharedIndex[itr->first] = _nShared++;
+    }
+
+    for (size_t i = 0; i < measurements.size(); i++) {
+      const Measurement *m(measurements[i]);
+      _diag[i] = m->statError()*m->statError();
+      for (set<string>::const_iterator i_err = names[i].begin(); i_err != names[i].end(); i_err++) {
+	double w = m->GetSystematicErrorWidth(*i_err);
+	map<string, size_t>::const_iterator shared = sharedIndex.find(*i_err);
+	if (shared == sharedIndex.end()) {
+	  _diag[i] += w*w;
+	} else {
+	  _loadings[i].push_back(make_pair(shared->second, w));
+	}
+      }
+    }
+  }
+
+  //
+  // V^-1 = D^-1 - D^-1 A (1 + A^T D^-1 A)^-1 A^T D^-1, so
+  // chi2 = r^T D^-1 r - u^T M^-1 u, with u = A^T D^-1 r and M = 1 + A^T D^-1 A.
+  //
+  double LowRankCovariance::Chi2 (const vector<double> &delta) const
+  {
+    if (delta.size() != _diag.size()) {
+      ostringstream err;
+      err << "Chi2 asked for " << delta.size() << " residuals, but the covariance has " << _diag.size() << " measurements";
+      throw runtime_error(err.str());
+    }
+
+    // If some measurement has no uncorrelated error at all, D can't be inverted. Rare - so just
+    // do it the old way.
+    for (size_t i = 0; i < _diag.size(); i++) {
+      if (_diag[i] <= 0.0) {
+	TMatrixTSym<double> Vinv (Dense());
+	Vinv.Invert();
+	double chi2 = 0.0;
+	for (size_t i_r = 0; i_r < delta.size(); i_r++)
+	  for (size_t i_c = 0; i_c < delta.size(); i_c++)
+	    chi2 += delta[i_r]*Vinv(i_r, i_c)*delta[i_c];
+	return chi2;
+      }
+    }
+
+    double chi2 = 0.0;
+    vector<double> u(_nShared, 0.0);
+    TMatrixTSym<double> M(_nShared);
+    for (size_t i = 0; i < _nShared; i++)
+      M(i, i) = 1.0;
+
+    for (size_t i = 0; i < _diag.size(); i++) {
+      double dinv = 1.0/_diag[i];
+      chi2 += delta[i]*delta[i]*dinv;
+
+      const vector<pair<size_t, double> > &row(_loadings[i]);
+      for (size_t i_1 = 0; i_1 < row.size(); i_1++) {
+	u[row[i_1].first] += row[i_1].second*dinv*delta[i];
+	for (size_t i_2 = 0; i_2 < row.size(); i_2++) {
+	  M(row[i_1].first, row[i_2].first) += row[i_1].second*dinv*row[i_2].second;
+	}
+      }
+    }
+
+    if (_nShared == 0)
+      return chi2;
+
+    // M is 1 + something positive semi-definite, so Cholesky always works.
+    TDecompChol chol(M);
+    if (!chol.Decompose())
+      throw runtime_error("Unable to factor the systematic error part of the covariance matrix");
+    TMatrixTSym<double> Minv(_nShared);
+    chol.Invert(Minv);
+
+    for (size_t i_r = 0; i_r < _nShared; i_r++) {
+      for (size_t i_c = 0; i_c < _nShared; i_c++) {
+	chi2 -= u[i_r]*Minv(i_r, i_c)*u[i_c];
+      }
+    }
+    return chi2;
+  }
+
+  TMatrixTSym<double> LowRankCovariance::Dense (void) const
+  {
+    TMatrixTSym<double> V(_diag.size());
+    for (size_t i = 0; i < _diag.size(); i++) {
+      V(i, i) += _diag[i];
+      for (size_t j = 0; j < _diag.size(); j++) {
+	for (size_t i_l = 0; i_l < _loadings[i].size(); i_l++) {
+	  for (size_t j_l = 0; j_l < _loadings[j].size(); j_l++) {
+	    if (_loadings[i][i_l].first == _loadings[j][j_l].first)
+	      V(i, j) += _loadings[i][i_l].second*_loadings[j][j_l].second;
+	  }
+	}
+      }
+    }
+    return V;
+  }
+
   // Calculate the chi2 for a set of measurements
   double CalcChi2(const std::vector<Measurement*> &measurements, const std::vector<Measurement*> &fitResults)
   {
@@ -150,23 +340,17 @@ namespace BTagCombination {
     if (measurements.size() == 0)
       return 0.0;
 
-    // Next, we have to build a covariance matrix from the list of measurements, and invert it to be ready
-    // for use in calculating the actual chi2.
-    TMatrixTSym<double> r(CalcCovarMatrixUsingRho(measurements));
-    TMatrixTSym<double> rInv (r.Invert());
+    // The covariance of the measurements is mostly uncorrelated errors plus a few shared
+    // systematic errors, so we never build (or invert) the full matrix.
+    LowRankCovariance covar(measurements);
 
-    // Assemble the column and row vectors that will contain how much each measurement varies from its
-    // fit value.
-    TMatrixT<double> asColumns(measurements.size(), 1);
-    TMatrixT<double> asRows(1, measurements.size());
+    // How much each measurement varies from its fit value.
+    vector<double> delta(measurements.size());
     for (size_t i = 0; i < measurements.size(); i++) {
       const Measurement &m(*measurements[i]);
-      asColumns(i, 0) = m.centralValue() - fitLookup[m.What()]->centralValue();
-      asRows(0, i) = asColumns(i, 0);
+      delta[i] = m.centralValue() - fitLookup[m.What()]->centralValue();
     }
 
-    // And finally calculate the chi2.
-    TMatrixT<double> chi2 = asRows * rInv * asColumns;
-    return chi2(0, 0);
+    return covar.Chi2(delta);
   }
 }
@@ -0,0 +1,263 @@
+//
+// ParallelUtils - a very simple worker pool.
+//
+
+#include "Combination/ParallelUtils.h"
+
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace {
+
+  // One forked worker, and what it has sent back so far.
+  struct WorkerProcess {
+    pid_t pid;
+    int fd;
+    size_t job;
+    string output;
+  };
+
+  // Write everything down the pipe (in the worker).
+  void WriteAll (int fd, const string &data)
+  {
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = write(fd, data.data() + done, data.size() - done);
+      if (n < 0) {
+	if (errno == EINTR)
+	  continue;
+	return;
+      }
+      done += n;
+    }
+  }
+
+  // Everything buffered has to go out before a fork, or it will be written twice.
+  void FlushAllOutput (void)
+  {
+    cout.flush();
+    cerr.flush();
+    clog.flush();
+    fflush(0);
+  }
+
+  // Fork a worker to run the job. In the worker, send back what the job returns (or the error
+  // message) and exit without running any of the parent's clean up. Returns false if the fork failed.
+  bool StartWorker (const function<string (void)> &job, size_t jobIndex, WorkerProcess &worker)
+  {
+    int fds[2];
+    if (pipe(fds) != 0)
+      return false;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+
+    if (pid == 0) {
+      close(fds[0]);
+      int status = 0;
+      string result;
+      try {
+	result = job();
+      } catch (exception &e) {
+	result = e.what();
+	status = 1;
+      } catch (...) {
+	result = "Unknown error in a worker process";
+	status = 1;
+      }
+      WriteAll(fds[1], result);
+      close(fds[1]);
+      FlushAllOutput();
+      _exit(status);
+    }
+
+    close(fds[1]);
+    worker.pid = pid;
+    worker.fd = fds[0];
+    worker.job = jobIndex;
+    return true;
+  }
+
+  // The worker has closed its end of the pipe. Wait for it to exit and see how it went - returns
+  // an error message, or the empty string if it worked.
+  string FinishWorker (const WorkerProcess &worker)
+  {
+    close(worker.fd);
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0) {
+      if (errno != EINTR)
+	return "Lost track of a worker process";
+    }
+
+    if (WIFEXITED(status)) {
+      if (WEXITSTATUS(status) == 0)
+	return "";
+      return worker.output.size() > 0 ? worker.output : "A worker process failed";
+    }
+
+    ostringstream err;
+    err << "A worker process was killed";
+    if (WIFSIGNALED(status))
+      err << " by signal " << WTERMSIG(status);
+    return err.str();
+  }
+}
+
+namespace BTagCombination {
+
+  //
+  // How many threads to run with. 0 means as many as the hardware has.
+  //
+  unsigned int NumberOfWorkerThreads (unsigned int nThreads)
+  {
+    if (nThreads == 0) {
+      nThreads = thread::hardware_concurrency();
+      if (nThreads == 0)
+	nThreads = 1;
+    }
+    return nThreads;
+  }
+
+  //
+  // Each worker grabs the next job off the list until there are none left.
+  //
+  void RunInParallel (const vector<function<void (void)> > &jobs, unsigned int nThreads)
+  {
+    nThreads = NumberOfWorkerThreads(nThreads);
+    if (nThreads > jobs.size())
+      nThreads = jobs.size();
+
+    // Simple case - no need for any threads at all.
+    if (nThreads <= 1) {
+      for (size_t i = 0; i < jobs.size(); i++)
+	jobs[i]();
+      return;
+    }
+
+    mutex lock;
+    size_t nextJob = 0;
+    exception_ptr firstError;
+
+    vector<thread> workers;
+    for (unsigned int i_t = 0; i_t < nThreads; i_t++) {
+      workers.push_back(thread([&] () {
+	    while (true) {
+	      size_t job;
+	      {
+		lock_guard<mutex> l(lock);
+		if (nextJob >= jobs.size() || firstError)
+		  return;
+		job = nextJob++;
+	      }
+
+	      try {
+		jobs[job]();
+	      } catch (...) {
+		lock_guard<mutex> l(lock);
+		if (!firstError)
+		  firstError = current_exception();
+	      }
+	    }
+	  }));
+    }
+
+    for (size_t i_t = 0; i_t < workers.size(); i_t++)
+      workers[i_t].join();
+
+    if (firstError)
+      rethrow_exception(firstError);
+  }
+
+  //
+  // Keep up to nProcesses workers going, collecting their output as it comes in (a worker
+  // can't finish until everything it has written has been read).
+  //
+  vector<string> RunInWorkerProcesses (const vector<function<string (void)> > &jobs, unsigned int nProcesses)
+  {
+    nProcesses = NumberOfWorkerThreads(nProcesses);
+    if (nProcesses > jobs.size())
+      nProcesses = jobs.size();
+
+    vector<string> results(jobs.size());
+
+    // Simple case - no need for any other processes.
+    if (nProcesses <= 1) {
+      for (size_t i = 0; i < jobs.size(); i++)
+	results[i] = jobs[i]();
+      return results;
+    }
+
+    FlushAllOutput();
+
+    vector<WorkerProcess> running;
+    size_t nextJob = 0;
+    string firstError;
+    while (true) {
+      while (running.size() < nProcesses && nextJob < jobs.size() && firstError.empty()) {
+	WorkerProcess w;
+	if (!StartWorker(jobs[nextJob], nextJob, w)) {
+	  firstError = "Unable to start a worker process";
+	  break;
+	}
+	running.push_back(w);
+	nextJob++;
+      }
+      if (running.size() == 0)
+	break;
+
+      vector<pollfd> fds(running.size());
+      for (size_t i = 0; i < running.size(); i++) {
+	fds[i].fd = running[i].fd;
+	fds[i].events = POLLIN;
+	fds[i].revents = 0;
+      }
+      if (poll(&fds[0], fds.size(), -1) < 0) {
+	if (errno == EINTR)
+	  continue;
+	throw runtime_error("Unable to wait for the worker processes");
+      }
+
+      for (size_t i = running.size(); i-- > 0; ) {
+	if (fds[i].revents == 0)
+	  continue;
+	char buffer[65536];
+	ssize_t n = read(running[i].fd, buffer, sizeof(buffer));
+	if (n < 0 && errno == EINTR)
+	  continue;
+	if (n > 0) {
+	  running[i].output.append(buffer, n);
+	  continue;
+	}
+
+	string error (FinishWorker(running[i]));
+	if (error.empty()) {
+	  results[running[i].job].swap(running[i].output);
+	} else if (firstError.empty()) {
+	  firstError = error;
+	}
+	running.erase(running.begin() + i);
+      }
+    }
+
+    if (!firstError.empty())
+      throw runtime_error(firstError);
+    return results;
+  }
+}
@@ -32,6 +32,7 @@
 #include <ostream>
 #include <string>
 #include <vector>
+#include <iterator>
 
 //
 // All the boost libraries
@@ -962,10 +963,35 @@ namespace BTagCombination
   CalibrationBinBoundary::BinBoundaryFormatEnum CalibrationBinBoundary::gFormatForNextBoundary =
     CalibrationBinBoundary::kNormal;
 
+  // Which parser to use for Parse and ParseFile.
+  namespace {
+    ParserBackend gParserBackend = kHandWrittenParser;
+  }
+
+  void SetParserBackend(ParserBackend backend)
+  {
+    gParserBackend = backend;
+  }
+
+  ParserBackend GetParserBackend()
+  {
+    return gParserBackend;
+  }
+
   //
   // Parse the input text as a list of calibration inputs
   //
   CalibrationInfo Parse(const string &inputText, calibrationFilterInfo &fInfo)
+  {
+    if (gParserBackend == kSpiritParser)
+      return ParseSpirit(inputText, fInfo);
+    return ParseBuffer(inputText.data(), inputText.data() + inputText.size(), fInfo);
+  }
+
+  //
+  // Parse the input text with the Spirit grammar.
+  //
+  CalibrationInfo ParseSpirit(const string &inputText, calibrationFilterInfo &fInfo)
   {
     string::const_iterator iter = inputText.begin();
     string::const_iterator end = inputText.end();
@@ -1003,6 +1029,12 @@ namespace BTagCombination
   //
   CalibrationInfo Parse(istream &input, calibrationFilterInfo &fInfo)
   {
+    // The hand-written parser drops the comment lines itself, so just grab the whole thing.
+    if (gParserBackend != kSpiritParser) {
+      string text((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+      return ParseBuffer(text.data(), text.data() + text.size(), fInfo, true);
+    }
+
     ostringstream text;
     while (!input.eof()) {
       string line;
@@ -7,6 +7,8 @@
 #include "Combination/BinNameUtils.h"
 #include "Combination/AtlasLabels.h"
 #include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/ParallelUtils.h"
+#include "Combination/BinKey.h"
 
 #include "TGraphErrors.h"
 #include "TCanvas.h"
@@ -27,6 +29,10 @@
 #include <stdexcept>
 #include <iomanip>
 #include <iostream>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/regex.hpp>
 
 using namespace std;
 
@@ -37,6 +43,29 @@ namespace {
   typedef set<CalibrationBinBoundary> t_BBSet;
   typedef map<string, t_BBSet> t_BinSet;
 
+  // For each bin along a plot's axis, the bin from each analysis (by its name on the plot).
+  typedef map<string, const CalibrationBin*> t_CBMap;
+  typedef map<CalibrationBinBoundary, t_CBMap> t_BoundaryMap;
+
+  // What goes on one set of plots - the bins along one axis, with the other axes fixed.
+  struct AxisPlot {
+    string axisDir;			// Directory below the group's, named for an axis...
+    vector<CalibrationBinBoundary> binDirs;	// ... and below that one per fixed bin, top first
+    t_BBSet specifiedBins;		// The fixed coordinates
+    t_BBSet axisBins;			// Bins along the axis that at least one analysis has
+    t_BoundaryMap taggerResults;
+  };
+
+  // Everything that goes in one group's directory.
+  struct GroupPlots {
+    string name;
+    const vector<CalibrationAnalysis> *anas;
+    vector<AxisPlot> plots;
+  };
+
+  // Each analysis' bins, by their coordinates. The first bin wins if there are two.
+  typedef unordered_map<BinKey, size_t, BinKeyHash> t_BinIndex;
+
   // A few global constants...
   const double c_legendXStart = 0.55;
   const double c_legendYStart = 0.90;
@@ -73,23 +102,20 @@ namespace {
   /// utility was needed.
   ///
 
-  // Find the bin results for a particular bin. Return an empty if we
-  // can't find it.
-  CalibrationBin FindBin (const CalibrationAnalysis &ana, t_BBSet &bininfo, bool &found)
+  t_BinIndex IndexBins (const CalibrationAnalysis &ana)
   {
-    found = false;
-    for (unsigned int ib = 0; ib < ana.bins.size(); ib++) {
-      const CalibrationBin &cb (ana.bins[ib]);
-      t_BBSet t (cb.binSpec.begin(), cb.binSpec.end());
-      if (t == bininfo) {
-	found = true;
-	return cb;
-      }
+    t_BinIndex result;
+    for (size_t ib = 0; ib < ana.bins.size(); ib++) {
+      result.insert(make_pair(BinKey(ana.bins[ib]), ib));
     }
+    return result;
+  }
 
-    // This line will cause an analysis that isn't present to appear as a "ZERO"
-    // in the plot. We should fix this.
-    return CalibrationBin();
+  // Find the bin results for a particular bin. Null if the analysis doesn't have it.
+  const CalibrationBin *FindBin (const CalibrationAnalysis &ana, const t_BinIndex &index, const t_BBSet &bininfo)
+  {
+    t_BinIndex::const_iterator itr = index.find(BinKey(bininfo));
+    return itr == index.end() ? 0 : &ana.bins[itr->second];
   }
 
   //
@@ -387,42 +413,23 @@ namespace {
   }
 
   ///
-  /// Actually generate the plots for a particular bin
+  /// Work out what goes on the plots along one axis
   ///
-  void GenerateCommonAnalysisPlots (TDirectory *out,
-				    const vector<CalibrationAnalysis> &anas,
-				    const t_BBSet &specifiedBins,
-				    const t_BBSet &allAxisBins,
-				    PlotCollection whatToPlot,
-				    GroupCriteria gp)
+  void FillAxisPlot (AxisPlot &plot,
+		     const vector<CalibrationAnalysis> &anas,
+		     const vector<t_BinIndex> &index,
+		     const vector<string> &anaNaming,
+		     const t_BBSet &allAxisBins)
   {
-    out -> cd();
-
-    // Some setup and defines that make life simpler below.
-    string binName (allAxisBins.begin()->variable);
-
-    double legendYPos = c_legendYStart;
-    double legendYDelta = c_legendYDelta;
-    double legendXPos = c_legendXStart;
-
-    string flavorName (anas[0].flavor);
-    string taggerName (anas[0].tagger);
-    string opName (anas[0].operatingPoint);
-
     // Extract all the results.
 
-    typedef map<string, CalibrationBin> t_CBMap;
-    typedef map<CalibrationBinBoundary, t_CBMap> t_BoundaryMap;
-    t_BoundaryMap taggerResults;
-
     for (t_BBSet::const_iterator ib = allAxisBins.begin(); ib != allAxisBins.end(); ib++) {
-      t_BBSet coordinate (specifiedBins);
+      t_BBSet coordinate (plot.specifiedBins);
       coordinate.insert(*ib);
       for(unsigned int ia = 0; ia < anas.size(); ia++) {
-	bool found;
-	CalibrationBin fb = FindBin (anas[ia], coordinate, found);
-	if (found)
-	  taggerResults[*ib][NamingForAna(anas[ia],gp)] = fb;
+	const CalibrationBin *fb = FindBin (anas[ia], index[ia], coordinate);
+	if (fb != 0)
+	  plot.taggerResults[*ib][anaNaming[ia]] = fb;
       }
     }
 
@@ -431,12 +438,34 @@ namespace {
     // we will remove them.
     //
 
-    t_BBSet axisBins;
     for (t_BBSet::const_iterator ib = allAxisBins.begin(); ib != allAxisBins.end(); ib++) {
-      if (taggerResults.find(*ib) != taggerResults.end()) {
-	axisBins.insert(*ib);
+      if (plot.taggerResults.find(*ib) != plot.taggerResults.end()) {
+	plot.axisBins.insert(*ib);
       }
     }
+  }
+
+  ///
+  /// Actually generate the plots for a particular bin
+  ///
+  void GenerateCommonAnalysisPlots (TDirectory *out,
+				    const vector<CalibrationAnalysis> &anas,
+				    const AxisPlot &plot,
+				    unsigned int kinds,
+				    GroupCriteria gp)
+  {
+    out -> cd();
+
+    // Some setup and defines that make life simpler below.
+    const t_BBSet &specifiedBins (plot.specifiedBins);
+    const t_BBSet &axisBins (plot.axisBins);
+    const t_BoundaryMap &taggerResults (plot.taggerResults);
+
+    double legendYPos = c_legendYStart;
+    double legendYDelta = c_legendYDelta;
+    double legendXPos = c_legendXStart;
+
+    string flavorName (anas[0].flavor);
 
     //
     // A little tricky here. The person providing input can split the analysis up into multiple
@@ -541,7 +570,7 @@ namespace {
 
       // Create the plots we are going to be filling as we go
       map<string, TH1F*> singlePlots;
-      if (whatToPlot == pcAll) {
+      if (kinds & pkBinValues) {
 	singlePlots["central"] = DeclareSingleHist(anaName,  "_cv", "Central values for ", axisBins.size(), out);
 	singlePlots["statistical"] = DeclareSingleHist(anaName,  "_stat", "Statistical errors for ", axisBins.size(), out);
 	singlePlots["total"] = DeclareSingleHist(anaName,  "_totalerror", "Total errors for ", axisBins.size(), out);
@@ -550,21 +579,23 @@ namespace {
       set<string> allSys;
       for (t_BoundaryMap::const_iterator i_c = taggerResults.begin(); i_c != taggerResults.end(); i_c++) {
 	if (i_c->second.find(anaName) != i_c->second.end()) {
-	  const CalibrationBin &cb(i_c->second.find(anaName)->second);
+	  const CalibrationBin &cb(*i_c->second.find(anaName)->second);
 	  for (unsigned int i = 0; i < cb.systematicErrors.size(); i++) {
 	    allSys.insert(cb.systematicErrors[i].name);
 	  }
 	}
       }
 
-      if (whatToPlot == pcAll) {
-	for (set<string>::const_iterator i = allSys.begin(); i != allSys.end(); i++) {
+      for (set<string>::const_iterator i = allSys.begin(); i != allSys.end(); i++) {
+	if (kinds & pkSysErrors) {
 	  TH1F *h = DeclareSingleHist(anaName, string("_sys_") + *i, string ("Systematic errors for ") + *i + " ", axisBins.size(), out);
 	  singlePlots[*i] = h;
 	  sysErrorPlots[*i].push_back(make_pair(anaName,h));
 	  sysErrorPlotsByAna[anaName].push_back(make_pair(*i,h));
+	}
 
-	  h = DeclareSingleHist(anaName, string("_cvShift_") + *i, string ("Central Value shifts caused by ") + *i + " ", axisBins.size(), 0);
+	if (kinds & pkCVShifts) {
+	  TH1F *h = DeclareSingleHist(anaName, string("_cvShift_") + *i, string ("Central Value shifts caused by ") + *i + " ", axisBins.size(), 0);
 	  cvShiftPlotsSingle[*i] = h;
 	  cvShiftPlotsSingleUsed[*i] = false;
 	  cvShiftPlotsByAna[anaName].push_back(make_pair(*i,h));
@@ -582,20 +613,25 @@ namespace {
 	int ibin = bbBinNumber[i_c->first];
 
 	if (i_c->second.find(anaName) != i_c->second.end()) {
-	  const CalibrationBin &cb(i_c->second.find(anaName)->second);
+	  const CalibrationBin &cb(*i_c->second.find(anaName)->second);
 	  v_central[ibin] = cb.centralValue;
 	  v_centralStatError[ibin] = cb.centralValueStatisticalError;
 	  v_centralTotError[ibin] = CalcTotalError(cb);
 
-	  if (whatToPlot == pcAll) {
-	    // Fill in the single plots now
+	  // Fill in the single plots now
+	  if (kinds & pkBinValues) {
 	    singlePlots["central"]->SetBinContent(ibin+1, cb.centralValue);
 	    singlePlots["statistical"]->SetBinContent(ibin+1, cb.centralValueStatisticalError);
 	    singlePlots["total"]->SetBinContent(ibin+1, v_centralTotError[ibin]);
+	  }
+
+	  if (kinds & pkSysErrors) {
 	    for (unsigned int i = 0; i < cb.systematicErrors.size(); i++) {
 	      singlePlots[cb.systematicErrors[i].name]->SetBinContent(ibin+1, cb.systematicErrors[i].value);
 	    }
+	  }
 
+	  if (kinds & pkCVShifts) {
 	    for (map<string, pair<double, double> >::const_iterator i_meta = cb.metadata.begin(); i_meta != cb.metadata.end(); i_meta++) {
 	      if (i_meta->first.find("CV Shift ") == 0) {
 		string name(i_meta->first.substr(9));
@@ -625,19 +661,21 @@ namespace {
       // Build the main comparison plot
       //
 
-      TGraphErrors *g = new TGraphErrors (axisBins.size(),
-				    v_bin, v_central,
-				    v_binError, v_centralStatError);
-      g->SetName(anaName.c_str());
-      g->SetTitle(anaName.c_str());
-      plots.push_back(g);
-
-      g = new TGraphErrors (axisBins.size(),
-			    v_bin, v_central,
-			    v_binError, v_centralTotError);
-      g->SetName((anaName + "TotError").c_str());
-      g->SetTitle((anaName + " Total Error").c_str());
-      plotsSys.push_back(g);
+      if (kinds & pkSF) {
+	TGraphErrors *g = new TGraphErrors (axisBins.size(),
+					    v_bin, v_central,
+					    v_binError, v_centralStatError);
+	g->SetName(anaName.c_str());
+	g->SetTitle(anaName.c_str());
+	plots.push_back(g);
+
+	g = new TGraphErrors (axisBins.size(),
+			      v_bin, v_central,
+			      v_binError, v_centralTotError);
+	g->SetName((anaName + "TotError").c_str());
+	g->SetTitle((anaName + " Total Error").c_str());
+	plotsSys.push_back(g);
+      }
 
       // The name should have a chi2 if we can
 
@@ -662,7 +700,7 @@ namespace {
 
     // Some detailed plots, if requested.
 
-    if (whatToPlot == pcAll) {
+    if (kinds & pkSysErrors) {
 
       //
       // Build a set of stacked histograms of the systematic errors^2 contribution in each plot.
@@ -671,6 +709,9 @@ namespace {
       //
 
       plot_stacked_by_ana(sysErrorPlotsByAna, binlabels, true, "ana_sys_", "Systematic Error (\\sigma^{2})",  "\\sigma^{2}");
+    }
+
+    if (kinds & pkCVShifts) {
 
       //
       // Now, do the same for the central value shifts. Eliminate the analyses which have no shifts first, however.
@@ -710,7 +751,7 @@ namespace {
     // see how fitting controls them.
     //
 
-    if (whatToPlot == pcAll) {
+    if (kinds & pkSysErrors) {
       for (map<string, vector<pair<string, TH1F*> > >::const_iterator itr = sysErrorPlots.begin(); itr != sysErrorPlots.end(); itr++) {
 	string name = "sys_" + itr->first;
 	TCanvas *c = new TCanvas (name.c_str());
@@ -796,6 +837,9 @@ namespace {
     // Now build the canvas that we are going to store. Do do special axis labels we have
     // to fake the whole TGraph guy out.
 
+    if (!(kinds & pkSF))
+      return;
+
     TCanvas *c = new TCanvas (NamingForCanvas(gp).c_str());
     TH1F *h = new TH1F("SF", "", binlabels.size(), 0.0, binlabels.size());
 
@@ -880,25 +924,31 @@ namespace {
 
   ///
   /// Recursive routine to look at all the variables and walk down until there
-  /// is just one left for the axis.
+  /// is just one left for the axis. Each plot is listed along with the directories
+  /// it goes in.
   ///
-  void GenerateCommonAnalysisPlots (TDirectory *out,
-				    const vector<CalibrationAnalysis> &anas,
-				    const string &binName,
-				    const t_BinSet &binSet,
-				    PlotCollection whatToPlot,
-				    GroupCriteria gp,
-				    const t_BBSet &otherBins = t_BBSet())
+  void ListAxisPlots (vector<AxisPlot> &plots,
+		      const vector<CalibrationAnalysis> &anas,
+		      const vector<t_BinIndex> &index,
+		      const vector<string> &anaNaming,
+		      const string &binName,
+		      const t_BinSet &binSet,
+		      const string &axisDir,
+		      const vector<CalibrationBinBoundary> &binDirs,
+		      const t_BBSet &otherBins = t_BBSet())
   {
     //
     // Are we at the last variable - which will be the axis of a plot?
     //
 
     if (otherBins.size() + 1 == binSet.size()) {
-      GenerateCommonAnalysisPlots (out, anas,
-				   otherBins,
-				   binSet.find(binName)->second,
-				   whatToPlot, gp);
+      plots.push_back(AxisPlot());
+      AxisPlot &plot (plots.back());
+      plot.axisDir = axisDir;
+      plot.binDirs = binDirs;
+      plot.specifiedBins = otherBins;
+      FillAxisPlot (plot, anas, index, anaNaming,
+		    binSet.find(binName)->second);
       return;
     }
 
@@ -924,16 +974,14 @@ namespace {
 
     t_BBSet bounds(binSet.find(binName)->second);
     for (t_BBSet::const_iterator i = bounds.begin(); i != bounds.end(); i++) {
-      ostringstream buf;
-      buf << *i;
-      TDirectory *r = out->mkdir(buf.str().c_str());
+      vector<CalibrationBinBoundary> binDirsNext(binDirs);
+      binDirsNext.push_back(*i);
 
       t_BBSet otherBinsNext(otherBins);
       otherBinsNext.insert(*i);
-      GenerateCommonAnalysisPlots (r, anas,
-				   nextBin, binSet,
-				   whatToPlot, gp,
-				   otherBinsNext);
+      ListAxisPlots (plots, anas, index, anaNaming,
+		     nextBin, binSet, axisDir, binDirsNext,
+		     otherBinsNext);
     }
   }
 
@@ -1084,21 +1132,24 @@ namespace {
   }
 
   ///
-  /// Split plots up by binning
+  /// Split plots up by binning, and work out what goes in each. This doesn't touch
+  /// ROOT, so it can run for several groups at once.
   ///
-  void GenerateCommonAnalysisPlots (TDirectory *out,
-				    const vector<CalibrationAnalysis> &anas,
-				    PlotCollection whatToPlot,
-				    GroupCriteria gp)
+  void ListGroupPlots (GroupPlots &group,
+		       unsigned int kinds,
+		       GroupCriteria gp)
   {
-    //
-    // Do the plots that are for a single analysis
-    //
+    // Nothing to work out if only the per-analysis plots were asked for.
+    if ((kinds & ~pkAnalysis) == 0)
+      return;
 
-    if (whatToPlot == pcAll) {
-      for (size_t i = 0; i < anas.size(); i++) {
-	GenerateAnalysisPlots (out, anas[i]);
-      }
+    const vector<CalibrationAnalysis> &anas (*group.anas);
+
+    vector<t_BinIndex> index;
+    vector<string> anaNaming;
+    for (unsigned int i = 0; i < anas.size(); i++) {
+      index.push_back(IndexBins(anas[i]));
+      anaNaming.push_back(NamingForAna(anas[i], gp));
     }
 
     // Get a list of all the axes that we have for bins, and the binning.
@@ -1118,8 +1169,55 @@ namespace {
     //
     
     for (t_BinSet::const_iterator i = binAxes.begin(); i != binAxes.end(); i++) {
-      TDirectory *r = out->mkdir(i->first.c_str());
-      GenerateCommonAnalysisPlots (r, anas, i->first, binAxes, whatToPlot, gp);
+      ListAxisPlots (group.plots, anas, index, anaNaming, i->first, binAxes, i->first, vector<CalibrationBinBoundary>());
+    }
+  }
+
+  ///
+  /// Draw one group's plots and write them out.
+  ///
+  void WriteGroupPlots (TDirectory *out,
+			const GroupPlots &group,
+			unsigned int kinds,
+			GroupCriteria gp)
+  {
+    const vector<CalibrationAnalysis> &anas (*group.anas);
+
+    //
+    // Do the plots that are for a single analysis
+    //
+
+    if (kinds & pkAnalysis) {
+      for (size_t i = 0; i < anas.size(); i++) {
+	GenerateAnalysisPlots (out, anas[i]);
+      }
+    }
+
+    //
+    // The directories are made the first time a plot needs them, so they come out
+    // parents first and in the order they always have. The bin directory names are
+    // formatted here rather than in ListAxisPlots: printing a boundary isn't thread safe.
+    //
+
+    map<vector<string>, TDirectory*> dirs;
+    for (size_t i_p = 0; i_p < group.plots.size(); i_p++) {
+      const AxisPlot &plot (group.plots[i_p]);
+      TDirectory *r = out;
+      vector<string> path (1, plot.axisDir);
+      for (size_t i_d = 0; i_d < plot.binDirs.size(); i_d++) {
+	ostringstream buf;
+	buf << plot.binDirs[i_d];
+	path.push_back(buf.str());
+      }
+      vector<string> parent;
+      for (size_t i_d = 0; i_d < path.size(); i_d++) {
+	parent.push_back(path[i_d]);
+	map<vector<string>, TDirectory*>::const_iterator d = dirs.find(parent);
+	if (d == dirs.end())
+	  d = dirs.insert(make_pair(parent, r->mkdir(path[i_d].c_str()))).first;
+	r = d->second;
+      }
+      GenerateCommonAnalysisPlots (r, anas, plot, kinds, gp);
     }
   }
 }
@@ -1131,6 +1229,16 @@ namespace BTagCombination {
   ///
   void DumpPlots (TDirectory *output, const vector<CalibrationAnalysis> &anas, GroupCriteria gp,
 		  PlotCollection whatToPlot)
+  {
+    DumpPlots (output, anas, gp, PlotSelection(whatToPlot));
+  }
+
+  ///
+  /// Dump the selected plots to an output directory. ROOT's drawing can't be shared
+  /// between threads, so only working out the plot contents is done in parallel.
+  ///
+  void DumpPlots (TDirectory *output, const vector<CalibrationAnalysis> &anas, GroupCriteria gp,
+		  const PlotSelection &what)
   {
     //
     // Group the analyses together so we put the proper things on
@@ -1153,12 +1261,39 @@ namespace BTagCombination {
     }
 
     //
-    // Dump each
+    // Only the groups asked for
     //
 
+    boost::regex filter (what.groupFilter);
+    vector<GroupPlots> groups;
     for (t_grouping::const_iterator i = grouping.begin(); i != grouping.end(); i++) {
-      TDirectory *r = output->mkdir(i->first.c_str());
-      GenerateCommonAnalysisPlots (r, i->second, whatToPlot, gp);
+      if (!what.groupFilter.empty() && !boost::regex_search(i->first, filter))
+	continue;
+      GroupPlots g;
+      g.name = i->first;
+      g.anas = &(i->second);
+      groups.push_back(g);
+    }
+
+    //
+    // Work out what goes in each group's plots, all at once.
+    //
+
+    vector<function<void (void)> > jobs;
+    for (size_t i = 0; i < groups.size(); i++) {
+      GroupPlots *g = &groups[i];
+      unsigned int kinds = what.kinds;
+      jobs.push_back([g, kinds, gp] () { ListGroupPlots (*g, kinds, gp); });
+    }
+    RunInParallel (jobs, what.nThreads);
+
+    //
+    // Dump each
+    //
+
+    for (size_t i = 0; i < groups.size(); i++) {
+      TDirectory *r = output->mkdir(groups[i].name.c_str());
+      WriteGroupPlots (r, groups[i], what.kinds, gp);
     }
   }
 
@@ -0,0 +1,149 @@
+///
+/// CppUnit tests for the analysis catalog.
+///
+
+#include "Combination/AnalysisCatalog.h"
+#include "Combination/BinNameUtils.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+
+using namespace std;
+using namespace BTagCombination;
+
+class AnalysisCatalogTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( AnalysisCatalogTest );
+
+  CPPUNIT_TEST( testFindNothing );
+  CPPUNIT_TEST( testFindAnalysis );
+  CPPUNIT_TEST( testFindFirstDuplicate );
+  CPPUNIT_TEST( testFindExactIdentity );
+  CPPUNIT_TEST( testUpdate );
+  CPPUNIT_TEST( testGroups );
+  CPPUNIT_TEST( testGroupsAfterUpdate );
+  CPPUNIT_TEST( testFindAfterGroupsAndUpdate );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  CalibrationAnalysis Ana(const string &name, const string &flavor, const string &tagger, const string &op, const string &jet)
+  {
+    CalibrationAnalysis ana;
+    ana.name = name;
+    ana.flavor = flavor;
+    ana.tagger = tagger;
+    ana.operatingPoint = op;
+    ana.jetAlgorithm = jet;
+    return ana;
+  }
+
+  void testFindNothing()
+  {
+    vector<CalibrationAnalysis> anas;
+    AnalysisCatalog catalog (anas);
+    CPPUNIT_ASSERT_EQUAL(AnalysisCatalog::npos, catalog.Find(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4")));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Group(kByAnalysisName, "ptrel").size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Groups(kByJetTagFlavOp).size());
+  }
+
+  void testFindAnalysis()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("s8", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.6", "AntiKt4"));
+    AnalysisCatalog catalog (anas);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Find(anas[0]));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Find("s8", "bottom", "MV1", "0.5", "AntiKt4"));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, catalog.Find(anas[2]));
+    CPPUNIT_ASSERT_EQUAL(AnalysisCatalog::npos, catalog.Find("s8", "bottom", "MV1", "0.6", "AntiKt4"));
+  }
+
+  void testFindFirstDuplicate()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    AnalysisCatalog catalog (anas);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Find(anas[1]));
+  }
+
+  // The "-" joined names would be the same for these two.
+  void testFindExactIdentity()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("ptrel-bottom", "MV1", "0.5", "AntiKt4", "x"));
+    AnalysisCatalog catalog (anas);
+    CPPUNIT_ASSERT_EQUAL(OPFullName(anas[0]), OPFullName(Ana("ptrel", "bottom-MV1", "0.5", "AntiKt4", "x")));
+    CPPUNIT_ASSERT_EQUAL(AnalysisCatalog::npos, catalog.Find(Ana("ptrel", "bottom-MV1", "0.5", "AntiKt4", "x")));
+  }
+
+  void testUpdate()
+  {
+    vector<CalibrationAnalysis> anas;
+    AnalysisCatalog catalog (anas);
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    CPPUNIT_ASSERT_EQUAL(AnalysisCatalog::npos, catalog.Find(anas[0]));
+    catalog.Update();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Find(anas[0]));
+  }
+
+  void testGroups()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("s8", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt6"));
+    anas.push_back(Ana("ptrel", "charm", "MV1", "0.5", "AntiKt4"));
+    AnalysisCatalog catalog (anas);
+
+    const map<string, vector<size_t> > &byOp(catalog.Groups(kByJetTagFlavOp));
+    CPPUNIT_ASSERT_EQUAL((size_t)3, byOp.size());
+    const vector<size_t> &g(catalog.Group(kByJetTagFlavOp, OPIndependentName(anas[0])));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, g.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, g[0]);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, g[1]);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)3, catalog.Group(kByAnalysisName, "ptrel").size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Group(kByAnalysisName, "s8").size());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, catalog.Group(kByFlavorTaggerOp, OPByFlavorTaggerOp(anas[0])).size());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, catalog.Group(kByCalibName, OPByCalibName(anas[1])).size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Group(kByCalibJetTagger, OPByCalibJetTagger(anas[2])).size());
+  }
+
+  void testGroupsAfterUpdate()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("s8", "bottom", "MV1", "0.5", "AntiKt4"));
+    AnalysisCatalog catalog (anas);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Group(kByJetTagFlavOp, OPIndependentName(anas[0])).size());
+
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    catalog.Update();
+    CPPUNIT_ASSERT_EQUAL((size_t)2, catalog.Group(kByJetTagFlavOp, OPIndependentName(anas[0])).size());
+  }
+
+  // The identity index is only built when Find is first used, and must still see everything.
+  void testFindAfterGroupsAndUpdate()
+  {
+    vector<CalibrationAnalysis> anas;
+    anas.push_back(Ana("s8", "bottom", "MV1", "0.5", "AntiKt4"));
+    AnalysisCatalog catalog (anas);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Groups(kByJetTagFlavOp).size());
+
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    anas.push_back(Ana("ptrel", "bottom", "MV1", "0.5", "AntiKt4"));
+    catalog.Update();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, catalog.Find(anas[0]));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, catalog.Find(anas[2]));
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(AnalysisCatalogTest);
+
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
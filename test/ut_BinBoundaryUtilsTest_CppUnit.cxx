@@ -28,6 +28,8 @@ class BinBoundaryUtilsTest : public CppUnit::TestFixture
   CPPUNIT_TEST_EXCEPTION ( TestGappedBins, std::runtime_error );
   CPPUNIT_TEST_EXCEPTION(thinBins, std::runtime_error);
   CPPUNIT_TEST_EXCEPTION(totalOverlapBins, std::runtime_error);
+  CPPUNIT_TEST (TestFindRegularOK);
+  CPPUNIT_TEST (TestFindRegularGapped);
 
   CPPUNIT_TEST (TestBBOK1D);
   CPPUNIT_TEST (TestBBOK1D2);
@@ -179,6 +181,53 @@ class BinBoundaryUtilsTest : public CppUnit::TestFixture
     bin_boundaries result (calcBoundaries(ana));
   }
 
+  void TestFindRegularOK()
+  {
+    CalibrationAnalysis ana;
+    CalibrationBin b1;
+    CalibrationBinBoundary bb1;
+    bb1.lowvalue = 0.0;
+    bb1.highvalue = 1.0;
+    bb1.variable = "pt";
+    b1.binSpec.push_back(bb1);
+    ana.bins.push_back(b1);
+    b1.binSpec[0].lowvalue = 1.0;
+    b1.binSpec[0].highvalue = 2.0;
+    ana.bins.push_back(b1);
+
+    bin_boundaries result;
+    string problems;
+    CPPUNIT_ASSERT (findRegularBoundaries(ana, result, problems));
+    CPPUNIT_ASSERT_EQUAL (string(""), problems);
+    CPPUNIT_ASSERT_EQUAL (size_t(3), result.get_axis_bins("pt").size());
+  }
+
+  void TestFindRegularGapped()
+  {
+    // Same as TestGappedBins, but we get told rather than having it thrown at us.
+    CalibrationAnalysis ana;
+    CalibrationBin b1;
+
+    CalibrationBinBoundary bb1;
+    bb1.lowvalue = 0.0;
+    bb1.highvalue = 1.0;
+    bb1.variable = "pt";
+    b1.binSpec.push_back(bb1);
+
+    CalibrationBinBoundary bb2;
+    bb2.lowvalue = 2.0;
+    bb2.highvalue = 3.0;
+    bb2.variable = "pt";
+    b1.binSpec.push_back(bb2);
+
+    ana.bins.push_back(b1);
+
+    bin_boundaries result;
+    string problems;
+    CPPUNIT_ASSERT (!findRegularBoundaries(ana, result, problems));
+    CPPUNIT_ASSERT (problems.find("adjacent") != string::npos);
+  }
+
   void TestBBOK1D()
   {
     // A set of analyses with bin boundaries that are "ok".
@@ -0,0 +1,232 @@
+///
+/// CppUnit tests for the bin box index. The queries must find exactly what testing every
+/// bin would.
+///
+
+#include "Combination/BinBoxIndex.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <cstdlib>
+
+using namespace std;
+using namespace BTagCombination;
+
+class BinBoxIndexTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( BinBoxIndexTest );
+
+  CPPUNIT_TEST( testBinsOverlap );
+  CPPUNIT_TEST( testBinsOverlapDifferentAxes );
+  CPPUNIT_TEST( testBinContains );
+  CPPUNIT_TEST( testOverlappingGrid );
+  CPPUNIT_TEST( testContainingGrid );
+  CPPUNIT_TEST( testOverlappingRandom );
+  CPPUNIT_TEST( testMixedAxes );
+  CPPUNIT_TEST( testRepeatedAxis );
+  CPPUNIT_TEST( testCovers );
+  CPPUNIT_TEST( testCoversGap );
+  CPPUNIT_TEST( testCoversOverlap );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  CalibrationBinBoundary Boundary(const string &var, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = var;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  CalibrationBin Bin(double ptLow, double ptHigh, double etaLow, double etaHigh)
+  {
+    CalibrationBin b;
+    b.binSpec.push_back(Boundary("pt", ptLow, ptHigh));
+    b.binSpec.push_back(Boundary("abseta", etaLow, etaHigh));
+    return b;
+  }
+
+  // A pt x eta grid of bins.
+  vector<CalibrationBin> Grid(const vector<double> &pt, const vector<double> &eta)
+  {
+    vector<CalibrationBin> r;
+    for (size_t i = 0; i + 1 < pt.size(); i++)
+      for (size_t j = 0; j + 1 < eta.size(); j++)
+	r.push_back(Bin(pt[i], pt[i+1], eta[j], eta[j+1]));
+    return r;
+  }
+
+  vector<double> Edges(double first, double step, int n)
+  {
+    vector<double> r;
+    for (int i = 0; i <= n; i++)
+      r.push_back(first + i*step);
+    return r;
+  }
+
+  vector<size_t> AllOverlapping(const vector<CalibrationBin> &bins, const vector<CalibrationBinBoundary> &spec)
+  {
+    vector<size_t> r;
+    for (size_t i = 0; i < bins.size(); i++)
+      if (BinsOverlap(spec, bins[i].binSpec))
+	r.push_back(i);
+    return r;
+  }
+
+  void testBinsOverlap()
+  {
+    CPPUNIT_ASSERT(BinsOverlap(Bin(0, 10, 0, 1).binSpec, Bin(5, 15, 0.5, 2).binSpec));
+    CPPUNIT_ASSERT(BinsOverlap(Bin(0, 10, 0, 1).binSpec, Bin(0, 10, 0, 1).binSpec));
+    CPPUNIT_ASSERT(!BinsOverlap(Bin(0, 10, 0, 1).binSpec, Bin(10, 15, 0, 1).binSpec));
+    CPPUNIT_ASSERT(!BinsOverlap(Bin(0, 10, 0, 1).binSpec, Bin(5, 15, 1, 2).binSpec));
+  }
+
+  void testBinsOverlapDifferentAxes()
+  {
+    CalibrationBin ptOnly;
+    ptOnly.binSpec.push_back(Boundary("pt", 0, 10));
+    CPPUNIT_ASSERT(!BinsOverlap(ptOnly.binSpec, Bin(0, 10, 0, 1).binSpec));
+    CPPUNIT_ASSERT(!BinsOverlap(Bin(0, 10, 0, 1).binSpec, ptOnly.binSpec));
+  }
+
+  void testBinContains()
+  {
+    vector<CalibrationBinBoundary> big(Bin(0, 100, 0, 2.5).binSpec);
+    set<CalibrationBinBoundary> container(big.begin(), big.end());
+    CPPUNIT_ASSERT(BinContains(container, Bin(0, 10, 0, 1).binSpec));
+    CPPUNIT_ASSERT(BinContains(container, big));
+    CPPUNIT_ASSERT(!BinContains(container, Bin(90, 110, 0, 1).binSpec));
+
+    CalibrationBin ptOnly;
+    ptOnly.binSpec.push_back(Boundary("pt", 0, 10));
+    CPPUNIT_ASSERT(!BinContains(container, ptOnly.binSpec));
+  }
+
+  void testOverlappingGrid()
+  {
+    vector<CalibrationBin> bins(Grid(Edges(20, 10, 30), Edges(0, 0.1, 25)));
+    BinBoxIndex index(bins);
+    CPPUNIT_ASSERT_EQUAL(bins.size(), index.size());
+
+    // Every bin finds just itself, and a big bin finds the same as a brute force search.
+    for (size_t i = 0; i < bins.size(); i += 7) {
+      vector<size_t> found(index.Overlapping(bins[i].binSpec));
+      CPPUNIT_ASSERT_EQUAL(size_t(1), found.size());
+      CPPUNIT_ASSERT_EQUAL(i, found[0]);
+    }
+
+    vector<CalibrationBinBoundary> q(Bin(44, 71, 0.55, 1.2).binSpec);
+    vector<size_t> expected(AllOverlapping(bins, q));
+    CPPUNIT_ASSERT(expected.size() > 0);
+    CPPUNIT_ASSERT(expected == index.Overlapping(q));
+  }
+
+  void testContainingGrid()
+  {
+    vector<CalibrationBin> coarse(Grid(Edges(20, 20, 10), Edges(0, 0.5, 5)));
+    set<set<CalibrationBinBoundary> > templates;
+    for (size_t i = 0; i < coarse.size(); i++)
+      templates.insert(set<CalibrationBinBoundary>(coarse[i].binSpec.begin(), coarse[i].binSpec.end()));
+    BinBoxIndex index(templates);
+
+    vector<CalibrationBin> fine(Grid(Edges(20, 10, 20), Edges(0, 0.25, 10)));
+    for (size_t i = 0; i < fine.size(); i++) {
+      vector<size_t> expected;
+      size_t pos = 0;
+      for (set<set<CalibrationBinBoundary> >::const_iterator t = templates.begin(); t != templates.end(); t++, pos++)
+	if (BinContains(*t, fine[i].binSpec))
+	  expected.push_back(pos);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), expected.size());
+      CPPUNIT_ASSERT(expected == index.Containing(fine[i].binSpec));
+    }
+
+    CPPUNIT_ASSERT_EQUAL(size_t(0), index.Containing(Bin(30, 50, 0, 0.25).binSpec).size());
+  }
+
+  void testOverlappingRandom()
+  {
+    srand(1234);
+    vector<CalibrationBin> bins;
+    for (int i = 0; i < 300; i++) {
+      double pt = rand() % 200;
+      double eta = (rand() % 25) / 10.0;
+      bins.push_back(Bin(pt, pt + 1 + rand() % 50, eta, eta + (1 + rand() % 10) / 10.0));
+    }
+    BinBoxIndex index(bins);
+    for (size_t i = 0; i < bins.size(); i++)
+      CPPUNIT_ASSERT(AllOverlapping(bins, bins[i].binSpec) == index.Overlapping(bins[i].binSpec));
+  }
+
+  void testMixedAxes()
+  {
+    vector<CalibrationBin> bins;
+    bins.push_back(Bin(0, 10, 0, 1));
+    CalibrationBin ptOnly;
+    ptOnly.binSpec.push_back(Boundary("pt", 0, 10));
+    bins.push_back(ptOnly);
+    bins.push_back(Bin(5, 20, 0.5, 1));
+
+    BinBoxIndex index(bins);
+    vector<size_t> found(index.Overlapping(Bin(0, 10, 0, 1).binSpec));
+    CPPUNIT_ASSERT_EQUAL(size_t(2), found.size());
+    CPPUNIT_ASSERT_EQUAL(size_t(0), found[0]);
+    CPPUNIT_ASSERT_EQUAL(size_t(2), found[1]);
+
+    found = index.Overlapping(ptOnly.binSpec);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), found.size());
+    CPPUNIT_ASSERT_EQUAL(size_t(1), found[0]);
+  }
+
+  void testRepeatedAxis()
+  {
+    // Not something real inputs have, but it must still get the same answer as BinsOverlap.
+    vector<CalibrationBin> bins;
+    bins.push_back(Bin(0, 10, 0, 1));
+    CalibrationBin odd;
+    odd.binSpec.push_back(Boundary("pt", 0, 10));
+    odd.binSpec.push_back(Boundary("pt", 5, 15));
+    bins.push_back(odd);
+
+    BinBoxIndex index(bins);
+    CalibrationBin empty;
+    CPPUNIT_ASSERT(AllOverlapping(bins, empty.binSpec) == index.Overlapping(empty.binSpec));
+    CPPUNIT_ASSERT(AllOverlapping(bins, odd.binSpec) == index.Overlapping(odd.binSpec));
+    CPPUNIT_ASSERT(AllOverlapping(bins, bins[0].binSpec) == index.Overlapping(bins[0].binSpec));
+  }
+
+  void testCovers()
+  {
+    vector<CalibrationBinBoundary> a(Bin(20, 60, 0, 1).binSpec);
+    set<CalibrationBinBoundary> area(a.begin(), a.end());
+    CPPUNIT_ASSERT(BinBoxIndex(Grid(Edges(20, 10, 4), Edges(0, 0.5, 2))).Covers(area));
+  }
+
+  void testCoversGap()
+  {
+    vector<CalibrationBinBoundary> a(Bin(20, 60, 0, 1).binSpec);
+    set<CalibrationBinBoundary> area(a.begin(), a.end());
+    vector<CalibrationBin> bins(Grid(Edges(20, 10, 4), Edges(0, 0.5, 2)));
+    bins.pop_back();
+    CPPUNIT_ASSERT(!BinBoxIndex(bins).Covers(area));
+  }
+
+  void testCoversOverlap()
+  {
+    // Same total area, but two bins overlap (and leave a hole).
+    vector<CalibrationBinBoundary> a(Bin(20, 40, 0, 1).binSpec);
+    set<CalibrationBinBoundary> area(a.begin(), a.end());
+    vector<CalibrationBin> bins;
+    bins.push_back(Bin(20, 30, 0, 1));
+    bins.push_back(Bin(25, 35, 0, 1));
+    CPPUNIT_ASSERT(!BinBoxIndex(bins).Covers(area));
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BinBoxIndexTest);
+
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
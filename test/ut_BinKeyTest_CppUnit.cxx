@@ -0,0 +1,154 @@
+///
+/// CppUnit tests for BinKey. It has to agree exactly with set<CalibrationBinBoundary> and
+/// OPBinName, as it stands in for them.
+///
+
+#include "Combination/BinKey.h"
+#include "Combination/BinNameUtils.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+using namespace BTagCombination;
+
+class BinKeyTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( BinKeyTest );
+
+  CPPUNIT_TEST( testEmpty );
+  CPPUNIT_TEST( testName );
+  CPPUNIT_TEST( testOrderDoesNotMatter );
+  CPPUNIT_TEST( testRepeatedBoundary );
+  CPPUNIT_TEST( testNotEqual );
+  CPPUNIT_TEST( testLessLikeSet );
+  CPPUNIT_TEST( testNegativeZero );
+  CPPUNIT_TEST( testWithout );
+  CPPUNIT_TEST( testRoundTrip );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  CalibrationBinBoundary Boundary(const string &var, double low, double high)
+  {
+    CalibrationBinBoundary b;
+    b.variable = var;
+    b.lowvalue = low;
+    b.highvalue = high;
+    return b;
+  }
+
+  vector<CalibrationBinBoundary> Spec(double ptLow, double ptHigh, double etaLow, double etaHigh)
+  {
+    vector<CalibrationBinBoundary> r;
+    r.push_back(Boundary("pt", ptLow, ptHigh));
+    r.push_back(Boundary("abseta", etaLow, etaHigh));
+    return r;
+  }
+
+  void testEmpty()
+  {
+    BinKey k;
+    CPPUNIT_ASSERT_EQUAL(size_t(0), k.size());
+    CPPUNIT_ASSERT(k == BinKey(vector<CalibrationBinBoundary>()));
+    CPPUNIT_ASSERT_EQUAL(string(""), k.Name());
+  }
+
+  void testName()
+  {
+    vector<CalibrationBinBoundary> spec(Spec(25.0, 40.0, 0.0, 2.5));
+    CPPUNIT_ASSERT_EQUAL(OPBinName(spec), BinKey(spec).Name());
+
+    vector<CalibrationBinBoundary> odd(Spec(1.0/3.0, 1e7, -0.1234567, 123456789.0));
+    CPPUNIT_ASSERT_EQUAL(OPBinName(odd), BinKey(odd).Name());
+  }
+
+  void testOrderDoesNotMatter()
+  {
+    vector<CalibrationBinBoundary> spec(Spec(25.0, 40.0, 0.0, 2.5));
+    vector<CalibrationBinBoundary> reversed(spec.rbegin(), spec.rend());
+    BinKey k1(spec), k2(reversed);
+    CPPUNIT_ASSERT(k1 == k2);
+    CPPUNIT_ASSERT_EQUAL(k1.Hash(), k2.Hash());
+    CPPUNIT_ASSERT_EQUAL(k1.Name(), k2.Name());
+  }
+
+  void testRepeatedBoundary()
+  {
+    // A set holds a boundary only once.
+    vector<CalibrationBinBoundary> spec(Spec(25.0, 40.0, 0.0, 2.5));
+    vector<CalibrationBinBoundary> twice(spec);
+    twice.push_back(spec[0]);
+    CPPUNIT_ASSERT(BinKey(spec) == BinKey(twice));
+    CPPUNIT_ASSERT_EQUAL(size_t(2), BinKey(twice).size());
+  }
+
+  void testNotEqual()
+  {
+    BinKey k1(Spec(25.0, 40.0, 0.0, 2.5));
+    CPPUNIT_ASSERT(k1 != BinKey(Spec(25.0, 40.0, 0.0, 1.2)));
+    CPPUNIT_ASSERT(k1 != BinKey(Spec(20.0, 40.0, 0.0, 2.5)));
+
+    vector<CalibrationBinBoundary> eta(Spec(25.0, 40.0, 0.0, 2.5));
+    eta[1].variable = "eta";
+    CPPUNIT_ASSERT(k1 != BinKey(eta));
+
+    vector<CalibrationBinBoundary> ptOnly(1, Boundary("pt", 25.0, 40.0));
+    CPPUNIT_ASSERT(k1 != BinKey(ptOnly));
+  }
+
+  void testLessLikeSet()
+  {
+    vector<vector<CalibrationBinBoundary> > specs;
+    specs.push_back(Spec(25.0, 40.0, 0.0, 2.5));
+    specs.push_back(Spec(25.0, 40.0, 0.0, 1.2));
+    specs.push_back(Spec(40.0, 60.0, 0.0, 1.2));
+    specs.push_back(Spec(20.0, 40.0, 1.2, 2.5));
+    specs.push_back(vector<CalibrationBinBoundary>(1, Boundary("pt", 25.0, 40.0)));
+    specs.push_back(vector<CalibrationBinBoundary>(1, Boundary("abseta", 0.0, 2.5)));
+
+    for (size_t i = 0; i < specs.size(); i++) {
+      set<CalibrationBinBoundary> si(specs[i].begin(), specs[i].end());
+      for (size_t j = 0; j < specs.size(); j++) {
+	set<CalibrationBinBoundary> sj(specs[j].begin(), specs[j].end());
+	CPPUNIT_ASSERT_EQUAL(si < sj, BinKey(specs[i]) < BinKey(specs[j]));
+      }
+    }
+  }
+
+  void testNegativeZero()
+  {
+    BinKey k1(Spec(25.0, 40.0, 0.0, 2.5));
+    BinKey k2(Spec(25.0, 40.0, -0.0, 2.5));
+    CPPUNIT_ASSERT(k1 == k2);
+    CPPUNIT_ASSERT_EQUAL(k1.Hash(), k2.Hash());
+  }
+
+  void testWithout()
+  {
+    vector<CalibrationBinBoundary> spec(Spec(25.0, 40.0, 0.0, 2.5));
+    vector<CalibrationBinBoundary> ptOnly(1, Boundary("pt", 25.0, 40.0));
+    CPPUNIT_ASSERT(BinKey::Without("abseta", spec) == BinKey(ptOnly));
+    CPPUNIT_ASSERT(BinKey::Without("eta", spec) == BinKey(spec));
+  }
+
+  void testRoundTrip()
+  {
+    vector<CalibrationBinBoundary> spec(Spec(25.0, 40.0, 0.0, 2.5));
+    BinKey k(spec);
+    set<CalibrationBinBoundary> s(spec.begin(), spec.end());
+    CPPUNIT_ASSERT(s == k.Boundaries());
+
+    vector<CalibrationBinBoundary> back(k.BinSpec());
+    CPPUNIT_ASSERT(back == vector<CalibrationBinBoundary>(s.begin(), s.end()));
+    CPPUNIT_ASSERT(BinKey(back) == k);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BinKeyTest);
+
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
@@ -0,0 +1,278 @@
+///
+/// CppUnit tests for the linear algebra (BLUE) combination context. Many of these
+/// mirror the MINUIT tests in ut_CombinationContextTest, as they should give the same answers.
+///
+
+#include "Combination/CombinationContextBLUE.h"
+#include "Combination/Measurement.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace BTagCombination;
+
+class CombinationContextBLUETest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( CombinationContextBLUETest );
+
+  CPPUNIT_TEST ( testCTor );
+  CPPUNIT_TEST ( testFindMeasurement );
+
+  CPPUNIT_TEST ( testFitOneNonZeroMeasurement );
+  CPPUNIT_TEST ( testFitTwoDataOneMeasurement3 );
+  CPPUNIT_TEST ( testFitWeirdMatches );
+  CPPUNIT_TEST ( testFitTwoDataOneMeasurementNoUse );
+
+  CPPUNIT_TEST ( testFitTwoDataOneMeasurementSys );
+  CPPUNIT_TEST ( testFitTwoDataOneMeasurement2 );
+  CPPUNIT_TEST ( testFitOneDataOneMeasurementSys3 );
+  CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys );
+  CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys5 );
+
+  CPPUNIT_TEST ( testFitCVShift );
+  CPPUNIT_TEST ( testFitChi2 );
+  CPPUNIT_TEST ( testFitCorrelatedResults );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  void testCTor()
+  {
+    CombinationContextBLUE *c = new CombinationContextBLUE();
+    delete c;
+  }
+
+  void testFindMeasurement()
+  {
+    CombinationContextBLUE c;
+    CPPUNIT_ASSERT (c.FindMeasurement("m1") == 0);
+    Measurement *m1 = c.AddMeasurement ("m1", "average", -10.0, 10.0, 5.0, 0.5);
+    Measurement *m2 = c.AddMeasurement ("m2", "average", -10.0, 10.0, 4.0, 0.5);
+    c.AddMeasurement ("m1", "average", -10.0, 10.0, 3.0, 0.5);
+
+    // The first one added with a name is the one found.
+    CPPUNIT_ASSERT (c.FindMeasurement("m1") == m1);
+    CPPUNIT_ASSERT (c.FindMeasurement("m2") == m2);
+    CPPUNIT_ASSERT (c.FindMeasurement("m3") == 0);
+  }
+
+  void testFitOneNonZeroMeasurement()
+  {
+    CombinationContextBLUE c;
+    c.AddMeasurement ("average", -10.0, 10.0, 5.0, 0.5);
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (5.0, fr["average"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.5, fr["average"].statisticalError, 0.0001);
+  }
+
+  void testFitTwoDataOneMeasurement3()
+  {
+    CombinationContextBLUE c;
+    double e1 = 0.1;
+    c.AddMeasurement ("average", -10.0, 10.0, 1.0, e1);
+    double e2 = 0.2;
+    c.AddMeasurement ("average", -10.0, 10.0, 0.0, e2);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    // Weighted average:
+    double w1 = 1.0/(e1*e1);
+    double w2 = 1.0/(e2*e2);
+
+    double expected = (w1*1.0 + w2*0.0)/(w1+w2);
+    double errExpected = sqrt(1.0/(w1+w2));
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (expected, fr["average"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (errExpected, fr["average"].statisticalError, 0.0001);
+  }
+
+  void testFitWeirdMatches()
+  {
+    CombinationContextBLUE c;
+    c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.2);
+    c.AddMeasurement ("a2", -10.0, 10.0, 0.0, 0.1);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.0, fr["a2"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1, fr["a2"].statisticalError, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0/sqrt(1.0/(0.1*0.1)+1.0/(0.2*0.2)), fr["a1"].statisticalError, 0.0001);
+  }
+
+  void testFitTwoDataOneMeasurementNoUse()
+  {
+    CombinationContextBLUE c;
+    c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m->setDoNotUse(true);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1, fr["a1"].statisticalError, 0.0001);
+  }
+
+  void testFitTwoDataOneMeasurementSys()
+  {
+    // Two different measurements, with two unconnected systematic errors.
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("a2", -10.0, 10.0, 0.0, 0.2);
+
+    m1->addSystematicAbs("s1", 0.2);
+    m2->addSystematicAbs("s2", 0.4);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.0, fr["a2"].centralValue, 0.0001);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1, fr["a1"].statisticalError, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, fr["a2"].statisticalError, 0.0001);
+
+    CPPUNIT_ASSERT_EQUAL (size_t(1), fr["a1"].sysErrors.size());
+    CPPUNIT_ASSERT_EQUAL (size_t(1), fr["a2"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, fr["a1"].sysErrors["s1"], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.4, fr["a2"].sysErrors["s2"], 0.0001);
+  }
+
+  void testFitTwoDataOneMeasurement2()
+  {
+    // Two measurements, common systematic error.
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a2", -10.0, 10.0, 1.0, 0.1);
+    m2->addSystematicAbs("s1", 0.2);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, fr["a2"].centralValue, 0.0001);
+
+    CPPUNIT_ASSERT_EQUAL (size_t(1), fr["a1"].sysErrors.size());
+    CPPUNIT_ASSERT_EQUAL (size_t(1), fr["a2"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, fr["a1"].sysErrors["s1"], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.2, fr["a2"].sysErrors["s1"], 0.0001);
+  }
+
+  void testFitOneDataOneMeasurementSys3()
+  {
+    CombinationContextBLUE c;
+    Measurement *m = c.AddMeasurement ("average", -10.0, 10.0, 2.0, 0.4);
+    m->addSystematicAbs("s1", 0.5748);
+    m->addSystematicAbs("s2", 0.7322);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (2.0, fr["average"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.4, fr["average"].statisticalError, 0.0001);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, fr["average"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.5748, fr["average"].sysErrors["s1"], 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.7322, fr["average"].sysErrors["s2"], 0.0001);
+  }
+
+  void testFitOneDataTwoMeasurementSys()
+  {
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.4);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s1", 0.4);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.5, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (sqrt(0.1*0.1/2.0), fr["a1"].statisticalError, 0.0001);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, fr["a1"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.4, fr["a1"].sysErrors["s1"], 0.0001);
+  }
+
+  void testFitOneDataTwoMeasurementSys5()
+  {
+    // Same numbers as the MINUIT fit gets.
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.772, fr["a1"].centralValue, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (sqrt(0.1*0.1/2.0), fr["a1"].statisticalError, 0.0001);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, fr["a1"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1708, fr["a1"].sysErrors["s1"], 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.174, fr["a1"].sysErrors["s2"], 0.01);
+  }
+
+  void testFitCVShift()
+  {
+    // Freezing s1 at zero leaves two uncorrelated measurements with errors 0.1 and
+    // sqrt(0.1^2+0.4^2) - so the shift is the difference between the two weighted averages.
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    double w1 = 1.0/(0.1*0.1 + 0.2*0.2);
+    double w2 = 1.0/(0.1*0.1 + 0.4*0.4);
+    double full = w1/(w1+w2);
+
+    double w1f = 1.0/(0.1*0.1);
+    double frozen = w1f/(w1f+w2);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (full, fr["a1"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (full - frozen, fr["a1"].cvShifts["s1"], 0.0001);
+  }
+
+  void testFitChi2()
+  {
+    // Two measurements one sigma apart from each other (0.6 and 0.8 add to 1.0 in quad)
+    CombinationContextBLUE c;
+    c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.6);
+    c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.8);
+
+    c.Fit();
+    CombinationContextBLUE::ExtraFitInfo info (c.GetExtraFitInformation());
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, info._globalChi2, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (1.0, info._ndof, 0.0001);
+  }
+
+  void testFitCorrelatedResults()
+  {
+    // one data point, two measurements, with their statistical error 25% correlated.
+    CombinationContextBLUE c;
+    Measurement *m1 = c.AddMeasurement ("average", -10.0, 10.0, 1.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("average", -10.0, 10.0, 0.0, 0.1);
+    c.AddCorrelation ("statistical", m1, m2, 0.25);
+
+    map<string, CombinationContextBLUE::FitResult> fr = c.Fit();
+
+    // The correlation is folded back into the stat error.
+    CPPUNIT_ASSERT_EQUAL (size_t(0), fr["average"].sysErrors.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.5, fr["average"].centralValue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1*sqrt((1+0.25)/2.0), fr["average"].statisticalError, 0.0001);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CombinationContextBLUETest);
+
+#ifdef ROOTCORE
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
+#endif
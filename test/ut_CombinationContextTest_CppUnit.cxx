@@ -13,6 +13,7 @@
 #include <cppunit/Exception.h>
 
 #include <stdexcept>
+#include <sstream>
 #include <cmath>
 
 using namespace std;
@@ -58,6 +59,12 @@ class CombinationContextTest : public CppUnit::TestFixture
   CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys5 );
   CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys6 );
   CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys7 );
+  CPPUNIT_TEST ( testFitOneDataTwoMeasurementSys5Covariance );
+  CPPUNIT_TEST ( testFitCVShiftCovariance );
+  CPPUNIT_TEST ( testFitCovarianceDoNotUseOnly );
+  CPPUNIT_TEST ( testFitTelemetry );
+  CPPUNIT_TEST ( testFitTelemetryCovariance );
+  CPPUNIT_TEST ( testFitTelemetryJSON );
 
   CPPUNIT_TEST ( testFitWeirdMatches );
   // Do nto understand this one yet, but going to leave it alone.
@@ -676,6 +683,152 @@ class CombinationContextTest : public CppUnit::TestFixture
     cout << "Finishing testFitOneDataTwoMeasurementSys5" << endl;
   }
 
+  void testFitOneDataTwoMeasurementSys5Covariance()
+  {
+    cout << "Starting testFitOneDataTwoMeasurementSys5Covariance" << endl;
+    // Same as Sys5, but the errors come from the covariance matrix of the single fit.
+    CombinationContext c;
+    c.setSysErrorDecomposition(CombinationContext::kFromCovariance);
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+    
+    setupRoo();
+    map<string, CombinationContext::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.772, fr["a1"].centralValue, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (sqrt(0.1*0.1/2.0), fr["a1"].statisticalError, 0.01);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, fr["a1"].sysErrors.size());
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1708, fr["a1"].sysErrors["s1"], 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.174, fr["a1"].sysErrors["s2"], 0.01);
+    cout << "Finishing testFitOneDataTwoMeasurementSys5Covariance" << endl;
+  }
+
+  void testFitCovarianceDoNotUseOnly()
+  {
+    // A quantity whose only measurement is not used isn't floated in the fit. It has nothing
+    // to decompose, and mustn't stop the others being done.
+    CombinationContext c;
+    c.setSysErrorDecomposition(CombinationContext::kFromCovariance);
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+    Measurement *m3 = c.AddMeasurement ("b1", -10.0, 10.0, 0.5, 0.1);
+    m3->addSystematicAbs("s3", 0.1);
+    m3->setDoNotUse(true);
+
+    setupRoo();
+    map<string, CombinationContext::FitResult> fr = c.Fit();
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.772, fr["a1"].centralValue, 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1708, fr["a1"].sysErrors["s1"], 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.174, fr["a1"].sysErrors["s2"], 0.01);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, fr["b1"].sysErrors.size());
+  }
+
+  void testFitCVShiftCovariance()
+  {
+    // The central value shift from freezing a nuisance parameter should be the same
+    // whether we refit or use the covariance matrix.
+    CombinationContext c1;
+    Measurement *m11 = c1.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m11->addSystematicAbs("s1", 0.2);
+    Measurement *m12 = c1.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m12->addSystematicAbs("s2", 0.4);
+
+    CombinationContext c2;
+    c2.setSysErrorDecomposition(CombinationContext::kFromCovariance);
+    Measurement *m21 = c2.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m21->addSystematicAbs("s1", 0.2);
+    Measurement *m22 = c2.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m22->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    map<string, CombinationContext::FitResult> fr1 = c1.Fit();
+    map<string, CombinationContext::FitResult> fr2 = c2.Fit();
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, fr2["a1"].cvShifts.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (fr1["a1"].cvShifts["s1"], fr2["a1"].cvShifts["s1"], 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (fr1["a1"].cvShifts["s2"], fr2["a1"].cvShifts["s2"], 0.01);
+  }
+
+  void testFitTelemetry()
+  {
+    // Every minimizer call should be recorded: the master fit, one per systematic, and the restore.
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    c.Fit();
+    CombinationContext::ExtraFitInfo info (c.GetExtraFitInformation());
+
+    CPPUNIT_ASSERT_EQUAL((size_t)4, info._fits.size());
+    CPPUNIT_ASSERT_EQUAL(string("master"), info._fits[0]._phase);
+    CPPUNIT_ASSERT_EQUAL(string("freeze s1"), info._fits[1]._phase);
+    CPPUNIT_ASSERT_EQUAL(string("freeze s2"), info._fits[2]._phase);
+    CPPUNIT_ASSERT_EQUAL(string("restore"), info._fits[3]._phase);
+
+    CPPUNIT_ASSERT_EQUAL(0, info._fits[0]._status);
+    CPPUNIT_ASSERT_EQUAL(3, info._fits[0]._covQual);
+    CPPUNIT_ASSERT(info._fits[0]._nllEvaluations > 0);
+    CPPUNIT_ASSERT(info._fits[0]._wallTime >= 0.0);
+    CPPUNIT_ASSERT_EQUAL(2, info._fits[0]._nMeasurements);
+    CPPUNIT_ASSERT_EQUAL(2, info._fits[0]._nNuisance);
+    CPPUNIT_ASSERT(info._fits[0]._nPDFNodes > 4);
+  }
+
+  void testFitTelemetryCovariance()
+  {
+    // With the covariance decomposition there is only the one fit.
+    CombinationContext c;
+    c.setSysErrorDecomposition(CombinationContext::kFromCovariance);
+    Measurement *m1 = c.AddMeasurement ("a1", -10.0, 10.0, 1.0, 0.1);
+    m1->addSystematicAbs("s1", 0.2);
+    Measurement *m2 = c.AddMeasurement ("a1", -10.0, 10.0, 0.0, 0.1);
+    m2->addSystematicAbs("s2", 0.4);
+
+    setupRoo();
+    c.Fit();
+    CombinationContext::ExtraFitInfo info (c.GetExtraFitInformation());
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, info._fits.size());
+    CPPUNIT_ASSERT_EQUAL(string("master"), info._fits[0]._phase);
+  }
+
+  void testFitTelemetryJSON()
+  {
+    CombinationContext::ExtraFitInfo info;
+    info.clear();
+    info._globalChi2 = 2.0;
+    info._ndof = 1.0;
+    CombinationContext::FitTelemetry t;
+    t._phase = "freeze \"s1\"";
+    t._wallTime = 0.5;
+    t._status = 0;
+    t._edm = 1e-7;
+    t._covQual = 3;
+    t._nllEvaluations = 42;
+    t._nMeasurements = 2;
+    t._nNuisance = 1;
+    t._nPDFNodes = 7;
+    info._fits.push_back(t);
+
+    ostringstream out;
+    info.WriteJSON(out, "bottom-MV1-0.50-AntiKt4Topo:combined");
+
+    CPPUNIT_ASSERT_EQUAL(string("{\"fit\": \"bottom-MV1-0.50-AntiKt4Topo:combined\", \"chi2\": 2, \"ndof\": 1, \"wall_time\": 0.5, "
+                                "\"minimizations\": [{\"phase\": \"freeze \\\"s1\\\"\", \"wall_time\": 0.5, \"status\": 0, \"edm\": 1e-07, "
+                                "\"cov_qual\": 3, \"nll_evaluations\": 42, \"measurements\": 2, \"nuisances\": 1, \"pdf_nodes\": 7}]}\n"),
+                         out.str());
+  }
+
   void testFitCorrelatedResults()
   {
     // one data pont, two measurements, with their statistical error 0% correlated.
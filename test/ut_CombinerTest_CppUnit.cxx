@@ -11,6 +11,7 @@
 #include "Combination/CombinationContext.h"
 
 #include <RooMsgService.h>
+#include <TSystem.h>
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/Exception.h>
@@ -90,11 +91,21 @@ class CombinerTest : public CppUnit::TestFixture
   CPPUNIT_TEST ( rebinOneToOne );
   CPPUNIT_TEST ( rebinTwoToOne );
   CPPUNIT_TEST ( rebinThreeToOne );
+  CPPUNIT_TEST ( rebinTwoToOneFit );
+  CPPUNIT_TEST ( rebinFitParallelSameAsSerial );
 
   CPPUNIT_TEST (testNDOFInBinByBin);
 
   CPPUNIT_TEST(fillContextWithOneBinAnalysis);
 
+  CPPUNIT_TEST(combineParallelSameAsSerial);
+  CPPUNIT_TEST(combineMinuitParallelSameAsSerial);
+  CPPUNIT_TEST(combineBBBParallelSameAsSerial);
+  CPPUNIT_TEST(combineBBBMinuitParallelSameAsSerial);
+
+  CPPUNIT_TEST(combineWithCacheSameResult);
+  CPPUNIT_TEST(combineWithCacheOnlyRefitsChanged);
+
   CPPUNIT_TEST_SUITE_END();
 
   void setupRoo()
@@ -2532,6 +2543,58 @@ class CombinerTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1/sqrt(3), result.bins[0].centralValueStatisticalError, 0.0001);
   }
 
+  void rebinTwoToOneFit()
+  {
+    CalibrationAnalysis ana(SimpleAna());
+    ana.bins[0].binSpec[0].highvalue = 5.0; // Now eta is 0 to 5 in one bin
+    set<set<CalibrationBinBoundary> > atemp (listAnalysisBins(ana));
+
+    ana = SimpleAna(false);
+    AddBin (ana,
+	    "eta",
+	    2.5, 5.0,
+	    0.7, 0.1);
+
+    setupRoo();
+    CalibrationAnalysis result (RebinAnalysis (atemp, ana, kRebinFit));
+
+    CPPUNIT_ASSERT_EQUAL (size_t(1), result.bins.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.6, result.bins[0].centralValue, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.1/sqrt(2), result.bins[0].centralValueStatisticalError, 0.001);
+    CPPUNIT_ASSERT_EQUAL (size_t(1), result.bins[0].binSpec.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (0.0, result.bins[0].binSpec[0].lowvalue, 0.0001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL (5.0, result.bins[0].binSpec[0].highvalue, 0.0001);
+  }
+
+  // The per-template-bin fits run in parallel must come back in template order.
+  void rebinFitParallelSameAsSerial()
+  {
+    CalibrationAnalysis tana(SimpleAna(false));
+    tana.bins.clear();
+    CalibrationAnalysis ana(SimpleAna(false));
+    ana.bins.clear();
+    for (int i_bin = 0; i_bin < 6; i_bin++) {
+      AddBin (tana, "eta", i_bin, i_bin+1, 0.5, 0.1);
+      AddBin (ana, "eta", i_bin, i_bin+0.5, 0.5 + 0.1*i_bin, 0.1);
+      AddBin (ana, "eta", i_bin+0.5, i_bin+1, 0.6 + 0.1*i_bin, 0.1);
+    }
+    set<set<CalibrationBinBoundary> > atemp (listAnalysisBins(tana));
+
+    setupRoo();
+    CalibrationAnalysis serial (RebinAnalysis (atemp, ana, kRebinFit, 1));
+    CalibrationAnalysis parallel (RebinAnalysis (atemp, ana, kRebinFit, 4));
+
+    CPPUNIT_ASSERT_EQUAL (size_t(6), serial.bins.size());
+    CPPUNIT_ASSERT_EQUAL (serial.bins.size(), parallel.bins.size());
+    for (size_t i = 0; i < serial.bins.size(); i++) {
+      CPPUNIT_ASSERT (serial.bins[i].binSpec == parallel.bins[i].binSpec);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL (double(i), parallel.bins[i].binSpec[0].lowvalue, 0.0001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL (0.55 + 0.1*i, parallel.bins[i].centralValue, 0.001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL (serial.bins[i].centralValue, parallel.bins[i].centralValue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL (serial.bins[i].centralValueStatisticalError, parallel.bins[i].centralValueStatisticalError, 1e-9);
+    }
+  }
+
   void rebinThreeToOneWithOverlap()
   {
     // Make sure that the low and high vale tests for bins being adjacent works
@@ -2650,6 +2713,233 @@ class CombinerTest : public CppUnit::TestFixture
 
   }
 
+  // Five OPs to fit, one of which only has a single analysis.
+  CalibrationInfo ParallelOPInfo()
+  {
+    CalibrationInfo info;
+    info.CombinationAnalysisName = "combined";
+    const char *ops[] = {"0.50", "0.60", "0.70", "0.80", "0.90"};
+    for (int i_op = 0; i_op < 5; i_op++) {
+      CalibrationAnalysis ana1(SimpleAna());
+      ana1.operatingPoint = ops[i_op];
+      ana1.bins[0].centralValue = 0.5 + 0.1*i_op;
+      info.Analyses.push_back(ana1);
+
+      // Leave one OP with only a single analysis so it isn't fit.
+      if (i_op != 2) {
+	CalibrationAnalysis ana2(ana1);
+	ana2.name = "ptrel";
+	ana2.bins[0].centralValue = 0.6 + 0.1*i_op;
+	info.Analyses.push_back(ana2);
+      }
+    }
+    return info;
+  }
+
+  // Several independent fits run in parallel must come back exactly as they do when run one
+  // after the other.
+  void combineParallelSameAsSerial()
+  {
+    CalibrationInfo info(ParallelOPInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> serial (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 1));
+    vector<CalibrationAnalysis> parallel (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 4));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)5, serial.size());
+    CPPUNIT_ASSERT_EQUAL(serial.size(), parallel.size());
+    for (size_t i = 0; i < serial.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(serial[i].operatingPoint, parallel[i].operatingPoint);
+      CPPUNIT_ASSERT_EQUAL(serial[i].bins.size(), parallel[i].bins.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[i].bins[0].centralValue, parallel[i].bins[0].centralValue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[i].bins[0].centralValueStatisticalError, parallel[i].bins[0].centralValueStatisticalError, 1e-9);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.55, parallel[0].bins[0].centralValue, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, parallel[2].bins[0].centralValue, 0.001);
+  }
+
+  // The same with MINUIT, whose fits are run in worker processes and sent back.
+  void combineMinuitParallelSameAsSerial()
+  {
+    CalibrationInfo info(ParallelOPInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> serial (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithMinuit, 1));
+    vector<CalibrationAnalysis> parallel (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithMinuit, 4));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)5, serial.size());
+    CPPUNIT_ASSERT_EQUAL(serial.size(), parallel.size());
+    for (size_t i = 0; i < serial.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(serial[i].name, parallel[i].name);
+      CPPUNIT_ASSERT_EQUAL(serial[i].operatingPoint, parallel[i].operatingPoint);
+      CPPUNIT_ASSERT_EQUAL(serial[i].bins.size(), parallel[i].bins.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[i].bins[0].centralValue, parallel[i].bins[0].centralValue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[i].bins[0].centralValueStatisticalError, parallel[i].bins[0].centralValueStatisticalError, 1e-9);
+      CPPUNIT_ASSERT_EQUAL(serial[i].bins[0].systematicErrors.size(), parallel[i].bins[0].systematicErrors.size());
+      CPPUNIT_ASSERT_EQUAL(serial[i].metadata.size(), parallel[i].metadata.size());
+      for (map<string, vector<double> >::const_iterator i_m = serial[i].metadata.begin(); i_m != serial[i].metadata.end(); i_m++) {
+	CPPUNIT_ASSERT_EQUAL(i_m->second.size(), parallel[i].metadata[i_m->first].size());
+	for (size_t i_v = 0; i_v < i_m->second.size(); i_v++)
+	  CPPUNIT_ASSERT_DOUBLES_EQUAL(i_m->second[i_v], parallel[i].metadata[i_m->first][i_v], 1e-9);
+      }
+      CPPUNIT_ASSERT(serial[i].metadata_s == parallel[i].metadata_s);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.55, parallel[0].bins[0].centralValue, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, parallel[2].bins[0].centralValue, 0.001);
+  }
+
+  // Two analyses with six bins each.
+  CalibrationInfo ParallelBBBInfo()
+  {
+    CalibrationAnalysis ana1(SimpleAna());
+    for (int i_bin = 1; i_bin < 6; i_bin++) {
+      CalibrationBin b(ana1.bins[0]);
+      b.binSpec[0].lowvalue = 2.5*i_bin;
+      b.binSpec[0].highvalue = 2.5*(i_bin+1);
+      b.centralValue = 0.5 + 0.05*i_bin;
+      ana1.bins.push_back(b);
+    }
+    CalibrationAnalysis ana2(ana1);
+    ana2.name = "ptrel";
+    for (size_t i_bin = 0; i_bin < ana2.bins.size(); i_bin++) {
+      ana2.bins[i_bin].centralValue += 0.1;
+    }
+
+    CalibrationInfo info;
+    info.Analyses.push_back(ana1);
+    info.Analyses.push_back(ana2);
+    return info;
+  }
+
+  // Bin-by-bin fits run in parallel must merge in the same bin order, with the same correlated chi2.
+  void combineBBBParallelSameAsSerial()
+  {
+    CalibrationInfo info(ParallelBBBInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> serial (CombineAnalyses(info, false, kCombineBySingleBin, kFitWithBLUE, 1));
+    vector<CalibrationAnalysis> parallel (CombineAnalyses(info, false, kCombineBySingleBin, kFitWithBLUE, 4));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, parallel.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)6, parallel[0].bins.size());
+    for (size_t i = 0; i < serial[0].bins.size(); i++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].bins[i].binSpec[0].lowvalue, parallel[0].bins[i].binSpec[0].lowvalue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].bins[i].centralValue, parallel[0].bins[i].centralValue, 1e-9);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].metadata["gchi2"][0], parallel[0].metadata["gchi2"][0], 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].metadata["sum_gchi2"][0], parallel[0].metadata["sum_gchi2"][0], 1e-9);
+  }
+
+  // The same with MINUIT, whose bin fits are run in worker processes (so the chi2 has to be done
+  // without the contexts they were fit in).
+  void combineBBBMinuitParallelSameAsSerial()
+  {
+    CalibrationInfo info(ParallelBBBInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> serial (CombineAnalyses(info, false, kCombineBySingleBin, kFitWithMinuit, 1));
+    vector<CalibrationAnalysis> parallel (CombineAnalyses(info, false, kCombineBySingleBin, kFitWithMinuit, 4));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)1, parallel.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)6, parallel[0].bins.size());
+    for (size_t i = 0; i < serial[0].bins.size(); i++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].bins[i].binSpec[0].lowvalue, parallel[0].bins[i].binSpec[0].lowvalue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].bins[i].centralValue, parallel[0].bins[i].centralValue, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].bins[i].centralValueStatisticalError, parallel[0].bins[i].centralValueStatisticalError, 1e-9);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].metadata["gchi2"][0], parallel[0].metadata["gchi2"][0], 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(serial[0].metadata["sum_gchi2"][0], parallel[0].metadata["sum_gchi2"][0], 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.55, parallel[0].bins[0].centralValue, 0.001);
+  }
+
+  // Remove everything from a fit cache directory so a test starts clean.
+  void clearCache(const string &dir)
+  {
+    void *d = gSystem->OpenDirectory(dir.c_str());
+    if (d == 0)
+      return;
+    vector<string> files;
+    const char *f;
+    while ((f = gSystem->GetDirEntry(d)) != 0) {
+      string fname(f);
+      if (fname != "." && fname != "..")
+	files.push_back(dir + "/" + fname);
+    }
+    gSystem->FreeDirectory(d);
+    for (size_t i = 0; i < files.size(); i++)
+      gSystem->Unlink(files[i].c_str());
+  }
+
+  // Two groups, each needing a fit.
+  CalibrationInfo cacheTestInfo()
+  {
+    CalibrationInfo info;
+    info.CombinationAnalysisName = "combined";
+    const char *ops[] = {"0.50", "0.60"};
+    for (int i_op = 0; i_op < 2; i_op++) {
+      CalibrationAnalysis ana1(SimpleAna());
+      ana1.operatingPoint = ops[i_op];
+      info.Analyses.push_back(ana1);
+      CalibrationAnalysis ana2(ana1);
+      ana2.name = "ptrel";
+      ana2.bins[0].centralValue = 0.7;
+      info.Analyses.push_back(ana2);
+    }
+    return info;
+  }
+
+  // Results read back from the cache must look exactly like a fresh fit.
+  void combineWithCacheSameResult()
+  {
+    string dir("ut_CombinerFitCache");
+    clearCache(dir);
+    CalibrationInfo info(cacheTestInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> fresh (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE));
+    vector<CalibrationAnalysis> first (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 1, dir));
+    vector<CalibrationAnalysis> second (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 1, dir));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, second.size());
+    for (size_t i = 0; i < fresh.size(); i++) {
+      ostringstream f, s1, s2;
+      f << fresh[i];
+      s1 << first[i];
+      s2 << second[i];
+      CPPUNIT_ASSERT_EQUAL(f.str(), s1.str());
+      CPPUNIT_ASSERT_EQUAL(f.str(), s2.str());
+    }
+    clearCache(dir);
+  }
+
+  // Change one group - only it should be refit, the other comes from the cache.
+  void combineWithCacheOnlyRefitsChanged()
+  {
+    string dir("ut_CombinerFitCache");
+    clearCache(dir);
+    CalibrationInfo info(cacheTestInfo());
+
+    setupRoo();
+    vector<CalibrationAnalysis> first (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 1, dir));
+
+    // One file per group (plus "." and "..").
+    void *d = gSystem->OpenDirectory(dir.c_str());
+    int nFiles = 0;
+    while (gSystem->GetDirEntry(d) != 0)
+      nFiles++;
+    gSystem->FreeDirectory(d);
+    CPPUNIT_ASSERT_EQUAL(4, nFiles);
+
+    info.Analyses[3].bins[0].centralValue = 0.9;
+    vector<CalibrationAnalysis> second (CombineAnalyses(info, false, kCombineByFullAnalysis, kFitWithBLUE, 1, dir));
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, second.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(first[0].bins[0].centralValue, second[0].bins[0].centralValue, 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.6, first[1].bins[0].centralValue, 0.001);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.7, second[1].bins[0].centralValue, 0.001);
+    clearCache(dir);
+  }
+
   // Try to fill a context with a set of simple measurements
   void fillContextWithOneBinAnalysis()
   {
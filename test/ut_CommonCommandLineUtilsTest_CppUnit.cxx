@@ -4,6 +4,7 @@
 
 #include "Combination/CommonCommandLineUtils.h"
 #include "Combination/BinNameUtils.h"
+#include "Combination/BinaryCalibrationInfo.h"
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/Exception.h>
@@ -11,6 +12,8 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
 
 using namespace std;
 using namespace BTagCombination;
@@ -40,6 +43,7 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
   CPPUNIT_TEST( testInputFromFileWithSpitAna );
 
   CPPUNIT_TEST( testOPName );
+  CPPUNIT_TEST( testOPIndependentNameCorrelation );
   CPPUNIT_TEST( testOPBin );
   CPPUNIT_TEST( testOPBinOrdering1 );
   CPPUNIT_TEST( testOPBinOrdering2 );
@@ -85,6 +89,13 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
   CPPUNIT_TEST_EXCEPTION(testCombineSplitWithOverlap, std::runtime_error);
   CPPUNIT_TEST_EXCEPTION(testCombineSplitWithPartialOverlap, std::runtime_error);
   CPPUNIT_TEST(emptyAnalysisRemoved);
+  CPPUNIT_TEST(testManyFilesInOrder);
+  CPPUNIT_TEST(testManyFilesErrorNamesFile);
+
+  CPPUNIT_TEST(shardForGroupStable);
+  CPPUNIT_TEST(analysesInShardPartition);
+  CPPUNIT_TEST_EXCEPTION(analysesInShardBadShard, std::runtime_error);
+  CPPUNIT_TEST(parseThreadCount);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -340,6 +351,28 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_EQUAL_MESSAGE("name", string("name-flavor-tagger-op-alg"), name);
   }
 
+  // A correlation has to name the same group as the analyses it is between.
+  void testOPIndependentNameCorrelation()
+  {
+    CalibrationAnalysis ana;
+    ana.name = "name";
+    ana.flavor = "flavor";
+    ana.tagger = "tagger";
+    ana.operatingPoint = "op";
+    ana.jetAlgorithm = "alg";
+
+    AnalysisCorrelation cor;
+    cor.analysis1Name = "name";
+    cor.analysis2Name = "other";
+    cor.flavor = "flavor";
+    cor.tagger = "tagger";
+    cor.operatingPoint = "op";
+    cor.jetAlgorithm = "alg";
+
+    CPPUNIT_ASSERT_EQUAL(string("flavor-tagger-op-alg"), OPIndependentName(ana));
+    CPPUNIT_ASSERT_EQUAL(OPIndependentName(ana), OPIndependentName(cor));
+  }
+
   void testOPBin()
   {
     CalibrationBin bin;
@@ -776,6 +809,74 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_EQUAL (true, b_seen);
   }
 
+  // Files are read at the same time, but must come out in command line order.
+  void testManyFilesInOrder()
+  {
+    CalibrationInfo results;
+    vector<string> unknown;
+    const char *argv[] = {TESTDATA "/JetFitCopy.txt",
+			  TESTDATA "/JetFitcnn_eff60.txt",
+			  TESTDATA "/cor.txt",
+			  TESTDATA "/JetFitcnn_eff60Split.txt"
+    };
+    ParseOPInputArgs(argv, 4, results, unknown);
+
+    ostringstream names;
+    for (size_t i = 0; i < results.Analyses.size(); i++)
+      names << results.Analyses[i].name << ":" << results.Analyses[i].bins.size() << " ";
+    CPPUNIT_ASSERT_EQUAL(string("aaa:9 bbb:9 ttbar_kin_ljets:18 "), names.str());
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, results.Correlations.size());
+    CPPUNIT_ASSERT_EQUAL(string("combined"), results.CombinationAnalysisName);
+
+    // And the same when asked for in a different order.
+    CalibrationInfo reversed;
+    const char *argvReversed[] = {argv[3], argv[2], argv[1], argv[0]};
+    ParseOPInputArgs(argvReversed, 4, reversed, unknown);
+    ostringstream reversedNames;
+    for (size_t i = 0; i < reversed.Analyses.size(); i++)
+      reversedNames << reversed.Analyses[i].name << ":" << reversed.Analyses[i].bins.size() << " ";
+    CPPUNIT_ASSERT_EQUAL(string("ttbar_kin_ljets:18 aaa:9 bbb:9 "), reversedNames.str());
+  }
+
+  // The error is for the first bad file on the command line, whichever finishes first.
+  void testManyFilesErrorNamesFile()
+  {
+    string badFile ("manyFilesBad.txt");
+    {
+      ofstream out (badFile.c_str());
+      out << "Analysis(ptrel, bottom, MV1, 0.50, MyJets){ bin(20<pt<30) }" << endl;
+    }
+
+    CalibrationInfo results;
+    vector<string> unknown;
+    const char *argv[] = {TESTDATA "/JetFitcnn_eff60.txt",
+			  badFile.c_str(),
+			  "manyFilesMissing.txt",
+			  TESTDATA "/cor.txt"
+    };
+    string message;
+    try {
+      ParseOPInputArgs(argv, 4, results, unknown);
+    }
+    catch (runtime_error &e) {
+      message = e.what();
+    }
+    CPPUNIT_ASSERT(message.find("'manyFilesBad.txt'") != string::npos);
+
+    argv[1] = TESTDATA "/cor.txt";
+    message = "";
+    try {
+      ParseOPInputArgs(argv, 4, results, unknown);
+    }
+    catch (runtime_error &e) {
+      message = e.what();
+    }
+    CPPUNIT_ASSERT(message.find("'manyFilesMissing.txt'") != string::npos);
+
+    remove(badFile.c_str());
+    remove(BinaryCacheName(badFile).c_str());
+  }
+
   CalibrationAnalysis CreateOneBinAnalsis()
   {
 	  CalibrationAnalysis result;
@@ -868,6 +969,64 @@ class CommonCommandLineUtilsTest : public CppUnit::TestFixture
 	  vector<CalibrationAnalysis> r(CombineSameAnalyses(list));
 	  CPPUNIT_ASSERT_EQUAL((size_t)0, r.size());
   }
+
+  void shardForGroupStable()
+  {
+	  // The shard a group lands in must never change - different nodes have to agree.
+	  CPPUNIT_ASSERT_EQUAL((unsigned int)1, ShardForGroup("bottom-MV1-0.50-AntiKt4Topo", 7));
+	  CPPUNIT_ASSERT_EQUAL((unsigned int)2, ShardForGroup("charm-MV1-0.60-AntiKt4Topo", 7));
+	  CPPUNIT_ASSERT_EQUAL((unsigned int)0, ShardForGroup("charm-MV1-0.60-AntiKt4Topo", 1));
+  }
+
+  void analysesInShardPartition()
+  {
+	  // Every analysis ends up in exactly one shard, and a whole group goes together.
+	  vector<CalibrationAnalysis> list;
+	  const char *ops[] = {"0.5", "0.6", "0.7", "0.8", "0.9"};
+	  for (int i = 0; i < 5; i++) {
+		  CalibrationAnalysis a1(CreateOneBinAnalsis());
+		  a1.operatingPoint = ops[i];
+		  list.push_back(a1);
+		  a1.name = "other_algo";
+		  list.push_back(a1);
+	  }
+
+	  size_t total = 0;
+	  for (unsigned int shard = 0; shard < 3; shard++) {
+		  vector<CalibrationAnalysis> r(AnalysesInShard(list, shard, 3));
+		  total += r.size();
+		  CPPUNIT_ASSERT_EQUAL((size_t)0, r.size() % 2);
+		  for (size_t i = 0; i < r.size(); i++) {
+			  CPPUNIT_ASSERT_EQUAL(shard, ShardForGroup(OPIndependentName(r[i]), 3));
+		  }
+	  }
+	  CPPUNIT_ASSERT_EQUAL(list.size(), total);
+  }
+
+  void analysesInShardBadShard()
+  {
+	  vector<CalibrationAnalysis> list;
+	  list.push_back(CreateOneBinAnalsis());
+	  AnalysesInShard(list, 3, 3);
+  }
+
+  void parseThreadCount()
+  {
+	  unsigned int n = 7;
+	  CPPUNIT_ASSERT(ParseThreadCount("8", n));
+	  CPPUNIT_ASSERT_EQUAL(8u, n);
+	  CPPUNIT_ASSERT(ParseThreadCount("0", n));
+	  CPPUNIT_ASSERT_EQUAL(0u, n);
+
+	  // Nothing that atoi would have quietly turned into 0 (all the cores).
+	  n = 7;
+	  CPPUNIT_ASSERT(!ParseThreadCount("", n));
+	  CPPUNIT_ASSERT(!ParseThreadCount("XYZ", n));
+	  CPPUNIT_ASSERT(!ParseThreadCount("-2", n));
+	  CPPUNIT_ASSERT(!ParseThreadCount("4x", n));
+	  CPPUNIT_ASSERT(!ParseThreadCount("99999999999999999999", n));
+	  CPPUNIT_ASSERT_EQUAL(7u, n);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CommonCommandLineUtilsTest);
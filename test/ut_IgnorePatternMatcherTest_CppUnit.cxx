@@ -0,0 +1,147 @@
+///
+/// CppUnit tests for the compiled --ignore matcher. Everything here should give the same
+/// answer as running regex_match with each pattern in turn.
+///
+
+#include "Combination/IgnorePatternMatcher.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/Exception.h>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+
+using namespace std;
+using namespace BTagCombination;
+
+class IgnorePatternMatcherTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( IgnorePatternMatcherTest );
+
+  CPPUNIT_TEST( testNoPatterns );
+  CPPUNIT_TEST( testLiteral );
+  CPPUNIT_TEST( testDotIsWildcard );
+  CPPUNIT_TEST( testRegex );
+  CPPUNIT_TEST( testManyRegex );
+  CPPUNIT_TEST( testBackReference );
+  CPPUNIT_TEST( testEmptyPattern );
+
+  CPPUNIT_TEST_SUITE_END();
+
+  map<string, boost::regex*> _patterns;
+
+  void Add(const string &pattern)
+  {
+    _patterns[pattern] = new boost::regex(pattern);
+  }
+
+  // The answer the patterns would give one at a time.
+  bool Expected(const string &key)
+  {
+    for (map<string, boost::regex*>::const_iterator itr = _patterns.begin(); itr != _patterns.end(); itr++) {
+      if (boost::regex_match(key, *(itr->second)))
+	return true;
+    }
+    return false;
+  }
+
+  void CheckSame(const string &key)
+  {
+    IgnorePatternMatcher m(_patterns);
+    CPPUNIT_ASSERT_EQUAL_MESSAGE(key, Expected(key), m.Matches(key));
+  }
+
+public:
+  void tearDown()
+  {
+    for (map<string, boost::regex*>::const_iterator itr = _patterns.begin(); itr != _patterns.end(); itr++)
+      delete itr->second;
+    _patterns.clear();
+  }
+
+  void testNoPatterns()
+  {
+    IgnorePatternMatcher m(_patterns);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), m.size());
+    CPPUNIT_ASSERT(!m.Matches("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-2.5:25-pt-40"));
+  }
+
+  void testLiteral()
+  {
+    Add("ptrel-bottom-MV1-0-AntiKt4Topo:25-pt-40");
+    IgnorePatternMatcher m(_patterns);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), m.size());
+    CPPUNIT_ASSERT(m.Matches("ptrel-bottom-MV1-0-AntiKt4Topo:25-pt-40"));
+    CPPUNIT_ASSERT(!m.Matches("ptrel-bottom-MV1-0-AntiKt4Topo:25-pt-400"));
+    CPPUNIT_ASSERT(!m.Matches("xptrel-bottom-MV1-0-AntiKt4Topo:25-pt-40"));
+    CPPUNIT_ASSERT(!m.Matches("AntiKt4Topo:25-pt-40"));
+  }
+
+  void testDotIsWildcard()
+  {
+    Add("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5:25-pt-40");
+    Add("ttbar-bottom-MV1-0.70-AntiKt4Topo:0-eta-4.5:40-pt-50");
+    CheckSame("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5:25-pt-40");
+    CheckSame("ttbar-bottom-MV1-0x60-AntiKt4Topo:0-eta-4y5:25-pt-40");
+    CheckSame("ttbar-bottom-MV1-0.70-AntiKt4Topo:0-eta-4.5:25-pt-40");
+    CheckSame("ttbar-bottom-MV1-0.70-AntiKt4Topo:0-eta-4.5:40-pt-50");
+    CheckSame("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5:25-pt-4");
+    CheckSame("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5");
+  }
+
+  void testRegex()
+  {
+    Add(".*:30-pt-40");
+    Add("ttbar-.*");
+    Add("ptrel-bottom-MV1-0.60-AntiKt4Topo:0-eta-[12]\\.5:.*");
+    CheckSame("system8-bottom-MV1-0.60-AntiKt4Topo:0-eta-2.5:30-pt-40");
+    CheckSame("system8-bottom-MV1-0.60-AntiKt4Topo:0-eta-2.5:30-pt-400");
+    CheckSame("ttbar-charm-SV0-5.85-AntiKt4Topo:0-eta-2.5:30-pt-400");
+    CheckSame("ptrel-bottom-MV1-0.60-AntiKt4Topo:0-eta-2.5:20-pt-30");
+    CheckSame("ptrel-bottom-MV1-0.60-AntiKt4Topo:0-eta-3.5:20-pt-30");
+    CheckSame("ptrel-bottom-MV1-0.60-AntiKt4Topo:0-eta-2x5:20-pt-30");
+  }
+
+  void testManyRegex()
+  {
+    // More than fit in one combined regex, and the only one that matches is near the end.
+    for (int i = 0; i < 200; i++) {
+      ostringstream p;
+      p << "ana" << i << "-.*:" << i << "-pt-" << (i+1);
+      Add(p.str());
+    }
+    IgnorePatternMatcher m(_patterns);
+    CPPUNIT_ASSERT_EQUAL(size_t(200), m.size());
+    CPPUNIT_ASSERT(m.Matches("ana199-bottom-MV1-0.60-AntiKt4Topo:199-pt-200"));
+    CPPUNIT_ASSERT(m.Matches("ana0-bottom-MV1-0.60-AntiKt4Topo:0-pt-1"));
+    CPPUNIT_ASSERT(!m.Matches("ana199-bottom-MV1-0.60-AntiKt4Topo:198-pt-199"));
+  }
+
+  void testBackReference()
+  {
+    // These mean something different once wrapped up with other patterns.
+    Add("(a+)-\\1");
+    Add("(b+)-x");
+    Add("c.*");
+    CheckSame("aa-aa");
+    CheckSame("aa-a");
+    CheckSame("bb-x");
+    CheckSame("bb-bb");
+    CheckSame("cc");
+  }
+
+  void testEmptyPattern()
+  {
+    // An ignore file ends with an empty line, which becomes an empty pattern.
+    Add("");
+    Add("ttbar-.*");
+    CheckSame("");
+    CheckSame("ttbar-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5:25-pt-40");
+    CheckSame("ptrel-bottom-MV1-0.60-AntiKt4Topo:0-eta-4.5:25-pt-40");
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IgnorePatternMatcherTest);
+
+// The common atlas test driver
+#include <TestPolicy/CppUnit_testdriver.cxx>
@@ -37,6 +37,10 @@ class MeasurementTest : public CppUnit::TestFixture
   CPPUNIT_TEST( testTotalError );
   CPPUNIT_TEST( testTotalErrorWithNegative );
 
+  CPPUNIT_TEST( testCovarOrderDoesNotMatter );
+  CPPUNIT_TEST( testCovarDifferentContexts );
+  CPPUNIT_TEST( testSysErrorLookup );
+
   CPPUNIT_TEST_SUITE_END();
 
   void testCovarSelf()
@@ -123,6 +127,67 @@ class MeasurementTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_DOUBLES_EQUAL(covar1, covar2, 0.01);
   }
 
+  void testCovarOrderDoesNotMatter()
+  {
+    // Errors are added in a different order than they are first seen in the context.
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("average1", -10.0, 10.0, 5.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("average2", -10.0, 10.0, 5.0, 0.1);
+    m1->addSystematicAbs("s3", 0.2);
+    m1->addSystematicAbs("s1", 0.5);
+    m1->addSystematicAbs("s2", 0.3);
+    m2->addSystematicAbs("s2", 0.4);
+    m2->addSystematicAbs("s4", 0.1);
+    m2->addSystematicAbs("s1", 0.25);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5*0.25+0.3*0.4, m1->Covar(m2), 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(m1->Covar(m2), m2->Covar(m1), 1e-9);
+
+    pair<double, double> shared (m1->SharedError(m2));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.1*0.1+0.2*0.2), shared.first, 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.5*0.5+0.3*0.3), shared.second, 1e-9);
+  }
+
+  void testCovarDifferentContexts()
+  {
+    // Each context numbers its errors on its own - matching must still be by name.
+    CombinationContext c1, c2;
+    c2.AddMeasurement ("other", -10.0, 10.0, 5.0, 0.1)->addSystematicAbs("s2", 0.1);
+    Measurement *m1 = c1.AddMeasurement ("average1", -10.0, 10.0, 5.0, 0.1);
+    Measurement *m2 = c2.AddMeasurement ("average2", -10.0, 10.0, 5.0, 0.1);
+    m1->addSystematicAbs("s1", 0.5);
+    m1->addSystematicAbs("s2", 0.3);
+    m2->addSystematicAbs("s1", 0.25);
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5*0.25, m1->Covar(m2), 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(0.1*0.1+0.3*0.3), m1->SharedError(m2).first, 1e-9);
+  }
+
+  void testSysErrorLookup()
+  {
+    CombinationContext c;
+    Measurement *m1 = c.AddMeasurement ("average1", -10.0, 10.0, 5.0, 0.1);
+    Measurement *m2 = c.AddMeasurement ("average2", -10.0, 10.0, 5.0, 0.1);
+    m1->addSystematicAbs("s2", 0.3);
+    m1->addSystematicAbs("s1", 0.5);
+    m2->addSystematicAbs("s3", 0.1);
+
+    CPPUNIT_ASSERT(m1->hasSysError("s1"));
+    CPPUNIT_ASSERT(m1->hasSysError("s2"));
+    CPPUNIT_ASSERT(!m1->hasSysError("s3"));
+    CPPUNIT_ASSERT(!m1->hasSysError("s4"));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, m1->GetSystematicErrorWidth("s1"), 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, m1->GetSystematicErrorWidth("s2"), 1e-9);
+
+    // Names come back in the order they were added.
+    vector<string> names (m1->GetSystematicErrorNames());
+    CPPUNIT_ASSERT_EQUAL((size_t)2, names.size());
+    CPPUNIT_ASSERT_EQUAL(string("s2"), names[0]);
+    CPPUNIT_ASSERT_EQUAL(string("s1"), names[1]);
+
+    CPPUNIT_ASSERT_THROW(m1->GetSystematicErrorWidth("s3"), runtime_error);
+  }
+
   void testSharedErrorIsWhole()
   {
     CombinationContext c;
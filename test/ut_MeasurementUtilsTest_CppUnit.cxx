@@ -54,6 +54,12 @@ class MeasurementUtilsTest : public CppUnit::TestFixture
   CPPUNIT_TEST(calcChi2SameFitAndMeasurementWithSys);
   CPPUNIT_TEST(calcChi2TwoMeasurementsOffBySys);
 
+  CPPUNIT_TEST(lowRankSameAsComposition);
+  CPPUNIT_TEST(lowRankChi2SameAsDense);
+  CPPUNIT_TEST(lowRankChi2NoStatError);
+
+  CPPUNIT_TEST(pairwiseSameAsMeasurement);
+
   CPPUNIT_TEST_SUITE_END();
 
   void testCovarM1One()
@@ -493,6 +499,109 @@ class MeasurementUtilsTest : public CppUnit::TestFixture
 
     CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1*0.1/0.5/0.5, CalcChi2(mlist, flist), 0.01);
   }
+
+  // A few measurements with shared, unshared, and negative systematic errors.
+  vector<Measurement*> lowRankMeasurements(CombinationContext &c)
+  {
+    vector<Measurement*> mlist;
+    mlist.push_back(c.AddMeasurement("v1", -10.0, 10.0, 5.0, 0.5));
+    mlist[0]->addSystematicAbs("s1", 0.3);
+    mlist[0]->addSystematicAbs("s2", 0.2);
+    mlist[0]->addSystematicAbs("u1", 0.4);
+    mlist.push_back(c.AddMeasurement("v1", -10.0, 10.0, 5.5, 0.3));
+    mlist[1]->addSystematicAbs("s1", -0.1);
+    mlist[1]->addSystematicAbs("s3", 0.25);
+    mlist.push_back(c.AddMeasurement("v2", -10.0, 10.0, 4.0, 0.2));
+    mlist[2]->addSystematicAbs("s2", 0.15);
+    mlist[2]->addSystematicAbs("s3", 0.35);
+    mlist.push_back(c.AddMeasurement("v2", -10.0, 10.0, 4.2, 0.6));
+    return mlist;
+  }
+
+  void lowRankSameAsComposition()
+  {
+    CombinationContext c;
+    vector<Measurement*> mlist(lowRankMeasurements(c));
+
+    LowRankCovariance lr(mlist);
+    CPPUNIT_ASSERT_EQUAL((size_t)4, lr.nMeasurements());
+    CPPUNIT_ASSERT_EQUAL((size_t)3, lr.nSharedSystematics());
+
+    TMatrixTSym<double> dense(lr.Dense());
+    TMatrixTSym<double> comp(CalcCovarMatrixUsingComposition(mlist));
+    for (int i = 0; i < 4; i++)
+      for (int j = 0; j < 4; j++)
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(comp(i, j), dense(i, j), 1e-12);
+  }
+
+  void lowRankChi2SameAsDense()
+  {
+    CombinationContext c;
+    vector<Measurement*> mlist(lowRankMeasurements(c));
+
+    vector<double> delta;
+    delta.push_back(0.1);
+    delta.push_back(-0.4);
+    delta.push_back(0.25);
+    delta.push_back(0.05);
+
+    TMatrixTSym<double> Vinv(CalcCovarMatrixUsingComposition(mlist));
+    Vinv.Invert();
+    double expected = 0.0;
+    for (int i = 0; i < 4; i++)
+      for (int j = 0; j < 4; j++)
+	expected += delta[i]*Vinv(i, j)*delta[j];
+
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, LowRankCovariance(mlist).Chi2(delta), 1e-9);
+  }
+
+  void lowRankChi2NoStatError()
+  {
+    // No uncorrelated error at all on one measurement - falls back to the full matrix.
+    CombinationContext c;
+    vector<Measurement*> mlist;
+    mlist.push_back(c.AddMeasurement("v1", -10.0, 10.0, 5.0, 0.0));
+    mlist[0]->addSystematicAbs("s1", 0.5);
+    mlist.push_back(c.AddMeasurement("v1", -10.0, 10.0, 5.0, 0.5));
+    mlist[1]->addSystematicAbs("s1", 0.5);
+
+    vector<double> delta;
+    delta.push_back(0.5);
+    delta.push_back(0.0);
+
+    // V = [[0.25, 0.25], [0.25, 0.5]], so V^-1(0,0) = 0.5/(0.125-0.0625) = 8
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25*8.0, LowRankCovariance(mlist).Chi2(delta), 1e-6);
+  }
+
+  void pairwiseSameAsMeasurement()
+  {
+    // Enough measurements to span several blocks, with a mix of shared and private errors.
+    CombinationContext c;
+    vector<Measurement*> mlist;
+    for (int i = 0; i < 70; i++) {
+      Measurement *m = c.AddMeasurement("v1", -10.0, 10.0, 5.0 + 0.01*i, 0.1 + 0.001*i);
+      for (int i_s = 0; i_s < 6; i_s++) {
+	if ((i + i_s) % 3 == 0)
+	  continue;
+	ostringstream name;
+	name << "s" << i_s;
+	m->addSystematicAbs(name.str(), (i_s % 2 == 0 ? 1.0 : -1.0) * 0.01*(1 + (i*7 + i_s) % 11));
+      }
+      if (i % 5 == 0)
+	m->addSystematicAbs("only" + string(1, char('a' + i/5)), 0.05);
+      mlist.push_back(m);
+    }
+
+    PairwiseCorrelations pairs(mlist);
+    CPPUNIT_ASSERT_EQUAL(mlist.size(), pairs.size());
+    for (size_t i = 0; i < mlist.size(); i++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(mlist[i]->totalError(), pairs.TotalError(i), 1e-12);
+      for (size_t j = 0; j < mlist.size(); j++) {
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(mlist[i]->Rho(mlist[j]), pairs.Rho(i, j), 1e-12);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL(mlist[i]->Covar(mlist[j]), pairs.Covar(i, j), 1e-12);
+      }
+    }
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(MeasurementUtilsTest);
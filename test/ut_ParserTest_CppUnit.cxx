@@ -9,16 +9,27 @@
 
 #include "Combination/Parser.h"
 #include "Combination/CalibrationDataModelStreams.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/BinaryCalibrationInfo.h"
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <cppunit/Exception.h>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
 
 using namespace std;
 using namespace BTagCombination;
 
+// Where test data is located depends on how we are building
+#ifdef ROOTCORE
+#define TESTDATA "../../../../../../Combination/testdata"
+#else
+#define TESTDATA "../testdata"
+#endif
+
 // VS2012 (which ROOT is built against) doesn't have NAN).
 #ifdef _MSC_VER
 #if (_MSC_VER <= 1700)
@@ -113,6 +124,17 @@ class ParserTest : public CppUnit::TestFixture
   CPPUNIT_TEST(testParseSplitAnalysis);
   CPPUNIT_TEST_EXCEPTION(testParseSplitAnalysisWithOverlap, std::runtime_error);
 
+  CPPUNIT_TEST(testHandWrittenSameAsSpirit);
+  CPPUNIT_TEST(testHandWrittenSameAsSpiritFiles);
+  CPPUNIT_TEST(testHandWrittenComments);
+  CPPUNIT_TEST(testHandWrittenErrors);
+  CPPUNIT_TEST(testParseStreamCallbacks);
+  CPPUNIT_TEST(testParseStreamFilter);
+  CPPUNIT_TEST(testBinaryRoundTrip);
+  CPPUNIT_TEST(testBinaryRoundTripFiles);
+  CPPUNIT_TEST(testBinaryBadInput);
+  CPPUNIT_TEST(testBinaryCache);
+
   CPPUNIT_TEST_SUITE_END();
 
   void testSourceComments()
@@ -1202,6 +1224,371 @@ class ParserTest : public CppUnit::TestFixture
     CPPUNIT_ASSERT_EQUAL(string("AntiKt"), c.jetAlgorithm);
   }
 
+  // Exact compare of everything that comes out of the parser.
+  void checkSameInfo (const CalibrationInfo &c1, const CalibrationInfo &c2)
+  {
+    CPPUNIT_ASSERT_EQUAL(c1.Analyses.size(), c2.Analyses.size());
+    for (size_t i_a = 0; i_a < c1.Analyses.size(); i_a++) {
+      const CalibrationAnalysis &a1(c1.Analyses[i_a]), &a2(c2.Analyses[i_a]);
+      CPPUNIT_ASSERT_EQUAL(OPFullName(a1), OPFullName(a2));
+      CPPUNIT_ASSERT(a1.metadata == a2.metadata);
+      CPPUNIT_ASSERT(a1.metadata_s == a2.metadata_s);
+      CPPUNIT_ASSERT_EQUAL(a1.bins.size(), a2.bins.size());
+      for (size_t i_b = 0; i_b < a1.bins.size(); i_b++) {
+        const CalibrationBin &b1(a1.bins[i_b]), &b2(a2.bins[i_b]);
+        CPPUNIT_ASSERT(b1.binSpec == b2.binSpec);
+        CPPUNIT_ASSERT_EQUAL(b1.centralValue, b2.centralValue);
+        CPPUNIT_ASSERT_EQUAL(b1.centralValueStatisticalError, b2.centralValueStatisticalError);
+        CPPUNIT_ASSERT_EQUAL(b1.isExtended, b2.isExtended);
+        CPPUNIT_ASSERT(b1.metadata == b2.metadata);
+        CPPUNIT_ASSERT_EQUAL(b1.systematicErrors.size(), b2.systematicErrors.size());
+        for (size_t i_s = 0; i_s < b1.systematicErrors.size(); i_s++) {
+          CPPUNIT_ASSERT_EQUAL(b1.systematicErrors[i_s].name, b2.systematicErrors[i_s].name);
+          CPPUNIT_ASSERT_EQUAL(b1.systematicErrors[i_s].value, b2.systematicErrors[i_s].value);
+          CPPUNIT_ASSERT_EQUAL(b1.systematicErrors[i_s].uncorrelated, b2.systematicErrors[i_s].uncorrelated);
+        }
+      }
+    }
+
+    CPPUNIT_ASSERT_EQUAL(c1.Correlations.size(), c2.Correlations.size());
+    for (size_t i_c = 0; i_c < c1.Correlations.size(); i_c++) {
+      const AnalysisCorrelation &a1(c1.Correlations[i_c]), &a2(c2.Correlations[i_c]);
+      CPPUNIT_ASSERT_EQUAL(a1.analysis1Name, a2.analysis1Name);
+      CPPUNIT_ASSERT_EQUAL(a1.analysis2Name, a2.analysis2Name);
+      CPPUNIT_ASSERT_EQUAL(a1.flavor, a2.flavor);
+      CPPUNIT_ASSERT_EQUAL(a1.tagger, a2.tagger);
+      CPPUNIT_ASSERT_EQUAL(a1.operatingPoint, a2.operatingPoint);
+      CPPUNIT_ASSERT_EQUAL(a1.jetAlgorithm, a2.jetAlgorithm);
+      CPPUNIT_ASSERT_EQUAL(a1.bins.size(), a2.bins.size());
+      for (size_t i_b = 0; i_b < a1.bins.size(); i_b++) {
+        CPPUNIT_ASSERT(a1.bins[i_b].binSpec == a2.bins[i_b].binSpec);
+        CPPUNIT_ASSERT_EQUAL(a1.bins[i_b].hasStatCorrelation, a2.bins[i_b].hasStatCorrelation);
+        CPPUNIT_ASSERT_EQUAL(a1.bins[i_b].statCorrelation, a2.bins[i_b].statCorrelation);
+      }
+    }
+
+    ostringstream d1, d2, al1, al2;
+    for (size_t i = 0; i < c1.Defaults.size(); i++)
+      d1 << "[" << c1.Defaults[i].name << "," << c1.Defaults[i].flavor << "," << c1.Defaults[i].tagger << "," << c1.Defaults[i].operatingPoint << "," << c1.Defaults[i].jetAlgorithm << "]";
+    for (size_t i = 0; i < c2.Defaults.size(); i++)
+      d2 << "[" << c2.Defaults[i].name << "," << c2.Defaults[i].flavor << "," << c2.Defaults[i].tagger << "," << c2.Defaults[i].operatingPoint << "," << c2.Defaults[i].jetAlgorithm << "]";
+    CPPUNIT_ASSERT_EQUAL(d1.str(), d2.str());
+
+    for (size_t i = 0; i < c1.Aliases.size(); i++)
+      al1 << c1.Aliases[i] << "|" << c1.Aliases[i].name << "|" << c1.Aliases[i].jetAlgorithm;
+    for (size_t i = 0; i < c2.Aliases.size(); i++)
+      al2 << c2.Aliases[i] << "|" << c2.Aliases[i].name << "|" << c2.Aliases[i].jetAlgorithm;
+    CPPUNIT_ASSERT_EQUAL(al1.str(), al2.str());
+  }
+
+  CalibrationInfo parseHandWritten (const string &text)
+  {
+    calibrationFilterInfo fInfo;
+    return ParseBuffer(text.data(), text.data() + text.size(), fInfo);
+  }
+
+  CalibrationInfo parseSpirit (const string &text)
+  {
+    calibrationFilterInfo fInfo;
+    return ParseSpirit(text, fInfo);
+  }
+
+  void testHandWrittenSameAsSpirit()
+  {
+    cout << "Test testHandWrittenSameAsSpirit" << endl;
+    const char *inputs[] = {
+      "",
+      "  \n\t ",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){}",
+      "Analysis(ptrel ,bottom ,SV0, 0.50 ,MyJets){bin(20<pt<30){central_value(0.5,0.01)}}",
+      "Analysis(negative tags,light, SV0, 0.50, MyJets){bin( 20<pt< 30, 0.0<abseta<1.2){central_value(0.5,0.01) meta_data(N jets tagger,    589, 24.3)}}",
+      "Analysis(ptrel, bottom, SV0, !=0, MyJets){bin(20<pt<30){central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){ meta_data_s (ISR FSR, no way) bin(20<pt<30){central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){ meta_data_s(Linage, D*[tbarpdf+dork=>DStar]) bin(20<pt<30){central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(ISR/FSR, -0.1%)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(\"dude \", 0.1%) sys(\"  a, b\" , 0.2)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(dude: fo.rk*, 0.1 %) usys(dude2, 0.1%)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.7,3.3%) sys(a\\b;c, 1e-2) sys(b  c, .5) sys(d, 5.) sys(e, -2.5E+1%) }}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)meta_data (ISR(FSR), -0.1,1.0) meta_data(dude, 0.1)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){meta_data(ISR FSR, -0.1)bin(20<pt<30){central_value(0.5,0.01)}meta_data(\"yo,dude\", -0.1, 4, 5)}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){exbin(20<pt<30){central_value(0.5,0.01) sys(dude, 0.1%)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}} Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(30<pt<40){central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets)\r\n{\r\n\tbin(20<pt<30)\r\n\t{\r\n\t\tcentral_value(+0.5,0.01)\r\n\t}\r\n}\r\n",
+      "Correlation (ptrel, s8, bottom, MV1, 0.9, AntiKt) { bin (0 < pt < 5) {statistical(-0.5)} bin(5<pt<10, 0<abseta<2.5){}}",
+      "Correlation(ptrel ,\n s8 is here\n, bottom, MV1, 0.9, AntiKt) { }",
+      "Default (ptrel, bottom, *, *,*) Default(a b,c,d,e,f )",
+      "Copy(ptrel, bottom, MV1, 0.9, AntiKt) {Analysis(ptrel, bottom, MV2, 0.9, AntiKt) Analysis(ptrel, bottom, MV3, 0.9, AntiKt)}",
+      0
+    };
+
+    for (int i = 0; inputs[i] != 0; i++) {
+      checkSameInfo(parseSpirit(inputs[i]), parseHandWritten(inputs[i]));
+    }
+  }
+
+  void testHandWrittenSameAsSpiritFiles()
+  {
+    cout << "Test testHandWrittenSameAsSpiritFiles" << endl;
+    const char *files[] = {"JetFitCopy.txt", "JetFitcnn_eff60.txt", "JetFitcnn_eff60Split.txt", "cor.txt", 0};
+    for (int i = 0; files[i] != 0; i++) {
+      string fname (string(TESTDATA) + "/" + files[i]);
+
+      calibrationFilterInfo fInfo;
+      SetParserBackend(kSpiritParser);
+      CalibrationInfo spirit (ParseFile(fname, fInfo));
+      SetParserBackend(kHandWrittenParser);
+      CalibrationInfo handWritten (ParseFile(fname, fInfo));
+
+      checkSameInfo(spirit, handWritten);
+    }
+  }
+
+  void testHandWrittenComments()
+  {
+    cout << "Test testHandWrittenComments" << endl;
+    string text ("# A comment\n"
+                 "Analysis(ptrel, bottom, SV0, 0.50, MyJets) {\n"
+                 "#bin(30<pt<40){central_value(0.5,0.01)}\n"
+                 "  bin(20<pt<30){central_value(0.5,0.01)}\n"
+                 "}\n"
+                 "Correlation(ptrel, s8\n"
+                 "# inside a name\n"
+                 "#\n"
+                 ", bottom, MV1, 0.9, AntiKt) {}\n"
+                 "#");
+
+    calibrationFilterInfo fInfo;
+    istringstream spiritInput (text);
+    SetParserBackend(kSpiritParser);
+    CalibrationInfo spirit (Parse(spiritInput, fInfo));
+    istringstream input (text);
+    SetParserBackend(kHandWrittenParser);
+    CalibrationInfo handWritten (Parse(input, fInfo));
+
+    checkSameInfo(spirit, handWritten);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, handWritten.Analyses.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, handWritten.Analyses[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL(string("s8\n"), handWritten.Correlations[0].analysis2Name);
+  }
+
+  void testHandWrittenErrors()
+  {
+    cout << "Test testHandWrittenErrors" << endl;
+    const char *inputs[] = {
+      "AAANNNnalysis(ptrel, bottom, SV050){}",
+      "Analysis(ptrel, botttom, SV050){}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(dude 0.1)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(dude, 1e)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(dude, 0.1) sys(dude, nan)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(nan,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){sys(dude, 0.1)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30,){central_value(0.5,0.01)}}",
+      "Analysis(ptrel, bottom, SV0, 0.50, MyJets){meta_data(junk)}",
+      "Correlation (ptrel, s8, bottom, MV1, 0.9, AntiKt) { bin (0 < pt < 5) {statistical(1.1)}}",
+      "Default (ptrel, bottom, MV1, 0.9)",
+      "Copy(ptrel, bottom, MV1, 0.9, AntiKt) {Analysis(ptrel, bottom, MV2, 0.9, AntiKt) junk}",
+      0
+    };
+
+    for (int i = 0; inputs[i] != 0; i++) {
+      bool spiritThrew = false, handWrittenThrew = false;
+      try { parseSpirit(inputs[i]); } catch (runtime_error &) { spiritThrew = true; }
+      try { parseHandWritten(inputs[i]); } catch (runtime_error &) { handWrittenThrew = true; }
+      CPPUNIT_ASSERT_MESSAGE(inputs[i], spiritThrew);
+      CPPUNIT_ASSERT_MESSAGE(inputs[i], handWrittenThrew);
+    }
+  }
+
+  void testParseStreamCallbacks()
+  {
+    cout << "Test testParseStreamCallbacks" << endl;
+    string text ("Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}}"
+                 "Default(ptrel, bottom, SV0, 0.50, MyJets)"
+                 "Analysis(ptrel, bottom, SV0, 0.50, MyJets){bin(30<pt<40){central_value(0.5,0.01)}}"
+                 "Correlation(ptrel, s8, bottom, SV0, 0.50, MyJets){bin(20<pt<30){statistical(0.5)}}"
+                 "Copy(ptrel, bottom, SV0, 0.50, MyJets){Analysis(ptrel, bottom, SV1, 0.50, MyJets)}");
+
+    ostringstream order;
+    CalibrationInfoCallbacks callbacks;
+    callbacks.Analysis = [&order] (CalibrationAnalysis &a) { order << "A" << a.bins.size(); };
+    callbacks.Correlation = [&order] (AnalysisCorrelation &c) { order << "C" << c.bins.size(); };
+    callbacks.Default = [&order] (DefaultAnalysis &) { order << "D"; };
+    callbacks.Alias = [&order] (AliasAnalysis &a) { order << "L" << a.CopyTargets.size(); };
+
+    calibrationFilterInfo fInfo;
+    ParseStream(text.data(), text.data() + text.size(), fInfo, callbacks);
+
+    // The split analysis comes out as two pieces - nothing is combined.
+    CPPUNIT_ASSERT_EQUAL(string("A1DA1C1L1"), order.str());
+  }
+
+  void testParseStreamFilter()
+  {
+    cout << "Test testParseStreamFilter" << endl;
+    string text ("Analysis(ptrel, bottom, MV1, 0.50, MyJets){meta_data_s(a, b) bin(20<pt<30){central_value(0.5,0.01)} bin(30<pt<40){central_value(0.5,0.01)}}"
+                 "Analysis(ptrel, bottom, MV2, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}}"
+                 "Analysis(s8, bottom, MV1, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}}"
+                 "Correlation(ptrel, s8, bottom, MV1, 0.50, MyJets){bin(20<pt<30){statistical(0.5)} bin(30<pt<40){}}"
+                 "Correlation(ptrel, s8, bottom, MV2, 0.50, MyJets){bin(20<pt<30){statistical(0.5)}}");
+
+    calibrationFilterInfo fInfo;
+    fInfo.spOnlyTagger["MV1"] = new boost::regex("MV1");
+    fInfo.OPsToIgnore[".*:30-pt-40"] = new boost::regex(".*:30-pt-40");
+
+    vector<CalibrationAnalysis> anas;
+    vector<AnalysisCorrelation> cors;
+    CalibrationInfoCallbacks callbacks;
+    callbacks.Analysis = [&anas] (CalibrationAnalysis &a) { anas.push_back(a); };
+    callbacks.Correlation = [&cors] (AnalysisCorrelation &c) { cors.push_back(c); };
+    ParseStream(text.data(), text.data() + text.size(), fInfo, callbacks);
+
+    CPPUNIT_ASSERT_EQUAL((size_t)2, anas.size());
+    CPPUNIT_ASSERT_EQUAL(string("ptrel"), anas[0].name);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, anas[0].bins.size());
+    CPPUNIT_ASSERT_EQUAL(string("s8"), anas[1].name);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, cors.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, cors[0].bins.size());
+
+    // And the same as filtering everything after a full parse.
+    checkSameInfo(ParseSpirit(text, fInfo), ParseBuffer(text.data(), text.data() + text.size(), fInfo));
+  }
+
+  CalibrationInfo binaryRoundTrip (const CalibrationInfo &info)
+  {
+    ostringstream out;
+    WriteBinary(out, info);
+    string buffer (out.str());
+    return ReadBinary(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  void testBinaryRoundTrip()
+  {
+    cout << "Test testBinaryRoundTrip" << endl;
+    CalibrationInfo info (parseHandWritten("Analysis(ptrel, bottom, MV1, 0.50, MyJets){ meta_data_s(Linage, ptrel) meta_data(gchi2, 1.5, 2, 3)"
+                                           " bin(20<pt<30, 0<abseta<2.5){central_value(0.5,0.01) sys(JES, 1%) usys(MC stats, 0.02) meta_data(N jets, 589, 24.3)}"
+                                           " exbin(30<pt<40, 0<abseta<2.5){central_value(-1e-24,1e300) sys(JES, 0)}}"
+                                           "Correlation(ptrel, s8, bottom, MV1, 0.50, MyJets){bin(20<pt<30){statistical(0.5)} bin(30<pt<40){}}"
+                                           "Default(ptrel, bottom, MV1, 0.50, MyJets)"
+                                           "Copy(ptrel, bottom, MV1, 0.50, MyJets){Analysis(ptrel, bottom, MV2, 0.50, MyJets) Analysis(ptrel, bottom, MV3, 0.50, MyJets)}"));
+    info.CombinationAnalysisName = "combined";
+    info.BinByBin = true;
+
+    CalibrationInfo result (binaryRoundTrip(info));
+    checkSameInfo(info, result);
+    CPPUNIT_ASSERT_EQUAL(string("combined"), result.CombinationAnalysisName);
+    CPPUNIT_ASSERT(result.BinByBin);
+    CPPUNIT_ASSERT(result.Analyses[0].bins[1].isExtended);
+    CPPUNIT_ASSERT(result.Analyses[0].bins[0].systematicErrors[1].uncorrelated);
+
+    checkSameInfo(CalibrationInfo(), binaryRoundTrip(CalibrationInfo()));
+  }
+
+  void testBinaryRoundTripFiles()
+  {
+    cout << "Test testBinaryRoundTripFiles" << endl;
+    const char *files[] = {"JetFitCopy.txt", "JetFitcnn_eff60.txt", "cor.txt", 0};
+    for (int i = 0; files[i] != 0; i++) {
+      calibrationFilterInfo fInfo;
+      CalibrationInfo info (ParseFile(string(TESTDATA) + "/" + files[i], fInfo));
+      checkSameInfo(info, binaryRoundTrip(info));
+    }
+  }
+
+  void testBinaryBadInput()
+  {
+    cout << "Test testBinaryBadInput" << endl;
+    ostringstream out;
+    WriteBinary(out, parseHandWritten("Analysis(ptrel, bottom, MV1, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01) sys(JES, 1%)}}"));
+    string buffer (out.str());
+
+    // Every possible truncation must be caught.
+    for (size_t len = 0; len < buffer.size(); len++) {
+      bool threw = false;
+      try {
+        ReadBinary(buffer.data(), buffer.data() + len);
+      }
+      catch (runtime_error &) {
+        threw = true;
+      }
+      CPPUNIT_ASSERT(threw);
+    }
+
+    // Text is not binary, nor is a file from a different version.
+    string text ("Analysis(ptrel, bottom, MV1, 0.50, MyJets){}");
+    CPPUNIT_ASSERT_THROW(ReadBinary(text.data(), text.data() + text.size()), runtime_error);
+    string otherVersion (buffer);
+    otherVersion[8] = 99;
+    CPPUNIT_ASSERT_THROW(ReadBinary(otherVersion.data(), otherVersion.data() + otherVersion.size()), runtime_error);
+  }
+
+  void testBinaryCache()
+  {
+    cout << "Test testBinaryCache" << endl;
+    string textFile ("binaryCacheTest.txt");
+    {
+      ofstream out (textFile.c_str());
+      out << "Analysis(ptrel, bottom, MV1, 0.50, MyJets){bin(20<pt<30){central_value(0.5,0.01)}}" << endl;
+    }
+    remove(BinaryCacheName(textFile).c_str());
+
+    calibrationFilterInfo fInfo;
+    CalibrationInfo info;
+    CPPUNIT_ASSERT(!LoadBinaryCache(textFile, fInfo, info));
+
+    // The cache is used as is once it is there - make it different from the text to be sure.
+    CalibrationInfo cached (ParseFile(textFile, fInfo));
+    cached.Analyses[0].bins[0].centralValue = 0.75;
+    StoreBinaryCache(textFile, fInfo, cached);
+    CPPUNIT_ASSERT(IsBinaryCalibrationFile(BinaryCacheName(textFile)));
+    CPPUNIT_ASSERT(!IsBinaryCalibrationFile(textFile));
+    CPPUNIT_ASSERT(LoadBinaryCache(textFile, fInfo, info));
+    CPPUNIT_ASSERT_EQUAL(0.75, info.Analyses[0].bins[0].centralValue);
+
+    // Different filter settings, or a turned-off cache, and it isn't used.
+    calibrationFilterInfo otherFilter;
+    otherFilter.spOnlyTagger["MV1"] = new boost::regex("MV1");
+    CPPUNIT_ASSERT(FilterKey(fInfo) != FilterKey(otherFilter));
+    CPPUNIT_ASSERT(!LoadBinaryCache(textFile, otherFilter, info));
+    SetBinaryCacheEnabled(false);
+    CPPUNIT_ASSERT(!LoadBinaryCache(textFile, fInfo, info));
+    SetBinaryCacheEnabled(true);
+
+    // A change to the text file makes it out of date.
+    {
+      ofstream out (textFile.c_str(), ios::app);
+      out << "Default(ptrel, bottom, MV1, 0.50, MyJets)" << endl;
+    }
+    CPPUNIT_ASSERT(!LoadBinaryCache(textFile, fInfo, info));
+
+    // An edit that keeps the size and the time stamp is still caught, by the contents' hash. Fake
+    // one by writing a cache whose header matches the file in everything but the hash.
+    BinaryCalibrationHeader before;
+    ReadBinaryFile(BinaryCacheName(textFile), &before);
+    {
+      ofstream out (textFile.c_str());
+      out << "Analysis(ptrel, bottom, MV1, 0.50, MyJets){bin(20<pt<30){central_value(0.6,0.01)}}" << endl;
+    }
+    StoreBinaryCache(textFile, fInfo, cached);
+    BinaryCalibrationHeader after;
+    ReadBinaryFile(BinaryCacheName(textFile), &after);
+    CPPUNIT_ASSERT_EQUAL(before.sourceSize, after.sourceSize);
+    CPPUNIT_ASSERT(before.sourceHash != after.sourceHash);
+    CPPUNIT_ASSERT(LoadBinaryCache(textFile, fInfo, info));
+
+    BinaryCalibrationHeader stale (after);
+    stale.sourceHash = before.sourceHash;
+    {
+      ofstream out (BinaryCacheName(textFile).c_str(), ios::binary);
+      WriteBinary(out, cached, stale);
+    }
+    CPPUNIT_ASSERT(!LoadBinaryCache(textFile, fInfo, info));
+
+    remove(BinaryCacheName(textFile).c_str());
+    remove(textFile.c_str());
+  }
+
   void testParseCopyRoundtrip()
   {
     cout << "Test testParseCopy" << endl;
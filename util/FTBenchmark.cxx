@@ -0,0 +1,401 @@
+//
+// FTBenchmark
+//
+//  Generate synthetic calibration inputs of a given size and time each stage of the
+// standard processing chain on them (parse, combine, rebin, extrapolate, CDI conversion).
+// Used to see how things scale as the inputs grow toward production sizes.
+//
+
+#include "Combination/Parser.h"
+#include "Combination/Combiner.h"
+#include "Combination/ExtrapolationTools.h"
+#include "Combination/CDIConverter.h"
+#include "Combination/CalibrationDataModelStreams.h"
+
+#include <RooMsgService.h>
+#include <TROOT.h>
+#include <RVersion.h>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+using namespace BTagCombination;
+
+namespace {
+
+  // How big the synthetic inputs should be.
+  struct BenchmarkSize {
+    unsigned int nAnalyses; // Analyses in each group
+    unsigned int nBins; // Bins along each axis
+    unsigned int nAxes; // Number of binning axes (1-3)
+    unsigned int nSys; // Systematic errors in each bin (shared by all analyses)
+    unsigned int nCorrelations; // Statistically correlated analysis pairs in each group
+    unsigned int nGroups; // Independent flavor/tagger/op/jet groups
+  };
+
+  const char *cAxisNames[] = {"pt", "abseta", "dr"};
+  const unsigned int cMaxAxes = 3;
+
+  // Make all the bins for a regular grid. The first axis (pt) can have some extra bins tacked
+  // onto the high end (for the extrapolation).
+  vector<vector<CalibrationBinBoundary> > GridBins (const BenchmarkSize &size, unsigned int extraPtBins = 0)
+  {
+    vector<vector<CalibrationBinBoundary> > result(1);
+    for (unsigned int i_axis = 0; i_axis < size.nAxes; i_axis++) {
+      unsigned int nBins = size.nBins + (i_axis == 0 ? extraPtBins : 0);
+      vector<vector<CalibrationBinBoundary> > next;
+      for (size_t i_r = 0; i_r < result.size(); i_r++) {
+	for (unsigned int i_b = 0; i_b < nBins; i_b++) {
+	  CalibrationBinBoundary b;
+	  b.variable = cAxisNames[i_axis];
+	  b.lowvalue = 20.0*i_b;
+	  b.highvalue = 20.0*(i_b+1);
+	  vector<CalibrationBinBoundary> spec(result[i_r]);
+	  spec.push_back(b);
+	  next.push_back(spec);
+	}
+      }
+      result = next;
+    }
+    return result;
+  }
+
+  // The name of each group
+  CalibrationAnalysis GroupTemplate (unsigned int group)
+  {
+    CalibrationAnalysis ana;
+    ana.flavor = "bottom";
+    ana.tagger = "MV1";
+    ostringstream op;
+    op << "OP" << group;
+    ana.operatingPoint = op.str();
+    ana.jetAlgorithm = "AntiKt4Topo";
+    ana.metadata_s["Hadronization"] = "Pythia6";
+    return ana;
+  }
+
+  //
+  // Build a full set of inputs. A fixed seed means a given size always gives the same inputs.
+  //
+  CalibrationInfo GenerateInputs (const BenchmarkSize &size)
+  {
+    mt19937 rnd(4357);
+    uniform_real_distribution<double> cv(0.9, 1.1), stat(0.05, 0.1), sys(0.01, 0.05);
+
+    vector<vector<CalibrationBinBoundary> > grid(GridBins(size));
+
+    CalibrationInfo info;
+    info.CombinationAnalysisName = "combined";
+    info.BinByBin = false;
+    for (unsigned int i_g = 0; i_g < size.nGroups; i_g++) {
+      for (unsigned int i_a = 0; i_a < size.nAnalyses; i_a++) {
+	CalibrationAnalysis ana(GroupTemplate(i_g));
+	ostringstream name;
+	name << "ana" << i_a;
+	ana.name = name.str();
+
+	for (size_t i_b = 0; i_b < grid.size(); i_b++) {
+	  CalibrationBin bin;
+	  bin.binSpec = grid[i_b];
+	  bin.centralValue = cv(rnd);
+	  bin.centralValueStatisticalError = stat(rnd);
+	  bin.isExtended = false;
+	  for (unsigned int i_s = 0; i_s < size.nSys; i_s++) {
+	    SystematicError e;
+	    ostringstream sname;
+	    sname << "sys" << i_s;
+	    e.name = sname.str();
+	    e.value = sys(rnd);
+	    e.uncorrelated = false;
+	    bin.systematicErrors.push_back(e);
+	  }
+	  ana.bins.push_back(bin);
+	}
+	info.Analyses.push_back(ana);
+      }
+
+      for (unsigned int i_c = 0; i_c < size.nCorrelations && i_c+1 < size.nAnalyses; i_c++) {
+	AnalysisCorrelation cor;
+	ostringstream n1, n2;
+	n1 << "ana" << i_c;
+	n2 << "ana" << i_c+1;
+	cor.analysis1Name = n1.str();
+	cor.analysis2Name = n2.str();
+	CalibrationAnalysis t(GroupTemplate(i_g));
+	cor.flavor = t.flavor;
+	cor.tagger = t.tagger;
+	cor.operatingPoint = t.operatingPoint;
+	cor.jetAlgorithm = t.jetAlgorithm;
+	for (size_t i_b = 0; i_b < grid.size(); i_b++) {
+	  BinCorrelation bc;
+	  bc.binSpec = grid[i_b];
+	  bc.hasStatCorrelation = true;
+	  bc.statCorrelation = 0.2;
+	  cor.bins.push_back(bc);
+	}
+	info.Correlations.push_back(cor);
+      }
+    }
+    return info;
+  }
+
+  // An extrapolation for an analysis: the same bins, plus one more pt bin on the high side.
+  CalibrationAnalysis GenerateExtrapolation (const BenchmarkSize &size, const CalibrationAnalysis &ana)
+  {
+    CalibrationAnalysis extrap(ana);
+    extrap.name = "extrap";
+    extrap.bins.clear();
+    extrap.metadata.clear();
+    vector<vector<CalibrationBinBoundary> > grid(GridBins(size, 1));
+    for (size_t i_b = 0; i_b < grid.size(); i_b++) {
+      CalibrationBin bin;
+      bin.binSpec = grid[i_b];
+      bin.centralValue = 1.0;
+      bin.centralValueStatisticalError = 0.1;
+      bin.isExtended = false;
+      SystematicError e;
+      e.name = "extr";
+      e.value = 0.02*(1+grid[i_b][0].lowvalue/20.0);
+      e.uncorrelated = false;
+      bin.systematicErrors.push_back(e);
+      extrap.bins.push_back(bin);
+    }
+    return extrap;
+  }
+
+  // Template binning that merges pairs of pt bins. With an odd number of pt bins the last one is
+  // left on its own (a pair would run past the end of the source bins).
+  set<set<CalibrationBinBoundary> > CoarsePtBinning (const CalibrationAnalysis &ana)
+  {
+    double ptMax = 0.0;
+    for (size_t i_b = 0; i_b < ana.bins.size(); i_b++) {
+      for (size_t i_bb = 0; i_bb < ana.bins[i_b].binSpec.size(); i_bb++) {
+	const CalibrationBinBoundary &b(ana.bins[i_b].binSpec[i_bb]);
+	if (b.variable == "pt" && b.highvalue > ptMax)
+	  ptMax = b.highvalue;
+      }
+    }
+
+    set<set<CalibrationBinBoundary> > result;
+    for (size_t i_b = 0; i_b < ana.bins.size(); i_b++) {
+      set<CalibrationBinBoundary> spec;
+      for (size_t i_bb = 0; i_bb < ana.bins[i_b].binSpec.size(); i_bb++) {
+	CalibrationBinBoundary b(ana.bins[i_b].binSpec[i_bb]);
+	if (b.variable == "pt") {
+	  int pair = int(b.lowvalue/40.0);
+	  b.lowvalue = 40.0*pair;
+	  b.highvalue = min(40.0*(pair+1), ptMax);
+	}
+	spec.insert(b);
+      }
+      result.insert(spec);
+    }
+    return result;
+  }
+
+  // Peak resident memory of the whole process so far, in MB. It never goes down, so a stage's
+  // own use only shows up as the amount it pushes this past the earlier stages' peak.
+  double PeakRSSMB (void)
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+  }
+
+  // Run one stage and print out how long it took, how much it raised the peak memory, and the
+  // peak so far.
+  void TimeStage (const string &stage, const BenchmarkSize &size, const function<void(void)> &work)
+  {
+    double peakBefore = PeakRSSMB();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    work();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double peakAfter = PeakRSSMB();
+
+    cout << setw(12) << left << stage << right
+	 << setw(6) << size.nGroups
+	 << setw(6) << size.nAnalyses
+	 << setw(6) << size.nBins
+	 << setw(6) << size.nAxes
+	 << setw(6) << size.nSys
+	 << setw(6) << size.nCorrelations
+	 << setw(12) << fixed << setprecision(3) << seconds
+	 << setw(12) << fixed << setprecision(1) << peakAfter - peakBefore
+	 << setw(12) << fixed << setprecision(1) << peakAfter
+	 << endl;
+  }
+
+  //
+  // Run the full chain once for a given size.
+  //
+  void RunBenchmark (const BenchmarkSize &size, CombinationFitter fitter, unsigned int nThreads, const string &dumpFile)
+  {
+    CalibrationInfo generated;
+    string text;
+    TimeStage("generate", size, [&] () {
+	generated = GenerateInputs(size);
+	ostringstream out;
+	out << generated;
+	text = out.str();
+      });
+
+    if (dumpFile != "") {
+      ofstream dump(dumpFile.c_str());
+      dump << text;
+    }
+
+    CalibrationInfo info;
+    TimeStage("parse", size, [&] () { info = Parse(text); });
+    info.CombinationAnalysisName = "combined";
+
+    vector<CalibrationAnalysis> combined;
+    TimeStage("combine", size, [&] () {
+	combined = CombineAnalyses(info, false, kCombineByFullAnalysis, fitter, nThreads);
+      });
+    TimeStage("combineBBB", size, [&] () {
+	CombineAnalyses(info, false, kCombineBySingleBin, fitter, nThreads);
+      });
+
+    if (size.nBins > 1) {
+      TimeStage("rebin", size, [&] () {
+	  for (size_t i = 0; i < combined.size(); i++)
+	    RebinAnalysis(CoarsePtBinning(combined[i]), combined[i]);
+	});
+    }
+
+    vector<CalibrationAnalysis> extrapolated;
+    TimeStage("extrapolate", size, [&] () {
+	for (size_t i = 0; i < combined.size(); i++)
+	  extrapolated.push_back(addExtrapolation(GenerateExtrapolation(size, combined[i]), combined[i]));
+      });
+
+    TimeStage("cdi", size, [&] () {
+	for (size_t i = 0; i < extrapolated.size(); i++)
+	  delete ConvertToCDI(extrapolated[i], "default_SF");
+      });
+  }
+
+  unsigned int &ScanParameter (BenchmarkSize &size, const string &name)
+  {
+    if (name == "analyses") return size.nAnalyses;
+    if (name == "bins") return size.nBins;
+    if (name == "axes") return size.nAxes;
+    if (name == "sys") return size.nSys;
+    if (name == "correlations") return size.nCorrelations;
+    if (name == "groups") return size.nGroups;
+    throw runtime_error("Unknown benchmark size parameter '" + name + "'");
+  }
+}
+
+void usage (void);
+
+int main (int argc, char **argv)
+{
+  try {
+    BenchmarkSize size;
+    size.nAnalyses = 3;
+    size.nBins = 4;
+    size.nAxes = 2;
+    size.nSys = 5;
+    size.nCorrelations = 1;
+    size.nGroups = 2;
+
+    CombinationFitter fitter = kFitWithMinuit;
+    unsigned int nThreads = 1;
+    string scan ("");
+    unsigned int steps = 1;
+    string dumpFile ("");
+
+    for (int i = 1; i < argc; i++) {
+      string a(argv[i]);
+      if (a == "--blue") {
+	fitter = kFitWithBLUE;
+	continue;
+      } else if (a == "--singlefit") {
+	fitter = kFitWithMinuitSingleFit;
+	continue;
+      }
+
+      if (a.substr(0, 2) != "--" || i + 1 == argc) {
+	cerr << "Error: Unknown or incomplete argument " << a << endl;
+	usage();
+	return 1;
+      }
+      string v(argv[++i]);
+      string flag(a.substr(2));
+      if (flag == "threads") {
+	nThreads = atoi(v.c_str());
+      } else if (flag == "scan") {
+	scan = v;
+	ScanParameter(size, scan);
+      } else if (flag == "steps") {
+	steps = atoi(v.c_str());
+      } else if (flag == "dump") {
+	dumpFile = v;
+      } else {
+	ScanParameter(size, flag) = atoi(v.c_str());
+      }
+    }
+
+    if (size.nAxes < 1 || size.nAxes > cMaxAxes) {
+      cerr << "Error: --axes must be between 1 and " << cMaxAxes << endl;
+      return 1;
+    }
+    if (steps > 1 && scan == "") {
+      cerr << "Error: --steps needs a --scan parameter to vary" << endl;
+      return 1;
+    }
+    if (size.nAnalyses < 1 || size.nBins < 1 || size.nGroups < 1) {
+      cerr << "Error: need at least one analysis, bin, and group" << endl;
+      return 1;
+    }
+
+    RooMsgService::instance().setSilentMode(true);
+    RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+    if (nThreads != 1)
+      ROOT::EnableThreadSafety();
+#endif
+
+    // Header. Peak RSS is for the whole process, so the last column is cumulative and only ever
+    // goes up; the one before it is how much each stage raised it.
+    cout << setw(12) << left << "stage" << right
+	 << setw(6) << "grp" << setw(6) << "ana" << setw(6) << "bins" << setw(6) << "axes"
+	 << setw(6) << "sys" << setw(6) << "cor"
+	 << setw(12) << "time (s)" << setw(12) << "+peak (MB)" << setw(12) << "peak (MB)" << endl;
+
+    // Double the scan parameter on each step.
+    for (unsigned int i_step = 0; i_step < steps; i_step++) {
+      if (i_step != 0) {
+	ScanParameter(size, scan) *= 2;
+	if (size.nAxes > cMaxAxes)
+	  break;
+      }
+      RunBenchmark(size, fitter, nThreads, dumpFile);
+    }
+
+  } catch (exception &e) {
+    cerr << "Error while running the benchmark: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+void usage (void)
+{
+  cerr << "Usage: FTBenchmark [--analyses n] [--bins n] [--axes n] [--sys n] [--correlations n] [--groups n]" << endl
+       << "                   [--scan <parameter> --steps n] [--blue | --singlefit] [--threads n] [--dump file.txt]" << endl;
+}
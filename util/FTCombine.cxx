@@ -10,9 +10,13 @@
 #include "Combination/CalibrationDataModelStreams.h"
 
 #include <RooMsgService.h>
+#include <TROOT.h>
+#include <RVersion.h>
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstdlib>
 
 using namespace std;
 using namespace BTagCombination;
@@ -22,17 +26,70 @@ void usage (void);
 int main (int argc, char **argv)
 {
   try {
+    // Pull out the shard, cache, and telemetry requests (they have arguments, so the common parser can't see them).
+    vector<string> args;
+    unsigned int shard = 0, nShards = 1;
+    string cacheDir ("");
+    string telemetryFile ("");
+    for (int i = 1; i < argc; i++) {
+      string a(argv[i]);
+      if (a == "--shard") {
+	if (i + 1 == argc) {
+	  cout << "Error: --shard must be followed by i/N" << endl;
+	  usage();
+	  return 1;
+	}
+	string spec(argv[++i]);
+	istringstream in(spec);
+	char slash = ' ';
+	in >> shard >> slash >> nShards;
+	if (in.fail() || slash != '/' || !in.eof() || nShards == 0 || shard >= nShards) {
+	  cout << "Error: --shard argument '" << spec << "' must be i/N with 0 <= i < N" << endl;
+	  usage();
+	  return 1;
+	}
+      } else if (a == "--cache") {
+	if (i + 1 == argc) {
+	  cout << "Error: --cache must be followed by a directory" << endl;
+	  usage();
+	  return 1;
+	}
+	cacheDir = argv[++i];
+      } else if (a == "--telemetry") {
+	if (i + 1 == argc) {
+	  cout << "Error: --telemetry must be followed by a file name" << endl;
+	  usage();
+	  return 1;
+	}
+	telemetryFile = argv[++i];
+      } else {
+	args.push_back(a);
+      }
+    }
+
     // Parse the input arguments
     CalibrationInfo info;
     vector<string> otherFlags;
-    ParseOPInputArgs ((const char**)&(argv[1]), argc-1, info, otherFlags);
+    ParseOPInputArgs (args, info, otherFlags);
 
     bool verbose = false;
     string prefix = "";
+    CombinationFitter fitter = kFitWithMinuit;
+    unsigned int nThreads = 1;
 
     for (unsigned int i = 0; i < otherFlags.size(); i++) {
       if (otherFlags[i] == "verbose") {
 	verbose = true;
+      } else if (otherFlags[i] == "blue") {
+	fitter = kFitWithBLUE;
+      } else if (otherFlags[i] == "singlefit") {
+	fitter = kFitWithMinuitSingleFit;
+      } else if (otherFlags[i].substr(0, 7) == "threads") {
+	if (!ParseThreadCount(otherFlags[i].substr(7), nThreads)) {
+	  cout << "Error: --threads must be followed by a number of threads (e.g. --threads8, or --threads0 for one per core)" << endl;
+	  usage();
+	  return 1;
+	}
       } else if (otherFlags[i].substr(0, 6) == "prefix") {
 	prefix = otherFlags[i].substr(6);
       } else {
@@ -48,13 +105,36 @@ int main (int argc, char **argv)
       RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
     }
 
+    // ROOT has to be told up front if it is going to be used from more than one thread.
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+    if (nThreads != 1)
+      ROOT::EnableThreadSafety();
+#endif
+
+    // If we are only one of several shards, only do our share of the fits.
+    if (nShards > 1) {
+      info.Analyses = AnalysesInShard(info.Analyses, shard, nShards);
+    }
+
+    // Record how each fit went, if asked.
+    ofstream telemetry;
+    if (telemetryFile != "") {
+      telemetry.open(telemetryFile.c_str());
+      if (!telemetry.is_open()) {
+	cout << "Error: Unable to open telemetry file " << telemetryFile << endl;
+	return 1;
+      }
+      SetFitTelemetryOutput(&telemetry);
+    }
+
     // Now that we have the calibrations, just combine them!
     vector<CalibrationAnalysis> result;
     if (!info.BinByBin) {
-      result = CombineAnalyses(info);
+      result = CombineAnalyses(info, true, kCombineByFullAnalysis, fitter, nThreads, cacheDir);
     } else {
-      result = CombineAnalyses(info, true, kCombineBySingleBin);
+      result = CombineAnalyses(info, true, kCombineBySingleBin, fitter, nThreads, cacheDir);
     }
+    SetFitTelemetryOutput(0);
     
     if (prefix != "") {
       for (vector<CalibrationAnalysis>::iterator itr = result.begin(); itr != result.end(); itr++) {
@@ -62,8 +142,14 @@ int main (int argc, char **argv)
       }
     }
 
-    // Dump them out to an output file.
-    ofstream out ("combined.txt");
+    // Dump them out to an output file. Shards are put back together with FTMergeShards.
+    string outputName ("combined.txt");
+    if (nShards > 1) {
+      ostringstream name;
+      name << "combined-shard" << shard << "of" << nShards << ".txt";
+      outputName = name.str();
+    }
+    ofstream out (outputName.c_str());
     for (unsigned int i = 0; i < result.size(); i++) {
       out << result[i] << endl;
     }
@@ -78,5 +164,7 @@ int main (int argc, char **argv)
 
 void usage (void)
 {
-  cerr << "Usage: FTCombine <files, --ignore> --verbose [--profile | --binbybin] --prefixXXX" << endl;
+  cerr << "Usage: FTCombine <files, --ignore> --verbose [--profile | --binbybin] [--blue | --singlefit] [--threadsN] [--shard i/N] [--cache dir] [--telemetry file.json] --prefixXXX" << endl;
+  cerr << "  --threadsN runs N independent fits at a time (default 1, 0 means one per core). --blue fits" << endl;
+  cerr << "  run on threads; RooFit/MINUIT fits each run in a worker process." << endl;
 }
@@ -9,6 +9,7 @@
 #include "Combination/Combiner.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/BinNameUtils.h"
+#include "Combination/AnalysisCatalog.h"
 
 #include <RooMsgService.h>
 
@@ -19,6 +20,7 @@
 #include <sstream>
 #include <cmath>
 #include <fstream>
+#include <cstdlib>
 
 using namespace std;
 using namespace BTagCombination;
@@ -34,18 +36,6 @@ string eatArg (char **argv, int &index, const int maxArg)
   return argv[index];
 }
 
-// Return an analysis from a list.
-bool getAnalysis (CalibrationAnalysis &foundAna, const string &aname, const vector<CalibrationAnalysis> &list)
-{
-  for (size_t i = 0; i < list.size(); i++) {
-    if (list[i].name == aname) {
-      foundAna = list[i];
-      return true;
-    }
-  }
-  return false;
-}
-
 bool getBin (CalibrationBin &bin, const CalibrationBin &proto, const vector<CalibrationBin> &list)
 {
   for (size_t i = 0; i < list.size(); i++) {
@@ -113,9 +103,19 @@ int main (int argc, char **argv)
     ParseOPInputArgs (otherArgs, info, otherFlags);
 
     bool verbose = false;
+    RebinMethod method = kRebinWeightedAverage;
+    unsigned int nThreads = 1;
     for (size_t i = 0; i < otherFlags.size(); i++) {
       if (otherFlags[i] == "verbose") {
 	verbose = true;
+      } else if (otherFlags[i] == "fit") {
+	method = kRebinFit;
+      } else if (otherFlags[i].substr(0, 7) == "threads") {
+	if (!ParseThreadCount(otherFlags[i].substr(7), nThreads)) {
+	  cout << "The --threads flag must be followed by a number of threads (e.g. --threads8, or --threads0 for one per core)" << endl;
+	  Usage();
+	  return 1;
+	}
       } else {
 	cout << "Unrecognized flag '" << otherFlags[i] << endl;
 	Usage();
@@ -134,11 +134,13 @@ int main (int argc, char **argv)
     // Find the template analysis and split it out from the other analyses that we will be doing a refit on.
     //
 
-    CalibrationAnalysis tAnalysis;
-    if (!getAnalysis(tAnalysis, templateAna, info.Analyses)) {
+    AnalysisCatalog catalog (info.Analyses);
+    const vector<size_t> &templateFound(catalog.Group(kByAnalysisName, templateAna));
+    if (templateFound.size() == 0) {
       cout << "Unable to find analysis '" << templateAna << "' in the input list of analyses" << endl;
       return 1;
     }
+    CalibrationAnalysis tAnalysis (info.Analyses[templateFound[0]]);
 
     set<set<CalibrationBinBoundary> > templateBinning;
     for (size_t ib = 0; ib < tAnalysis.bins.size(); ib++) {
@@ -162,7 +164,7 @@ int main (int argc, char **argv)
 
       // Do the rebinning
       cout << "Rebinning analysis '" << OPFullName(info.Analyses[i]) << "'" << endl;
-      CalibrationAnalysis r (RebinAnalysis(templateBinning, info.Analyses[i]));
+      CalibrationAnalysis r (RebinAnalysis(templateBinning, info.Analyses[i], method, nThreads));
       r.name = stringReplace(outputAna, "<>", info.Analyses[i].name);
 
       // Is this a legal name - are we going to make a duplicate?
@@ -210,6 +212,9 @@ void Usage(void)
   cout << "  ouputAna <ana>                      - The rebined analysis should be called this. [required]" << endl;
   cout << "  templateAna <ana>                      - Name of the analysis to use as a template. There should be only one [required]" << endl;
   cout << "  output <fname>                      - Write results to an output file instead of stdout." << endl;
+  cout << "  --fit                               - Fit the source bins in each template bin rather than take a stat weighted average." << endl;
+  cout << "  --threadsN                          - Run N of the --fit fits at a time, each in a worker process (default is 1," << endl;
+  cout << "                                        0 is one per core)." << endl;
   cout << endl;
   cout << " All the other standard commands apply. Use them to window down to a particular analysis or flavor, etc." << endl;
   cout << " An attempt will be made to rebin all analyses except the template ones." << endl;
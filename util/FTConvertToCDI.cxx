@@ -6,18 +6,25 @@
 #include "Combination/Parser.h"
 #include "Combination/CDIConverter.h"
 #include "Combination/CommonCommandLineUtils.h"
+#include "Combination/ParallelUtils.h"
 
 #include <TFile.h>
 #include <TDirectory.h>
 #include <TH1.h>
 #include <TKey.h>
 #include <TClass.h>
+#include <TList.h>
+#include <TStreamerInfo.h>
+#include <TROOT.h>
+#include <RVersion.h>
 
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <stdexcept>
 #include <set>
+#include <functional>
+#include <cstdlib>
 
 using namespace std;
 using namespace BTagCombination;
@@ -83,8 +90,56 @@ namespace {
   Analysis::CalibrationDataFunctionContainer *__c1 __attribute ((unused));
   Analysis::CalibrationDataContainer *__c2 __attribute ((unused));
 
+  // Copy one (non-directory) key into out. A raw copy moves the key's buffer (still
+  // compressed) straight across to the output file, without ever turning it back into an
+  // object; otherwise the object is read in and written back out.
+  void copy_key (TDirectory *out, TKey *k, bool raw)
+  {
+    out->cd();
+    if (raw) {
+      TKey *copy = new TKey(out, *k, 0);
+      copy->WriteFile();
+    } else {
+      TObject *o = k->ReadObj();
+      out->WriteTObject(o, k->GetName(), "SingleKey");
+    }
+  }
+
+  // A raw copy doesn't write the streamer infos of the classes it copies, the way writing the
+  // object does. So copy over all of the input file's, as TTreeCloner::CopyStreamerInfos does,
+  // or the output can't be read with any other version of those classes.
+  void copy_streamer_infos (TFile *out, TFile *in)
+  {
+    TList *infos = in->GetStreamerInfoList();
+    if (infos == 0)
+      return;
+
+    TIter next(infos);
+    TObject *o;
+    while ((o = next())) {
+      if (o->IsA() != TStreamerInfo::Class())
+	continue;
+      TStreamerInfo *info = (TStreamerInfo*) o;
+
+      // Prefer the copy the class already has in memory (that is what is numbered for writing).
+      TClass *cl = TClass::GetClass(info->GetName());
+      if (cl != 0 && (!cl->IsLoaded() || cl->GetNew())) {
+	TStreamerInfo *current = (TStreamerInfo*) cl->GetStreamerInfo(info->GetClassVersion());
+	if (info->GetClassVersion() == 1) {
+	  TStreamerInfo *match = (TStreamerInfo*) cl->FindStreamerInfo(info->GetCheckSum());
+	  if (match != 0)
+	    current = match;
+	}
+	if (current != 0)
+	  info = current;
+      }
+      info->ForceWriteInfo(out);
+    }
+    delete infos;
+  }
+
   // Do a deep copy of the in directory into the out directory
-  void copy_directory_structure (TDirectory *out, TDirectory *in, bool create = true)
+  void copy_directory_structure (TDirectory *out, TDirectory *in, bool create = true, bool raw = true)
   {
     //
     // Do a simple depth copy.
@@ -108,12 +163,10 @@ namespace {
 
 	if (out_subdir != 0) {
 	  TDirectory *in_subdir = (TDirectory*) get_sub_dir(in, k->GetName());
-	  copy_directory_structure(out_subdir, in_subdir, create);
+	  copy_directory_structure(out_subdir, in_subdir, create, raw);
 	}
       } else {
-	out->cd();
-	TObject *o = k->ReadObj();
-	out->WriteTObject(o, k->GetName(), "SingleKey");
+	copy_key(out, k, raw);
       }
     }
   }
@@ -156,6 +209,8 @@ int main(int argc, char **argv)
   vector<string> other_mcfiles_slim;
 
   string inputfile = "";
+  unsigned int nThreads = 0;
+  bool rawCopy = true;
 
   try {
 
@@ -167,11 +222,15 @@ int main(int argc, char **argv)
     for (unsigned int i = 0; i < otherFlags.size(); i++) {
       if (otherFlags[i] == "update") {
 	updateROOTFile = true;
+      } else if (otherFlags[i] == "copyByObject") {
+	rawCopy = false;
       } else if (otherFlags[i].find("copySlim") == 0) {
 	useInputFile = true;
 	other_mcfiles_slim.push_back(otherFlags[i].substr(8));
       } else if (otherFlags[i].find("copy") == 0) {
 	other_mcfiles_flat.push_back(otherFlags[i].substr(4));
+      } else if (otherFlags[i].substr(0, 7) == "threads") {
+	nThreads = atoi(otherFlags[i].substr(7).c_str());
       } else {
         if (otherFlags[i].find("inputSlim") == string::npos) {
 	  cerr << "ERROR: Unknown command line flag '" << otherFlags[i] << "'." << endl;
@@ -243,27 +302,68 @@ int main(int argc, char **argv)
   }
 
   //
-  // Now, write out everything. If the analysis is a default re-run the conversion
-  // (to make sure that we are not doing somethign funny in ROOT).
+  // Now, convert everything. If the analysis is a default re-run the conversion
+  // (to make sure that we are not doing somethign funny in ROOT). Each conversion
+  // stands on its own, so they are all built in memory on as many threads as we
+  // have (biggest first), and only then written out.
   //
 
   const vector<CalibrationAnalysis> calib (info.Analyses);
+  vector<CalibrationDataContainer*> containers (calib.size(), 0);
+  vector<CalibrationDataContainer*> defaultContainers (calib.size(), 0);
+
+  vector<size_t> bySize;
+  for (size_t i = 0; i < calib.size(); i++)
+    bySize.push_back(i);
+  stable_sort(bySize.begin(), bySize.end(), [&calib] (size_t a, size_t b) {
+      return calib[a].bins.size() > calib[b].bins.size();
+    });
+
+  vector<function<void (void)> > jobs;
+  for (size_t i_job = 0; i_job < bySize.size(); i_job++) {
+    size_t i = bySize[i_job];
+    jobs.push_back([&, i] () {
+	const CalibrationAnalysis &c(calib[i]);
+	containers[i] = ConvertToCDI (c, c.name + "_SF");
+	if (isAMatch(info.Defaults, c))
+	  defaultContainers[i] = ConvertToCDI (c, "default_SF");
+      });
+  }
+
+  // ROOT has to be told up front if it is going to be used from more than one thread.
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+  if (nThreads != 1)
+    ROOT::EnableThreadSafety();
+#endif
+
+  try {
+    RunInParallel(jobs, nThreads);
+  } catch (exception &e) {
+    cerr << "Error converting to the CDI format: " << e.what() << endl;
+    output->Close();
+    delete output;
+    return 1;
+  }
+
+  //
+  // Write them out in the order of the input, one at a time, so the file is laid out
+  // exactly as if they had been converted one after the other.
+  //
+
   for (unsigned int i = 0; i < calib.size(); i++) {
     const CalibrationAnalysis &c(calib[i]);
 
-    string name = c.name + "_SF";
-    CalibrationDataContainer *container = ConvertToCDI (c, name);
-
     TDirectory *loc = get_sub_dir(output, c.tagger);
     loc = get_sub_dir(loc, c.jetAlgorithm);
     loc = get_sub_dir(loc, c.operatingPoint);
     loc = get_sub_dir(loc, convert_flavor(c.flavor));
 
-    loc->WriteTObject(container, 0, "SingleKey");
+    loc->WriteTObject(containers[i], 0, "SingleKey");
+    delete containers[i];
 
-    if (isAMatch(info.Defaults, c)) {
-      CalibrationDataContainer *def_c = ConvertToCDI (c, "default_SF");
-      loc->WriteTObject(def_c, 0, "SingleKey");
+    if (defaultContainers[i] != 0) {
+      loc->WriteTObject(defaultContainers[i], 0, "SingleKey");
+      delete defaultContainers[i];
     }
   }
 
@@ -299,14 +399,18 @@ int main(int argc, char **argv)
 
   for (unsigned int i = 0; i < other_mcfiles_slim.size(); i++) {
     TFile *in = TFile::Open(other_mcfiles_slim[i].c_str(), "READ");
-    copy_directory_structure(output, in, true); 
+    copy_directory_structure(output, in, true, rawCopy); 
+    if (rawCopy)
+      copy_streamer_infos(output, in);
     in->Close();
     delete in;
   }
 
   for (unsigned int i = 0; i < other_mcfiles_flat.size(); i++) {
     TFile *in = TFile::Open(other_mcfiles_flat[i].c_str(), "READ");
-    copy_directory_structure(output, in, true); 
+    copy_directory_structure(output, in, true, rawCopy); 
+    if (rawCopy)
+      copy_streamer_infos(output, in);
     in->Close();
     delete in;
   }
@@ -326,6 +430,8 @@ void Usage (void)
   cout << "  --copy <filename> - to include the file content" << endl;
   cout << "  --copySlim <filename> - to include and slim the file content" << endl;
   cout << "  --inputSlim - to steer the slimming of the file content" << endl;
+  cout << "  --copyByObject - read in and re-write each object when copying, rather than copying it raw" << endl;
+  cout << "  --threadsN - convert on N threads (default is one per core)" << endl;
 }
 
 //
@@ -11,9 +11,12 @@
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/BinNameUtils.h"
 #include "Combination/FitLinage.h"
+#include "Combination/AnalysisCatalog.h"
+#include "Combination/BinKey.h"
 
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
@@ -35,17 +38,14 @@ namespace {
 		return argv[index];
 	}
 
-	// Return an analysis from a list.
+	// Return all the analyses with a name.
 	bool getAnalysis(vector<CalibrationAnalysis> &foundAna, const string &aname, const vector<CalibrationAnalysis> &list)
 	{
-		bool found = false;
-		for (size_t i = 0; i < list.size(); i++) {
-			if (list[i].name == aname) {
-				foundAna.push_back(list[i]);
-				found = true;
-			}
-		}
-		return found;
+		AnalysisCatalog catalog(list);
+		const vector<size_t> &found(catalog.Group(kByAnalysisName, aname));
+		for (size_t i = 0; i < found.size(); i++)
+			foundAna.push_back(list[found[i]]);
+		return found.size() > 0;
 	}
   
         string FindSysErrorName(CalibrationBin &b, const vector<string> &names)
@@ -130,17 +130,15 @@ namespace {
 	{
 		// Build lookup table to help us with next step.
 
-		map<set<CalibrationBinBoundary>, CalibrationBin> bSFBinLookup;
+		unordered_map<BinKey, CalibrationBin, BinKeyHash> bSFBinLookup;
 		for (size_t i = 0; i < bSFBins.size(); i++) {
-			const vector<CalibrationBinBoundary> &bs(bSFBins[i].binSpec);
-			bSFBinLookup[set<CalibrationBinBoundary>(bs.begin(), bs.end())] = bSFBins[i];
+			bSFBinLookup[BinKey(bSFBins[i])] = bSFBins[i];
 		}
 
 		// Loop through the D* bins, rescaling one at a time.
 
 		for (size_t i = 0; i < dstarBins.size(); i++) {
-			set<CalibrationBinBoundary> key(dstarBins[i].binSpec.begin(), dstarBins[i].binSpec.end());
-			map<set<CalibrationBinBoundary>, CalibrationBin>::const_iterator i_bsfBin = bSFBinLookup.find(key);
+			unordered_map<BinKey, CalibrationBin, BinKeyHash>::const_iterator i_bsfBin = bSFBinLookup.find(BinKey(dstarBins[i]));
 			if (i_bsfBin == bSFBinLookup.end()) {
 				cerr << "For bin " << OPBinName(dstarBins[i]) << " in D* template could not find matching bin in bSF:" << endl;
 				for (size_t ib = 0; ib < bSFBins.size(); ib++) {
@@ -9,6 +9,7 @@
 #include "Combination/BinNameUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
+#include "Combination/BinaryCalibrationInfo.h"
 
 #include <vector>
 #include <set>
@@ -129,6 +130,7 @@ int main(int argc, char **argv)
     bool doQNames = false;
     bool doCompareNames = false;
     bool printAsInput = false;
+    bool writeBinary = false;
     bool printCorr = false;
     bool dumpMetaDataForCPU = false;
     bool dumpMetaDataForBins = false;
@@ -169,6 +171,10 @@ int main(int argc, char **argv)
         printAsInput = true;
         sawFlag = true;
       }
+      else if (otherFlags[i] == "binary") {
+        writeBinary = true;
+        sawFlag = true;
+      }
       else if (otherFlags[i] == "corr") {
         printCorr = true;
         sawFlag = true;
@@ -201,6 +207,18 @@ int main(int argc, char **argv)
     if (!sawFlag)
       doDump = true;
 
+    // The binary format can only go to a file.
+    if (writeBinary) {
+      if (outputFilename.size() == 0) {
+        cerr << "The --binary option needs an output file" << endl;
+        Usage();
+        return 1;
+      }
+      ofstream binaryOutput (outputFilename.c_str(), ios::binary);
+      WriteBinary(binaryOutput, info);
+      return 0;
+    }
+
     // Do the output file
     ostream *output(&cout);
     if (outputFilename.size() > 0) {
@@ -717,6 +735,7 @@ void Usage(void)
   cout << "  --qnames - print out the names used in a fully qualified, and easily computer parsable format" << endl;
   cout << "  --cnames - parse the code and compares variables to a list of known values (needs input file)" << endl;
   cout << "  --asInput - print out the inputs as a single file after applying all command line options" << endl;
+  cout << "  --binary - write the inputs as a single binary file after applying all command line options (needs output). Binary files can be read anywhere a text file can, so --asInput converts one back" << endl;
   cout << "  --corr - print out the correlation inputs in a CSV command format" << endl;
   cout << "  --inputfile - to be used together with cnames flag (input files are located inside the directory inputdata)" << endl;
   cout << "  --linage - print out the linage for all input analyses" << endl;
@@ -11,6 +11,7 @@
 #include "Combination/BinBoundaryUtils.h"
 #include "Combination/CalibrationDataModelStreams.h"
 #include "Combination/FitLinage.h"
+#include "Combination/AnalysisCatalog.h"
 
 #include <vector>
 #include <set>
@@ -34,18 +35,6 @@ string eatArg(char **argv, int &index, const int maxArg)
   return argv[index];
 }
 
-// Return an analysis from a list.
-bool getAnalysis(CalibrationAnalysis &foundAna, const string &aname, const vector<CalibrationAnalysis> &list)
-{
-  for (size_t i = 0; i < list.size(); i++) {
-    if (list[i].name == aname) {
-      foundAna = list[i];
-      return true;
-    }
-  }
-  return false;
-}
-
 bool getBin(CalibrationBin &bin, const CalibrationBin &proto, const vector<CalibrationBin> &list)
 {
   for (size_t i = 0; i < list.size(); i++) {
@@ -187,10 +176,15 @@ int main(int argc, char **argv)
     }
     else if (relDifAna1.size() > 0) {
       // Taking two guys, and in each common bin, using the difference as a new sys error
-      map<string, vector<CalibrationAnalysis> > splitAnas(BinAnalysesByJetTagFlavOp(info.Analyses));
-      for (map<string, vector<CalibrationAnalysis> >::const_iterator i_alist = splitAnas.begin(); i_alist != splitAnas.end(); i_alist++) {
-        CalibrationAnalysis a1, a2;
-        if (getAnalysis(a1, relDifAna1, i_alist->second) && getAnalysis(a2, relDifAna2, i_alist->second)) {
+      AnalysisCatalog catalog (info.Analyses);
+      const map<string, vector<size_t> > &splitAnas(catalog.Groups(kByJetTagFlavOp));
+      for (map<string, vector<size_t> >::const_iterator i_alist = splitAnas.begin(); i_alist != splitAnas.end(); i_alist++) {
+        const CalibrationAnalysis &proto(info.Analyses[i_alist->second[0]]);
+        size_t i1 = catalog.Find(relDifAna1, proto.flavor, proto.tagger, proto.operatingPoint, proto.jetAlgorithm);
+        size_t i2 = catalog.Find(relDifAna2, proto.flavor, proto.tagger, proto.operatingPoint, proto.jetAlgorithm);
+        if (i1 != AnalysisCatalog::npos && i2 != AnalysisCatalog::npos) {
+          CalibrationAnalysis a1 (info.Analyses[i1]);
+          const CalibrationAnalysis &a2 (info.Analyses[i2]);
           bool good = true;
           for (size_t ib = 0; ib < a1.bins.size(); ib++) {
             CalibrationBin otherBin;
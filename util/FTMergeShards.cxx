@@ -0,0 +1,104 @@
+///
+/// FTMergeShards
+///
+///  Put the output of several FTCombine --shard i/N runs back together into a single
+/// combined.txt. The result is identical to running FTCombine in a single process.
+///
+
+#include "Combination/Parser.h"
+#include "Combination/BinNameUtils.h"
+#include "Combination/CalibrationDataModelStreams.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <map>
+
+using namespace std;
+using namespace BTagCombination;
+
+void usage (void);
+
+namespace {
+  // FTCombine writes its results out in the order of the groups it fit.
+  bool GroupOrder (const CalibrationAnalysis &a1, const CalibrationAnalysis &a2)
+  {
+    return OPIndependentName(a1) < OPIndependentName(a2);
+  }
+}
+
+int main (int argc, char **argv)
+{
+  try {
+    string outputName ("combined.txt");
+    vector<string> shardFiles;
+    for (int i = 1; i < argc; i++) {
+      string a(argv[i]);
+      if (a == "--output") {
+	if (i + 1 == argc) {
+	  usage();
+	  return 1;
+	}
+	outputName = argv[++i];
+      } else {
+	shardFiles.push_back(a);
+      }
+    }
+
+    if (shardFiles.size() == 0) {
+      usage();
+      return 1;
+    }
+
+    //
+    // Load up every shard. Each group can only have been fit in one shard.
+    //
+
+    vector<CalibrationAnalysis> result;
+    map<string, string> groupSource;
+    for (size_t i_f = 0; i_f < shardFiles.size(); i_f++) {
+      ifstream input (shardFiles[i_f].c_str());
+      if (!input.is_open()) {
+	ostringstream msg;
+	msg << "Unable to open shard file '" << shardFiles[i_f] << "'";
+	throw runtime_error(msg.str());
+      }
+      calibrationFilterInfo fInfo;
+      CalibrationInfo info (Parse(input, fInfo));
+      input.close();
+
+      for (size_t i_a = 0; i_a < info.Analyses.size(); i_a++) {
+	const CalibrationAnalysis &ana(info.Analyses[i_a]);
+	string group (OPIndependentName(ana));
+	map<string, string>::const_iterator f = groupSource.find(group);
+	if (f != groupSource.end()) {
+	  ostringstream msg;
+	  msg << "Group " << group << " appears in both '" << f->second << "' and '" << shardFiles[i_f] << "'";
+	  throw runtime_error(msg.str());
+	}
+	groupSource[group] = shardFiles[i_f];
+	result.push_back(ana);
+      }
+    }
+
+    stable_sort(result.begin(), result.end(), GroupOrder);
+
+    ofstream out (outputName.c_str());
+    for (unsigned int i = 0; i < result.size(); i++) {
+      out << result[i] << endl;
+    }
+    out.close();
+
+  } catch (exception &e) {
+    cerr << "Error while merging the shards: " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
+
+void usage (void)
+{
+  cerr << "Usage: FTMergeShards <combined-shard0ofN.txt ...> [--output combined.txt]" << endl;
+}
@@ -16,6 +16,7 @@
 #include <TFile.h>
 
 #include <iostream>
+#include <cstdlib>
 
 using namespace std;
 using namespace BTagCombination;
@@ -45,7 +46,9 @@ int main (int argc, char **argv)
     vector<CalibrationAnalysis> &calibs(info.Analyses);
 
     GroupCriteria grouping = gcByBin;
-    PlotCollection whatToPlot = pcAll;
+    PlotSelection what;
+    what.nThreads = 0;
+    unsigned int onlyKinds = 0;
     for (unsigned int i = 0; i < otherFlags.size(); i++) {
       string arg(otherFlags[i]);
       if (arg == "ByBin") {
@@ -57,13 +60,29 @@ int main (int argc, char **argv)
       } else if (arg == "ByCalibTaggerJet") {
 	grouping = gcByCalibTaggerJet;
       } else if (arg == "EffOnly") {
-	whatToPlot = pcEffOnly;
+	onlyKinds |= pkSF;
+      } else if (arg == "OnlyAnalysis") {
+	onlyKinds |= pkAnalysis;
+      } else if (arg == "OnlySF") {
+	onlyKinds |= pkSF;
+      } else if (arg == "OnlyBinValues") {
+	onlyKinds |= pkBinValues;
+      } else if (arg == "OnlySysErrors") {
+	onlyKinds |= pkSysErrors;
+      } else if (arg == "OnlyCVShifts") {
+	onlyKinds |= pkCVShifts;
+      } else if (arg.substr(0, 5) == "group") {
+	what.groupFilter = arg.substr(5);
+      } else if (arg.substr(0, 7) == "threads") {
+	what.nThreads = atoi(arg.substr(7).c_str());
       } else {
 	cout << "Unknown option '" << arg << "'." << endl;
 	usage();
 	return 1;
       }
     }
+    if (onlyKinds != 0)
+      what.kinds = onlyKinds;
 
     //
     // Now generate the plots in the output file.
@@ -73,7 +92,7 @@ int main (int argc, char **argv)
 
     gROOT->SetBatch(kTRUE);
     SetAtlasStyle();
-    DumpPlots (f, calibs, grouping, whatToPlot);
+    DumpPlots (f, calibs, grouping, what);
 
     f->Write();
     f->Close();
@@ -87,5 +106,11 @@ int main (int argc, char **argv)
 
 void usage(void)
 {
-  cout << "FTPlot <std-cmd-line-argsw>" << endl;
+  cout << "FTPlot <std-cmd-line-argsw> [options]" << endl;
+  cout << "  --ByBin, --ByCalib, --ByCalibEff, --ByCalibTaggerJet - How to group the analyses on the plots" << endl;
+  cout << "  --EffOnly        - Only the scale factor plots (same as --OnlySF)" << endl;
+  cout << "  --OnlyAnalysis, --OnlySF, --OnlyBinValues, --OnlySysErrors, --OnlyCVShifts" << endl;
+  cout << "                   - Only make these kinds of plots (they add up; default is all of them)" << endl;
+  cout << "  --groupREGEX     - Only plot groups whose name contains a match for REGEX" << endl;
+  cout << "  --threadsN       - Work out the plots on N threads (default is one per core)" << endl;
 }